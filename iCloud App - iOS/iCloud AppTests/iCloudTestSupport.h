@@ -0,0 +1,42 @@
+//
+//  iCloudTestSupport.h
+//  iCloud AppTests
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import <XCTest/XCTest.h>
+#import <iCloud/iCloud.h>
+
+/** A temporary ubiquity container with a Documents folder, and an iCloud object reading it through a local backend.
+
+ The container, backend and iCloud object are created together. Seed documents and configure the cloud or backend, then call setUpDocumentSync. Call tearDown when the test is done, it stops the backend and removes the container. */
+@interface iCloudTestContainer : NSObject
+
+/// The temporary directory used as the ubiquity container
+@property (strong, readonly) NSURL *containerURL;
+
+/// The Documents folder of the container
+@property (strong, readonly) NSURL *documentsURL;
+
+/// The local backend assigned to the cloud's fileManager
+@property (strong, readonly) iCloudLocalBackend *backend;
+
+/// An iCloud object which does not persist its metadata snapshot
+@property (strong, readonly) iCloud *cloud;
+
+/// Set up document sync with the default ubiquity container
+- (void)setUpDocumentSync;
+
+/// Stop the backend's metadata updates and remove the container
+- (void)tearDown;
+
+@end
+
+@interface XCTestCase (iCloudTestSupport)
+
+/// Spin the main run loop until the flag is set, iCloud calls its handlers on the main queue
+- (void)waitForFlag:(BOOL *)flag;
+
+@end
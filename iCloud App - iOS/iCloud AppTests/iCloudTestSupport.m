@@ -0,0 +1,54 @@
+//
+//  iCloudTestSupport.m
+//  iCloud AppTests
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudTestSupport.h"
+
+@interface iCloudTestContainer ()
+
+@property (strong, readwrite) NSURL *containerURL;
+@property (strong, readwrite) NSURL *documentsURL;
+@property (strong, readwrite) iCloudLocalBackend *backend;
+@property (strong, readwrite) iCloud *cloud;
+
+@end
+
+@implementation iCloudTestContainer
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _containerURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+        _documentsURL = [_containerURL URLByAppendingPathComponent:@"Documents"];
+        [[NSFileManager defaultManager] createDirectoryAtURL:_documentsURL withIntermediateDirectories:YES attributes:nil error:nil];
+        
+        _backend = [[iCloudLocalBackend alloc] initWithContainerURL:_containerURL];
+        _cloud = [[iCloud alloc] init];
+        _cloud.fileManager = _backend;
+        _cloud.persistsMetadataSnapshot = NO;
+    }
+    return self;
+}
+
+- (void)setUpDocumentSync {
+    [self.cloud setupiCloudDocumentSyncWithUbiquityContainer:nil];
+}
+
+- (void)tearDown {
+    [self.backend stopMetadataUpdates];
+    [[NSFileManager defaultManager] removeItemAtURL:self.containerURL error:nil];
+}
+
+@end
+
+@implementation XCTestCase (iCloudTestSupport)
+
+- (void)waitForFlag:(BOOL *)flag {
+    while (*flag == NO) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+}
+
+@end
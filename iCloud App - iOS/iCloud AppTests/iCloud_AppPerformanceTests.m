@@ -0,0 +1,452 @@
+//
+//  iCloud_AppPerformanceTests.m
+//  iCloud AppTests
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import <XCTest/XCTest.h>
+#import <iCloud/iCloud.h>
+#import "iCloudTestSupport.h"
+
+/// Benchmarks of the iCloud class against a simulated container. They are skipped by the iCloud AppTests scheme and run by the iCloud AppPerformanceTests scheme.
+@interface iCloud_AppPerformanceTests : XCTestCase
+
+@end
+
+/// Number of timed calls of each operation per benchmark run
+static NSUInteger const iCloudBenchmarkSampleCount = 200;
+
+/// The slowest p99 latency, in seconds, any single operation may reach before a benchmark fails. Runs with a simulated backend latency are not held to it.
+static NSTimeInterval const iCloudBenchmarkLatencyCeiling = 0.25;
+
+@implementation iCloud_AppPerformanceTests
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Harness ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Harness
+
+/// Time a synchronous or asynchronous operation, log its throughput and latency percentiles and fail if its p99 latency is over the ceiling
+- (NSDictionary *)benchmarkOperation:(NSString *)operation documentCount:(NSUInteger)documentCount block:(void (^)(NSUInteger index, dispatch_block_t done))block {
+    NSMutableArray *latencies = [NSMutableArray arrayWithCapacity:iCloudBenchmarkSampleCount];
+    CFAbsoluteTime runStart = CFAbsoluteTimeGetCurrent();
+    
+    for (NSUInteger index = 0; index < iCloudBenchmarkSampleCount; index++) {
+        @autoreleasepool {
+            __block BOOL finished = NO;
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            block(index, ^{
+                finished = YES;
+            });
+            [self waitForFlag:&finished];
+            [latencies addObject:@(CFAbsoluteTimeGetCurrent() - start)];
+        }
+    }
+    
+    NSTimeInterval duration = CFAbsoluteTimeGetCurrent() - runStart;
+    NSArray *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    double p50 = [sorted[sorted.count / 2] doubleValue] * 1000;
+    double p99 = [sorted[MIN(sorted.count - 1, sorted.count * 99 / 100)] doubleValue] * 1000;
+    double opsPerSecond = iCloudBenchmarkSampleCount / duration;
+    
+    NSLog(@"[iCloud Benchmark] %@ documents=%lu ops/sec=%.1f p50=%.3fms p99=%.3fms", operation, (unsigned long)documentCount, opsPerSecond, p50, p99);
+    if ([[[NSProcessInfo processInfo] environment][@"ICLOUD_BENCHMARK_LATENCY"] doubleValue] == 0) XCTAssertLessThanOrEqual(p99, iCloudBenchmarkLatencyCeiling * 1000, @"%@ is over the latency ceiling with %lu documents", operation, (unsigned long)documentCount);
+    
+    return @{@"operation": operation, @"documents": @(documentCount), @"opsPerSecond": @(opsPerSecond), @"p50": @(p50), @"p99": @(p99)};
+}
+
+/// Run every public operation against a simulated container holding the specified number of documents, measuring each run of the whole set
+- (void)runBenchmarksWithDocumentCount:(NSUInteger)documentCount {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    NSURL *documentsURL = container.documentsURL;
+    
+    // Seed the container directly, without going through the library
+    NSData *payload = [NSMutableData dataWithLength:4096];
+    for (NSUInteger index = 0; index < documentCount; index++) {
+        @autoreleasepool {
+            [payload writeToURL:[documentsURL URLByAppendingPathComponent:[NSString stringWithFormat:@"Seed-%06lu.dat", (unsigned long)index]] atomically:NO];
+        }
+    }
+    
+    iCloudLocalBackend *backend = container.backend;
+    backend.operationLatency = [[[NSProcessInfo processInfo] environment][@"ICLOUD_BENCHMARK_LATENCY"] doubleValue];
+    backend.bandwidth = [[[NSProcessInfo processInfo] environment][@"ICLOUD_BENCHMARK_BANDWIDTH"] longLongValue];
+    
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    
+    // Wait for the first metadata pass
+    NSString *lastSeed = [NSString stringWithFormat:@"Seed-%06lu.dat", (unsigned long)documentCount - 1];
+    while ([cloud doesFileExistInCloud:lastSeed] == NO) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    NSString *(^seedName)(NSUInteger) = ^NSString *(NSUInteger index) {
+        return [NSString stringWithFormat:@"Seed-%06lu.dat", (unsigned long)((index * 7919) % documentCount)];
+    };
+    
+    // Every run saves, renames and deletes the same documents, so each one starts from the seeded container
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        [self startMeasuring];
+        
+        [self benchmarkOperation:@"saveAndCloseDocumentWithName" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            [cloud saveAndCloseDocumentWithName:[NSString stringWithFormat:@"Saved-%06lu.dat", (unsigned long)index] withContent:payload completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+                XCTAssertNil(error);
+                done();
+            }];
+        }];
+        
+        [self benchmarkOperation:@"retrieveCloudDocumentWithName" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            [cloud retrieveCloudDocumentWithName:seedName(index) completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+                XCTAssertEqual(documentData.length, payload.length);
+                done();
+            }];
+        }];
+        
+        [self benchmarkOperation:@"retrieveCloudDocumentObjectWithName" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            XCTAssertNotNil([cloud retrieveCloudDocumentObjectWithName:seedName(index)]);
+            done();
+        }];
+        
+        [self benchmarkOperation:@"listCloudFiles" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            XCTAssertGreaterThanOrEqual([[cloud listCloudFiles] count], documentCount);
+            done();
+        }];
+        
+        [self benchmarkOperation:@"fileSize" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            XCTAssertEqual([[cloud fileSize:seedName(index)] unsignedIntegerValue], payload.length);
+            done();
+        }];
+        
+        [self benchmarkOperation:@"fileModifiedDate" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            XCTAssertNotNil([cloud fileModifiedDate:seedName(index)]);
+            done();
+        }];
+        
+        [self benchmarkOperation:@"doesFileExistInCloud" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            XCTAssertTrue([cloud doesFileExistInCloud:seedName(index)]);
+            done();
+        }];
+        
+        [self benchmarkOperation:@"findUnresolvedConflictingVersionsOfFile" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            [cloud findUnresolvedConflictingVersionsOfFile:seedName(index)];
+            done();
+        }];
+        
+        [self benchmarkOperation:@"updateProcessing" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            // Touch one document and measure the rescan plus the metadata index update
+            [payload writeToURL:[documentsURL URLByAppendingPathComponent:seedName(index)] atomically:NO];
+            [backend refreshMetadata];
+            done();
+        }];
+        
+        [self benchmarkOperation:@"renameOriginalDocument" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            NSString *name = [NSString stringWithFormat:@"Saved-%06lu.dat", (unsigned long)index];
+            [cloud renameOriginalDocument:name withNewName:[@"Renamed-" stringByAppendingString:name] completion:^(NSError *error) {
+                XCTAssertNil(error);
+                done();
+            }];
+        }];
+        
+        [self benchmarkOperation:@"deleteDocumentWithName" documentCount:documentCount block:^(NSUInteger index, dispatch_block_t done) {
+            NSString *name = [NSString stringWithFormat:@"Renamed-Saved-%06lu.dat", (unsigned long)index];
+            [cloud deleteDocumentWithName:name completion:^(NSError *error) {
+                XCTAssertNil(error);
+                done();
+            }];
+        }];
+        
+        [self stopMeasuring];
+    }];
+    
+    [cloud.documentPool removeAllDocuments];
+    [container tearDown];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Benchmarks ---------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Benchmarks
+
+- (void)testBenchmark100Documents {
+    [self runBenchmarksWithDocumentCount:100];
+}
+
+- (void)testBenchmark10kDocuments {
+    [self runBenchmarksWithDocumentCount:10000];
+}
+
+- (void)testBenchmark100kDocuments {
+    // Seeding 100k documents takes minutes, only run when release gating asks for it
+    XCTSkipUnless([[[NSProcessInfo processInfo] environment][@"ICLOUD_BENCHMARK_LARGE"] boolValue], @"Set ICLOUD_BENCHMARK_LARGE to run the 100k document benchmark");
+    [self runBenchmarksWithDocumentCount:100000];
+}
+
+- (void)testBenchmarkTimeToFirstFileList {
+    NSUInteger documentCount = 10000;
+    NSURL *containerURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSURL *documentsURL = [containerURL URLByAppendingPathComponent:@"Documents"];
+    NSURL *snapshotURL = [containerURL URLByAppendingPathComponent:@"MetadataSnapshot.bin"];
+    [[NSFileManager defaultManager] createDirectoryAtURL:documentsURL withIntermediateDirectories:YES attributes:nil error:nil];
+    
+    NSData *payload = [NSMutableData dataWithLength:1024];
+    for (NSUInteger index = 0; index < documentCount; index++) {
+        @autoreleasepool {
+            [payload writeToURL:[documentsURL URLByAppendingPathComponent:[NSString stringWithFormat:@"Seed-%06lu.dat", (unsigned long)index]] atomically:NO];
+        }
+    }
+    
+    // Launch with nothing saved, and time the launch until the first file list
+    NSTimeInterval (^launch)(BOOL) = ^NSTimeInterval(BOOL measured) {
+        iCloudLocalBackend *backend = [[iCloudLocalBackend alloc] initWithContainerURL:containerURL];
+        backend.operationLatency = [[[NSProcessInfo processInfo] environment][@"ICLOUD_BENCHMARK_LATENCY"] doubleValue];
+        
+        if (measured) [self startMeasuring];
+        iCloud *cloud = [[iCloud alloc] init];
+        cloud.fileManager = backend;
+        cloud.metadataSnapshotURL = snapshotURL;
+        [cloud setupiCloudDocumentSyncWithUbiquityContainer:nil];
+        
+        while (cloud.timeToFirstFileList == 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+        if (measured) [self stopMeasuring];
+        XCTAssertEqual(cloud.metadataSnapshot.count, documentCount);
+        
+        // Wait for the live pass to be saved before the next launch
+        while (![[NSFileManager defaultManager] fileExistsAtPath:[snapshotURL path]] || !cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+        [backend stopMetadataUpdates];
+        return cloud.timeToFirstFileList;
+    };
+    
+    // The cold launch saves the snapshot every warm launch is restored from
+    NSTimeInterval coldTime = launch(NO);
+    NSLog(@"[iCloud Benchmark] timeToFirstFileList launch=cold documents=%lu time=%.3fms", (unsigned long)documentCount, coldTime * 1000);
+    
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        NSTimeInterval warmTime = launch(YES);
+        NSLog(@"[iCloud Benchmark] timeToFirstFileList launch=warm documents=%lu time=%.3fms", (unsigned long)documentCount, warmTime * 1000);
+        XCTAssertLessThanOrEqual(warmTime, iCloudBenchmarkLatencyCeiling);
+    }];
+    
+    // A restored snapshot matches the one it was saved from
+    iCloudMetadataSnapshot *restored = [[iCloudMetadataSnapshot alloc] initWithContentsOfURL:snapshotURL error:nil];
+    XCTAssertNotNil(restored);
+    XCTAssertEqual(restored.count, documentCount);
+    XCTAssertNotNil([restored entryForDocumentPath:@"Seed-000000.dat"][NSMetadataItemURLKey]);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:containerURL error:nil];
+}
+
+- (void)testBenchmarkDocumentCompression {
+    // JSON-like text, the kind of payload compression is meant for
+    NSMutableString *json = [NSMutableString stringWithString:@"["];
+    for (NSUInteger index = 0; json.length < 512 * 1024; index++) {
+        [json appendFormat:@"{\"id\":%lu,\"title\":\"Document %lu\",\"modified\":\"2026-10-%02lu\",\"tags\":[\"draft\",\"shared\"],\"words\":%lu},", (unsigned long)index, (unsigned long)index, (unsigned long)(index % 28 + 1), (unsigned long)(index * 37 % 5000)];
+    }
+    [json appendString:@"{}]"];
+    NSData *payload = [json dataUsingEncoding:NSUTF8StringEncoding];
+    
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+    
+    // Every run saves and opens the payload with each available codec
+    NSDictionary *codecs = @{@"none": @(iCloudCompressionCodecNone), @"zlib": @(iCloudCompressionCodecZlib), @"lz4": @(iCloudCompressionCodecLZ4), @"lzfse": @(iCloudCompressionCodecLZFSE)};
+    [self measureBlock:^{
+        for (NSString *codecName in [[codecs allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+            iCloudCompressionCodec codec = [codecs[codecName] integerValue];
+            if (![iCloudCompression isCodecAvailable:codec]) continue;
+            NSURL *fileURL = [directoryURL URLByAppendingPathComponent:[codecName stringByAppendingPathExtension:@"json"]];
+            
+            [self benchmarkOperation:[@"saveCompressedDocument-" stringByAppendingString:codecName] documentCount:1 block:^(NSUInteger index, dispatch_block_t done) {
+                iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+                document.compressionCodec = codec;
+                document.contents = payload;
+                UIDocumentSaveOperation operation = [[NSFileManager defaultManager] fileExistsAtPath:[fileURL path]] ? UIDocumentSaveForOverwriting : UIDocumentSaveForCreating;
+                [document saveToURL:fileURL forSaveOperation:operation completionHandler:^(BOOL success) {
+                    XCTAssertTrue(success);
+                    [document closeWithCompletionHandler:^(BOOL closed) {
+                        done();
+                    }];
+                }];
+            }];
+            
+            [self benchmarkOperation:[@"openCompressedDocument-" stringByAppendingString:codecName] documentCount:1 block:^(NSUInteger index, dispatch_block_t done) {
+                // Open with compression off, reading must not depend on the codec
+                iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+                [document openWithCompletionHandler:^(BOOL success) {
+                    XCTAssertTrue(success);
+                    XCTAssertEqualObjects(document.contents, payload);
+                    [document closeWithCompletionHandler:^(BOOL closed) {
+                        done();
+                    }];
+                }];
+            }];
+            
+            unsigned long long fileSize = [[[NSFileManager defaultManager] attributesOfItemAtPath:[fileURL path] error:nil] fileSize];
+            NSLog(@"[iCloud Benchmark] compression codec=%@ payload=%lu stored=%llu ratio=%.2f", codecName, (unsigned long)payload.length, fileSize, (double)payload.length / fileSize);
+            if (codec != iCloudCompressionCodecNone) XCTAssertLessThan(fileSize, (unsigned long long)payload.length);
+        }
+    }];
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
+- (void)testBenchmarkWriteBehindSaves {
+    NSUInteger editCount = 500;
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    cloud.writeBehindBuffer.enabled = YES;
+    cloud.writeBehindBuffer.idleDelay = 0.05;
+    cloud.writeBehindBuffer.maximumStaleness = 0.5;
+    
+    // One edit per millisecond, as an editor saving on every keystroke would
+    [self measureBlock:^{
+        __block NSUInteger completedEdits = 0;
+        __block NSUInteger failedEdits = 0;
+        NSUInteger writeCount = cloud.writeBehindBuffer.writeCount;
+        NSData *lastContent = nil;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger index = 0; index < editCount; index++) {
+            lastContent = [[NSString stringWithFormat:@"Edit %lu", (unsigned long)index] dataUsingEncoding:NSUTF8StringEncoding];
+            [cloud saveChangesToDocumentWithName:@"Editor.txt" withContent:lastContent completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+                completedEdits++;
+                if (error) failedEdits++;
+            }];
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+        }
+        
+        __block BOOL flushed = NO;
+        [cloud.writeBehindBuffer flushAllDocumentsWithCompletion:^{
+            flushed = YES;
+        }];
+        [self waitForFlag:&flushed];
+        
+        writeCount = cloud.writeBehindBuffer.writeCount - writeCount;
+        NSLog(@"[iCloud Benchmark] writeBehind edits=%lu writes=%lu time=%.3fs", (unsigned long)editCount, (unsigned long)writeCount, CFAbsoluteTimeGetCurrent() - start);
+        
+        // Every caller is answered, by far fewer writes, and the last edit is the one on disk
+        XCTAssertEqual(completedEdits, editCount);
+        XCTAssertEqual(failedEdits, (NSUInteger)0);
+        XCTAssertLessThanOrEqual(writeCount * 10, editCount);
+        XCTAssertEqualObjects([NSData dataWithContentsOfURL:[container.documentsURL URLByAppendingPathComponent:@"Editor.txt"]], lastContent);
+    }];
+    
+    [container tearDown];
+}
+
+- (void)testBenchmarkBatchFileOperations {
+    NSUInteger documentCount = 2000;
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    NSURL *documentsURL = container.documentsURL;
+    
+    NSMutableArray *names = [NSMutableArray arrayWithCapacity:documentCount];
+    NSMutableDictionary *copyNames = [NSMutableDictionary dictionaryWithCapacity:documentCount];
+    NSMutableDictionary *newNames = [NSMutableDictionary dictionaryWithCapacity:documentCount];
+    NSData *payload = [NSMutableData dataWithLength:1024];
+    for (NSUInteger index = 0; index < documentCount; index++) {
+        NSString *name = [NSString stringWithFormat:@"Batch-%05lu.dat", (unsigned long)index];
+        [names addObject:name];
+        copyNames[name] = [@"Copies" stringByAppendingPathComponent:name];
+        newNames[copyNames[name]] = [@"Renamed" stringByAppendingPathComponent:name];
+    }
+    
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    
+    // Duplicate, rename the copies, then delete the originals, each as one batch. Every run seeds the originals again first.
+    NSArray *operations = @[@"duplicate", @"rename", @"delete"];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        [[NSFileManager defaultManager] removeItemAtURL:[documentsURL URLByAppendingPathComponent:@"Renamed"] error:nil];
+        for (NSString *name in names) [payload writeToURL:[documentsURL URLByAppendingPathComponent:name] atomically:NO];
+        
+        [self startMeasuring];
+        for (NSString *operation in operations) {
+            __block BOOL finished = NO;
+            __block NSDictionary *batchErrors = nil;
+            void (^completion)(NSDictionary *) = ^(NSDictionary *errors) {
+                batchErrors = errors;
+                finished = YES;
+            };
+            
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            if ([operation isEqualToString:@"duplicate"]) [cloud duplicateDocumentsWithNewNames:copyNames completion:completion];
+            else if ([operation isEqualToString:@"rename"]) [cloud renameDocumentsWithNewNames:newNames completion:completion];
+            else [cloud deleteDocumentsWithNames:names completion:completion];
+            [self waitForFlag:&finished];
+            
+            NSLog(@"[iCloud Benchmark] batch operation=%@ documents=%lu time=%.3fms", operation, (unsigned long)documentCount, (CFAbsoluteTimeGetCurrent() - start) * 1000);
+            XCTAssertEqual(batchErrors.count, (NSUInteger)0, @"%@ failed: %@", operation, batchErrors);
+        }
+        [self stopMeasuring];
+        
+        XCTAssertEqual([[[NSFileManager defaultManager] contentsOfDirectoryAtPath:[[documentsURL URLByAppendingPathComponent:@"Renamed"] path] error:nil] count], documentCount);
+        XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[[documentsURL URLByAppendingPathComponent:names.firstObject] path]]);
+    }];
+    
+    // Items are reported one by one, the rest of the batch still runs
+    __block BOOL finished = NO;
+    __block NSDictionary *batchErrors = nil;
+    [cloud renameDocumentsWithNewNames:@{@"Missing.dat": @"Other.dat", newNames.allValues.firstObject: @"Moved.dat"} completion:^(NSDictionary *errors) {
+        batchErrors = errors;
+        finished = YES;
+    }];
+    [self waitForFlag:&finished];
+    XCTAssertEqual([batchErrors[@"Missing.dat"] code], 404);
+    XCTAssertEqual(batchErrors.count, (NSUInteger)1);
+    
+    // Every batch is timed as a whole
+    XCTAssertGreaterThanOrEqual([cloud.telemetry.snapshot[@"batch"][@"count"] unsignedIntegerValue], (NSUInteger)1);
+    
+    [container tearDown];
+}
+
+- (void)testBenchmarkOfflineUpload {
+    NSUInteger documentCount = 1000;
+    NSURL *localDirectory = [NSURL fileURLWithPath:NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES)[0] isDirectory:YES];
+    NSData *payload = [NSMutableData dataWithLength:4096];
+    NSDate *localDate = [NSDate dateWithTimeIntervalSinceReferenceDate:floor([NSDate timeIntervalSinceReferenceDate])];
+    
+    // Every run uploads into a fresh container. Half the local files are new, a quarter are already in iCloud with the same contents and date, and a quarter are older in iCloud.
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+        iCloud *cloud = container.cloud;
+        for (NSUInteger index = 0; index < documentCount; index++) {
+            @autoreleasepool {
+                NSString *name = [NSString stringWithFormat:@"Offline-%04lu.dat", (unsigned long)index];
+                NSURL *localURL = [localDirectory URLByAppendingPathComponent:name];
+                [payload writeToURL:localURL atomically:NO];
+                [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: localDate} ofItemAtPath:[localURL path] error:nil];
+                if (index % 2 == 0) continue;
+                
+                NSURL *cloudURL = [container.documentsURL URLByAppendingPathComponent:name];
+                [payload writeToURL:cloudURL atomically:NO];
+                NSDate *cloudDate = (index % 4 == 1) ? localDate : [localDate dateByAddingTimeInterval:-60];
+                [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: cloudDate} ofItemAtPath:[cloudURL path] error:nil];
+            }
+        }
+        [container setUpDocumentSync];
+        while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+        
+        __block NSDictionary *report = nil;
+        [self startMeasuring];
+        [cloud uploadLocalOfflineDocumentsWithRepeatingHandler:^(NSString *documentName, NSError *error) {
+            XCTAssertNil(error, @"%@ failed to upload", documentName);
+        } report:^(NSDictionary *uploadReport) {
+            report = uploadReport;
+        }];
+        while (report == nil) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+        [self stopMeasuring];
+        
+        NSLog(@"[iCloud Benchmark] offlineUpload documents=%lu time=%.3fms report=%@", (unsigned long)documentCount, [report[@"duration"] doubleValue] * 1000, report);
+        XCTAssertEqual([report[@"uploaded"] unsignedIntegerValue], documentCount / 2);
+        XCTAssertEqual([report[@"removedLocally"] unsignedIntegerValue], documentCount / 4);
+        XCTAssertEqual([report[@"replacedInCloud"] unsignedIntegerValue], documentCount / 4);
+        XCTAssertEqual([report[@"failed"] unsignedIntegerValue], (NSUInteger)0);
+        
+        // Local files a run did not move or remove must not leak into the next one
+        for (NSUInteger index = 0; index < documentCount; index++) [[NSFileManager defaultManager] removeItemAtURL:[localDirectory URLByAppendingPathComponent:[NSString stringWithFormat:@"Offline-%04lu.dat", (unsigned long)index]] error:nil];
+        [container tearDown];
+    }];
+}
+
+@end
@@ -7,9 +7,103 @@
 //
 
 #import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
 #import <iCloud/iCloud.h>
+#import "iCloudTestSupport.h"
 
-@interface iCloud_AppTests : XCTestCase
+@interface iCloud_AppTests : XCTestCase <iCloudDelegate>
+
+/// Document paths in the file list reported through iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:
+@property (strong) NSMutableSet *listedFileNames;
+
+/// Document paths reported as updated through iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:
+@property (strong) NSMutableSet *updatedFileNames;
+
+/// Document paths reported as deleted through iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:
+@property (strong) NSMutableSet *deletedFileNames;
+
+@end
+
+/// Stands in for the metadata items of a folder query's NSMetadataQuery, which cannot be created on iOS
+@interface iCloudTestMetadataItem : NSObject
+
+@property (strong) NSDictionary *attributes;
+
+@end
+
+@implementation iCloudTestMetadataItem
+
+- (id)valueForAttribute:(NSString *)key {
+    return self.attributes[key];
+}
+
+- (NSDictionary *)valuesForAttributes:(NSArray *)keys {
+    NSMutableDictionary *values = [NSMutableDictionary dictionary];
+    for (NSString *key in keys) if (self.attributes[key]) values[key] = self.attributes[key];
+    return values;
+}
+
+@end
+
+/// Records the downloads and evictions asked for by the download scheduler and eviction manager instead of passing them to iCloud
+@interface iCloudTestUbiquityManager : NSFileManager
+
+/// The URLs passed to startDownloadingUbiquitousItemAtURL:error:, in order
+@property (strong) NSMutableArray *startedURLs;
+
+/// The URLs passed to evictUbiquitousItemAtURL:error:, in order
+@property (strong) NSMutableArray *evictedURLs;
+
+/// The file names of the started URLs, read safely while the scheduler may still be starting downloads
+- (NSArray *)startedNames;
+
+/// The file names of the evicted URLs, read safely while the eviction manager may still be evicting
+- (NSArray *)evictedNames;
+
+@end
+
+@implementation iCloudTestUbiquityManager
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _startedURLs = [NSMutableArray array];
+        _evictedURLs = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (BOOL)startDownloadingUbiquitousItemAtURL:(NSURL *)url error:(NSError **)error {
+    @synchronized (self.startedURLs) {
+        [self.startedURLs addObject:url];
+    }
+    return YES;
+}
+
+- (NSArray *)startedNames {
+    @synchronized (self.startedURLs) {
+        return [self.startedURLs valueForKey:@"lastPathComponent"];
+    }
+}
+
+- (BOOL)evictUbiquitousItemAtURL:(NSURL *)url error:(NSError **)error {
+    @synchronized (self.evictedURLs) {
+        [self.evictedURLs addObject:url];
+    }
+    return YES;
+}
+
+- (NSArray *)evictedNames {
+    @synchronized (self.evictedURLs) {
+        return [self.evictedURLs valueForKey:@"lastPathComponent"];
+    }
+}
+
+@end
+
+@interface iCloudFolderQuery (Testing)
+
+- (void)queryDidUpdate:(NSNotification *)notification;
 
 @end
 
@@ -25,4 +119,1196 @@
     [super tearDown];
 }
 
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Operations ---------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Operations
+
+- (void)testWriteBehindCopiesContentAndOrdersDirectSaves {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    cloud.writeBehindBuffer.enabled = YES;
+    cloud.writeBehindBuffer.idleDelay = 60;
+    cloud.writeBehindBuffer.maximumStaleness = 60;
+    
+    // Changing the caller's buffer after handing it over does not change what is written
+    NSMutableData *content = [[@"buffered" dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+    __block NSData *bufferedData = nil;
+    __block BOOL bufferedWritten = NO;
+    [cloud saveChangesToDocumentWithName:@"Editor.txt" withContent:content completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+        XCTAssertNil(error);
+        bufferedData = documentData;
+        bufferedWritten = YES;
+    }];
+    [content setData:[@"changed" dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    // A direct save made while the buffered write is in flight is written after it, not alongside it
+    [cloud.writeBehindBuffer flushDocumentWithName:@"Editor.txt" completion:nil];
+    while ([cloud.writeBehindBuffer hasBufferedContentForDocumentWithName:@"Editor.txt"]) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+    XCTAssertTrue([cloud.writeBehindBuffer hasPendingWritesForDocumentWithName:@"Editor.txt"]);
+    
+    __block BOOL directWritten = NO;
+    NSData *directContent = [@"direct" dataUsingEncoding:NSUTF8StringEncoding];
+    [cloud saveAndCloseDocumentWithName:@"Editor.txt" withContent:directContent completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertTrue(bufferedWritten);
+        directWritten = YES;
+    }];
+    [self waitForFlag:&directWritten];
+    
+    XCTAssertEqualObjects(bufferedData, [@"buffered" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertEqual(cloud.writeBehindBuffer.writeCount, (NSUInteger)2);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:[container.documentsURL URLByAppendingPathComponent:@"Editor.txt"]], directContent);
+    
+    [container tearDown];
+}
+
+- (void)testOperationJournalCoalescesAndSurvivesReopen {
+    NSURL *journalURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    iCloudOperationJournal *journal = [[iCloudOperationJournal alloc] initWithJournalURL:journalURL];
+    
+    // 100 documents saved 10 times each, then a rename chain, a rename back and forth and a deleted duplicate
+    for (NSUInteger round = 0; round < 10; round++) {
+        for (NSUInteger index = 0; index < 100; index++) {
+            XCTAssertNotNil([journal appendOperation:iCloudJournalOperationSave documentPath:[NSString stringWithFormat:@"Doc-%03lu.txt", (unsigned long)index] destinationPath:nil error:nil]);
+        }
+    }
+    [journal appendOperation:iCloudJournalOperationRename documentPath:@"Doc-000.txt" destinationPath:@"A.txt" error:nil];
+    [journal appendOperation:iCloudJournalOperationRename documentPath:@"A.txt" destinationPath:@"Folder/B.txt" error:nil];
+    [journal appendOperation:iCloudJournalOperationRename documentPath:@"Doc-001.txt" destinationPath:@"C.txt" error:nil];
+    [journal appendOperation:iCloudJournalOperationRename documentPath:@"C.txt" destinationPath:@"Doc-001.txt" error:nil];
+    [journal appendOperation:iCloudJournalOperationDuplicate documentPath:@"Doc-002.txt" destinationPath:@"Copy.txt" error:nil];
+    [journal appendOperation:iCloudJournalOperationDelete documentPath:@"Copy.txt" destinationPath:nil error:nil];
+    [journal appendOperation:iCloudJournalOperationDelete documentPath:@"Doc-003.txt" destinationPath:nil error:nil];
+    XCTAssertEqual(journal.count, (NSUInteger)1007);
+    
+    // A record torn by a crash is dropped without losing the ones before it
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingToURL:journalURL error:nil];
+    [fileHandle seekToEndOfFile];
+    [fileHandle writeData:[NSData dataWithBytes:"\x40\0\0\0torn" length:8]];
+    [fileHandle closeFile];
+    
+    iCloudOperationJournal *reopened = [[iCloudOperationJournal alloc] initWithJournalURL:journalURL];
+    XCTAssertEqual(reopened.count, (NSUInteger)1007);
+    XCTAssertEqual(reopened.lastSequence, journal.lastSequence);
+    
+    // 99 saves (Doc-003 is deleted), the rename to Folder/B.txt and the delete of Doc-003
+    NSArray *coalesced = [reopened coalescedEntries];
+    XCTAssertEqual(coalesced.count, (NSUInteger)101);
+    NSArray *renames = [coalesced filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"operation == %@", @(iCloudJournalOperationRename)]];
+    XCTAssertEqual(renames.count, (NSUInteger)1);
+    XCTAssertEqualObjects([renames.firstObject documentPath], @"Doc-000.txt");
+    XCTAssertEqualObjects([renames.firstObject destinationPath], @"Folder/B.txt");
+    XCTAssertEqual([coalesced filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"documentPath == 'Folder/B.txt' AND operation == %@", @(iCloudJournalOperationSave)]].count, (NSUInteger)1);
+    XCTAssertEqual([coalesced filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"operation == %@", @(iCloudJournalOperationDuplicate)]].count, (NSUInteger)0);
+    
+    // Entries keep the account and container they were queued for, and whether they were applied to the container already
+    NSData *identityToken = [@"account-a" dataUsingEncoding:NSUTF8StringEncoding];
+    reopened.identityToken = identityToken;
+    reopened.containerIdentifier = @"iCloud.com.example.app";
+    [reopened appendOperation:iCloudJournalOperationRename documentPath:@"Doc-004.txt" destinationPath:@"D.txt" appliedLocally:YES error:nil];
+    [reopened appendOperation:iCloudJournalOperationRename documentPath:@"D.txt" destinationPath:@"E.txt" appliedLocally:YES error:nil];
+    iCloudJournalEntry *tagged = [[[iCloudOperationJournal alloc] initWithJournalURL:journalURL] entries].lastObject;
+    XCTAssertEqualObjects(tagged.identityToken, identityToken);
+    XCTAssertEqualObjects(tagged.containerIdentifier, @"iCloud.com.example.app");
+    XCTAssertTrue(tagged.appliedLocally);
+    iCloudJournalEntry *chained = [[reopened coalescedEntries] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"destinationPath == 'E.txt'"]].firstObject;
+    XCTAssertEqualObjects(chained.documentPath, @"Doc-004.txt");
+    XCTAssertEqualObjects(chained.identityToken, identityToken);
+    XCTAssertTrue(chained.appliedLocally);
+    
+    // Compacting keeps entries appended after the replayed sequence
+    uint64_t sequence = reopened.lastSequence;
+    [reopened appendOperation:iCloudJournalOperationSave documentPath:@"Late.txt" destinationPath:nil error:nil];
+    XCTAssertTrue([reopened replaceEntriesThroughSequence:sequence withEntries:@[] error:nil]);
+    XCTAssertEqual([[iCloudOperationJournal alloc] initWithJournalURL:journalURL].count, (NSUInteger)1);
+    
+    [reopened removeAllEntries];
+}
+
+- (void)testOperationJournalDeletesARenamedDocumentBeforeItsNameIsReused {
+    NSURL *journalURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    iCloudOperationJournal *journal = [[iCloudOperationJournal alloc] initWithJournalURL:journalURL];
+    
+    // A is renamed to B, a new document is saved as A, then B is deleted
+    [journal appendOperation:iCloudJournalOperationRename documentPath:@"A.txt" destinationPath:@"B.txt" error:nil];
+    [journal appendOperation:iCloudJournalOperationSave documentPath:@"A.txt" destinationPath:nil error:nil];
+    [journal appendOperation:iCloudJournalOperationDelete documentPath:@"B.txt" destinationPath:nil error:nil];
+    
+    // The original A is deleted before the new A is uploaded, not after
+    NSArray *coalesced = [journal coalescedEntries];
+    XCTAssertEqual(coalesced.count, (NSUInteger)2);
+    XCTAssertEqual([coalesced[0] operation], iCloudJournalOperationDelete);
+    XCTAssertEqualObjects([coalesced[0] documentPath], @"A.txt");
+    XCTAssertEqual([coalesced[1] operation], iCloudJournalOperationSave);
+    XCTAssertEqualObjects([coalesced[1] documentPath], @"A.txt");
+    
+    [journal removeAllEntries];
+}
+
+- (void)testConflictStateSurvivesSnapshotAndResolverSkipsCleanDocuments {
+    NSURL *folderURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:folderURL withIntermediateDirectories:YES attributes:nil error:nil];
+    NSURL *cleanURL = [folderURL URLByAppendingPathComponent:@"Clean.txt"];
+    [[@"clean" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:cleanURL atomically:YES];
+    
+    // Only conflicted entries carry the key, so restored entries compare equal to live ones
+    NSDictionary *conflicted = @{iCloudMetadataItemDocumentPathKey: @"Conflicted.txt", NSMetadataItemFSNameKey: @"Conflicted.txt", NSMetadataItemURLKey: [folderURL URLByAppendingPathComponent:@"Conflicted.txt"], NSMetadataUbiquitousItemDownloadingStatusKey: NSMetadataUbiquitousItemDownloadingStatusCurrent, NSMetadataUbiquitousItemHasUnresolvedConflictsKey: @YES};
+    NSDictionary *clean = @{iCloudMetadataItemDocumentPathKey: @"Clean.txt", NSMetadataItemFSNameKey: @"Clean.txt", NSMetadataItemURLKey: cleanURL, NSMetadataUbiquitousItemDownloadingStatusKey: NSMetadataUbiquitousItemDownloadingStatusCurrent};
+    iCloudMetadataSnapshot *snapshot = [[iCloudMetadataSnapshot alloc] initWithEntriesByDocumentPath:@{@"Conflicted.txt": conflicted, @"Clean.txt": clean} generation:1 complete:YES];
+    
+    NSURL *snapshotURL = [folderURL URLByAppendingPathComponent:@"MetadataSnapshot.bin"];
+    XCTAssertTrue([snapshot writeToURL:snapshotURL error:nil]);
+    iCloudMetadataSnapshot *restored = [[iCloudMetadataSnapshot alloc] initWithContentsOfURL:snapshotURL error:nil];
+    XCTAssertEqualObjects([restored entryForDocumentPath:@"Conflicted.txt"][NSMetadataUbiquitousItemHasUnresolvedConflictsKey], @YES);
+    XCTAssertNil([restored entryForDocumentPath:@"Clean.txt"][NSMetadataUbiquitousItemHasUnresolvedConflictsKey]);
+    
+    // The manual policy queues nothing, other policies leave documents without conflicts untouched
+    iCloudConflictResolver *resolver = [[iCloudConflictResolver alloc] init];
+    [resolver resolveConflictsInDocuments:@{@"Clean.txt": cleanURL}];
+    XCTAssertEqual(resolver.pendingDocumentCount, (NSUInteger)0);
+    
+    resolver.policy = iCloudConflictPolicyLatestWins;
+    NSDictionary *resolution = [resolver resolveConflictsInDocumentWithName:@"Clean.txt" atURL:cleanURL error:nil];
+    XCTAssertEqualObjects(resolution, @{});
+    XCTAssertEqual(resolver.resolvedDocumentCount, (NSUInteger)0);
+    XCTAssertEqualObjects([NSString stringWithContentsOfURL:cleanURL encoding:NSUTF8StringEncoding error:nil], @"clean");
+    
+    [[NSFileManager defaultManager] removeItemAtURL:folderURL error:nil];
+}
+
+- (void)testConflictsAreTrackedAndResolvedWithAPolicy {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    iCloudLocalBackend *backend = container.backend;
+    iCloud *cloud = container.cloud;
+    NSURL *documentsURL = container.documentsURL;
+    NSURL *notesURL = [documentsURL URLByAppendingPathComponent:@"Notes.txt"];
+    NSURL *remoteURL = [container.containerURL URLByAppendingPathComponent:@"Remote.txt"];
+    [[@"local" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:notesURL atomically:YES];
+    [[@"remote" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:remoteURL atomically:YES];
+    
+    cloud.conflictResolver.retryInterval = 0.05;
+    [container setUpDocumentSync];
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertEqual(cloud.conflictedDocumentNames.count, (NSUInteger)0);
+    
+    // A conflicting version from another device enters the conflicted set with the next metadata update, the manual policy leaves it alone
+    XCTAssertNotNil([backend addConflictVersionOfItemAtURL:notesURL withContentsOfURL:remoteURL savingComputer:@"iPad" error:nil]);
+    [backend refreshMetadata];
+    while (cloud.conflictedDocumentNames.count == 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertEqualObjects(cloud.conflictedDocumentNames, [NSSet setWithObject:@"Notes.txt"]);
+    XCTAssertEqual(cloud.conflictResolver.pendingDocumentCount, (NSUInteger)0);
+    
+    // Merging without a handler cannot succeed by retrying, the failure is reported once and the document is not queued again
+    __block NSDictionary *reportedErrors = nil;
+    cloud.conflictResolver.reportHandler = ^(NSDictionary *resolutions, NSDictionary *errors) {
+        reportedErrors = errors;
+    };
+    cloud.conflictResolver.policy = iCloudConflictPolicyMerge;
+    [cloud resolveUnresolvedConflicts];
+    while (reportedErrors == nil) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertEqual([reportedErrors[@"Notes.txt"] code], 521);
+    XCTAssertEqual(cloud.conflictResolver.resolvedDocumentCount, (NSUInteger)0);
+    XCTAssertEqual(cloud.conflictResolver.pendingDocumentCount, (NSUInteger)0);
+    XCTAssertTrue([cloud.conflictedDocumentNames containsObject:@"Notes.txt"]);
+    cloud.conflictResolver.reportHandler = nil;
+    
+    // Keeping both resolves the document once it is queued again, the version is copied next to the document and the conflict leaves the set
+    cloud.conflictResolver.policy = iCloudConflictPolicyKeepBoth;
+    [cloud resolveUnresolvedConflicts];
+    while (cloud.conflictedDocumentNames.count > 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertEqual(cloud.conflictResolver.resolvedDocumentCount, (NSUInteger)1);
+    XCTAssertEqual(cloud.conflictResolver.pendingDocumentCount, (NSUInteger)0);
+    XCTAssertEqualObjects([NSString stringWithContentsOfURL:notesURL encoding:NSUTF8StringEncoding error:nil], @"local");
+    XCTAssertEqualObjects([NSString stringWithContentsOfURL:[documentsURL URLByAppendingPathComponent:@"Notes (iPad).txt"] encoding:NSUTF8StringEncoding error:nil], @"remote");
+    XCTAssertEqual([backend unresolvedConflictVersionsOfItemAtURL:notesURL].count, (NSUInteger)0);
+    
+    // A newly conflicted document is queued on its own and merged, documents which stayed clean are not touched
+    cloud.conflictResolver.policy = iCloudConflictPolicyMerge;
+    cloud.conflictResolver.mergeHandler = ^NSData *(NSString *documentName, NSData *currentContents, NSArray *conflictContents) {
+        NSMutableData *merged = [currentContents mutableCopy];
+        for (NSData *contents in conflictContents) [merged appendData:contents];
+        return merged;
+    };
+    [backend addConflictVersionOfItemAtURL:notesURL withContentsOfURL:remoteURL savingComputer:@"iPad" error:nil];
+    [backend refreshMetadata];
+    while (cloud.conflictResolver.resolvedDocumentCount < 2 || cloud.conflictedDocumentNames.count > 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertEqualObjects([NSString stringWithContentsOfURL:notesURL encoding:NSUTF8StringEncoding error:nil], @"localremote");
+    XCTAssertEqualObjects([NSString stringWithContentsOfURL:[documentsURL URLByAppendingPathComponent:@"Notes (iPad).txt"] encoding:NSUTF8StringEncoding error:nil], @"remote");
+    
+    // The resolver coordinates through the storage backend
+    XCTAssertGreaterThanOrEqual(backend.fileCoordinatorCount, (NSUInteger)2);
+    
+    [container tearDown];
+}
+
+- (void)testBackendMetadataReportsAreCoalesced {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    iCloud *cloud = container.cloud;
+    cloud.updateCoalescingInterval = 0.5;
+    cloud.maximumUpdateLatency = 2;
+    [container setUpDocumentSync];
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    NSUInteger passCount = cloud.updatePassCount;
+    
+    // A burst of reports from the backend lands in one update pass, like a burst of query notifications
+    for (NSUInteger index = 0; index < 5; index++) {
+        [[@"burst" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:[NSString stringWithFormat:@"Burst-%lu.txt", (unsigned long)index]] atomically:YES];
+        [container.backend refreshMetadata];
+    }
+    while (![cloud doesFileExistInCloud:@"Burst-4.txt"]) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    XCTAssertEqual(cloud.updatePassCount - passCount, (NSUInteger)1);
+    XCTAssertGreaterThanOrEqual(cloud.coalescedUpdateNotificationCount, (NSUInteger)4);
+    XCTAssertEqual(cloud.metadataSnapshot.count, (NSUInteger)5);
+    
+    [container tearDown];
+}
+
+- (void)testMaximumUpdateLatencyBoundsASteadyStreamOfReports {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    iCloud *cloud = container.cloud;
+    cloud.updateCoalescingInterval = 10;
+    cloud.maximumUpdateLatency = 0.2;
+    [container setUpDocumentSync];
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    NSUInteger passCount = cloud.updatePassCount;
+    NSUInteger coalescedCount = cloud.coalescedUpdateNotificationCount;
+    
+    // A report every 50 ms never leaves a quiet window, the maximum latency still forces passes through
+    for (NSUInteger index = 0; index < 20; index++) {
+        [[@"stream" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:[NSString stringWithFormat:@"Stream-%lu.txt", (unsigned long)index]] atomically:YES];
+        [container.backend refreshMetadata];
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+    }
+    while ([cloud.metadataSnapshot entryForDocumentPath:@"Stream-19.txt"] == nil) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    NSUInteger passes = cloud.updatePassCount - passCount;
+    XCTAssertGreaterThanOrEqual(passes, (NSUInteger)2);
+    XCTAssertLessThan(passes, (NSUInteger)20);
+    
+    // Every report either ran its own pass or was merged into one
+    XCTAssertEqual(passes + (cloud.coalescedUpdateNotificationCount - coalescedCount), (NSUInteger)20);
+    XCTAssertEqual(cloud.metadataSnapshot.count, (NSUInteger)20);
+    
+    [container tearDown];
+}
+
+- (void)testBatchOperationsReportEachDocument {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    for (NSString *name in @[@"A.txt", @"B.txt", @"C.txt"]) [[name dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:name] atomically:YES];
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    // Each rename fails or succeeds on its own
+    __block BOOL finished = NO;
+    __block NSDictionary *batchErrors = nil;
+    NSProgress *progress = [cloud renameDocumentsWithNewNames:@{@"A.txt": @"Renamed.txt", @"Missing.txt": @"Other.txt", @"B.txt": @"C.txt", @"": @"Empty.txt"} completion:^(NSDictionary *errors) {
+        batchErrors = errors;
+        finished = YES;
+    }];
+    [self waitForFlag:&finished];
+    XCTAssertEqual(batchErrors.count, (NSUInteger)3);
+    XCTAssertEqual([batchErrors[@"Missing.txt"] code], 404);
+    XCTAssertEqual([batchErrors[@"B.txt"] code], 512);
+    XCTAssertEqual([batchErrors[@""] code], 1);
+    XCTAssertTrue(progress.finished);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[[container.documentsURL URLByAppendingPathComponent:@"Renamed.txt"] path]]);
+    XCTAssertEqualObjects([NSString stringWithContentsOfURL:[container.documentsURL URLByAppendingPathComponent:@"C.txt"] encoding:NSUTF8StringEncoding error:nil], @"C.txt");
+    
+    [container tearDown];
+}
+
+- (void)testOfflineBatchOperationsReportOnceEveryDocumentIsQueued {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    for (NSString *name in @[@"A.txt", @"B.txt"]) [[name dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:name] atomically:YES];
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    [cloud.operationJournal removeAllEntries];
+    
+    // Signed out, every delete is applied locally and queued, and the handler only runs once all of them are
+    container.backend.identityToken = nil;
+    __block BOOL finished = NO;
+    __block NSDictionary *batchErrors = nil;
+    NSProgress *progress = [cloud deleteDocumentsWithNames:@[@"A.txt", @"B.txt", @""] completion:^(NSDictionary *errors) {
+        batchErrors = errors;
+        finished = YES;
+    }];
+    [self waitForFlag:&finished];
+    XCTAssertEqual(batchErrors.count, (NSUInteger)3);
+    XCTAssertEqual([batchErrors[@"A.txt"] code], 503);
+    XCTAssertEqual([batchErrors[@"B.txt"] code], 503);
+    XCTAssertEqual([batchErrors[@""] code], 1);
+    XCTAssertTrue(progress.finished);
+    XCTAssertEqual(cloud.operationJournal.count, (NSUInteger)2);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[[container.documentsURL URLByAppendingPathComponent:@"A.txt"] path]]);
+    
+    [cloud.operationJournal removeAllEntries];
+    [container tearDown];
+}
+
+- (void)testIndexedLookupsFollowDeletesAndRenames {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    for (NSString *name in @[@"A.txt", @"B.txt", @"Batch.txt"]) [[name dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:name] atomically:YES];
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertTrue([cloud doesFileExistInCloud:@"A.txt"]);
+    
+    // The handlers run before the backend reports the changes, so the answers come from the index as the operation left it
+    __block BOOL deleted = NO;
+    [cloud deleteDocumentWithName:@"A.txt" completion:^(NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertFalse([cloud doesFileExistInCloud:@"A.txt"]);
+        XCTAssertNil([cloud fileSize:@"A.txt"]);
+        deleted = YES;
+    }];
+    [self waitForFlag:&deleted];
+    
+    __block BOOL renamed = NO;
+    [cloud renameOriginalDocument:@"B.txt" withNewName:@"Renamed.txt" completion:^(NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertFalse([cloud doesFileExistInCloud:@"B.txt"]);
+        XCTAssertNil([cloud fileSize:@"B.txt"]);
+        XCTAssertTrue([cloud doesFileExistInCloud:@"Renamed.txt"]);
+        XCTAssertEqualObjects([cloud fileSize:@"Renamed.txt"], @5);
+        renamed = YES;
+    }];
+    [self waitForFlag:&renamed];
+    
+    __block BOOL batchRenamed = NO;
+    [cloud renameDocumentsWithNewNames:@{@"Batch.txt": @"Folder/Batch.txt"} completion:^(NSDictionary *errors) {
+        XCTAssertEqual(errors.count, (NSUInteger)0);
+        XCTAssertFalse([cloud doesFileExistInCloud:@"Batch.txt"]);
+        XCTAssertTrue([cloud doesFileExistInCloud:@"Folder/Batch.txt"]);
+        XCTAssertEqualObjects([cloud fileSize:@"Folder/Batch.txt"], @9);
+        batchRenamed = YES;
+    }];
+    [self waitForFlag:&batchRenamed];
+    
+    [container tearDown];
+}
+
+- (void)testCancelledBatchSaveReportsEveryDocumentThatWasNotSaved {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    iCloud *cloud = container.cloud;
+    cloud.maximumConcurrentDocumentOperations = 1;
+    [container setUpDocumentSync];
+    
+    // One save at a time, and the first one cannot finish before the main run loop spins, so every later document is skipped
+    NSMutableDictionary *documents = [NSMutableDictionary dictionary];
+    for (NSUInteger index = 0; index < 5; index++) documents[[NSString stringWithFormat:@"Batch-%lu.txt", (unsigned long)index]] = [@"batch" dataUsingEncoding:NSUTF8StringEncoding];
+    __block BOOL finished = NO;
+    __block NSDictionary *batchErrors = nil;
+    NSProgress *progress = [cloud saveAndCloseDocumentsWithContents:documents completion:^(NSDictionary *errors) {
+        batchErrors = errors;
+        finished = YES;
+    }];
+    [progress cancel];
+    [self waitForFlag:&finished];
+    
+    XCTAssertGreaterThanOrEqual(batchErrors.count, (NSUInteger)4);
+    for (NSString *documentName in documents) {
+        NSError *error = batchErrors[documentName];
+        BOOL saved = [[NSFileManager defaultManager] fileExistsAtPath:[[container.documentsURL URLByAppendingPathComponent:documentName] path]];
+        if (error) {
+            XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+            XCTAssertEqual(error.code, NSUserCancelledError);
+            XCTAssertFalse(saved);
+        } else {
+            XCTAssertTrue(saved);
+        }
+    }
+    XCTAssertEqual(progress.completedUnitCount, (int64_t)documents.count);
+    XCTAssertTrue(progress.finished);
+    
+    [container tearDown];
+}
+
+- (void)testDifferentialUndoStaysWithinMemoryBudget {
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:@"UndoBudget.dat"];
+    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+    document.differentialUndo = YES;
+    document.undoMemoryBudget = 1024 * 1024;
+    document.undoManager.groupsByEvent = NO;
+    
+    // Start from a 4 MB document
+    NSMutableData *data = [NSMutableData dataWithLength:4 * 1024 * 1024];
+    document.contents = data;
+    
+    NSData *previousData = nil;
+    for (NSUInteger edit = 0; edit < 5000; edit++) {
+        @autoreleasepool {
+            // Overwrite a small region at a pseudo-random location
+            NSUInteger location = (edit * 7919 * 131) % (data.length - 256);
+            unsigned char bytes[256];
+            memset(bytes, (int)(edit % 255) + 1, sizeof(bytes));
+            [data replaceBytesInRange:NSMakeRange(location, sizeof(bytes)) withBytes:bytes];
+            
+            previousData = document.contents;
+            [document.undoManager beginUndoGrouping];
+            [document setDocumentData:data];
+            [document.undoManager endUndoGrouping];
+            
+            XCTAssertLessThanOrEqual(document.undoMemoryUsage, document.undoMemoryBudget, @"Undo memory exceeded the budget after %lu edits", (unsigned long)edit);
+        }
+    }
+    
+    // The most recent edit can still be undone
+    XCTAssertTrue(document.undoManager.canUndo);
+    [document.undoManager undo];
+    XCTAssertEqualObjects(document.contents, previousData);
+    XCTAssertLessThanOrEqual(document.undoMemoryUsage, document.undoMemoryBudget);
+    
+    // Dropping levels for the budget leaves the configured number of levels alone
+    XCTAssertEqual(document.undoManager.levelsOfUndo, (NSUInteger)0);
+}
+
+- (void)testDifferentialUndoReleasesRecordsWithTheUndoStack {
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:@"UndoStack.dat"];
+    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+    document.differentialUndo = YES;
+    document.undoManager.groupsByEvent = NO;
+    document.undoManager.levelsOfUndo = 3;
+    document.contents = [NSMutableData dataWithLength:1024];
+    
+    // Every edit replaces 16 bytes in its own undo group
+    void (^edit)(NSUInteger) = ^(NSUInteger index) {
+        NSMutableData *data = [document.contents mutableCopy];
+        unsigned char bytes[16];
+        memset(bytes, (int)index + 1, sizeof(bytes));
+        [data replaceBytesInRange:NSMakeRange(index * 16, sizeof(bytes)) withBytes:bytes];
+        [document.undoManager beginUndoGrouping];
+        [document setDocumentData:data];
+        [document.undoManager endUndoGrouping];
+    };
+    
+    edit(0);
+    unsigned long long levelUsage = document.undoMemoryUsage;
+    XCTAssertGreaterThan(levelUsage, 0ULL);
+    
+    // Levels the undo manager discards beyond levelsOfUndo no longer count
+    for (NSUInteger index = 1; index < 10; index++) edit(index);
+    XCTAssertEqual(document.undoMemoryUsage, levelUsage * 3);
+    
+    // Undoing moves a level to the redo stack, a new edit clears the redo stack
+    [document.undoManager undo];
+    XCTAssertEqual(document.undoMemoryUsage, levelUsage * 3);
+    [document.undoManager redo];
+    XCTAssertEqual(document.undoMemoryUsage, levelUsage * 3);
+    [document.undoManager undo];
+    [document.undoManager undo];
+    edit(20);
+    XCTAssertEqual(document.undoMemoryUsage, levelUsage * 2);
+    XCTAssertFalse(document.undoManager.canRedo);
+    XCTAssertEqual(document.undoManager.levelsOfUndo, (NSUInteger)3);
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Compression --------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Compression
+
+- (NSData *)compressionTestPayload {
+    NSMutableData *payload = [NSMutableData data];
+    for (NSUInteger index = 0; index < 4096; index++) [payload appendData:[[NSString stringWithFormat:@"Line %lu of a compressible document.\n", (unsigned long)index] dataUsingEncoding:NSUTF8StringEncoding]];
+    return payload;
+}
+
+- (void)testCompressionRoundTripsEveryAvailableCodec {
+    NSData *payload = [self compressionTestPayload];
+    
+    for (NSNumber *codecNumber in @[@(iCloudCompressionCodecZlib), @(iCloudCompressionCodecLZ4), @(iCloudCompressionCodecLZFSE)]) {
+        iCloudCompressionCodec codec = [codecNumber integerValue];
+        if (![iCloudCompression isCodecAvailable:codec]) continue;
+        
+        NSError *error = nil;
+        NSData *compressed = [iCloudCompression compressData:payload codec:codec error:&error];
+        XCTAssertNil(error);
+        XCTAssertTrue([iCloudCompression isCompressedData:compressed]);
+        XCTAssertLessThan(compressed.length, payload.length);
+        XCTAssertEqual([iCloudCompression uncompressedLengthOfData:compressed], (unsigned long long)payload.length);
+        XCTAssertEqualObjects([iCloudCompression decompressData:compressed error:&error], payload);
+        XCTAssertNil(error);
+        
+        // Streaming through a small buffer gives back the same bytes, in order
+        NSMutableData *streamed = [NSMutableData data];
+        XCTAssertTrue([iCloudCompression decompressData:compressed bufferLength:1000 chunkHandler:^(NSData *chunk, BOOL *stop) {
+            XCTAssertLessThanOrEqual(chunk.length, (NSUInteger)1000);
+            [streamed appendData:chunk];
+        } error:&error]);
+        XCTAssertEqualObjects(streamed, payload);
+    }
+    
+    // A compressed document hands back the uncompressed payload
+    if (![iCloudCompression isCodecAvailable:iCloudCompressionCodecZlib]) return;
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+    document.compressionCodec = iCloudCompressionCodecZlib;
+    document.contents = payload;
+    __block BOOL saved = NO;
+    [document saveToURL:fileURL forSaveOperation:UIDocumentSaveForCreating completionHandler:^(BOOL success) {
+        XCTAssertTrue(success);
+        saved = YES;
+    }];
+    [self waitForFlag:&saved];
+    
+    NSData *fileContents = [NSData dataWithContentsOfURL:fileURL];
+    XCTAssertTrue([iCloudCompression isCompressedData:fileContents]);
+    iCloudDocument *reopened = [[iCloudDocument alloc] initWithFileURL:fileURL];
+    XCTAssertTrue([reopened loadFromContents:fileContents ofType:reopened.fileType error:nil]);
+    XCTAssertEqualObjects(reopened.contents, payload);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+}
+
+- (void)testCompressionReadsLegacyUncompressedDocuments {
+    NSData *payload = [self compressionTestPayload];
+    
+    // Payloads without the header are returned as they are, even one which starts like a header but is too short for one
+    NSError *error = nil;
+    XCTAssertFalse([iCloudCompression isCompressedData:payload]);
+    XCTAssertEqualObjects([iCloudCompression decompressData:payload error:&error], payload);
+    XCTAssertNil(error);
+    XCTAssertEqual([iCloudCompression uncompressedLengthOfData:payload], (unsigned long long)payload.length);
+    NSData *shortPayload = [@"iCDZ" dataUsingEncoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects([iCloudCompression decompressData:shortPayload error:nil], shortPayload);
+    
+    // A document set to compress still reads the files written before compression was enabled
+    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:[[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:@"Legacy.txt"]];
+    document.compressionCodec = iCloudCompressionCodecZlib;
+    XCTAssertTrue([document loadFromContents:payload ofType:document.fileType error:&error]);
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(document.contents, payload);
+}
+
+- (void)testCompressionRejectsCorruptTruncatedAndOversizedPayloads {
+    if (![iCloudCompression isCodecAvailable:iCloudCompressionCodecZlib]) return;
+    NSData *payload = [self compressionTestPayload];
+    NSData *compressed = [iCloudCompression compressData:payload codec:iCloudCompressionCodecZlib error:nil];
+    
+    // A payload cut short
+    NSError *error = nil;
+    XCTAssertNil([iCloudCompression decompressData:[compressed subdataWithRange:NSMakeRange(0, compressed.length - 16)] error:&error]);
+    XCTAssertEqual(error.code, 520);
+    
+    // A body which is not a valid stream
+    NSMutableData *corrupt = [compressed mutableCopy];
+    memset((unsigned char *)corrupt.mutableBytes + iCloudCompressionHeaderLength, 0xFF, corrupt.length - iCloudCompressionHeaderLength);
+    error = nil;
+    XCTAssertNil([iCloudCompression decompressData:corrupt error:&error]);
+    XCTAssertEqual(error.code, 520);
+    
+    // A declared length the body cannot produce, too long, too short, or far beyond any real ratio
+    for (NSNumber *declaredLength in @[@(payload.length + 1), @(payload.length - 1), @(1ULL << 40)]) {
+        NSMutableData *mislabelled = [compressed mutableCopy];
+        unsigned long long length = [declaredLength unsignedLongLongValue];
+        unsigned char *header = mislabelled.mutableBytes;
+        for (NSUInteger index = 0; index < 8; index++) header[8 + index] = (unsigned char)(length >> (8 * index));
+        
+        error = nil;
+        XCTAssertNil([iCloudCompression decompressData:mislabelled error:&error]);
+        XCTAssertEqual(error.code, 520);
+    }
+    
+    // A document refuses to load the corrupt payload rather than showing garbage
+    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:[[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:@"Corrupt.txt"]];
+    error = nil;
+    XCTAssertFalse([document loadFromContents:corrupt ofType:document.fileType error:&error]);
+    XCTAssertNotNil(error);
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Package Document ---------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Package Document
+
+- (void)testPackageDocumentMarksChunksDirtyAsTheyAreWritten {
+    NSURL *fileURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[[NSUUID UUID] UUIDString] stringByAppendingPathExtension:@"package"]];
+    iCloudPackageDocument *document = [[iCloudPackageDocument alloc] initWithFileURL:fileURL];
+    document.chunkLength = 4;
+    document.contents = [@"aaaabbbbccccdddd" dataUsingEncoding:NSUTF8StringEncoding];
+    
+    // A new package writes every chunk, after which nothing is dirty
+    XCTAssertEqualObjects([document dirtyChunkIndexes], [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, 4)]);
+    XCTAssertNotNil([document contentsForType:document.fileType error:nil]);
+    XCTAssertEqual(document.lastSaveWrittenChunkCount, (NSUInteger)4);
+    XCTAssertEqual([document dirtyChunkIndexes].count, (NSUInteger)0);
+    
+    // Setting new contents marks only the chunks between the first and last difference
+    [document setDocumentData:[@"aaaaBBBBccccdddd" dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqualObjects([document dirtyChunkIndexes], [NSIndexSet indexSetWithIndex:1]);
+    [document contentsForType:document.fileType error:nil];
+    XCTAssertEqual(document.lastSaveWrittenChunkCount, (NSUInteger)1);
+    
+    // Replacing a range marks its chunks without comparing the contents, a change of length marks every following chunk
+    [document replaceContentsInRange:NSMakeRange(13, 2) withData:[@"DD" dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqualObjects([document dirtyChunkIndexes], [NSIndexSet indexSetWithIndex:3]);
+    [document contentsForType:document.fileType error:nil];
+    [document replaceContentsInRange:NSMakeRange(5, 0) withData:[@"x" dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqualObjects([document dirtyChunkIndexes], [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(1, 4)]);
+    XCTAssertEqualObjects(document.contents, [@"aaaaBxBBBccccdDDd" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testClosedPackageDocumentsFailRangeReadsWithAClearError {
+    NSURL *packageURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[[NSUUID UUID] UUIDString] stringByAppendingPathExtension:@"package"]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:packageURL withIntermediateDirectories:YES attributes:nil error:nil];
+    iCloudPackageDocument *document = [[iCloudPackageDocument alloc] initWithFileURL:packageURL];
+    
+    NSError *error = nil;
+    XCTAssertNil([document contentsInRange:NSMakeRange(0, 16) error:&error]);
+    XCTAssertEqual(error.code, 415);
+    
+    error = nil;
+    XCTAssertFalse([document enumerateContentsInChunksOfLength:16 usingBlock:^(NSData *chunk, unsigned long long offset, BOOL *stop) {
+        XCTFail(@"A closed package has no chunks to enumerate");
+    } error:&error]);
+    XCTAssertEqual(error.code, 415);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:packageURL error:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Content Hash Cache -------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Content Hash Cache
+
+- (void)testContentHashCacheDropsDeletedAndLeastRecentlyUsedFiles {
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+    iCloudContentHashCache *cache = [[iCloudContentHashCache alloc] initWithCacheURL:[directoryURL URLByAppendingPathComponent:@"ContentHashes.plist"]];
+    cache.maximumEntryCount = 10;
+    
+    NSMutableArray *fileURLs = [NSMutableArray array];
+    for (NSUInteger index = 0; index < 12; index++) {
+        NSURL *fileURL = [directoryURL URLByAppendingPathComponent:[NSString stringWithFormat:@"File %lu.txt", (unsigned long)index]];
+        [[[NSString stringWithFormat:@"Contents %lu", (unsigned long)index] dataUsingEncoding:NSUTF8StringEncoding] writeToURL:fileURL atomically:YES];
+        [fileURLs addObject:fileURL];
+    }
+    
+    // Digests are SHA-256
+    XCTAssertEqual([[cache digestForFileAtURL:fileURLs[0] error:nil] length], (NSUInteger)32);
+    for (NSUInteger index = 1; index < 10; index++) [cache digestForFileAtURL:fileURLs[index] error:nil];
+    XCTAssertEqual(cache.entryCount, (NSUInteger)10);
+    
+    // Growing past the maximum drops the least recently used digests, the first file was just used again
+    [cache digestForFileAtURL:fileURLs[0] error:nil];
+    [cache digestForFileAtURL:fileURLs[10] error:nil];
+    XCTAssertEqual(cache.entryCount, (NSUInteger)9);
+    NSUInteger misses = cache.missCount;
+    [cache digestForFileAtURL:fileURLs[0] error:nil];
+    XCTAssertEqual(cache.missCount, misses);
+    
+    // Digests of deleted files are dropped when the cache is saved
+    [[NSFileManager defaultManager] removeItemAtURL:fileURLs[0] error:nil];
+    XCTAssertTrue([cache synchronize]);
+    XCTAssertEqual(cache.entryCount, (NSUInteger)8);
+    XCTAssertEqual([[iCloudContentHashCache alloc] initWithCacheURL:cache.cacheURL].entryCount, (NSUInteger)8);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Document Pool ------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Document Pool
+
+- (void)testDocumentPoolCountsHitsAndOnlyEvictsIdleDocuments {
+    NSURL *directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+    iCloudDocumentPool *pool = [[iCloudDocumentPool alloc] init];
+    pool.maximumDocumentCount = 2;
+    
+    // The pool only hands out open documents, saving a new document leaves it open
+    NSArray *names = @[@"Pooled-0.txt", @"Pooled-1.txt", @"Pooled-2.txt"];
+    NSMutableArray *documents = [NSMutableArray array];
+    for (NSString *name in names) {
+        iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:[directoryURL URLByAppendingPathComponent:name]];
+        document.contents = [name dataUsingEncoding:NSUTF8StringEncoding];
+        __block BOOL saved = NO;
+        [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForCreating completionHandler:^(BOOL success) {
+            XCTAssertTrue(success);
+            saved = YES;
+        }];
+        [self waitForFlag:&saved];
+        [documents addObject:document];
+    }
+    
+    // Added documents are handed out, so the pool keeps all of them over its limit until they are released
+    for (NSUInteger index = 0; index < names.count; index++) [pool addDocument:documents[index] withName:names[index]];
+    XCTAssertEqual(pool.documentCount, (NSUInteger)3);
+    
+    // A lookup of a pooled document is a hit and hands it out once more, anything else is a miss
+    XCTAssertEqual([pool documentWithName:@"Pooled-0.txt"], documents[0]);
+    XCTAssertNil([pool documentWithName:@"Missing.txt"]);
+    XCTAssertEqual(pool.hitCount, (NSUInteger)1);
+    XCTAssertEqual(pool.missCount, (NSUInteger)1);
+    XCTAssertEqualWithAccuracy(pool.hitRate, 0.5, 0.001);
+    
+    // Every hand-out is released on its own, the least recently used document goes once it is idle
+    [pool releaseDocumentWithName:@"Pooled-0.txt"];
+    XCTAssertEqual(pool.documentCount, (NSUInteger)3);
+    [pool releaseDocumentWithName:@"Pooled-1.txt"];
+    XCTAssertEqual(pool.documentCount, (NSUInteger)2);
+    XCTAssertFalse([pool containsDocumentAtURL:[documents[1] fileURL]]);
+    XCTAssertTrue([pool containsDocumentAtURL:[documents[0] fileURL]]);
+    
+    // A memory warning releases idle documents and keeps the one still handed out
+    [pool releaseDocumentWithName:@"Pooled-2.txt"];
+    [[NSNotificationCenter defaultCenter] postNotificationName:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    XCTAssertEqual(pool.documentCount, (NSUInteger)1);
+    XCTAssertTrue([pool containsDocumentAtURL:[documents[0] fileURL]]);
+    [pool releaseDocumentWithName:@"Pooled-0.txt"];
+    [[NSNotificationCenter defaultCenter] postNotificationName:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    XCTAssertEqual(pool.documentCount, (NSUInteger)0);
+    
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Download Scheduler -------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Download Scheduler
+
+- (void)testDownloadSchedulerStartsByPriorityWithinItsBudgets {
+    NSURL *directoryURL = [NSURL fileURLWithPath:NSTemporaryDirectory()];
+    iCloudTestUbiquityManager *manager = [[iCloudTestUbiquityManager alloc] init];
+    iCloudDownloadScheduler *scheduler = [[iCloudDownloadScheduler alloc] init];
+    scheduler.fileManager = manager;
+    scheduler.maximumConcurrentDownloads = 1;
+    
+    // The first item takes the only slot, everything after it waits in its priority class
+    NSDate *oldDate = [NSDate dateWithTimeIntervalSinceNow:-30 * 24 * 60 * 60];
+    NSURL *blockerURL = [directoryURL URLByAppendingPathComponent:@"Blocker.txt"];
+    [scheduler updateItemAtURL:blockerURL downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@10 modifiedDate:oldDate];
+    [scheduler updateItemAtURL:[directoryURL URLByAppendingPathComponent:@"Background.txt"] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@10 modifiedDate:oldDate];
+    [scheduler updateItemAtURL:[directoryURL URLByAppendingPathComponent:@"Recent.txt"] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@10 modifiedDate:[NSDate date]];
+    [scheduler raisePriorityOfItemAtURL:[directoryURL URLByAppendingPathComponent:@"Requested.txt"] toPriority:iCloudDownloadPriorityRequested];
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)1);
+    XCTAssertEqual(scheduler.queuedCount, (NSUInteger)3);
+    
+    // Each finished download lets the most urgent waiting item through
+    for (NSString *name in @[@"Blocker.txt", @"Requested.txt", @"Recent.txt", @"Background.txt"]) {
+        [scheduler updateItemAtURL:[directoryURL URLByAppendingPathComponent:name] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusCurrent fileSize:@10 modifiedDate:oldDate];
+    }
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)0);
+    XCTAssertEqualObjects([manager startedNames], (@[@"Blocker.txt", @"Requested.txt", @"Recent.txt", @"Background.txt"]));
+    
+    // More slots only help while the downloads also fit the byte budget, a single large download still starts on its own
+    scheduler.maximumConcurrentDownloads = 3;
+    scheduler.maximumBytesInFlight = 100;
+    for (NSString *name in @[@"Large-0.bin", @"Large-1.bin", @"Large-2.bin"]) {
+        [scheduler updateItemAtURL:[directoryURL URLByAppendingPathComponent:name] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@80 modifiedDate:oldDate];
+    }
+    [scheduler updateItemAtURL:[directoryURL URLByAppendingPathComponent:@"Huge.bin"] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@500 modifiedDate:oldDate];
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)1);
+    XCTAssertEqual(scheduler.bytesInFlight, (unsigned long long)80);
+    for (NSString *name in @[@"Large-0.bin", @"Large-1.bin", @"Large-2.bin"]) {
+        [scheduler updateItemAtURL:[directoryURL URLByAppendingPathComponent:name] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusCurrent fileSize:@80 modifiedDate:oldDate];
+    }
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)1);
+    XCTAssertEqual(scheduler.bytesInFlight, (unsigned long long)500);
+    XCTAssertEqualObjects([manager startedNames].lastObject, @"Huge.bin");
+}
+
+- (void)testDownloadSchedulerRetriesFailedAndTimedOutDownloadsAfterABackoff {
+    NSURL *directoryURL = [NSURL fileURLWithPath:NSTemporaryDirectory()];
+    iCloudTestUbiquityManager *manager = [[iCloudTestUbiquityManager alloc] init];
+    iCloudDownloadScheduler *scheduler = [[iCloudDownloadScheduler alloc] init];
+    scheduler.fileManager = manager;
+    scheduler.maximumConcurrentDownloads = 1;
+    scheduler.retryInterval = 0.3;
+    
+    // A reported error gives the slot back right away, the item waits out the backoff before it is started again
+    NSURL *failingURL = [directoryURL URLByAppendingPathComponent:@"Failing.txt"];
+    [scheduler updateItemAtURL:failingURL downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@10 modifiedDate:nil];
+    [scheduler updateItemAtURL:failingURL downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded downloadingError:[NSError errorWithDomain:NSCocoaErrorDomain code:NSUbiquitousFileUnavailableError userInfo:nil] fileSize:@10 modifiedDate:nil];
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)0);
+    XCTAssertEqual(scheduler.queuedCount, (NSUInteger)0);
+    XCTAssertEqual(scheduler.bytesInFlight, (unsigned long long)0);
+    XCTAssertEqual([manager startedNames].count, (NSUInteger)1);
+    
+    NSDate *failedAt = [NSDate date];
+    while ([manager startedNames].count < 2) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertGreaterThanOrEqual([[NSDate date] timeIntervalSinceDate:failedAt], 0.25);
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)1);
+    [scheduler updateItemAtURL:failingURL downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusCurrent fileSize:@10 modifiedDate:nil];
+    
+    // A download which is never reported as finished times out, the delay doubles with every attempt
+    scheduler.downloadTimeout = 0.1;
+    scheduler.retryInterval = 0.2;
+    NSURL *stalledURL = [directoryURL URLByAppendingPathComponent:@"Stalled.txt"];
+    NSDate *startedAt = [NSDate date];
+    [scheduler updateItemAtURL:stalledURL downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded fileSize:@10 modifiedDate:nil];
+    while ([manager startedNames].count < 5) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    // Three starts take at least two timeouts plus delays of 0.2 and 0.4 seconds
+    XCTAssertGreaterThanOrEqual([[NSDate date] timeIntervalSinceDate:startedAt], 0.75);
+    XCTAssertEqualObjects([[manager startedNames] subarrayWithRange:NSMakeRange(2, 3)], (@[@"Stalled.txt", @"Stalled.txt", @"Stalled.txt"]));
+    [scheduler removeItemAtURL:stalledURL];
+    XCTAssertEqual(scheduler.downloadingCount, (NSUInteger)0);
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Eviction Manager ---------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Eviction Manager
+
+- (void)testEvictionManagerKeepsPinnedAndInUseItemsWithinItsBudget {
+    NSURL *directoryURL = [NSURL fileURLWithPath:NSTemporaryDirectory()];
+    iCloudTestUbiquityManager *manager = [[iCloudTestUbiquityManager alloc] init];
+    iCloudEvictionManager *evictionManager = [[iCloudEvictionManager alloc] init];
+    evictionManager.fileManager = manager;
+    
+    // Five downloaded items of 100 bytes, least recently used first
+    NSArray *names = @[@"Old.txt", @"Pinned.txt", @"InUse.txt", @"Recent.txt", @"Newest.txt"];
+    for (NSUInteger index = 0; index < names.count; index++) {
+        NSDate *modifiedDate = [NSDate dateWithTimeIntervalSinceNow:-(NSTimeInterval)(names.count - index) * 24 * 60 * 60];
+        [evictionManager updateItemAtURL:[directoryURL URLByAppendingPathComponent:names[index]] downloadingStatus:NSMetadataUbiquitousItemDownloadingStatusCurrent fileSize:@100 modifiedDate:modifiedDate];
+    }
+    
+    // Without a budget nothing is evicted
+    [evictionManager enforceBudget];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(evictionManager.localBytes, (unsigned long long)500);
+    XCTAssertEqual([manager evictedNames].count, (NSUInteger)0);
+    
+    // Pinned items and items the in-use handler vetoes are skipped, the next least recently used items go instead
+    [evictionManager pinItemAtURL:[directoryURL URLByAppendingPathComponent:@"Pinned.txt"]];
+    evictionManager.inUseHandler = ^BOOL(NSURL *fileURL) {
+        return [[fileURL lastPathComponent] isEqualToString:@"InUse.txt"];
+    };
+    evictionManager.localByteBudget = 300;
+    while ([manager evictedNames].count < 2) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqualObjects([manager evictedNames], (@[@"Old.txt", @"Recent.txt"]));
+    XCTAssertEqual(evictionManager.localBytes, (unsigned long long)300);
+    XCTAssertEqual(evictionManager.evictionCount, (NSUInteger)2);
+    XCTAssertEqual(evictionManager.evictedBytes, (unsigned long long)200);
+    
+    // Once they are released they are evicted in their turn like any other item
+    evictionManager.inUseHandler = nil;
+    [evictionManager unpinItemAtURL:[directoryURL URLByAppendingPathComponent:@"Pinned.txt"]];
+    XCTAssertFalse([evictionManager isItemPinnedAtURL:[directoryURL URLByAppendingPathComponent:@"Pinned.txt"]]);
+    evictionManager.localByteBudget = 100;
+    while ([manager evictedNames].count < 4) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqualObjects([manager evictedNames], (@[@"Old.txt", @"Recent.txt", @"Pinned.txt", @"InUse.txt"]));
+    XCTAssertEqual(evictionManager.localBytes, (unsigned long long)100);
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Telemetry ----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Telemetry
+
+/// A span start which makes endSpan:forOperation: record at least the given duration
+- (uint64_t)spanStartMicrosecondsAgo:(uint64_t)microseconds {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return mach_absolute_time() - microseconds * 1000 * timebase.denom / timebase.numer;
+}
+
+- (void)testTelemetryCountsSpansIntoPowerOfTwoBuckets {
+    iCloudTelemetry *telemetry = [[iCloudTelemetry alloc] init];
+    
+    // Every operation is listed, with one bucket per power of two microseconds
+    NSDictionary *snapshot = [telemetry snapshot];
+    XCTAssertEqualObjects([NSSet setWithArray:[snapshot allKeys]], ([NSSet setWithObjects:@"save", @"open", @"updatePass", @"downloadStart", @"conflict", @"upload", @"fileOperation", @"firstFileList", @"downloadRetry", @"batch", nil]));
+    XCTAssertEqual([snapshot[@"save"][@"histogram"] count], (NSUInteger)40);
+    XCTAssertEqualObjects(snapshot[@"save"][@"count"], @0);
+    
+    // Counters are counted without a duration
+    [telemetry incrementCounterForOperation:iCloudTelemetryOperationDownloadStart];
+    [telemetry incrementCounterForOperation:iCloudTelemetryOperationDownloadStart];
+    snapshot = [telemetry snapshot];
+    XCTAssertEqualObjects(snapshot[@"downloadStart"][@"count"], @2);
+    XCTAssertEqualObjects(snapshot[@"downloadStart"][@"meanDuration"], @0);
+    XCTAssertEqualObjects([snapshot[@"downloadStart"][@"histogram"] valueForKeyPath:@"@sum.self"], @0);
+    
+    // 3 ms is below 2^12 microseconds and 100 ms below 2^17, each span lands in the bucket of its highest bit
+    [telemetry endSpan:[self spanStartMicrosecondsAgo:3000] forOperation:iCloudTelemetryOperationSave];
+    [telemetry endSpan:[self spanStartMicrosecondsAgo:3000] forOperation:iCloudTelemetryOperationSave];
+    [telemetry endSpan:[self spanStartMicrosecondsAgo:100000] forOperation:iCloudTelemetryOperationSave];
+    NSDictionary *save = [telemetry snapshot][@"save"];
+    XCTAssertEqualObjects(save[@"count"], @3);
+    XCTAssertEqualObjects(save[@"histogram"][12], @2);
+    XCTAssertEqualObjects(save[@"histogram"][17], @1);
+    XCTAssertEqualObjects([save[@"histogram"] valueForKeyPath:@"@sum.self"], @3);
+    XCTAssertEqualWithAccuracy([save[@"p50"] doubleValue], 4096 / 1000000.0, 0.000001);
+    XCTAssertEqualWithAccuracy([save[@"p99"] doubleValue], 131072 / 1000000.0, 0.000001);
+    XCTAssertGreaterThanOrEqual([save[@"maxDuration"] doubleValue], 0.1);
+    XCTAssertLessThan([save[@"maxDuration"] doubleValue], 0.131072);
+    
+    // Nothing is recorded while disabled, and reset clears every operation
+    telemetry.enabled = NO;
+    XCTAssertEqual([telemetry beginSpan], (uint64_t)0);
+    [telemetry incrementCounterForOperation:iCloudTelemetryOperationSave];
+    XCTAssertEqualObjects([telemetry snapshot][@"save"][@"count"], @3);
+    telemetry.enabled = YES;
+    [telemetry reset];
+    snapshot = [telemetry snapshot];
+    for (NSString *operation in snapshot) {
+        XCTAssertEqualObjects(snapshot[operation][@"count"], @0);
+        XCTAssertEqualObjects([snapshot[operation][@"histogram"] valueForKeyPath:@"@sum.self"], @0);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  File Changes -------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - File Changes
+
+- (void)iCloudFilesDidChangeWithInsertedFiles:(NSArray *)insertedFiles updatedFiles:(NSArray *)updatedFiles deletedFileNames:(NSArray *)deletedFileNames {
+    for (NSDictionary *entry in insertedFiles) [self.listedFileNames addObject:entry[iCloudMetadataItemDocumentPathKey]];
+    for (NSString *name in deletedFileNames) [self.listedFileNames removeObject:name];
+    for (NSDictionary *entry in updatedFiles) [self.updatedFileNames addObject:entry[iCloudMetadataItemDocumentPathKey]];
+    [self.deletedFileNames addObjectsFromArray:deletedFileNames];
+}
+
+- (void)testFileChangesAreDeliveredAsInsertedUpdatedAndDeletedDocuments {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    [[@"a" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"A.txt"] atomically:YES];
+    [[@"b" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"B.txt"] atomically:YES];
+    
+    iCloud *cloud = container.cloud;
+    cloud.delegate = self;
+    cloud.updateCoalescingInterval = 0;
+    self.listedFileNames = [NSMutableSet set];
+    self.updatedFileNames = [NSMutableSet set];
+    self.deletedFileNames = [NSMutableSet set];
+    [container setUpDocumentSync];
+    
+    // The first pass inserts every document
+    while (!cloud.metadataSnapshot.complete || self.listedFileNames.count < 2) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertEqualObjects(self.listedFileNames, ([NSSet setWithObjects:@"A.txt", @"B.txt", nil]));
+    XCTAssertEqual(self.updatedFileNames.count, (NSUInteger)0);
+    XCTAssertEqual(self.deletedFileNames.count, (NSUInteger)0);
+    
+    // Later passes only report the differences, each document in the list which matches its change
+    [[@"c" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"C.txt"] atomically:YES];
+    [[@"a, changed" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"A.txt"] atomically:YES];
+    [[NSFileManager defaultManager] removeItemAtURL:[container.documentsURL URLByAppendingPathComponent:@"B.txt"] error:nil];
+    [container.backend refreshMetadata];
+    while (![self.listedFileNames containsObject:@"C.txt"] || ![self.updatedFileNames containsObject:@"A.txt"] || ![self.deletedFileNames containsObject:@"B.txt"]) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    XCTAssertEqualObjects(self.listedFileNames, ([NSSet setWithObjects:@"A.txt", @"C.txt", nil]));
+    XCTAssertEqualObjects(self.updatedFileNames, [NSSet setWithObject:@"A.txt"]);
+    XCTAssertEqualObjects(self.deletedFileNames, [NSSet setWithObject:@"B.txt"]);
+    XCTAssertEqualObjects([cloud.metadataSnapshot entryForDocumentPath:@"A.txt"][NSMetadataItemFSSizeKey], @10);
+    XCTAssertNil([cloud.metadataSnapshot entryForDocumentPath:@"B.txt"]);
+    
+    [container tearDown];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Query Filter -------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Query Filter
+
+- (void)testQueryFilterOnlyNarrowsTheDelegateFileList {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    [[@"notes" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"Notes.txt"] atomically:YES];
+    [[@"photo" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"Photo.jpg"] atomically:YES];
+    
+    iCloud *cloud = container.cloud;
+    cloud.delegate = self;
+    cloud.queryFilter = [iCloudQueryFilter filterWithFileExtensions:@[@"txt"]];
+    self.listedFileNames = [NSMutableSet set];
+    [container setUpDocumentSync];
+    
+    while (!cloud.metadataSnapshot.complete || self.listedFileNames.count == 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    // Only the delegate's file list is filtered, the index and existence checks still see every document
+    XCTAssertEqualObjects(self.listedFileNames, [NSSet setWithObject:@"Notes.txt"]);
+    XCTAssertEqual(cloud.metadataSnapshot.count, (NSUInteger)2);
+    XCTAssertTrue([cloud doesFileExistInCloud:@"Photo.jpg"]);
+    
+    // Widening the filter reports the documents which enter the file list without gathering again
+    cloud.queryFilter = nil;
+    while (![self.listedFileNames containsObject:@"Photo.jpg"]) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertEqual(self.listedFileNames.count, (NSUInteger)2);
+    
+    // The name pattern is compiled once and compiled again when it changes
+    iCloudQueryFilter *filter = [[iCloudQueryFilter alloc] init];
+    NSDictionary *entry = [cloud.metadataSnapshot entryForDocumentPath:@"Notes.txt"];
+    filter.nameGlob = @"n*.TXT";
+    XCTAssertTrue([filter evaluateEntry:entry]);
+    XCTAssertTrue([filter evaluateEntry:entry]);
+    filter.nameGlob = @"P*";
+    XCTAssertFalse([filter evaluateEntry:entry]);
+    
+    [container tearDown];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Folder Query -------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Folder Query
+
+- (void)testFolderQueryAppliesOnlyTheItemsAnUpdateLists {
+    NSURL *folderURL = [NSURL fileURLWithPath:@"/private/var/mobile/Library/Mobile Documents/iCloud~Test/Documents/Folder"];
+    iCloudFolderQuery *folderQuery = [[iCloudFolderQuery alloc] initWithFolderURL:folderURL folderPath:@"Folder" includingSubfolders:NO];
+    NSMetadataQuery *query = [[NSMetadataQuery alloc] init];
+    
+    NSMutableArray *items = [NSMutableArray array];
+    for (NSString *path in @[@"/var/mobile/Library/Mobile Documents/iCloud~Test/Documents/Folder/B.txt", @"/private/var/mobile/Library/Mobile Documents/iCloud~Test/Documents/Folder/A.txt", @"/private/var/mobile/Library/Mobile Documents/iCloud~Test/Documents/Folder/Sub/C.txt"]) {
+        iCloudTestMetadataItem *item = [[iCloudTestMetadataItem alloc] init];
+        item.attributes = @{NSMetadataItemURLKey: [NSURL fileURLWithPath:path], NSMetadataItemFSNameKey: [path lastPathComponent], NSMetadataItemFSSizeKey: @1};
+        [items addObject:item];
+    }
+    
+    // Added items are inserted in document path order, items in subfolders are left out
+    [folderQuery queryDidUpdate:[NSNotification notificationWithName:NSMetadataQueryDidUpdateNotification object:query userInfo:@{NSMetadataQueryUpdateAddedItemsKey: items}]];
+    XCTAssertEqualObjects([folderQuery.results valueForKey:iCloudMetadataItemDocumentPathKey], (@[@"Folder/A.txt", @"Folder/B.txt"]));
+    
+    // Changed items replace their entry and leave the others untouched
+    NSDictionary *untouchedEntry = folderQuery.results[1];
+    iCloudTestMetadataItem *changedItem = items[1];
+    changedItem.attributes = @{NSMetadataItemURLKey: changedItem.attributes[NSMetadataItemURLKey], NSMetadataItemFSNameKey: @"A.txt", NSMetadataItemFSSizeKey: @2};
+    [folderQuery queryDidUpdate:[NSNotification notificationWithName:NSMetadataQueryDidUpdateNotification object:query userInfo:@{NSMetadataQueryUpdateChangedItemsKey: @[changedItem]}]];
+    XCTAssertEqualObjects(folderQuery.results[0][NSMetadataItemFSSizeKey], @2);
+    XCTAssertTrue(folderQuery.results[1] == untouchedEntry);
+    
+    // Removed items are found by the path they were listed under
+    changedItem.attributes = @{};
+    [folderQuery queryDidUpdate:[NSNotification notificationWithName:NSMetadataQueryDidUpdateNotification object:query userInfo:@{NSMetadataQueryUpdateRemovedItemsKey: @[changedItem]}]];
+    XCTAssertEqualObjects([folderQuery.results valueForKey:iCloudMetadataItemDocumentPathKey], (@[@"Folder/B.txt"]));
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Metadata Snapshot --------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Metadata Snapshot
+
+- (void)testMetadataSnapshotIsPublishedOnTheFirstReadAfterAChange {
+    iCloudTestContainer *container = [[iCloudTestContainer alloc] init];
+    [[@"notes" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"Notes.txt"] atomically:YES];
+    
+    iCloud *cloud = container.cloud;
+    [container setUpDocumentSync];
+    
+    while (!cloud.metadataSnapshot.complete) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    // Reading again without a change hands back the same snapshot instead of copying the index
+    iCloudMetadataSnapshot *snapshot = cloud.metadataSnapshot;
+    XCTAssertEqual(cloud.metadataSnapshot, snapshot);
+    XCTAssertEqual(cloud.metadataSnapshot.generation, snapshot.generation);
+    
+    // Point lookups read the index itself and never publish a snapshot
+    XCTAssertTrue([cloud doesFileExistInCloud:@"Notes.txt"]);
+    XCTAssertEqual(cloud.metadataSnapshot, snapshot);
+    
+    // A change is picked up by the next read, which builds one new snapshot
+    [[@"photo" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[container.documentsURL URLByAppendingPathComponent:@"Photo.jpg"] atomically:YES];
+    [container.backend refreshMetadata];
+    while ([cloud.metadataSnapshot entryForDocumentPath:@"Photo.jpg"] == nil) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    
+    iCloudMetadataSnapshot *changedSnapshot = cloud.metadataSnapshot;
+    XCTAssertNotEqual(changedSnapshot, snapshot);
+    XCTAssertGreaterThan(changedSnapshot.generation, snapshot.generation);
+    XCTAssertEqual(changedSnapshot.count, (NSUInteger)2);
+    XCTAssertEqual(snapshot.count, (NSUInteger)1);
+    XCTAssertEqual(cloud.metadataSnapshot, changedSnapshot);
+    
+    [container tearDown];
+}
+
+- (void)testSavedMetadataSnapshotIsKeptPerAccount {
+    NSURL *containerURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSURL *documentsURL = [containerURL URLByAppendingPathComponent:@"Documents"];
+    [[NSFileManager defaultManager] createDirectoryAtURL:documentsURL withIntermediateDirectories:YES attributes:nil error:nil];
+    [[@"notes" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:[documentsURL URLByAppendingPathComponent:@"Notes.txt"] atomically:YES];
+    
+    NSString *containerID = [@"iCloud.test." stringByAppendingString:[[NSUUID UUID] UUIDString]];
+    NSURL *snapshotsURL = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject URLByAppendingPathComponent:@"iCloudDocumentSync"];
+    NSArray *(^savedSnapshots)(void) = ^NSArray *{
+        NSPredicate *predicate = [NSPredicate predicateWithFormat:@"lastPathComponent BEGINSWITH %@", [NSString stringWithFormat:@"MetadataSnapshot_%@_", containerID]];
+        return [[[NSFileManager defaultManager] contentsOfDirectoryAtURL:snapshotsURL includingPropertiesForKeys:nil options:0 error:nil] filteredArrayUsingPredicate:predicate];
+    };
+    
+    // The first account saves a snapshot of its own
+    iCloudLocalBackend *backend = [[iCloudLocalBackend alloc] initWithContainerURL:containerURL];
+    backend.identityToken = @"first-account";
+    iCloud *cloud = [[iCloud alloc] init];
+    cloud.fileManager = backend;
+    [cloud setupiCloudDocumentSyncWithUbiquityContainer:containerID];
+    while (savedSnapshots().count == 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    NSURL *firstSnapshotURL = [savedSnapshots() firstObject];
+    [backend stopMetadataUpdates];
+    
+    // Another account never sees it, and the snapshot of the first one is discarded
+    backend = [[iCloudLocalBackend alloc] initWithContainerURL:containerURL];
+    backend.identityToken = @"second-account";
+    cloud = [[iCloud alloc] init];
+    cloud.fileManager = backend;
+    [cloud setupiCloudDocumentSyncWithUbiquityContainer:containerID];
+    while (cloud.timeToFirstFileList == 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertFalse(cloud.metadataSnapshot.restored);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[firstSnapshotURL path]]);
+    
+    // The second account gets a file with a different name
+    while (savedSnapshots().count == 0) [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    XCTAssertNotEqualObjects([[savedSnapshots() firstObject] lastPathComponent], [firstSnapshotURL lastPathComponent]);
+    
+    [backend stopMetadataUpdates];
+    for (NSURL *savedURL in savedSnapshots()) [[NSFileManager defaultManager] removeItemAtURL:savedURL error:nil];
+    [[NSFileManager defaultManager] removeItemAtURL:containerURL error:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  File Cursor --------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - File Cursor
+
+- (void)testSortedFileCursorPagesFromOneListing {
+    NSURL *folderURL = [[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtURL:folderURL withIntermediateDirectories:YES attributes:nil error:nil];
+    for (NSUInteger index = 0; index < 250; index++) {
+        [[NSMutableData dataWithLength:index % 50] writeToURL:[folderURL URLByAppendingPathComponent:[NSString stringWithFormat:@"File-%03lu.dat", (unsigned long)index]] atomically:NO];
+    }
+    
+    iCloudFileCursor *cursor = [[iCloudFileCursor alloc] initWithDirectoryURL:folderURL fileManager:[NSFileManager defaultManager]];
+    cursor.pageSize = 40;
+    cursor.filterPredicate = [NSPredicate predicateWithFormat:@"fileSize > 0"];
+    cursor.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"fileSize" ascending:NO]];
+    
+    NSMutableArray *files = [NSMutableArray array];
+    NSArray *page = [cursor nextPage:nil];
+    
+    // Files created after the first page are not part of the listing being paged
+    [[NSMutableData dataWithLength:100] writeToURL:[folderURL URLByAppendingPathComponent:@"Late.dat"] atomically:NO];
+    
+    while (page.count > 0) {
+        XCTAssertLessThanOrEqual(page.count, (NSUInteger)40);
+        [files addObjectsFromArray:page];
+        page = [cursor nextPage:nil];
+    }
+    XCTAssertTrue(cursor.finished);
+    
+    // Largest first, ties by name, and the filtered files never show up
+    XCTAssertEqual(files.count, (NSUInteger)245);
+    XCTAssertEqualObjects([files.firstObject name], @"File-049.dat");
+    XCTAssertEqualObjects([files[1] name], @"File-099.dat");
+    XCTAssertEqualObjects([files.lastObject name], @"File-201.dat");
+    for (NSUInteger index = 1; index < files.count; index++) {
+        XCTAssertGreaterThanOrEqual([files[index - 1] fileSize], [files[index] fileSize]);
+    }
+    
+    // Resetting lists the directory again
+    [cursor reset];
+    XCTAssertEqualObjects([[cursor nextPage:nil].firstObject name], @"Late.dat");
+    
+    // Sort keys may be key paths into the file's attributes
+    cursor.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"name.length" ascending:NO], [NSSortDescriptor sortDescriptorWithKey:@"fileSize" ascending:YES]];
+    cursor.pageSize = 1;
+    XCTAssertEqualObjects([[cursor nextPage:nil].firstObject name], @"File-001.dat");
+    
+    [[NSFileManager defaultManager] removeItemAtURL:folderURL error:nil];
+}
+
 @end
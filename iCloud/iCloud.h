@@ -19,6 +19,57 @@
 // Import iCloudDocument
 #import "iCloudDocument.h"
 
+// Import iCloudTelemetry
+#import "iCloudTelemetry.h"
+
+// Import iCloudStorageBackend
+#import "iCloudStorageBackend.h"
+
+// Import iCloudLocalBackend
+#import "iCloudLocalBackend.h"
+
+// Import iCloudPackageDocument
+#import "iCloudPackageDocument.h"
+
+// Import iCloudContentHashCache
+#import "iCloudContentHashCache.h"
+
+// Import iCloudDocumentPool
+#import "iCloudDocumentPool.h"
+
+// Import iCloudDownloadScheduler
+#import "iCloudDownloadScheduler.h"
+
+// Import iCloudEvictionManager
+#import "iCloudEvictionManager.h"
+
+// Import iCloudFileCursor
+#import "iCloudFileCursor.h"
+
+// Import iCloudMetadataSnapshot
+#import "iCloudMetadataSnapshot.h"
+
+// Import iCloudFolderIndex
+#import "iCloudFolderIndex.h"
+
+// Import iCloudFolderQuery
+#import "iCloudFolderQuery.h"
+
+// Import iCloudQueryFilter
+#import "iCloudQueryFilter.h"
+
+// Import iCloudCompression
+#import "iCloudCompression.h"
+
+// Import iCloudOperationJournal
+#import "iCloudOperationJournal.h"
+
+// Import iCloudWriteBehindBuffer
+#import "iCloudWriteBehindBuffer.h"
+
+// Import iCloudConflictResolver
+#import "iCloudConflictResolver.h"
+
 // Ensure that the build is for iOS 6.0 or higher
 #ifndef __IPHONE_6_0
     #error iCloudDocumentSync is built with features only available is iOS SDK 6.0 and later.
@@ -85,9 +136,34 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
 
 /** @name Properties */
 
-/** The current NSMetadataQuery object */
+/** The current NSMetadataQuery object
+ 
+ @discussion The query runs on a dedicated serial operation queue rather than the main run loop, so gathering and update notifications never block the main thread. Only read the query's results from its operationQueue. Use metadataSnapshot to read the results from any other thread. */
 @property (strong) NSMetadataQuery *query;
 
+/** The filter which decides which iCloud documents are tracked
+ 
+ @discussion The metadata query and the index always cover every document, so existence and attribute checks, the download scheduler and the conflict resolver are unaffected by the filter. It is applied when changes are delivered: documents which do not match are left out of iCloudFilesDidChange:withNewFileNames:, iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames: and folder queries, and documents which start or stop matching are reported as inserted or deleted. Assigning a new filter does not gather again, the delegate is told about the documents which entered or left the file list. metadataSnapshot is not filtered, use the filter's evaluateEntry: method to narrow it. When the filter sets no file extensions, the extensions returned by the delegate's iCloudQueryLimitedToFileExtensions method are used. The filter is copied when assigned. The default value is nil, which lists every document. */
+@property (copy, nonatomic) iCloudQueryFilter *queryFilter;
+
+/** The most recently published view of the iCloud documents directory
+ 
+ @discussion The snapshot is immutable, so it can be kept and read from any thread without locking and is always internally consistent. It is built from the index the first time this property is read after an update pass changed something, and the same object is returned until the next change, so update passes never pay for a copy of the whole index nobody reads. The snapshot is nil until the first update pass, or until the snapshot saved by the previous launch has been restored (see persistsMetadataSnapshot). The delegate is also handed each snapshot on the main thread through iCloudDidPublishMetadataSnapshot:. */
+@property (strong, readonly) iCloudMetadataSnapshot *metadataSnapshot;
+
+/** Save the metadata snapshot between launches, so the last known file list is available immediately on the next setup. The default value is YES.
+ 
+ @discussion After every full update pass the snapshot is written to metadataSnapshotURL in a compact binary format, and nothing is saved or restored while no iCloud account is signed in. On setup the saved snapshot is restored off the main thread and handed to the delegate through iCloudDidPublishMetadataSnapshot: and iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:, before the ubiquity container is resolved or the query has gathered anything. The first live pass then reconciles against it and the delegate only receives the differences. The restored snapshot is not complete, so existence and attribute checks keep reading the file system until the first live pass. Conflicted documents in the restored snapshot are listed in conflictedDocumentNames, but only handed to the conflict resolver once the live pass reports them as still conflicted. Set this property before calling setupiCloudDocumentSyncWithUbiquityContainer:. */
+@property BOOL persistsMetadataSnapshot;
+
+/** The file the metadata snapshot is saved to. The default value is nil.
+ 
+ @discussion When nil, each container and iCloud account gets its own file in the iCloudDocumentSync folder of the application's Caches directory, named after the container identifier and a hash of the ubiquity identity token. Snapshots saved for the same container under another account are discarded on setup, so a launch never shows the documents of a different account. A file set here is used for every container and account, so keep one per container and discard it when the account changes. Set it before calling setupiCloudDocumentSyncWithUbiquityContainer:. */
+@property (strong) NSURL *metadataSnapshotURL;
+
+/** The time, in seconds, from setupiCloudDocumentSyncWithUbiquityContainer: to the first file list, whether restored from the saved snapshot or gathered by the first full pass. 0 until the first list is available. The same duration is recorded by the telemetry object. */
+@property (readonly) NSTimeInterval timeToFirstFileList;
+
 /** A list of iCloud files from the current query */
 @property (strong) NSMutableArray *fileList;
 
@@ -97,6 +173,89 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
 /** Enable verbose logging for detailed feedback in the log. Turning this off only prints crucial log notes such as errors. */
 @property BOOL verboseLogging;
 
+/** Deliver incremental file changes instead of re-enumerating the whole query on every update.
+ 
+ @discussion When set to YES, NSMetadataQuery update notifications are processed using only the added, changed, and removed items they carry. The changes are applied to an internal index keyed by file name and delivered through the iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames: delegate method, so the cost of each update scales with the size of the change rather than with the number of documents in the container. The iCloudFilesDidChange:withNewFileNames: delegate method is then only called for full passes (when the initial gathering finishes or when updateFiles is called). This property is OFF by default. */
+@property BOOL incrementalUpdates;
+
+/** The quiet window, in seconds, used to coalesce bursts of NSMetadataQuery notifications, or of metadata reports from the storage backend, into a single update pass.
+ 
+ @discussion Update notifications which arrive within this interval of each other are merged into one pass, and any pass which is superseded before it starts is dropped. Set this to 0 to run a pass as soon as possible. The default value is 0.25 seconds. */
+@property NSTimeInterval updateCoalescingInterval;
+
+/** The maximum time, in seconds, an update notification may wait for the quiet window before a pass is forced. The default value is 1 second. */
+@property NSTimeInterval maximumUpdateLatency;
+
+/** The number of update requests (NSMetadataQuery notifications or storage backend reports) which were merged into another update pass instead of running their own. Use this with updatePassCount to tune updateCoalescingInterval. */
+@property (readonly) NSUInteger coalescedUpdateNotificationCount;
+
+/** The number of update passes performed in response to NSMetadataQuery notifications or storage backend reports */
+@property (readonly) NSUInteger updatePassCount;
+
+/** The maximum number of document operations which batch methods run at the same time. The default value is 4. */
+@property NSUInteger maximumConcurrentDocumentOperations;
+
+/** The maximum number of bytes read or copied at the same time while uploading local offline documents. The default value is 32 MB. */
+@property unsigned long long maximumUploadBytesInFlight;
+
+/** Lowercase file extensions (without the leading period) of documents which should be stored as chunked packages. Documents with one of these extensions, and any document which is already a package on disk, are opened as iCloudPackageDocument objects so that saves only write the chunks which changed. The default value is an empty set. */
+@property (copy) NSSet *packageDocumentExtensions;
+
+/** The codec used to compress the contents of documents saved through this object. The default value is iCloudCompressionCodecNone.
+ 
+ @discussion Documents created by the iCloud class use this codec when they are saved (see the compressionCodec property of iCloudDocument). Compressed and uncompressed documents are both read transparently, so the codec can be changed at any time; existing documents are converted the next time they are saved. Packages are never compressed. */
+@property iCloudCompressionCodec documentCompressionCodec;
+
+/** The persistent content digest cache used to decide whether a local file and an iCloud file are the same.
+ 
+ @discussion Equality checks during uploads and evictions compare cached digests instead of reading both files. A file is only hashed again when its inode, size or modification time changed, so repeated sync passes over unchanged files do not read them at all. Use the hitCount and missCount properties of the cache to monitor its effectiveness. */
+@property (strong, readonly) iCloudContentHashCache *contentHashCache;
+
+/** The pool of open documents reused by retrieveCloudDocumentWithName:completion: and retrieveCloudDocumentObjectWithName:.
+ 
+ @discussion Retrieving a document which is still in the pool returns the open document immediately, without reading or coordinating the file again. Use the pool's limits to bound how many documents (and bytes) stay open, and its hitRate and averageOpenLatency properties to monitor its effectiveness. The pool only closes documents which have been released with releaseDocumentWithName: and have no unsaved changes. */
+@property (strong, readonly) iCloudDocumentPool *documentPool;
+
+/** The buffer which coalesces the changes recorded through saveChangesToDocumentWithName:withContent:completion:.
+ 
+ @discussion The buffer is disabled by default. Enable it to keep only the latest content of each document in memory while it is being edited, and write it once the document goes idle, once it has been buffered for too long, on an explicit flush, or when the application enters the background. Every caller's handler is called when that single write lands. */
+@property (strong, readonly) iCloudWriteBehindBuffer *writeBehindBuffer;
+
+/** The scheduler which downloads iCloud documents that are not available locally.
+ 
+ @discussion Documents are downloaded in priority order (explicitly requested, recently modified, then background prefetch) within the scheduler's concurrency and byte budgets. Retrieving a document which has not been downloaded yet moves it to the front of the queue. Adjust the scheduler's budgets to control how aggressively the container is downloaded on first launch. */
+@property (strong, readonly) iCloudDownloadScheduler *downloadScheduler;
+
+/** The manager which keeps the local footprint of downloaded iCloud documents within a byte budget.
+ 
+ @discussion Eviction is disabled by default. Once the manager's localByteBudget is set and the downloaded documents take more space than it, the least recently opened or read documents are evicted from the device (they stay in iCloud). Documents held by the documentPool, documents which are open, saving or being read, and documents pinned with the manager are never evicted. Use the manager's localBytes, evictionCount and evictedBytes properties to monitor it. Unlike evictCloudDocumentWithName:completion:, eviction does not move the document out of iCloud. */
+@property (strong, readonly) iCloudEvictionManager *evictionManager;
+
+/** The storage backend used for all container access. The default value is [NSFileManager defaultManager].
+ 
+ @discussion Every file operation and ubiquity request made by the iCloud class goes through this file manager. Assign an iCloudLocalBackend (or another NSFileManager subclass conforming to iCloudStorageBackend) before calling setupiCloudDocumentSyncWithUbiquityContainer: to run against a simulated container, for example in tests and benchmarks. */
+@property (strong, nonatomic) NSFileManager <iCloudStorageBackend> *fileManager;
+
+/** Counters, latency histograms and diagnostic logging for the operations performed by this object.
+ 
+ @discussion Saves, opens, update passes, download starts, conflicts, uploads and file operations are timed or counted here. Call snapshot on it to read the statistics, or set its sink to receive them as they are recorded. Verbose log messages are also written through it, off the calling thread, so enabling verboseLogging no longer slows down update passes. */
+@property (strong, readonly) iCloudTelemetry *telemetry;
+
+/** The journal of document operations made while iCloud was unavailable.
+ 
+ @discussion Uploads, saves, deletes, renames and duplicates requested while iCloud is unavailable are applied to the local copy, appended to this journal and flushed to disk before their completion handler is called with a 503 error. Documents in a ubiquity container which is still cached are changed under file coordination, and replay leaves those changes to iCloud. Every entry records the iCloud account and container it was made for: entries made for another account or container are discarded on replay and reported with a 409 error. The journal survives crashes and relaunches. Once iCloud becomes available again (observed through NSUbiquityIdentityDidChangeNotification, setup and checkCloudAvailability) its coalesced entries are replayed in order and the delegate is told through iCloudDidReplayOfflineOperations:withErrors:. The journal is stored in the application's Application Support directory. */
+@property (strong, readonly) iCloudOperationJournal *operationJournal;
+
+/** The resolver which settles document conflicts in the background.
+ 
+ @discussion The resolver's policy defaults to iCloudConflictPolicyManual, which leaves conflicts to findUnresolvedConflictingVersionsOfFile: and resolveConflictForFile:withSelectedFileVersion:. Set it to latest-wins, keep-both or merge (with a mergeHandler) and every document the metadata query reports as conflicted is resolved in bounded batches. The delegate is told what was resolved, and how, through iCloudDidResolveConflicts:withErrors:. */
+@property (strong, readonly) iCloudConflictResolver *conflictResolver;
+
+/** The names of the documents which currently have unresolved conflicts.
+ 
+ @discussion Maintained incrementally from NSMetadataUbiquitousItemHasUnresolvedConflictsKey as the metadata query reports changes, so reading it never touches the file system. Resolved documents leave the set on the next query update. */
+@property (copy, readonly) NSSet *conflictedDocumentNames;
+
 /** Enable verbose availability logging for repeated feedback about iCloud availability in the log. Turning this off will prevent availability-related messages from being printed in the log. This property does not relate to the verboseLogging property. */
 @property BOOL verboseAvailabilityLogging;
 
@@ -161,10 +320,42 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  
  Documents can be created even if the user is not connected to the internet. The only case in which a document will not be created is when the user has disabled iCloud or if the current application is not setup for iCloud.
  
+ The write begins before this method returns, unless an open copy of the document has to be closed first or a buffered write of it is still in flight, in which case it begins once they are done. Cancelling the returned progress while the write is waiting stops the save, and the completion handler is passed an NSCocoaErrorDomain error with the NSUserCancelledError code. A write which has already begun always runs to completion so that the document is never left half written.
+ 
+ @param documentName The name of the document being written to iCloud. This value must not be nil.
+ @param content The data to write to the document
+ @param handler Code block called when the document is successfully saved. The completion block passes UIDocument and NSData objects containing the saved document and it's contents in the form of NSData. The NSError object contains any error information if an error occurred, otherwise it will be nil.
+ 
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)saveAndCloseDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull));
+
+/** Record changes made to a document in iCloud, for editors which save on nearly every change.
+ 
+ @discussion When the writeBehindBuffer is enabled, the content is buffered instead of written. Further changes to the same document replace the buffered content, and the latest content is written with a single save and close once the document has gone unchanged for the buffer's idleDelay, has been buffered for its maximumStaleness, is flushed, or the application enters the background. Every handler waiting for the document is then called with the result of that write. Retrieving, renaming or duplicating the document writes its buffered changes first, deleting it discards them, and saving it with saveAndCloseDocumentWithName:withContent:completion: writes that content in their place, after any write of the document which is already in flight.
+ 
+ When the writeBehindBuffer is disabled this method behaves exactly like saveAndCloseDocumentWithName:withContent:completion:.
+ 
  @param documentName The name of the document being written to iCloud. This value must not be nil.
  @param content The data to write to the document
- @param handler Code block called when the document is successfully saved. The completion block passes UIDocument and NSData objects containing the saved document and it's contents in the form of NSData. The NSError object contains any error information if an error occurred, otherwise it will be nil. */
-- (void)saveAndCloseDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull));
+ @param handler Code block called when the changes have been written. The completion block passes UIDocument and NSData objects containing the saved document and it's contents in the form of NSData, which may include changes recorded after this call. The NSError object contains any error information if an error occurred, otherwise it will be nil. If the document was deleted before the changes were written, the error is an NSUserCancelledError. */
+- (void)saveChangesToDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull));
+
+/** Create, save, and close many documents in iCloud.
+ 
+ @discussion Each document is saved and closed in the same way as saveAndCloseDocumentWithName:withContent:completion:, but no more than maximumConcurrentDocumentOperations saves are in flight at any time. This keeps throughput predictable and memory bounded when writing thousands of documents, and avoids flooding the main queue.
+ 
+    NSProgress *progress = [[iCloud sharedCloud] saveAndCloseDocumentsWithContents:@{@"One.ext": dataOne, @"Two.ext": dataTwo} completion:^(NSDictionary *errors) {
+        if ([errors count] == 0) {
+            // All documents were saved
+        }
+    }];
+ 
+ Cancelling the returned progress stops any saves which have not started yet. Those documents are reported in the completion handler with an NSUserCancelledError.
+ 
+ @param documents A dictionary of document names (NSString) and the data (NSData) to write to each document. This value must not be nil.
+ @param handler Code block called once, on the main thread, after every save has finished. The errors dictionary maps the name of each document which could not be saved to its NSError, and is empty if all documents were saved.
+ @return An NSProgress object reporting the number of documents saved so far. */
+- (NSProgress *)saveAndCloseDocumentsWithContents:(NSDictionary *)documents completion:(void (^)(NSDictionary *errors))handler __attribute__((nonnull (1)));
 
 /** Upload any local files that weren't created with iCloud
  
@@ -185,11 +376,26 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  @param completion Code block called after all files have been uploaded to iCloud. This block is only called once at the end of the method, regardless of any successes or failures that may have occurred during the upload(s). */
 - (void)uploadLocalOfflineDocumentsWithRepeatingHandler:(void (^)(NSString *documentName, NSError *error))repeatingHandler completion:(void (^)(void))completion __attribute__((nonnull (1)));
 
+/** Upload any local files that weren't created with iCloud, and report a summary when done
+ 
+ @discussion This method performs the same work as uploadLocalOfflineDocumentsWithRepeatingHandler:completion: as a staged pipeline. The local directory is scanned once, then each file moves through a metadata comparison, a content comparison (only when both files have the same modification date and size), and finally a move, replace or delete. Every stage processes up to maximumConcurrentDocumentOperations files at a time, and no more than maximumUploadBytesInFlight bytes are read or copied at once. Files are never loaded into memory in full.
+ 
+ Cancelling the returned progress stops each file at its next stage boundary. Cancelled files are counted in the report but are not passed to the repeating handler.
+ 
+ @param repeatingHandler Code block called on the main thread after each file has been processed. The NSError object contains any error information if an error occurred, otherwise it will be nil.
+ @param completion Code block called once on the main thread when every file has been processed. The report dictionary contains the number of files (NSNumber) for each outcome, under the keys `uploaded`, `replacedInCloud`, `removedLocally`, `conflicts`, `hidden`, `failed` and `cancelled`, and the total time in seconds under `duration`. If iCloud is not available nothing is uploaded, every count is 0 and the report also contains an NSError with the code 503 under `error`.
+ @return An NSProgress object reporting the number of files processed so far. If iCloud is not available the progress is already finished. */
+- (NSProgress *)uploadLocalOfflineDocumentsWithRepeatingHandler:(void (^)(NSString *documentName, NSError *error))repeatingHandler report:(void (^)(NSDictionary *report))completion __attribute__((nonnull (1)));
+
 /** Upload a local file to iCloud
  
+ @discussion Cancelling the returned progress before the file is moved stops the upload, and the completion handler is passed an NSUserCancelledError.
+ 
  @param documentName The name of the local file stored in the application's documents directory. This value must not be nil.
- @param handler Code block called after the file has been uploaded to iCloud */
-- (void)uploadLocalDocumentToCloudWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler __attribute__((nonnull));
+ @param handler Code block called after the file has been uploaded to iCloud. If iCloud is not available the upload is queued in operationJournal and the error has the code 503.
+ 
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)uploadLocalDocumentToCloudWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler __attribute__((nonnull));
 
 
 
@@ -202,9 +408,19 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  @param documentName The name of the iCloud file being uploaded to a public URL. This value must not be nil.
  @param handler Code block called when the document is successfully uploaded. The completion block passes NSURL, NSDate, and NSError objects. The NSURL object is the public URL where the file is available at, could be nil. The NSDate object is the date that the URL expires on, could be nil. The NSError object contains any error information if an error occurred, otherwise it will be nil.
  
- @return The public URL where the file is available */
+ @return Always nil, the public URL is only known once publishing has finished and is passed to the completion handler. Use shareDocumentWithName:cancellableCompletion: to be able to cancel the share. */
 - (NSURL *)shareDocumentWithName:(NSString *)documentName completion:(void (^)(NSURL *sharedURL, NSDate *expirationDate, NSError *error))handler __attribute__((nonnull));
 
+/** Share an iCloud document by uploading it to a public URL, with the option to cancel before publishing starts
+ 
+ @discussion Behaves like shareDocumentWithName:completion:. Cancelling the returned progress before the document is published stops the share, and the completion handler is passed an NSUserCancelledError.
+ 
+ @param documentName The name of the iCloud file being uploaded to a public URL. This value must not be nil.
+ @param handler Code block called when the document is successfully uploaded, with the same parameters as in shareDocumentWithName:completion:.
+ 
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)shareDocumentWithName:(NSString *)documentName cancellableCompletion:(void (^)(NSURL *sharedURL, NSDate *expirationDate, NSError *error))handler __attribute__((nonnull));
+
 
 
 /** @name Deleting iCloud Content */
@@ -213,9 +429,24 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  
  @discussion Permanently delete a document stored in iCloud. This will only affect copies of the specified file stored in iCloud, if there is a copy stored locally it will not be affected.
  
+ Cancelling the returned progress while the delete is still waiting for file coordination abandons it, and the completion handler is passed an NSUserCancelledError.
+ 
  @param documentName The name of the document to delete from iCloud. This value must not be nil.
- @param handler Code block called when a file is successfully deleted from iCloud. The NSError object contains any error information if an error occurred, otherwise it will be nil. */
-- (void)deleteDocumentWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler __attribute__((nonnull (1)));
+ @param handler Code block called when a file is successfully deleted from iCloud. The NSError object contains any error information if an error occurred, otherwise it will be nil. If iCloud is not available the local copy is deleted, the delete is queued in operationJournal and the error has the code 503.
+ 
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)deleteDocumentWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler __attribute__((nonnull (1)));
+
+/** Delete many documents from iCloud at once.
+ 
+ @discussion Every document is checked first, then all of them are deleted inside a single coordinated access (one NSFileCoordinator and one coordinateAccessWithIntents:queue:byAccessor: call for the whole batch). The deletes run in parallel within that window, and the file list is refreshed once when they have finished instead of once per document. Use this method rather than calling deleteDocumentWithName:completion: in a loop when removing a selection of documents.
+ 
+ Cancelling the returned progress while the batch is waiting for file coordination abandons it, and every document which was not deleted is reported with an NSUserCancelledError. If iCloud is not available each delete is queued in operationJournal, as with deleteDocumentWithName:completion:.
+ 
+ @param documentNames The names (NSString) of the documents to delete. This value must not be nil.
+ @param handler Code block called once, on the main thread, after every document has been processed. The errors dictionary maps the name of each document which could not be deleted to its NSError (404 if it does not exist), and is empty if all documents were deleted.
+ @return An NSProgress object reporting the number of documents processed so far. */
+- (NSProgress *)deleteDocumentsWithNames:(NSArray *)documentNames completion:(void (^)(NSDictionary *errors))handler __attribute__((nonnull (1)));
 
 /** Evict a document from iCloud, move it from iCloud to the current application's local documents directory.
  
@@ -240,9 +471,13 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
         }
      }];
  
+ Cancelling the returned progress while the document is being opened or created closes it again once the open finishes, and the completion handler is passed an NSUserCancelledError instead of the document.
+ 
  @param documentName The name of the document in iCloud. This value must not be nil.
- @param handler Code block called when the document is successfully retrieved (opened or downloaded). The completion block passes UIDocument and NSData objects containing the opened document and it's contents in the form of NSData. If there is an error, the NSError object will have an error message (may be nil if there is no error). This value must not be nil. */
-- (void)retrieveCloudDocumentWithName:(NSString *)documentName completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull));
+ @param handler Code block called when the document is successfully retrieved (opened or downloaded). The completion block passes UIDocument and NSData objects containing the opened document and it's contents in the form of NSData. If there is an error, the NSError object will have an error message (may be nil if there is no error). If iCloud is not available the error has the code 503. This value must not be nil.
+ 
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)retrieveCloudDocumentWithName:(NSString *)documentName completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull));
 
 /** Get the relevant iCloudDocument object for the specified file
  
@@ -252,35 +487,83 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  @return An iCloudDocument (UIDocument subclass) object. May return nil if iCloud is unavailable or if an error occurred */
 - (iCloudDocument *)retrieveCloudDocumentObjectWithName:(NSString *)documentName __attribute__((nonnull));
 
+/** Tell the iCloud class that you no longer use a document you retrieved, without closing it
+ 
+ @discussion Documents returned by retrieveCloudDocumentWithName:completion: and retrieveCloudDocumentObjectWithName: stay in the documentPool, and are never closed by it, until they are released, closed or saved with saveAndCloseDocumentWithName:withContent:completion:. Call this method once for every retrieval of a document you keep no reference to, so the pool can close it when it needs room. Releasing a document does not close it, retrieving it again returns the same open document until the pool evicts it.
+ 
+ @param documentName The name of the document in iCloud. This value must not be nil. */
+- (void)releaseDocumentWithName:(NSString *)documentName __attribute__((nonnull));
+
 /** Check if a file exists in iCloud
  
  @param documentName The name of the UIDocument in iCloud. This value must not be nil.
+ @discussion Once the metadata query has gathered its results, indexed documents are answered from an in-memory index without touching the disk. Documents missing from the index are checked on the file system, so files created since the last update pass are still found. Files which exist in iCloud but have not been downloaded yet are reported as existing.
+ 
  @return BOOL value, YES if the file does exist in iCloud, NO if it does not. May return NO if iCloud is unavailable. */
 - (BOOL)doesFileExistInCloud:(NSString *)documentName __attribute__((nonnull));
 
 /** Get the size of a file stored in iCloud
  
  @param documentName The name of the file in iCloud. This value must not be nil.
+ @discussion Once the metadata query has gathered its results, indexed documents are answered from an in-memory index without touching the disk. Documents missing from the index are read from the file system.
+ 
  @return The number of bytes in an unsigned long long. Returns nil if the file does not exist. May return a nil value if iCloud is unavailable. */
 - (NSNumber *)fileSize:(NSString *)documentName __attribute__((nonnull));
 
 /** Get the last modified date of a file stored in iCloud
  
+ @discussion Once the metadata query has gathered its results, indexed documents are answered from an in-memory index without touching the disk. Documents missing from the index are read from the file system.
+ 
  @param documentName The name of the file in iCloud. This value must not be nil.
  @return The date that the file was last modified. Returns nil if the file does not exist. May return a nil value if iCloud is unavailable. */
 - (NSDate *)fileModifiedDate:(NSString *)documentName __attribute__((nonnull));
 
 /** Get the creation date of a file stored in iCloud
  
+ @discussion Once the metadata query has gathered its results, indexed documents are answered from an in-memory index without touching the disk. Documents missing from the index are read from the file system.
+ 
  @param documentName The name of the file in iCloud. This value must not be nil.
  @return The date that the file was created. Returns nil if the file does not exist. May return a nil value if iCloud is unavailable. */
 - (NSDate *)fileCreatedDate:(NSString *)documentName __attribute__((nonnull));
 
 /** Get a list of files stored in iCloud
  
+ @discussion The whole directory is listed at once. For large containers use cloudFileCursorWithPageSize: instead, which returns files in pages together with their attributes.
+ 
  @return NSArray with a list of all the files currently stored in your app's iCloud Documents directory. May return a nil value if iCloud is unavailable. */
 - (NSArray *)listCloudFiles;
 
+/** Get a cursor which lists the files stored in iCloud one page at a time
+ 
+ @discussion Each page contains iCloudFileInfo objects whose size, dates and ubiquity status were read together with the listing, so there is no need to call fileSize: or fileModifiedDate: for every file. Set the cursor's filterPredicate and sortDescriptors before reading the first page to filter and order the files by those attributes.
+ 
+    iCloudFileCursor *cursor = [[iCloud sharedCloud] cloudFileCursorWithPageSize:50];
+    cursor.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"modificationDate" ascending:NO]];
+    NSArray *firstPage = [cursor nextPage:nil];
+ 
+ @param pageSize The maximum number of files in each page. Pass 0 to use the default of 100.
+ @return A cursor over your app's iCloud Documents directory. May return nil if iCloud is unavailable. */
+- (iCloudFileCursor *)cloudFileCursorWithPageSize:(NSUInteger)pageSize;
+
+
+
+/** @name Folders */
+
+/** The folder tree of the iCloud documents directory, kept in line with every metadata update pass.
+ 
+ @discussion Every document method accepts a path relative to the documents directory wherever it takes a document name, for example @"Projects/2026/Notes.txt". Missing folders are created when a document is saved, created, uploaded, renamed or duplicated into them, and empty, "." and ".." path components are ignored so a path never leaves the documents directory. Use the folder index to browse the folders without listing the whole container. */
+@property (strong, readonly) iCloudFolderIndex *folderIndex;
+
+/** Start a live query for the documents in one folder
+ 
+ @discussion Unlike the container-wide query, the folder query's NSMetadataQuery is scoped to the folder, so its cost is proportional to the folder being viewed. Stop the query when the folder is no longer displayed. When the storage backend reports its own metadata the query is answered from folderIndex instead.
+ 
+ @param folderPath The path of the folder relative to the documents directory. Pass the empty string for the documents directory itself. This value must not be nil.
+ @param includeSubfolders YES to also list the documents in every subfolder, NO for only the documents directly inside the folder
+ @param handler Code block called on the main thread with the folder's metadata entries whenever they change. Each entry has the same keys as the entries of iCloudMetadataSnapshot.
+ @return The running query, or nil if iCloud is unavailable or the query could not be started */
+- (iCloudFolderQuery *)startQueryForFolderAtPath:(NSString *)folderPath includingSubfolders:(BOOL)includeSubfolders updateHandler:(void (^)(NSArray *entries))handler __attribute__((nonnull (1)));
+
 
 
 /** @name Managing iCloud Content */
@@ -289,15 +572,35 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  
  @param documentName The name of the document being renamed in iCloud. The file specified should exist, otherwise an error will occur. This value must not be nil.
  @param newName The new name which the document should be renamed with. The file specified should not exist, otherwise an error will occur. This value must not be nil.
- @param handler Code block called when the document renaming has completed. The completion block passes and NSError object which contains any error information if an error occurred, otherwise it will be nil. */
-- (void)renameOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler __attribute__((nonnull));
+ @param handler Code block called when the document renaming has completed. The completion block passes and NSError object which contains any error information if an error occurred, otherwise it will be nil. If the returned progress was cancelled while the rename was waiting for file coordination, the error is an NSUserCancelledError. If iCloud is not available the local copy is renamed, the rename is queued in operationJournal and the error has the code 503.
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)renameOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler __attribute__((nonnull));
 
 /** Duplicate a document in iCloud
  
  @param documentName The name of the document being duplicated in iCloud. The file specified should exist, otherwise an error will occur. This value must not be nil.
  @param newName The new name which the document should be duplicated to (usually the same name with the word "copy" appended to the end). The file specified should not exist, otherwise an error will occur. This value must not be nil.
- @param handler Code block called when the document duplication has completed. The completion block passes and NSError object which contains any error information if an error occurred, otherwise it will be nil. */
-- (void)duplicateOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler __attribute__((nonnull));
+ @param handler Code block called when the document duplication has completed. The completion block passes and NSError object which contains any error information if an error occurred, otherwise it will be nil. If the returned progress was cancelled before the copy started, the error is an NSUserCancelledError. If iCloud is not available the local copy is duplicated, the duplicate is queued in operationJournal and the error has the code 503.
+ @return A cancellable NSProgress object which completes when the handler is called. */
+- (NSProgress *)duplicateOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler __attribute__((nonnull));
+
+/** Rename many documents in iCloud at once
+ 
+ @discussion Every rename is checked first, then all of them are performed inside a single coordinated access covering every source and destination, in parallel, followed by a single refresh of the file list. Each rename is independent: a new name must not exist before the batch starts, and must not be used twice in the same batch. Cancelling the returned progress while the batch is waiting for file coordination abandons it. If iCloud is not available each rename is queued in operationJournal.
+ 
+ @param newNames A dictionary of current document names (NSString) and the new name (NSString) of each document. This value must not be nil.
+ @param handler Code block called once, on the main thread, after every document has been processed. The errors dictionary maps the current name of each document which could not be renamed to its NSError (404 if it does not exist, 512 if the new name is taken), and is empty if all documents were renamed.
+ @return An NSProgress object reporting the number of documents processed so far. */
+- (NSProgress *)renameDocumentsWithNewNames:(NSDictionary *)newNames completion:(void (^)(NSDictionary *errors))handler __attribute__((nonnull (1)));
+
+/** Duplicate many documents in iCloud at once
+ 
+ @discussion Behaves like renameDocumentsWithNewNames:completion:, but copies each document to its new name instead of moving it. The sources are coordinated for reading and the copies for writing, all in the same coordinated access.
+ 
+ @param newNames A dictionary of document names (NSString) and the name (NSString) of the copy to make of each document. This value must not be nil.
+ @param handler Code block called once, on the main thread, after every document has been processed. The errors dictionary maps the name of each document which could not be duplicated to its NSError, and is empty if all documents were duplicated.
+ @return An NSProgress object reporting the number of documents processed so far. */
+- (NSProgress *)duplicateDocumentsWithNewNames:(NSDictionary *)newNames completion:(void (^)(NSDictionary *errors))handler __attribute__((nonnull (1)));
 
 
 
@@ -330,6 +633,8 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
 
 /** Find all the conflicting versions of a specified document
  
+ @discussion Use conflictedDocumentNames to find which documents have conflicts without checking each one.
+ 
  @param documentName The name of the file in iCloud. This value must not be nil.
  @return An array of NSFileVersion objects, or nil if no such version object exists. */
 - (NSArray *)findUnresolvedConflictingVersionsOfFile:(NSString *)documentName __attribute__((nonnull));
@@ -342,10 +647,17 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  * Choose one of the document versions based on some pertinent factor, such as the version with the latest modification date.
  * Enable the user to view conflicting versions of a document and select the one to use.
  
+ To apply one of these strategies to every conflicted document automatically, set the policy of conflictResolver instead.
+ 
  @param documentName The name of the file in iCloud. This value must not be nil.
  @param documentVersion The version of the document which should be kept and saved. All other conflicting versions will be removed. */
 - (void)resolveConflictForFile:(NSString *)documentName withSelectedFileVersion:(NSFileVersion *)documentVersion __attribute__((nonnull));
 
+/** Queue every document in conflictedDocumentNames for background resolution
+ 
+ @discussion Newly conflicted documents are queued automatically. Call this after changing the policy of conflictResolver to also resolve the documents which were already conflicted. Does nothing when the policy is iCloudConflictPolicyManual. */
+- (void)resolveUnresolvedConflicts;
+
 
 
 /** @name Deprecated Methods */
@@ -356,15 +668,6 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
  @return NSArray with a list of all the files currently stored in your app's iCloud Documents directory. May return a nil value if iCloud is unavailable. */
 - (NSArray *)getListOfCloudFiles __attribute((deprecated(" use listCloudFiles instead.")));
 
-/** DEPRECATED. Use saveAndCloseDocumentWithName:withContent:completion: instead. Record changes made to a document in iCloud. Changes are saved when the document is closed.
- 
- @deprecated Deprecated beginning in version 7.1. Use saveAndCloseDocumentWithName:withContent:completion: instead. This method may become unavailable in a future version.
- 
- @param documentName The name of the document being written to iCloud. This value must not be nil.
- @param content The data to write to the document
- @param handler Code block called when the document changes are recorded. The completion block passes UIDocument and NSData objects containing the saved document and it's contents in the form of NSData. The NSError object contains any error information if an error occurred, otherwise it will be nil. */
-- (void)saveChangesToDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull)) __deprecated;
-
 /** DEPRECATED. Use uploadLocalOfflineDocuments instead, like so: [[iCloud sharedCloud] uploadLocalOfflineDocuments];
  
  @deprecated Deprecated in version 7.0. Use uploadLocalOfflineDocuments instead.
@@ -397,6 +700,24 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
 - (void)iCloudAvailabilityDidChangeToState:(BOOL)cloudIsAvailable withUbiquityToken:(id)ubiquityToken withUbiquityContainer:(NSURL *)ubiquityContainer;
 
 
+/** Tells the delegate that the operations queued while iCloud was unavailable have been replayed
+ 
+ @discussion This method is called on the main thread at the end of each replay of operationJournal. If iCloud became unavailable again during the replay, the entries which were not replayed stay in the journal for the next one.
+ 
+ @param entries The coalesced journal entries (iCloudJournalEntry) which were replayed, in order
+ @param errors The errors (NSError) of the entries which failed, keyed by their document path. Entries discarded because they were queued for another iCloud account or container fail with code 409. */
+- (void)iCloudDidReplayOfflineOperations:(NSArray *)entries withErrors:(NSDictionary *)errors;
+
+
+/** Tells the delegate that the conflictResolver finished a batch of conflicted documents
+ 
+ @discussion This method is called on the main thread after each batch in which a document was resolved or failed to resolve.
+ 
+ @param resolutions The applied policy, number of conflicting versions and any kept copies (NSDictionary) of each resolved document, keyed by its name. See the reportHandler property of iCloudConflictResolver.
+ @param errors The errors (NSError) of the documents which could not be resolved, keyed by their name. These documents are tried again later. */
+- (void)iCloudDidResolveConflicts:(NSDictionary *)resolutions withErrors:(NSDictionary *)errors;
+
+
 /** Called when the iCloud initiaization process is finished and the iCloud is available
  
  @param cloudToken An iCloud ubiquity token that represents the current iCloud identity. Can be used to determine if iCloud is available and if the iCloud account has been changed (ex. if the user logged out and then logged in with a different iCloud account). This object may be nil if iCloud is not available for any reason.
@@ -407,9 +728,9 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
 
 /** Called before creating an iCloud Query filter. Specify the type of file to be queried. 
  
- @discussion If this delegate is not implemented or returns nil, all files stored in the documents directory will be queried.
+ @discussion If this delegate is not implemented or returns nil, all files stored in the documents directory will be queried. The extensions are ignored when the queryFilter property sets its own. Use queryFilter to filter by name, size, date or status.
  
- @return An NSArray with one file extension formatted like this (NSString with usage of simple quote): [NSArray arrayWithObjects:@"'zip'", @"'txt'", nil] */
+ @return An NSArray of file extensions, for example @[@"zip", @"txt"]. Extensions wrapped in single quotes (@"'zip'"), as required by earlier versions, are still accepted. */
 - (NSArray *)iCloudQueryLimitedToFileExtensions;
 
 
@@ -426,10 +747,30 @@ NS_CLASS_AVAILABLE_IOS(6_0) @interface iCloud : NSObject
 /** Tells the delegate that the files in iCloud have been modified
  
  @param files A list of the files now in the app's iCloud documents directory - each NSMetadataItem in the array contains information such as file version, url, localized name, date, etc.
- @param fileNames A list of the file names (NSString) now in the app's iCloud documents directory */
+ @param fileNames A list of the file names (NSString) now in the app's iCloud documents directory. Documents in folders are listed by their path relative to the documents directory. */
 - (void)iCloudFilesDidChange:(NSMutableArray *)files withNewFileNames:(NSMutableArray *)fileNames;
 
 
+/** Tells the delegate which files in iCloud were inserted, updated or deleted since the last update
+ 
+ @discussion This method is called after every update pass that changed the list of files, both for incremental updates (see the incrementalUpdates property) and for full passes. Only files which are fully downloaded are considered part of the file list, which matches the files passed to iCloudFilesDidChange:withNewFileNames:.
+ 
+ Each entry in the insertedFiles and updatedFiles arrays is an immutable NSDictionary keyed by NSMetadataItem attribute keys (for example NSMetadataItemFSNameKey, NSMetadataItemURLKey, NSMetadataItemFSSizeKey and NSMetadataItemFSContentChangeDateKey). Unlike NSMetadataItem objects, these dictionaries can safely be used on any thread.
+ 
+ @param insertedFiles The files which were added to the app's iCloud documents directory
+ @param updatedFiles The files which already existed and whose metadata changed
+ @param deletedFileNames The names (NSString) of the files which were removed from the app's iCloud documents directory, as paths relative to the documents directory for documents in folders */
+- (void)iCloudFilesDidChangeWithInsertedFiles:(NSArray *)insertedFiles updatedFiles:(NSArray *)updatedFiles deletedFileNames:(NSArray *)deletedFileNames;
+
+
+/** Tells the delegate that an update pass has finished and published a new snapshot of the iCloud documents directory
+ 
+ @discussion This method is called on the main thread after every update pass, full or incremental. All of the work of the pass has already been done on background queues, the snapshot is immutable and is the same object returned by the metadataSnapshot property at the time it was published.
+ 
+ @param snapshot The newly published snapshot */
+- (void)iCloudDidPublishMetadataSnapshot:(iCloudMetadataSnapshot *)snapshot;
+
+
 /** Sent to the delegate where there is a conflict between a local file and an iCloud file during an upload or download
  
  @discussion When both files have the same modification date and file content, iCloud Document Sync will not be able to automatically determine how to handle the conflict. As a result, this delegate method is called to pass the file information to the delegate which should be able to appropriately handle and resolve the conflict. The delegate should, if needed, present the user with a conflict resolution interface. iCloud Document Sync does not need to know the result of the attempted resolution, it will continue to upload all files which are not conflicting. 
@@ -7,6 +7,7 @@
 //
 
 #import "iCloud.h"
+#import <CommonCrypto/CommonDigest.h>
 
 // Check for ARC
 #if !__has_feature(objc_arc)
@@ -14,17 +15,164 @@
     #error iCloudDocumentSync is built with Objective-C ARC. You must enable ARC for iCloudDocumentSync.
 #endif
 
+/// User defaults key of the archived identity token of the last iCloud account seen, stamped on operations queued while offline
+static NSString * const iCloudJournalIdentityTokenKey = @"iCloudDocumentSyncJournalIdentityToken";
+
 @interface iCloud ()
 @property (strong,nonatomic) NSOperationQueue *updatesQueue;
+@property (nonatomic, strong) NSOperationQueue *queryQueue;
+@property (strong, readwrite) iCloudFolderIndex *folderIndex;
+@property (nonatomic, strong) NSHashTable *indexedFolderQueries;
 @property (nonatomic, assign) UIBackgroundTaskIdentifier backgroundProcess;
-@property (nonatomic, strong) NSFileManager *fileManager;
 @property (nonatomic, strong) NSNotificationCenter *notificationCenter;
-@property (nonatomic, copy) NSString *fileExtension;
+@property (nonatomic, strong) iCloudQueryFilter *activeQueryFilter;
+@property (nonatomic, assign) BOOL documentEnumerationStarted;
+@property (nonatomic, assign) BOOL metadataSnapshotSaveScheduled;
+@property (nonatomic, assign) uint64_t setupSpan;
+@property (nonatomic, assign) CFAbsoluteTime setupTime;
+@property (nonatomic, assign) BOOL firstFileListDelivered;
+@property (readwrite) NSTimeInterval timeToFirstFileList;
+@property (strong, readwrite) iCloudOperationJournal *operationJournal;
+@property (nonatomic, assign) BOOL replayingOperationJournal;
+@property (nonatomic, strong) dispatch_queue_t journalQueue;
+@property (nonatomic, copy) NSString *containerIdentifier;
 @property (nonatomic, strong) NSURL *ubiquityContainer;
+@property (strong, readwrite) iCloudContentHashCache *contentHashCache;
+@property (strong, readwrite) iCloudDocumentPool *documentPool;
+@property (strong, readwrite) iCloudDownloadScheduler *downloadScheduler;
+@property (strong, readwrite) iCloudEvictionManager *evictionManager;
+@property (strong, readwrite) iCloudTelemetry *telemetry;
+@property (strong, readwrite) iCloudConflictResolver *conflictResolver;
+@property (nonatomic, strong) NSMutableSet *conflictedNames;
+@property (nonatomic, strong) NSMutableSet *restoredConflictedNames;
+@property (copy, readwrite) NSSet *conflictedDocumentNames;
+@property (nonatomic, strong) NSMutableDictionary *metadataIndex;
+@property (nonatomic, assign) BOOL metadataIndexIsWarm;
+@property (nonatomic, assign) NSUInteger metadataIndexGeneration;
+@property (nonatomic, strong) dispatch_queue_t coalescingQueue;
+@property (nonatomic, strong) NSMutableDictionary *pendingEntries;
+@property (nonatomic, strong) NSMutableSet *pendingRemovedNames;
+@property (nonatomic, assign) BOOL pendingFullPass;
+@property (nonatomic, strong) NSArray *pendingFullPassEntries;
+@property (nonatomic, assign) BOOL pendingGatheringEnd;
+@property (nonatomic, assign) NSUInteger pendingNotificationCount;
+@property (nonatomic, assign) CFAbsoluteTime pendingSince;
+@property (nonatomic, assign) NSUInteger coalescingGeneration;
+@property (nonatomic, strong) NSOperation *pendingUpdateOperation;
+@property (readwrite) NSUInteger coalescedUpdateNotificationCount;
+@property (readwrite) NSUInteger updatePassCount;
 
 /// Setup and start the metadata query and related notifications
 - (void)enumerateCloudDocuments;
 
+/// The file the snapshot of the current container and account is saved to, metadataSnapshotURL if set, nil while signed out
+- (NSURL *)persistedMetadataSnapshotURL;
+
+/// Load the snapshot saved by a previous launch into the metadata index and hand it to the delegate, unless a live pass got there first
+- (void)restorePersistedMetadataSnapshot;
+
+/// Save the published snapshot a couple of seconds from now, collapsing the passes of a burst into one write
+- (void)scheduleMetadataSnapshotSave;
+
+/// Write the published snapshot to persistedMetadataSnapshotURL if it came from a full pass
+- (void)saveMetadataSnapshot;
+
+/// Record the time from setup to the first file list, called on the main thread
+- (void)recordFirstFileListFromSnapshot:(iCloudMetadataSnapshot *)snapshot;
+
+/// Record an operation made while iCloud is unavailable, apply its effect to the local copy and report it as queued
+- (void)journalOfflineOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath completion:(void (^)(NSError *error))handler;
+
+/// The error passed to completion handlers when an operation was queued in the journal
+- (NSError *)queuedErrorForDocumentName:(NSString *)documentName;
+
+/// Apply an offline delete, rename or duplicate to the local files, under file coordination for documents in the ubiquity container
+- (BOOL)applyOfflineOperation:(iCloudJournalOperation)operation sourceURL:(NSURL *)sourceURL destinationURL:(NSURL *)destinationURL coordinated:(BOOL)coordinated error:(NSError **)error;
+
+/// The current ubiquity identity token archived for comparison and storage, nil if iCloud is not available
+- (NSData *)archivedIdentityToken;
+
+/// Stamp new journal entries with the current account and remember it for offline launches
+- (void)rememberIdentityToken:(NSData *)identityToken;
+
+/// Replay the coalesced journal in order, called whenever iCloud becomes available
+- (void)replayOperationJournal;
+
+/// Replay one coalesced entry made for the current account and move on to the next, compacting the journal once done
+- (void)replayJournalEntries:(NSArray *)entries fromIndex:(NSUInteger)index throughSequence:(uint64_t)sequence identityToken:(NSData *)identityToken errors:(NSMutableDictionary *)errors;
+
+/// Merge the queryFilter property with the delegate's file extensions into the filter applied to delegate deliveries
+- (iCloudQueryFilter *)compiledQueryFilter;
+
+/// The predicate handed to NSMetadataQuery, which gathers every document whatever the filter
+- (NSPredicate *)metadataQueryPredicate;
+
+/// Check whether an indexed entry is part of the file list reported to the delegate
+- (BOOL)isListedEntry:(NSDictionary *)entry filter:(iCloudQueryFilter *)filter;
+
+/// Switch to a new filter and report the documents which enter or leave the file list, the index is left as it is
+- (void)reapplyQueryFilter;
+
+/// Capture an immutable copy of the indexed attributes of a metadata item
+- (NSDictionary *)metadataEntryForItem:(NSMetadataItem *)item;
+
+/// Apply changed and removed entries to the metadata index and notify the delegate of the differences
+- (void)applyMetadataEntries:(NSArray *)entries removedNames:(NSArray *)removedNames replacingIndex:(BOOL)replaceIndex;
+
+/// Hand conflicted index entries to the conflict resolver, unless conflicts are resolved manually
+- (void)queueConflictedEntries:(NSArray *)entries;
+
+/// Run a block on the metadata query's queue and wait for it, the query's results may only be read there
+- (void)performOnQueryQueueAndWait:(void (^)(void))block;
+
+/// Look up a document in the metadata index. The index is warm once a full query pass has populated it, until then callers must fall back to the file system
+- (NSDictionary *)indexedMetadataForDocumentName:(NSString *)documentName indexIsWarm:(BOOL *)indexIsWarm;
+
+/// Drop deleted documents from the metadata index and re-key renamed ones (names mapped to their new name, or NSNull for deletes), so lookups do not wait for the next query pass
+- (void)moveIndexedDocuments:(NSDictionary *)newNames;
+
+/// Overwrite an iCloud file with a copy of a local file using a coordinated write
+- (BOOL)replaceCloudItemAtURL:(NSURL *)cloudURL withContentsOfLocalItemAtURL:(NSURL *)localURL error:(NSError **)error;
+
+/// Create the document object for a file URL, using a package document for packages and package extensions
+- (iCloudDocument *)documentForFileURL:(NSURL *)fileURL;
+
+/// Resolve a document name, or a path relative to the documents directory such as @"Folder/Name.ext", to a URL which never leaves the documents directory
+- (NSURL *)URLForDocumentPath:(NSString *)documentPath;
+
+/// The path of a URL relative to the documents directory, or nil if the URL is not inside it
+- (NSString *)documentPathForURL:(NSURL *)fileURL;
+
+/// Create the folders leading up to a document which is about to be written
+- (BOOL)createParentFoldersForURL:(NSURL *)fileURL error:(NSError **)error;
+
+/// Refresh the folder queries which are answered from the folder index
+- (void)updateIndexedFolderQueries;
+
+/// Create the cancellable progress returned by a single document operation
+- (NSProgress *)documentOperationProgress;
+
+/// The error passed to completion handlers when an operation was cancelled
+- (NSError *)cancellationErrorForDocumentName:(NSString *)documentName;
+
+/// The error passed to the handler when an exception was caught while working on a document
+- (NSError *)exceptionErrorForDocumentName:(NSString *)documentName exception:(NSException *)exception;
+
+/// Save and close a document without looking at the write-behind buffer, the buffer writes its content through here
+- (void)writeDocumentWithName:(NSString *)documentName content:(NSData *)content progress:(NSProgress *)progress completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler;
+
+/// Cancel an operation started after buffered writes landed when the progress returned for it is cancelled
+- (void)forwardCancellationOfProgress:(NSProgress *)progress toProgress:(NSProgress *)operationProgress;
+
+/// Delete, rename or duplicate documents (names mapped to their new name, or NSNull for deletes) inside a single coordinated access, then refresh once
+- (NSProgress *)performBatchOperation:(iCloudJournalOperation)operation withDocuments:(NSDictionary *)documents completion:(void (^)(NSDictionary *errors))handler;
+
+/// Merge an update request into the pending pass and schedule it once the quiet window or maximum latency elapses
+- (void)scheduleUpdatePassWithEntries:(NSArray *)entries removedNames:(NSArray *)removedNames fullPass:(BOOL)fullPass endsGathering:(BOOL)endsGathering;
+
+/// Run the single update pass covering every request merged since the last pass
+- (void)performPendingUpdatePass;
+
 /// Called by the NSMetadataQuery notifications to updateFiles
 - (void)startUpdate:(NSMetadataQuery *)notification;
 
@@ -35,6 +183,9 @@
 
 @implementation iCloud
 
+@synthesize queryFilter = _queryFilter;
+@synthesize metadataSnapshot = _metadataSnapshot;
+
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 //------------ Setup --------------------------------------------------------------------------------------------------------------------------//
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -51,6 +202,50 @@
 
 - (instancetype)init {
     self = [super init];
+    if (self) {
+        _updateCoalescingInterval = 0.25;
+        _maximumUpdateLatency = 1.0;
+        _maximumConcurrentDocumentOperations = 4;
+        _maximumUploadBytesInFlight = 32 * 1024 * 1024;
+        _packageDocumentExtensions = [NSSet set];
+        _persistsMetadataSnapshot = YES;
+        _operationJournal = [[iCloudOperationJournal alloc] initWithJournalURL:[[[NSFileManager defaultManager] URLsForDirectory:NSApplicationSupportDirectory inDomains:NSUserDomainMask].firstObject URLByAppendingPathComponent:@"iCloudDocumentSync/OperationJournal.bin"]];
+        _operationJournal.identityToken = [[NSUserDefaults standardUserDefaults] dataForKey:iCloudJournalIdentityTokenKey];
+        _journalQueue = dispatch_queue_create("com.iRareMedia.iCloud.journal", DISPATCH_QUEUE_SERIAL);
+        _fileManager = [NSFileManager defaultManager];
+        _telemetry = [[iCloudTelemetry alloc] init];
+        _documentPool = [[iCloudDocumentPool alloc] init];
+        _downloadScheduler = [[iCloudDownloadScheduler alloc] init];
+        _evictionManager = [[iCloudEvictionManager alloc] init];
+        _folderIndex = [[iCloudFolderIndex alloc] init];
+        _writeBehindBuffer = [[iCloudWriteBehindBuffer alloc] init];
+        _conflictResolver = [[iCloudConflictResolver alloc] init];
+        _conflictedNames = [NSMutableSet set];
+        _restoredConflictedNames = [NSMutableSet set];
+        _conflictedDocumentNames = [NSSet set];
+        _indexedFolderQueries = [NSHashTable weakObjectsHashTable];
+        _downloadScheduler.telemetry = _telemetry;
+        _evictionManager.telemetry = _telemetry;
+        _conflictResolver.telemetry = _telemetry;
+        
+        // Documents held by the pool, and any document open or in flight elsewhere, must stay on the device
+        __weak iCloudDocumentPool *documentPool = _documentPool;
+        _evictionManager.inUseHandler = ^BOOL(NSURL *fileURL) {
+            return [documentPool containsDocumentAtURL:fileURL] || [iCloudDocument isDocumentInUseAtURL:fileURL];
+        };
+        
+        // Buffered changes are written through a regular save and close
+        __weak __typeof(self) wself=self;
+        _writeBehindBuffer.writeHandler = ^(NSString *documentName, NSData *content, void (^completion)(UIDocument *, NSData *, NSError *)) {
+            [wself writeDocumentWithName:documentName content:content progress:[wself documentOperationProgress] completion:completion];
+        };
+        
+        // Tell the delegate what the background resolver did, the next query pass clears the resolved names
+        _conflictResolver.reportHandler = ^(NSDictionary *resolutions, NSDictionary *errors) {
+            if ([wself.delegate respondsToSelector:@selector(iCloudDidResolveConflicts:withErrors:)])
+                [wself.delegate iCloudDidResolveConflicts:resolutions withErrors:errors];
+        };
+    }
     return self;
 }
 
@@ -61,6 +256,9 @@
 - (void)setupiCloudDocumentSyncWithUbiquityContainer:(NSString *)containerID {
     // Setup the File Manager
     if (_fileManager == nil) _fileManager = [NSFileManager defaultManager];
+    self.downloadScheduler.fileManager = _fileManager;
+    self.evictionManager.fileManager = _fileManager;
+    self.conflictResolver.fileManager = _fileManager;
     
     // Setup the Notification Center
     if (_notificationCenter == nil) _notificationCenter = [NSNotificationCenter defaultCenter];
@@ -68,13 +266,38 @@
     // Initialize file lists, results, and queries
     if (_fileList == nil) _fileList = [NSMutableArray array];
     if (_previousQueryResults == nil) _previousQueryResults = [NSMutableArray array];
+    if (_metadataIndex == nil) _metadataIndex = [NSMutableDictionary dictionary];
+    if (_pendingEntries == nil) _pendingEntries = [NSMutableDictionary dictionary];
+    if (_pendingRemovedNames == nil) _pendingRemovedNames = [NSMutableSet set];
+    if (_coalescingQueue == nil) _coalescingQueue = dispatch_queue_create("com.iRareMedia.iCloud.coalescing", DISPATCH_QUEUE_SERIAL);
     if (_query == nil) _query = [[NSMetadataQuery alloc] init];
+    if (_queryQueue == nil) {
+        _queryQueue = [[NSOperationQueue alloc] init];
+        _queryQueue.name = @"com.iRareMedia.iCloud.query";
+        _queryQueue.maxConcurrentOperationCount = 1;
+        _queryQueue.qualityOfService = NSQualityOfServiceUtility;
+    }
+    
+    // Serve the file list saved by the previous launch while the container and the query start up
+    self.setupTime = CFAbsoluteTimeGetCurrent();
+    self.setupSpan = [self.telemetry beginSpan];
+    self.firstFileListDelivered = NO;
+    
+    // Operations queued from here on are made for this container
+    self.containerIdentifier = containerID;
+    self.operationJournal.containerIdentifier = containerID;
+    
+    if (self.persistsMetadataSnapshot) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+            [self restorePersistedMetadataSnapshot];
+        });
+    }
     
     // Check the iCloud Ubiquity Container
     dispatch_async(dispatch_get_global_queue (DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void) {
         NSLog(@"[iCloud] Initializing Ubiquity Container");
         
-        _ubiquityContainer = [[NSFileManager defaultManager] URLForUbiquityContainerIdentifier:containerID];
+        _ubiquityContainer = [_fileManager URLForUbiquityContainerIdentifier:containerID];
         if (_ubiquityContainer) {
             // We can write to the ubiquity container
             
@@ -89,8 +312,12 @@
                 [self enumerateCloudDocuments];
                 
                 // Subscribe to changes in iCloud availability (should run on main thread)
+                [_notificationCenter removeObserver:self name:NSUbiquityIdentityDidChangeNotification object:nil];
                 [_notificationCenter addObserver:self selector:@selector(checkCloudAvailability) name:NSUbiquityIdentityDidChangeNotification object:nil];
                 
+                // Operations journaled while iCloud was unavailable, possibly by a previous launch
+                [self replayOperationJournal];
+                
                 if ([_delegate respondsToSelector:@selector(iCloudDidFinishInitializingWitUbiquityToken: withUbiquityContainer:)])
                     [_delegate iCloudDidFinishInitializingWitUbiquityToken:cloudToken withUbiquityContainer:_ubiquityContainer];
             });
@@ -103,6 +330,12 @@
             
             if ([self.delegate respondsToSelector:@selector(iCloudAvailabilityDidChangeToState:withUbiquityToken:withUbiquityContainer:)])
                 [self.delegate iCloudAvailabilityDidChangeToState:NO withUbiquityToken:nil withUbiquityContainer:self.ubiquityContainer];
+            
+            // Watch for iCloud becoming available so that journaled operations can be replayed
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [_notificationCenter removeObserver:self name:NSUbiquityIdentityDidChangeNotification object:nil];
+                [_notificationCenter addObserver:self selector:@selector(checkCloudAvailability) name:NSUbiquityIdentityDidChangeNotification object:nil];
+            });
         }
     });
     
@@ -132,6 +365,17 @@
 }
 
 
+- (iCloudContentHashCache *)contentHashCache {
+    @synchronized (self) {
+        if (!_contentHashCache) {
+            NSURL *cachesDirectory = [[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject;
+            _contentHashCache = [[iCloudContentHashCache alloc] initWithCacheURL:[cachesDirectory URLByAppendingPathComponent:@"iCloudDocumentSync/ContentHashes.plist"]];
+        }
+        return _contentHashCache;
+    }
+}
+
+
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 //------------ Basic --------------------------------------------------------------------------------------------------------------------------//
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -140,15 +384,18 @@
 - (BOOL)checkCloudAvailability {
     id cloudToken = [self.fileManager ubiquityIdentityToken];
     if (cloudToken) {
-        if (self.verboseAvailabilityLogging == YES) NSLog(@"[iCloud] iCloud is available. Ubiquity URL: %@\nUbiquity Token: %@", self.ubiquityContainer, cloudToken);
+        if (self.verboseAvailabilityLogging == YES) [self.telemetry log:@"[iCloud] iCloud is available. Ubiquity URL: %@\nUbiquity Token: %@", self.ubiquityContainer, cloudToken];
         
         if ([self.delegate respondsToSelector:@selector(iCloudAvailabilityDidChangeToState:withUbiquityToken:withUbiquityContainer:)])
             [self.delegate iCloudAvailabilityDidChangeToState:YES withUbiquityToken:cloudToken withUbiquityContainer:self.ubiquityContainer];
         
+        // Catch up on the operations made while iCloud was unavailable
+        [self replayOperationJournal];
+        
         return YES;
     } else {
         if (self.verboseAvailabilityLogging == YES)
-            NSLog(@"[iCloud] iCloud is not available. iCloud may be unavailable for a number of reasons:\n• The device has not yet been configured with an iCloud account, or the Documents & Data option is disabled\n• Your app, %@, does not have properly configured entitlements\nGo to http://bit.ly/18HkxPp for more information on setting up iCloud", [[NSBundle mainBundle] infoDictionary][@"CFBundleName"]);
+            [self.telemetry log:@"[iCloud] iCloud is not available. iCloud may be unavailable for a number of reasons:\n• The device has not yet been configured with an iCloud account, or the Documents & Data option is disabled\n• Your app, %@, does not have properly configured entitlements\nGo to http://bit.ly/18HkxPp for more information on setting up iCloud", [[NSBundle mainBundle] infoDictionary][@"CFBundleName"]];
         else
             NSLog(@"[iCloud] iCloud unavailable");
         
@@ -175,7 +422,7 @@
 
 - (NSURL *)ubiquitousDocumentsDirectoryURL {
     // Use the instance variable here - no need to start the retrieval process again
-    if (self.ubiquityContainer == nil) self.ubiquityContainer = [[NSFileManager defaultManager] URLForUbiquityContainerIdentifier:nil];
+    if (self.ubiquityContainer == nil) self.ubiquityContainer = [self.fileManager URLForUbiquityContainerIdentifier:nil];
     NSURL *documentsDirectory = [self.ubiquityContainer URLByAppendingPathComponent:DOCUMENT_DIRECTORY];
     NSError *error;
     
@@ -210,6 +457,518 @@
     }
 }
 
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+//------------ Folders ------------------------------------------------------------------------------------------------------------------------//
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+#pragma mark - Folders
+
+- (NSURL *)URLForDocumentPath:(NSString *)documentPath {
+    NSURL *fileURL = [self ubiquitousDocumentsDirectoryURL];
+    
+    // Skip empty, current and parent directory components so that a path can never leave the documents directory
+    for (NSString *component in [documentPath pathComponents]) {
+        if ([component isEqualToString:@"/"] || [component isEqualToString:@"."] || [component isEqualToString:@".."]) continue;
+        fileURL = [fileURL URLByAppendingPathComponent:component];
+    }
+    
+    return fileURL;
+}
+
+- (NSString *)documentPathForURL:(NSURL *)fileURL {
+    // Avoid ubiquitousDocumentsDirectoryURL here, this is called for every metadata item and must not touch the disk
+    NSString *directoryPath = [[self.ubiquityContainer URLByAppendingPathComponent:DOCUMENT_DIRECTORY] path];
+    NSString *path = [fileURL path];
+    if (directoryPath == nil || path == nil) return nil;
+    
+    // Metadata queries may report /private/var paths for a /var container, compare both without the prefix
+    if ([directoryPath hasPrefix:@"/private/"]) directoryPath = [directoryPath substringFromIndex:8];
+    if ([path hasPrefix:@"/private/"]) path = [path substringFromIndex:8];
+    
+    NSString *directoryPrefix = [directoryPath stringByAppendingString:@"/"];
+    if (![path hasPrefix:directoryPrefix]) return nil;
+    return [path substringFromIndex:directoryPrefix.length];
+}
+
+- (BOOL)createParentFoldersForURL:(NSURL *)fileURL error:(NSError **)error {
+    NSURL *folderURL = [fileURL URLByDeletingLastPathComponent];
+    
+    BOOL isDirectory = NO;
+    if ([self.fileManager fileExistsAtPath:[folderURL path] isDirectory:&isDirectory] && isDirectory) return YES;
+    
+    return [self.fileManager createDirectoryAtURL:folderURL withIntermediateDirectories:YES attributes:nil error:error];
+}
+
+- (iCloudFolderQuery *)startQueryForFolderAtPath:(NSString *)folderPath includingSubfolders:(BOOL)includeSubfolders updateHandler:(void (^)(NSArray *entries))handler {
+    // Check for iCloud
+    if ([self quickCloudCheck] == NO) return nil;
+    
+    // Normalize the folder path the same way document paths are resolved
+    NSURL *folderURL = [self URLForDocumentPath:folderPath];
+    NSString *normalizedPath = [self documentPathForURL:folderURL] ?: @"";
+    
+    iCloudFolderQuery *query = [[iCloudFolderQuery alloc] initWithFolderURL:folderURL folderPath:normalizedPath includingSubfolders:includeSubfolders];
+    query.updateHandler = handler;
+    
+    // Folder queries deliver no more than the delegate is told about
+    query.predicate = [self.activeQueryFilter predicate];
+    
+    // Backends which report their own metadata cannot be queried, answer their folder queries from the folder index
+    if ([self.fileManager respondsToSelector:@selector(startMetadataUpdatesForDirectoryAtURL:handler:)]) {
+        query.usesMetadataQuery = NO;
+        [query start];
+        @synchronized (self.indexedFolderQueries) {
+            [self.indexedFolderQueries addObject:query];
+        }
+        [self updateIndexedFolderQueries];
+        return query;
+    }
+    
+    if ([query start] == NO) {
+        NSLog(@"[iCloud] Failed to start query for folder: %@", normalizedPath);
+        return nil;
+    }
+    
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Started query for folder: %@", normalizedPath];
+    return query;
+}
+
+- (void)updateIndexedFolderQueries {
+    NSArray *queries = nil;
+    @synchronized (self.indexedFolderQueries) {
+        queries = [self.indexedFolderQueries allObjects];
+    }
+    if (queries.count == 0) return;
+    
+    // Each query only reads its own folder from the index, without publishing a snapshot of the whole index
+    for (iCloudFolderQuery *query in queries) {
+        if (!query.running) continue;
+        
+        NSMutableArray *entries = [NSMutableArray array];
+        @synchronized (self.metadataIndex) {
+            for (NSString *documentPath in [self.folderIndex documentPathsInFolderAtPath:query.folderPath recursive:query.includesSubfolders]) {
+                NSDictionary *entry = self.metadataIndex[documentPath];
+                if (entry) [entries addObject:entry];
+            }
+        }
+        [query updateWithEntries:entries];
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+//------------ Offline Journal ----------------------------------------------------------------------------------------------------------------//
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+#pragma mark - Offline Journal
+
+- (NSError *)queuedErrorForDocumentName:(NSString *)documentName {
+    return [NSError errorWithDomain:[NSString stringWithFormat:@"iCloud is not available, the operation on the document, %@, has been queued and will run when iCloud becomes available", documentName] code:503 userInfo:@{@"FileName": documentName ?: @""}];
+}
+
+- (NSData *)archivedIdentityToken {
+    id cloudToken = [self.fileManager ubiquityIdentityToken];
+    return cloudToken ? [NSKeyedArchiver archivedDataWithRootObject:cloudToken] : nil;
+}
+
+- (void)rememberIdentityToken:(NSData *)identityToken {
+    if (identityToken == nil || [identityToken isEqualToData:self.operationJournal.identityToken]) return;
+    
+    self.operationJournal.identityToken = identityToken;
+    [[NSUserDefaults standardUserDefaults] setObject:identityToken forKey:iCloudJournalIdentityTokenKey];
+}
+
+- (void)journalOfflineOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath completion:(void (^)(NSError *error))handler {
+    // Check for nil / null document names
+    BOOL needsDestination = (operation == iCloudJournalOperationRename || operation == iCloudJournalOperationDuplicate);
+    if (documentPath.length == 0 || (needsDestination && destinationPath.length == 0)) {
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
+        NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be used. Specify a document name next time." code:001 userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (handler) handler(error);
+        });
+        return;
+    }
+    
+    NSURL *sourceURL = [self URLForDocumentPath:documentPath];
+    NSURL *destinationURL = needsDestination ? [self URLForDocumentPath:destinationPath] : nil;
+    if (operation != iCloudJournalOperationSave) [self.documentPool removeDocumentWithName:documentPath];
+    
+    // Documents in a cached ubiquity container are changed under file coordination, like online, and replay leaves them to iCloud.
+    // Documents in the local documents directory are changed as they are, and replay applies the change to the container.
+    BOOL inContainer = [self documentPathForURL:sourceURL] != nil;
+    
+    // One operation at a time, so that later offline calls and the replay see the documents in the order they were changed
+    dispatch_async(self.journalQueue, ^{
+        NSError *localError = nil;
+        BOOL appliedLocally = NO;
+        if (operation != iCloudJournalOperationSave && [self.fileManager fileExistsAtPath:[sourceURL path]]) {
+            if ([self applyOfflineOperation:operation sourceURL:sourceURL destinationURL:destinationURL coordinated:inContainer error:&localError]) appliedLocally = inContainer;
+        }
+        
+        // Only journal operations which could be applied locally
+        NSError *journalError = nil;
+        iCloudJournalEntry *entry = localError ? nil : [self.operationJournal appendOperation:operation documentPath:documentPath destinationPath:destinationPath appliedLocally:appliedLocally error:&journalError];
+        if (!entry) {
+            NSError *error = localError ?: journalError;
+            NSLog(@"[iCloud] Failed to queue offline operation on %@: %@", documentPath, error);
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (handler) handler(error);
+            });
+            return;
+        }
+        
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] iCloud is not available, queued %@", entry];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (handler) handler([self queuedErrorForDocumentName:documentPath]);
+        });
+    });
+}
+
+- (BOOL)applyOfflineOperation:(iCloudJournalOperation)operation sourceURL:(NSURL *)sourceURL destinationURL:(NSURL *)destinationURL coordinated:(BOOL)coordinated error:(NSError **)error {
+    __block BOOL success = NO;
+    __block NSError *fileError = nil;
+    void (^apply)(NSURL *, NSURL *) = ^(NSURL *source, NSURL *destination) {
+        if (destination) [self createParentFoldersForURL:destination error:nil];
+        
+        if (operation == iCloudJournalOperationDelete) success = [self.fileManager removeItemAtURL:source error:&fileError];
+        else if (operation == iCloudJournalOperationRename) success = [self.fileManager moveItemAtURL:source toURL:destination error:&fileError];
+        else if (operation == iCloudJournalOperationDuplicate) success = [self.fileManager copyItemAtURL:source toURL:destination error:&fileError];
+        if (success && operation != iCloudJournalOperationDuplicate) [self.contentHashCache removeDigestForFileAtURL:source];
+    };
+    
+    if (coordinated == NO) {
+        apply(sourceURL, destinationURL);
+        if (error) *error = fileError;
+        return success;
+    }
+    
+    NSError *coordinatorError = nil;
+    NSFileCoordinator *coordinator = [self.fileManager fileCoordinatorWithFilePresenter:nil];
+    if (operation == iCloudJournalOperationDelete) {
+        [coordinator coordinateWritingItemAtURL:sourceURL options:NSFileCoordinatorWritingForDeleting error:&coordinatorError byAccessor:^(NSURL *writingURL) {
+            apply(writingURL, nil);
+        }];
+    } else if (operation == iCloudJournalOperationRename) {
+        [coordinator coordinateWritingItemAtURL:sourceURL options:NSFileCoordinatorWritingForMoving writingItemAtURL:destinationURL options:NSFileCoordinatorWritingForReplacing error:&coordinatorError byAccessor:^(NSURL *newURL1, NSURL *newURL2) {
+            apply(newURL1, newURL2);
+            if (success) [coordinator itemAtURL:newURL1 didMoveToURL:newURL2];
+        }];
+    } else {
+        [coordinator coordinateReadingItemAtURL:sourceURL options:NSFileCoordinatorReadingWithoutChanges writingItemAtURL:destinationURL options:NSFileCoordinatorWritingForReplacing error:&coordinatorError byAccessor:^(NSURL *newReadingURL, NSURL *newWritingURL) {
+            apply(newReadingURL, newWritingURL);
+        }];
+    }
+    
+    if (error) *error = coordinatorError ?: fileError;
+    return success;
+}
+
+- (void)replayOperationJournal {
+    if ([self quickCloudCheck] == NO) return;
+    
+    // Entries made for another account are told apart by the token they were stamped with, new entries get the current one
+    NSData *identityToken = [self archivedIdentityToken];
+    if (self.operationJournal.count == 0) {
+        [self rememberIdentityToken:identityToken];
+        return;
+    }
+    
+    @synchronized (self) {
+        if (self.replayingOperationJournal == YES) return;
+        self.replayingOperationJournal = YES;
+    }
+    
+    // Replay only the net effect, entries appended from here on are kept for the next replay
+    uint64_t sequence = self.operationJournal.lastSequence;
+    NSArray *entries = [self.operationJournal coalescedEntries];
+    [self rememberIdentityToken:identityToken];
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Replaying %lu queued operations (coalesced from %lu)", (unsigned long)entries.count, (unsigned long)self.operationJournal.count];
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self replayJournalEntries:entries fromIndex:0 throughSequence:sequence identityToken:identityToken errors:[NSMutableDictionary dictionary]];
+    });
+}
+
+- (void)replayJournalEntries:(NSArray *)entries fromIndex:(NSUInteger)index throughSequence:(uint64_t)sequence identityToken:(NSData *)identityToken errors:(NSMutableDictionary *)errors {
+    // Stop when done, or when iCloud went away again and the rest has to wait for the next replay
+    if (index >= entries.count || [self quickCloudCheck] == NO) {
+        NSArray *remainingEntries = index < entries.count ? [entries subarrayWithRange:NSMakeRange(index, entries.count - index)] : @[];
+        NSArray *replayedEntries = [entries subarrayWithRange:NSMakeRange(0, MIN(index, entries.count))];
+        
+        // Rewriting the journal touches the disk, keep it off the main thread
+        dispatch_async(self.journalQueue, ^{
+            NSError *error = nil;
+            if (![self.operationJournal replaceEntriesThroughSequence:sequence withEntries:remainingEntries error:&error]) NSLog(@"[iCloud] Failed to compact the operation journal: %@", error);
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                @synchronized (self) {
+                    self.replayingOperationJournal = NO;
+                }
+                
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Replayed %lu queued operations, %lu failed, %lu left", (unsigned long)replayedEntries.count, (unsigned long)errors.count, (unsigned long)remainingEntries.count];
+                if ([self.delegate respondsToSelector:@selector(iCloudDidReplayOfflineOperations:withErrors:)])
+                    [self.delegate iCloudDidReplayOfflineOperations:replayedEntries withErrors:errors];
+                
+                // Operations queued while the replay was running
+                if (remainingEntries.count == 0 && self.operationJournal.count > 0) [self replayOperationJournal];
+            });
+        });
+        return;
+    }
+    
+    iCloudJournalEntry *entry = entries[index];
+    __weak __typeof(self) wself=self;
+    void (^next)(NSError *) = ^(NSError *error) {
+        // Failed entries are reported, not retried, the document they refer to is gone or conflicting
+        if (error && error.code != 503) errors[entry.documentPath] = error;
+        [wself replayJournalEntries:entries fromIndex:index + 1 throughSequence:sequence identityToken:identityToken errors:errors];
+    };
+    
+    // Never apply one account's or container's operations to another, entries made before any account was known go to the current one
+    BOOL sameAccount = entry.identityToken == nil || [entry.identityToken isEqualToData:identityToken];
+    BOOL sameContainer = (entry.containerIdentifier == nil && self.containerIdentifier == nil) || [entry.containerIdentifier isEqualToString:self.containerIdentifier];
+    if (!sameAccount || !sameContainer) {
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Discarding %@, it was queued for another iCloud account or container", entry];
+        next([NSError errorWithDomain:[NSString stringWithFormat:@"The queued operation on the document, %@, was made for another iCloud account or container and has been discarded", entry.documentPath] code:409 userInfo:@{@"FileName": entry.documentPath}]);
+        return;
+    }
+    
+    // The change was made to the container under file coordination already, iCloud uploads it on its own
+    if (entry.appliedLocally) {
+        next(nil);
+        return;
+    }
+    
+    switch (entry.operation) {
+        case iCloudJournalOperationSave: {
+            // Saves made before the container was known are in the local documents directory, the others are in the container already
+            NSString *localDocument = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES)[0] stringByAppendingPathComponent:entry.documentPath];
+            if (![self.fileManager fileExistsAtPath:localDocument] || [[self URLForDocumentPath:entry.documentPath].path isEqualToString:localDocument]) next(nil);
+            else [self uploadLocalDocumentToCloudWithName:entry.documentPath completion:next];
+            break;
+        }
+        case iCloudJournalOperationDelete:
+            [self deleteDocumentWithName:entry.documentPath completion:next];
+            break;
+        case iCloudJournalOperationRename:
+            [self renameOriginalDocument:entry.documentPath withNewName:entry.destinationPath completion:next];
+            break;
+        case iCloudJournalOperationDuplicate:
+            [self duplicateOriginalDocument:entry.documentPath withNewName:entry.destinationPath completion:next];
+            break;
+        default:
+            next(nil);
+            break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+//------------ Snapshot Persistence -----------------------------------------------------------------------------------------------------------//
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+#pragma mark - Snapshot Persistence
+
+- (NSURL *)persistedMetadataSnapshotURL {
+    if (self.metadataSnapshotURL) return self.metadataSnapshotURL;
+    
+    // Without an account there is no file list worth keeping
+    NSData *identityToken = [self archivedIdentityToken];
+    if (identityToken == nil) return nil;
+    
+    // Every container and account gets its own file, so a launch never shows the documents of another account
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(identityToken.bytes, (CC_LONG)identityToken.length, digest);
+    NSMutableString *tokenHash = [NSMutableString stringWithCapacity:16];
+    for (NSUInteger index = 0; index < 8; index++) [tokenHash appendFormat:@"%02x", digest[index]];
+    
+    NSMutableCharacterSet *allowedCharacters = [NSMutableCharacterSet alphanumericCharacterSet];
+    [allowedCharacters addCharactersInString:@".-"];
+    NSString *container = [[(self.containerIdentifier ?: @"Default") componentsSeparatedByCharactersInSet:[allowedCharacters invertedSet]] componentsJoinedByString:@"-"];
+    
+    NSURL *directoryURL = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject URLByAppendingPathComponent:@"iCloudDocumentSync"];
+    return [directoryURL URLByAppendingPathComponent:[NSString stringWithFormat:@"MetadataSnapshot_%@_%@.bin", container, tokenHash]];
+}
+
+- (void)restorePersistedMetadataSnapshot {
+    NSURL *snapshotURL = [self persistedMetadataSnapshotURL];
+    if (snapshotURL == nil) return;
+    
+    // Snapshots saved for this container under another account no longer describe it, discard them
+    if (self.metadataSnapshotURL == nil) {
+        NSString *containerPrefix = [[snapshotURL lastPathComponent] stringByDeletingPathExtension];
+        containerPrefix = [containerPrefix substringToIndex:[containerPrefix rangeOfString:@"_" options:NSBackwardsSearch].location + 1];
+        NSURL *directoryURL = [snapshotURL URLByDeletingLastPathComponent];
+        for (NSURL *savedURL in [[NSFileManager defaultManager] contentsOfDirectoryAtURL:directoryURL includingPropertiesForKeys:nil options:0 error:nil]) {
+            if (![[savedURL lastPathComponent] hasPrefix:containerPrefix] || [[savedURL lastPathComponent] isEqualToString:[snapshotURL lastPathComponent]]) continue;
+            
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Discarding metadata snapshot saved for another account: %@", [savedURL lastPathComponent]];
+            [[NSFileManager defaultManager] removeItemAtURL:savedURL error:nil];
+        }
+    }
+    
+    if (![[NSFileManager defaultManager] fileExistsAtPath:[snapshotURL path]]) {
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] No saved metadata snapshot, waiting for the first query pass"];
+        return;
+    }
+    
+    CFAbsoluteTime loadStart = CFAbsoluteTimeGetCurrent();
+    NSError *error = nil;
+    iCloudMetadataSnapshot *snapshot = [[iCloudMetadataSnapshot alloc] initWithContentsOfURL:snapshotURL error:&error];
+    if (!snapshot) {
+        NSLog(@"[iCloud] Discarding saved metadata snapshot: %@", error);
+        [[NSFileManager defaultManager] removeItemAtURL:snapshotURL error:nil];
+        return;
+    }
+    
+    NSMutableArray *downloadedEntries = [NSMutableArray array];
+    @synchronized (self.metadataIndex) {
+        // A live pass which finished first is more recent than anything on disk
+        if (self.metadataIndexGeneration > 0) return;
+        
+        // Seed the index, the first live pass then reconciles against it and reports only the differences
+        for (NSDictionary *entry in snapshot.entries) {
+            NSString *name = entry[iCloudMetadataItemDocumentPathKey];
+            self.metadataIndex[name] = entry;
+            [self.folderIndex addDocumentAtPath:name];
+            if ([entry[NSMetadataUbiquitousItemDownloadingStatusKey] isEqualToString:NSMetadataUbiquitousItemDownloadingStatusCurrent]) [downloadedEntries addObject:entry];
+            
+            // Restored conflicts are shown right away, but only go to the resolver once a live pass confirms them
+            if ([entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] boolValue]) {
+                [self.conflictedNames addObject:name];
+                [self.restoredConflictedNames addObject:name];
+            }
+        }
+        self.conflictedDocumentNames = self.conflictedNames;
+        
+        // The restored snapshot is the published view of the seeded index until the first live pass
+        self.metadataIndexGeneration = snapshot.generation;
+        _metadataSnapshot = snapshot;
+    }
+    
+    [self updateIndexedFolderQueries];
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Restored %lu files from the saved metadata snapshot in %.1fms", (unsigned long)snapshot.count, (CFAbsoluteTimeGetCurrent() - loadStart) * 1000];
+    
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self recordFirstFileListFromSnapshot:snapshot];
+        if ([self.delegate respondsToSelector:@selector(iCloudDidPublishMetadataSnapshot:)])
+            [self.delegate iCloudDidPublishMetadataSnapshot:snapshot];
+        if (downloadedEntries.count > 0 && [self.delegate respondsToSelector:@selector(iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:)])
+            [self.delegate iCloudFilesDidChangeWithInsertedFiles:downloadedEntries updatedFiles:@[] deletedFileNames:@[]];
+    });
+}
+
+- (void)scheduleMetadataSnapshotSave {
+    if (!self.persistsMetadataSnapshot) return;
+    
+    @synchronized (self) {
+        if (self.metadataSnapshotSaveScheduled == YES) return;
+        self.metadataSnapshotSaveScheduled = YES;
+    }
+    
+    __weak __typeof(self) wself=self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(2 * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [wself saveMetadataSnapshot];
+    });
+}
+
+- (void)saveMetadataSnapshot {
+    @synchronized (self) {
+        self.metadataSnapshotSaveScheduled = NO;
+    }
+    
+    // Only full passes describe the whole container
+    iCloudMetadataSnapshot *snapshot = self.metadataSnapshot;
+    NSURL *snapshotURL = [self persistedMetadataSnapshotURL];
+    if (!snapshot.complete || snapshotURL == nil) return;
+    
+    NSError *error = nil;
+    if (![snapshot writeToURL:snapshotURL error:&error]) NSLog(@"[iCloud] Failed to save metadata snapshot: %@", error);
+    else if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Saved metadata snapshot with %lu files", (unsigned long)snapshot.count];
+}
+
+- (void)recordFirstFileListFromSnapshot:(iCloudMetadataSnapshot *)snapshot {
+    if (self.firstFileListDelivered == YES) return;
+    self.firstFileListDelivered = YES;
+    
+    self.timeToFirstFileList = CFAbsoluteTimeGetCurrent() - self.setupTime;
+    [self.telemetry endSpan:self.setupSpan forOperation:iCloudTelemetryOperationFirstFileList];
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] First file list (%@) available %.1fms after setup", snapshot.restored ? @"restored" : @"live", self.timeToFirstFileList * 1000];
+}
+
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+//------------ Query Filter -------------------------------------------------------------------------------------------------------------------//
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+#pragma mark - Query Filter
+
+- (void)setQueryFilter:(iCloudQueryFilter *)queryFilter {
+    @synchronized (self) {
+        _queryFilter = [queryFilter copy];
+    }
+    
+    // Filters assigned before setup are picked up when enumeration starts
+    if (self.documentEnumerationStarted) [self reapplyQueryFilter];
+}
+
+- (iCloudQueryFilter *)queryFilter {
+    @synchronized (self) {
+        return _queryFilter;
+    }
+}
+
+- (iCloudQueryFilter *)compiledQueryFilter {
+    iCloudQueryFilter *filter = [self.queryFilter copy] ?: [[iCloudQueryFilter alloc] init];
+    
+    // The delegate's file extensions apply when the filter does not name its own
+    if (filter.fileExtensions.count == 0 && [self.delegate respondsToSelector:@selector(iCloudQueryLimitedToFileExtensions)]) {
+        NSMutableArray *fileExtensions = [NSMutableArray array];
+        NSCharacterSet *quotes = [NSCharacterSet characterSetWithCharactersInString:@"'\". "];
+        for (id fileExtension in [self.delegate iCloudQueryLimitedToFileExtensions]) {
+            // Extensions used to be formatted straight into the predicate, so they may still be quoted
+            NSString *trimmedExtension = [[fileExtension description] stringByTrimmingCharactersInSet:quotes];
+            if (trimmedExtension.length > 0) [fileExtensions addObject:trimmedExtension];
+        }
+        if (fileExtensions.count > 0) filter.fileExtensions = fileExtensions;
+    }
+    
+    return filter;
+}
+
+- (NSPredicate *)metadataQueryPredicate {
+    // The index, the download scheduler and the conflict resolver need every document, so the filter is never part of the query. NSMetadataQuery does not start without a predicate
+    return [NSPredicate predicateWithFormat:@"%K LIKE '*'", NSMetadataItemFSNameKey];
+}
+
+- (BOOL)isListedEntry:(NSDictionary *)entry filter:(iCloudQueryFilter *)filter {
+    // Only downloaded files which match the filter are part of the file list
+    if (![entry[NSMetadataUbiquitousItemDownloadingStatusKey] isEqualToString:NSMetadataUbiquitousItemDownloadingStatusCurrent]) return NO;
+    return filter == nil || [filter evaluateEntry:entry];
+}
+
+- (void)reapplyQueryFilter {
+    iCloudQueryFilter *filter = [self compiledQueryFilter];
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document query filter has been changed to %@", [filter predicate] ?: @"all documents"];
+    
+    // The index already holds every document, compare the file list under both filters instead of gathering again
+    NSMutableArray *insertedFiles = [NSMutableArray array];
+    NSMutableArray *deletedFileNames = [NSMutableArray array];
+    @synchronized (self.metadataIndex) {
+        iCloudQueryFilter *previousFilter = self.activeQueryFilter;
+        self.activeQueryFilter = filter;
+        
+        [self.metadataIndex enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSDictionary *entry, BOOL *stop) {
+            BOOL wasListed = [self isListedEntry:entry filter:previousFilter];
+            BOOL isListed = [self isListedEntry:entry filter:filter];
+            if (isListed && !wasListed) [insertedFiles addObject:entry];
+            else if (!isListed && wasListed) [deletedFileNames addObject:name];
+        }];
+    }
+    
+    if ([insertedFiles count] == 0 && [deletedFileNames count] == 0) return;
+    
+    // Notify the delegate of the changes on the main thread
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if ([self.delegate respondsToSelector:@selector(iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:)])
+            [self.delegate iCloudFilesDidChangeWithInsertedFiles:insertedFiles updatedFiles:@[] deletedFileNames:deletedFileNames];
+    });
+}
+
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 //------------ Sync ---------------------------------------------------------------------------------------------------------------------------//
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -217,26 +976,33 @@
 
 - (void)enumerateCloudDocuments {
     // Log document enumeration
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Creating metadata query and notifications");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Creating metadata query and notifications"];
+    
+    // Compile the query filter and the delegate's file extensions into a single filter
+    @synchronized (self.metadataIndex) {
+        self.activeQueryFilter = [self compiledQueryFilter];
+    }
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document query filter has been set to %@", [self.activeQueryFilter predicate] ?: @"all documents"];
+    self.documentEnumerationStarted = YES;
     
-    // Request information from the delegate
-    if ([self.delegate respondsToSelector:@selector(iCloudQueryLimitedToFileExtensions)]) {
-        NSArray *fileExt = [self.delegate iCloudQueryLimitedToFileExtensions];
-        if (fileExt != nil && [fileExt count] > 0) self.fileExtension = [[fileExt valueForKey:@"description"] componentsJoinedByString:@","];
-        else self.fileExtension = nil;
+    // Backends which cannot be observed by NSMetadataQuery report their metadata themselves
+    if ([self.fileManager respondsToSelector:@selector(startMetadataUpdatesForDirectoryAtURL:handler:)]) {
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Using metadata updates from the storage backend"];
         
-        // Log file extension
-        NSLog(@"[iCloud] Document query filter has been set to IN { %@ }", self.fileExtension);
-    } else self.fileExtension = nil;
+        __weak __typeof(self) wself=self;
+        [self.fileManager startMetadataUpdatesForDirectoryAtURL:[self ubiquitousDocumentsDirectoryURL] handler:^(NSArray *entries, NSArray *removedNames, BOOL fullPass) {
+            // Reports are coalesced like query notifications, a full pass carries the complete result set and is applied right away
+            [wself scheduleUpdatePassWithEntries:entries removedNames:removedNames fullPass:fullPass endsGathering:fullPass];
+        }];
+        
+        return;
+    }
     
     // Setup iCloud Metadata Query : scope
     [self.query setSearchScopes:@[NSMetadataQueryUbiquitousDocumentsScope]];
     
-    // Setup iCloud Metadata Query : predicate
-    if(self.fileExtension != nil)
-    {
-        [self.query setPredicate:[NSPredicate predicateWithFormat:[NSString stringWithFormat:@"%%K.pathExtension IN { %@ }", self.fileExtension], NSMetadataItemFSNameKey]];
-    }
+    // Setup iCloud Metadata Query : predicate, every document is gathered and the filter is applied when changes are delivered
+    [self.query setPredicate:[self metadataQueryPredicate]];
     
     // Setup iCloud Metadata Query : order by (could be not working on some iOS release)
     NSSortDescriptor *FileNameSortDescriptor = [[NSSortDescriptor alloc] initWithKey:NSMetadataItemFSNameKey ascending:FALSE];
@@ -252,23 +1018,32 @@
     // Notify the responder that the update has completed
 	[self.notificationCenter addObserver:self selector:@selector(endUpdate:) name:NSMetadataQueryDidFinishGatheringNotification object:self.query];
     
-    // Start the query on the main thread
-    dispatch_async(dispatch_get_main_queue(), ^{
+    // Gather results and post notifications on the query's own queue instead of the main run loop (iOS 7.0 and later)
+    NSOperationQueue *startQueue = [NSOperationQueue mainQueue];
+    if ([self.query respondsToSelector:@selector(setOperationQueue:)]) {
+        self.query.operationQueue = self.queryQueue;
+        startQueue = self.queryQueue;
+    } else {
+        self.queryQueue = nil;
+    }
+    
+    // Start the query on its queue
+    [startQueue addOperationWithBlock:^{
         BOOL startedQuery = [self.query startQuery];
         if (!startedQuery) {
             NSLog(@"[iCloud] Failed to start query.");
             return;
         } else {
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Query initialized successfully"); // Log file query success
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Query initialized successfully"]; // Log file query success
         }
-    });
+    }];
 }
 
 - (void)startUpdate:(NSNotification *)notification {
     __weak __typeof(self) wself=self;
     [self.updatesQueue addOperationWithBlock:^{
         // Log file update
-        if (wself.verboseLogging == YES) NSLog(@"[iCloud] Beginning file update with NSMetadataQuery");
+        if (wself.verboseLogging == YES) [wself.telemetry log:@"[iCloud] Beginning file update with NSMetadataQuery"];
         
         // Notify the delegate of the results on the main thread
         dispatch_async(dispatch_get_main_queue(), ^{
@@ -279,40 +1054,150 @@
 }
 
 - (void)recievedUpdate:(NSNotification *)notification {
-    
-    __weak __typeof(self) wself=self;
-    [self.updatesQueue addOperationWithBlock:^{
-        // Log file update
-        if (wself.verboseLogging == YES) NSLog(@"[iCloud] An update has been pushed from iCloud with NSMetadataQuery");
-        
-        // Get the updated files
-        [wself updateFiles];
-    }];
-   
+    // Capture the changed items while still on the query's queue, the items must not be read once the query moves on
+    NSMutableArray *changedEntries = nil;
+    NSMutableArray *removedNames = nil;
+    if (self.incrementalUpdates == YES && notification.userInfo != nil) {
+        changedEntries = [NSMutableArray array];
+        removedNames = [NSMutableArray array];
+        
+        for (NSMetadataItem *item in notification.userInfo[NSMetadataQueryUpdateAddedItemsKey]) [changedEntries addObject:[self metadataEntryForItem:item]];
+        for (NSMetadataItem *item in notification.userInfo[NSMetadataQueryUpdateChangedItemsKey]) [changedEntries addObject:[self metadataEntryForItem:item]];
+        for (NSMetadataItem *item in notification.userInfo[NSMetadataQueryUpdateRemovedItemsKey]) {
+            NSString *documentPath = [self documentPathForURL:[item valueForAttribute:NSMetadataItemURLKey]] ?: [item valueForAttribute:NSMetadataItemFSNameKey];
+            if (documentPath) [removedNames addObject:documentPath];
+        }
+    }
+    
+    // Log file update
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] An update has been pushed from iCloud with NSMetadataQuery"];
+    
+    // Merge the update into the pending pass
+    [self scheduleUpdatePassWithEntries:changedEntries removedNames:removedNames fullPass:(changedEntries == nil) endsGathering:NO];
 }
 
 - (void)endUpdate:(NSNotification *)notification {
+    // The initial gathering is complete, run the pending pass right away
+    [self scheduleUpdatePassWithEntries:nil removedNames:nil fullPass:YES endsGathering:YES];
+}
+
+- (void)scheduleUpdatePassWithEntries:(NSArray *)entries removedNames:(NSArray *)removedNames fullPass:(BOOL)fullPass endsGathering:(BOOL)endsGathering {
+    if (self.coalescingQueue == nil) return;
+    
+    dispatch_async(self.coalescingQueue, ^{
+        if (self.pendingNotificationCount == 0) self.pendingSince = CFAbsoluteTimeGetCurrent();
+        self.pendingNotificationCount++;
+        
+        // A full pass supersedes any incremental changes waiting to be applied. Backends report the complete result set with the pass, a query pass reads the query's results when it runs
+        if (fullPass) {
+            self.pendingFullPass = YES;
+            self.pendingFullPassEntries = entries;
+            [self.pendingEntries removeAllObjects];
+            [self.pendingRemovedNames removeAllObjects];
+        } else if (self.pendingFullPass && self.pendingFullPassEntries == nil) {
+            // The pending query pass picks these changes up from the query
+        } else {
+            for (NSDictionary *entry in entries) {
+                NSString *name = entry[iCloudMetadataItemDocumentPathKey] ?: entry[NSMetadataItemFSNameKey];
+                if (name == nil) continue;
+                self.pendingEntries[name] = entry;
+                [self.pendingRemovedNames removeObject:name];
+            }
+            for (NSString *name in removedNames) {
+                [self.pendingEntries removeObjectForKey:name];
+                [self.pendingRemovedNames addObject:name];
+            }
+        }
+        if (endsGathering) self.pendingGatheringEnd = YES;
+        
+        // Wait for a quiet window, but never longer than the maximum latency since the first pending request
+        NSTimeInterval elapsed = CFAbsoluteTimeGetCurrent() - self.pendingSince;
+        NSTimeInterval delay = MIN(self.updateCoalescingInterval, self.maximumUpdateLatency - elapsed);
+        if (endsGathering || delay <= 0) delay = 0;
+        
+        NSUInteger generation = ++self.coalescingGeneration;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.coalescingQueue, ^{
+            // A newer request rescheduled the pass
+            if (generation != self.coalescingGeneration) return;
+            
+            // A pass is already waiting on the updates queue, it will pick up everything pending when it starts
+            if (self.pendingUpdateOperation != nil) return;
+            
+            __weak __typeof(self) wself=self;
+            self.pendingUpdateOperation = [NSBlockOperation blockOperationWithBlock:^{
+                [wself performPendingUpdatePass];
+            }];
+            [self.updatesQueue addOperation:self.pendingUpdateOperation];
+        });
+    });
+}
+
+- (void)performPendingUpdatePass {
+    __block NSArray *entries = nil;
+    __block NSArray *removedNames = nil;
+    __block BOOL fullPass = NO;
+    __block NSArray *fullPassEntries = nil;
+    __block BOOL endsGathering = NO;
+    __block NSUInteger notificationCount = 0;
+    
+    // Take everything merged so far, later requests start a new pending pass
+    dispatch_sync(self.coalescingQueue, ^{
+        entries = [self.pendingEntries allValues];
+        removedNames = [self.pendingRemovedNames allObjects];
+        fullPass = self.pendingFullPass;
+        fullPassEntries = self.pendingFullPassEntries;
+        endsGathering = self.pendingGatheringEnd;
+        notificationCount = self.pendingNotificationCount;
+        
+        [self.pendingEntries removeAllObjects];
+        [self.pendingRemovedNames removeAllObjects];
+        self.pendingFullPass = NO;
+        self.pendingFullPassEntries = nil;
+        self.pendingGatheringEnd = NO;
+        self.pendingNotificationCount = 0;
+        self.pendingUpdateOperation = nil;
+    });
     
-    __weak __typeof(self) wself=self;
-    [self.updatesQueue addOperationWithBlock:^{
+    if (notificationCount == 0) return;
+    uint64_t span = [self.telemetry beginSpan];
+    self.updatePassCount++;
+    if (notificationCount > 1) self.coalescedUpdateNotificationCount += notificationCount - 1;
+    
+    if (fullPass && fullPassEntries == nil) {
         // Get the updated files
-        [wself updateFiles];
-        
+        [self updateFiles];
+    } else if ([self quickCloudCheck] == YES) {
+        // A backend's full pass replaces the index, then only apply what changed after it
+        if (fullPass) [self applyMetadataEntries:fullPassEntries removedNames:nil replacingIndex:YES];
+        if (!fullPass || entries.count > 0 || removedNames.count > 0) [self applyMetadataEntries:entries removedNames:removedNames replacingIndex:NO];
+    }
+    [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationUpdatePass];
+    
+    if (endsGathering) {
         // Notify the delegate of the results on the main thread
         dispatch_async(dispatch_get_main_queue(), ^{
-            if ([wself.delegate respondsToSelector:@selector(iCloudFileUpdateDidEnd)])
-                [wself.delegate iCloudFileUpdateDidEnd];
+            if ([self.delegate respondsToSelector:@selector(iCloudFileUpdateDidEnd)])
+                [self.delegate iCloudFileUpdateDidEnd];
         });
         
         // Log query completion
-        if (wself.verboseLogging == YES) NSLog(@"[iCloud] Finished file update with NSMetadataQuery");
-    }];
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished file update with NSMetadataQuery"];
+    }
 }
      
 
 - (void)updateFiles {
+    // Never read the query on the main thread, run the pass on the updates queue instead
+    if ([NSThread isMainThread]) {
+        __weak __typeof(self) wself=self;
+        [self.updatesQueue addOperationWithBlock:^{
+            [wself updateFiles];
+        }];
+        return;
+    }
+    
     // Log file update
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Beginning file update with NSMetadataQuery");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Beginning file update with NSMetadataQuery"];
     
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return;
@@ -320,60 +1205,54 @@
     // Initialize the discovered files and file names array
     NSMutableArray *discoveredFiles = [NSMutableArray array];
     NSMutableArray *names = [NSMutableArray array];
-
-    if ([self.query respondsToSelector:@selector(enumerateResultsUsingBlock:)]) {
-        // Code for iOS 7.0 and later
-        
-        // Enumerate through the results
-        [self.query enumerateResultsUsingBlock:^(id result, NSUInteger idx, BOOL *stop) {
-            // Grab the file URL
-            NSURL *fileURL = [result valueForAttribute:NSMetadataItemURLKey];
-            NSString *fileStatus;
-	    NSError *error;
-	    [fileURL getResourceValue:&fileStatus forKey:NSURLUbiquitousItemDownloadingStatusKey error:&error];
-	    if(error){
-		//If failed to get the resource value of the file, the file should not appear in the 'names' list.
-	        if (self.verboseLogging == YES) NSLog(@"[iCloud] Failed to get resource value with error: %@.", error);
-	        return;
-	    }     
-            if ([fileStatus isEqualToString:NSURLUbiquitousItemDownloadingStatusDownloaded]) {
-                // File will be updated soon
-            }
+    NSMutableArray *entries = [NSMutableArray array];
+    iCloudQueryFilter *filter = self.activeQueryFilter;
+
+    // Read the results on the query's queue, where the query cannot mutate them underneath us
+    [self performOnQueryQueueAndWait:^{
+        if ([self.query respondsToSelector:@selector(enumerateResultsUsingBlock:)]) {
+            // Code for iOS 7.0 and later
+        
+            // Enumerate through the results
+            [self.query enumerateResultsUsingBlock:^(id result, NSUInteger idx, BOOL *stop) {
+                // Read the downloading status from the query instead of asking the file system for every item
+                NSDictionary *entry = [self metadataEntryForItem:result];
+                [entries addObject:entry];
             
-            if ([fileStatus isEqualToString:NSURLUbiquitousItemDownloadingStatusCurrent]) {
-                // Add the file metadata and file names to arrays
-                [discoveredFiles addObject:result];
-                [names addObject:[result valueForAttribute:NSMetadataItemFSNameKey]];
-            } else if ([fileStatus isEqualToString:NSURLUbiquitousItemDownloadingStatusNotDownloaded]) {
-                NSError *error;
-                BOOL downloading = [[NSFileManager defaultManager] startDownloadingUbiquitousItemAtURL:fileURL error:&error];
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] %@ started downloading locally, successful? %@", [fileURL lastPathComponent], downloading ? @"YES" : @"NO");
-                if (error) {
-                    if (self.verboseLogging == YES) NSLog(@"[iCloud] Ubiquitous item failed to start downloading with error: %@", error);
+                if ([self isListedEntry:entry filter:filter]) {
+                    // Add the file metadata and file names to arrays
+                    [discoveredFiles addObject:result];
+                    [names addObject:entry[iCloudMetadataItemDocumentPathKey] ?: entry[NSMetadataItemFSNameKey]];
                 }
-            }
-        }];
-    } else {
-        // Code for iOS 6.1 and earlier
+            }];
+        } else {
+            // Code for iOS 6.1 and earlier
         
-        // Disable updates to iCloud while we update to avoid errors
-        [self.query disableUpdates];
+            // Disable updates to iCloud while we update to avoid errors
+            [self.query disableUpdates];
         
-        // Log the query results
-        if (self.verboseLogging == YES) NSLog(@"Query Results: %@", self.query.results);
+            // Log the query results
+            if (self.verboseLogging == YES) [self.telemetry log:@"Query Results: %@", self.query.results];
         
-        // Gather the query results
-        for (NSMetadataItem *result in self.query.results) {
-            [discoveredFiles addObject:result];
-            [names addObject:[result valueForAttribute:NSMetadataItemFSNameKey]];
-        }
+            // Gather the query results
+            for (NSMetadataItem *result in self.query.results) {
+                NSDictionary *entry = [self metadataEntryForItem:result];
+                [entries addObject:entry];
+                if (filter && ![filter evaluateEntry:entry]) continue;
+                [discoveredFiles addObject:result];
+                [names addObject:entry[iCloudMetadataItemDocumentPathKey] ?: entry[NSMetadataItemFSNameKey]];
+            }
         
-        // Log query completion
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Finished file update with NSMetadataQuery");
+            // Log query completion
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished file update with NSMetadataQuery"];
 		
-        // Reenable Updates
-        [self.query enableUpdates];
-    }
+            // Reenable Updates
+            [self.query enableUpdates];
+        }
+    }];
+    
+    // Bring the metadata index in line with the full result set
+    [self applyMetadataEntries:entries removedNames:nil replacingIndex:YES];
     
     // Notify the delegate of the results on the main thread
     dispatch_async(dispatch_get_main_queue(), ^{
@@ -382,15 +1261,262 @@
     });
 }
 
+- (void)performOnQueryQueueAndWait:(void (^)(void))block {
+    if (self.queryQueue == nil || [NSOperationQueue currentQueue] == self.queryQueue) {
+        block();
+        return;
+    }
+    
+    [self.queryQueue addOperations:@[[NSBlockOperation blockOperationWithBlock:block]] waitUntilFinished:YES];
+}
+
+- (NSDictionary *)metadataEntryForItem:(NSMetadataItem *)item {
+    NSMutableDictionary *entry = [[item valuesForAttributes:[iCloudMetadataSnapshot indexedAttributes]] mutableCopy];
+    
+    // Only conflicted documents carry the conflict flag, so entries compare equal to the ones restored from a saved snapshot
+    if (![entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] boolValue]) [entry removeObjectForKey:NSMetadataUbiquitousItemHasUnresolvedConflictsKey];
+    
+    // Key documents by their path so that documents with the same name in different folders stay apart
+    NSString *documentPath = [self documentPathForURL:entry[NSMetadataItemURLKey]] ?: entry[NSMetadataItemFSNameKey];
+    if (documentPath) entry[iCloudMetadataItemDocumentPathKey] = documentPath;
+    
+    return [entry copy];
+}
+
+- (void)applyMetadataEntries:(NSArray *)entries removedNames:(NSArray *)removedNames replacingIndex:(BOOL)replaceIndex {
+    NSMutableArray *insertedFiles = [NSMutableArray array];
+    NSMutableArray *updatedFiles = [NSMutableArray array];
+    NSMutableArray *deletedFileNames = [NSMutableArray array];
+    NSMutableArray *scheduledEntries = [NSMutableArray array];
+    NSMutableArray *unscheduledURLs = [NSMutableArray array];
+    NSMutableArray *conflictedEntries = [NSMutableArray array];
+    BOOL indexIsComplete = NO;
+    
+    @synchronized (self.metadataIndex) {
+        // The index keeps every document, the filter only decides what the delegate is told about
+        iCloudQueryFilter *filter = self.activeQueryFilter;
+        
+        // When replacing the index, anything not present in the new entries has been removed
+        NSMutableSet *staleNames = replaceIndex ? [NSMutableSet setWithArray:[self.metadataIndex allKeys]] : nil;
+        
+        for (NSDictionary *entry in entries) {
+            NSString *name = entry[iCloudMetadataItemDocumentPathKey] ?: entry[NSMetadataItemFSNameKey];
+            if (name == nil) continue;
+            [staleNames removeObject:name];
+            
+            NSDictionary *previousEntry = self.metadataIndex[name];
+            self.metadataIndex[name] = entry;
+            if (previousEntry == nil) [self.folderIndex addDocumentAtPath:name];
+            
+            // Documents which start or stop matching the filter enter or leave the file list
+            NSString *status = entry[NSMetadataUbiquitousItemDownloadingStatusKey];
+            NSString *previousStatus = previousEntry[NSMetadataUbiquitousItemDownloadingStatusKey];
+            BOOL isListed = [self isListedEntry:entry filter:filter];
+            BOOL wasListed = previousEntry != nil && [self isListedEntry:previousEntry filter:filter];
+            
+            if (isListed && !wasListed) [insertedFiles addObject:entry];
+            else if (!isListed && wasListed) [deletedFileNames addObject:name];
+            else if (isListed && ![entry isEqualToDictionary:previousEntry]) [updatedFiles addObject:entry];
+            
+            // Feed downloading status changes and download errors to the scheduler, every full pass reports every file again
+            BOOL errorChanged = entry[NSMetadataUbiquitousItemDownloadingErrorKey] && ![entry[NSMetadataUbiquitousItemDownloadingErrorKey] isEqual:previousEntry[NSMetadataUbiquitousItemDownloadingErrorKey]];
+            if (entry[NSMetadataItemURLKey] && (replaceIndex || errorChanged || ![status isEqualToString:previousStatus])) [scheduledEntries addObject:entry];
+            
+            // Maintain the conflicted set from the same entries, only newly conflicted documents go to the resolver, restored conflicts count as new until a live pass reports them
+            BOOL wasRestoredConflict = [self.restoredConflictedNames containsObject:name];
+            [self.restoredConflictedNames removeObject:name];
+            if ([entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] boolValue]) {
+                if (![self.conflictedNames containsObject:name] || wasRestoredConflict) [conflictedEntries addObject:entry];
+                [self.conflictedNames addObject:name];
+            } else {
+                [self.conflictedNames removeObject:name];
+            }
+        }
+        
+        NSMutableArray *namesToRemove = [NSMutableArray arrayWithArray:removedNames];
+        if (staleNames) [namesToRemove addObjectsFromArray:[staleNames allObjects]];
+        for (NSString *name in namesToRemove) {
+            NSDictionary *previousEntry = self.metadataIndex[name];
+            if (previousEntry == nil) continue;
+            
+            [self.metadataIndex removeObjectForKey:name];
+            [self.folderIndex removeDocumentAtPath:name];
+            [self.conflictedNames removeObject:name];
+            [self.restoredConflictedNames removeObject:name];
+            if (previousEntry[NSMetadataItemURLKey]) [unscheduledURLs addObject:previousEntry[NSMetadataItemURLKey]];
+            if ([self isListedEntry:previousEntry filter:filter]) [deletedFileNames addObject:name];
+        }
+        
+        if (replaceIndex) self.metadataIndexIsWarm = YES;
+        self.conflictedDocumentNames = self.conflictedNames;
+        indexIsComplete = self.metadataIndexIsWarm;
+        
+        // Only count the change, the snapshot is copied from the index the first time it is read afterwards
+        self.metadataIndexGeneration++;
+    }
+    
+    // Folder queries fed by the index pick up the changes
+    [self updateIndexedFolderQueries];
+    
+    // Hand the snapshot to the main thread, passes which pile up before it runs share one copy of the index
+    BOOL delegateWantsSnapshot = [self.delegate respondsToSelector:@selector(iCloudDidPublishMetadataSnapshot:)];
+    if (delegateWantsSnapshot || (indexIsComplete && self.firstFileListDelivered == NO)) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            iCloudMetadataSnapshot *snapshot = self.metadataSnapshot;
+            if (snapshot.complete) [self recordFirstFileListFromSnapshot:snapshot];
+            if ([self.delegate respondsToSelector:@selector(iCloudDidPublishMetadataSnapshot:)])
+                [self.delegate iCloudDidPublishMetadataSnapshot:snapshot];
+        });
+    }
+    
+    // Keep the saved snapshot close to the live one for the next launch
+    if (indexIsComplete) [self scheduleMetadataSnapshotSave];
+    
+    // Let the download scheduler decide which files to download, and when
+    self.downloadScheduler.verboseLogging = self.verboseLogging;
+    self.evictionManager.verboseLogging = self.verboseLogging;
+    for (NSDictionary *entry in scheduledEntries) {
+        [self.downloadScheduler updateItemAtURL:entry[NSMetadataItemURLKey] downloadingStatus:entry[NSMetadataUbiquitousItemDownloadingStatusKey] downloadingError:entry[NSMetadataUbiquitousItemDownloadingErrorKey] fileSize:entry[NSMetadataItemFSSizeKey] modifiedDate:entry[NSMetadataItemFSContentChangeDateKey]];
+    }
+    for (NSURL *fileURL in unscheduledURLs) [self.downloadScheduler removeItemAtURL:fileURL];
+    
+    // Track the local footprint of downloaded files, evicting the least recently used ones when over budget
+    for (NSDictionary *entry in entries) {
+        if (entry[NSMetadataItemURLKey]) [self.evictionManager updateItemAtURL:entry[NSMetadataItemURLKey] downloadingStatus:entry[NSMetadataUbiquitousItemDownloadingStatusKey] fileSize:entry[NSMetadataItemFSSizeKey] modifiedDate:entry[NSMetadataItemFSContentChangeDateKey]];
+    }
+    for (NSURL *fileURL in unscheduledURLs) [self.evictionManager removeItemAtURL:fileURL];
+    
+    // Resolve new conflicts in the background according to the conflict policy
+    [self queueConflictedEntries:conflictedEntries];
+    
+    // Drop open documents which changed or disappeared underneath the pool
+    for (NSDictionary *entry in updatedFiles) [self.documentPool invalidateDocumentWithName:entry[iCloudMetadataItemDocumentPathKey] ?: entry[NSMetadataItemFSNameKey] modifiedDate:entry[NSMetadataItemFSContentChangeDateKey]];
+    for (NSString *name in deletedFileNames) [self.documentPool removeDocumentWithName:name];
+    
+    // Log the changes
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Metadata index updated: %lu inserted, %lu updated, %lu deleted", (unsigned long)[insertedFiles count], (unsigned long)[updatedFiles count], (unsigned long)[deletedFileNames count]];
+    
+    if ([insertedFiles count] == 0 && [updatedFiles count] == 0 && [deletedFileNames count] == 0) return;
+    
+    // Notify the delegate of the changes on the main thread
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if ([self.delegate respondsToSelector:@selector(iCloudFilesDidChangeWithInsertedFiles:updatedFiles:deletedFileNames:)])
+            [self.delegate iCloudFilesDidChangeWithInsertedFiles:insertedFiles updatedFiles:updatedFiles deletedFileNames:deletedFileNames];
+    });
+}
+
+- (iCloudMetadataSnapshot *)metadataSnapshot {
+    if (self.metadataIndex == nil) return _metadataSnapshot;
+    
+    @synchronized (self.metadataIndex) {
+        // Publish lazily, the index is copied once on the first read after a change instead of on every update pass
+        if (_metadataSnapshot == nil || _metadataSnapshot.generation != self.metadataIndexGeneration) {
+            if (self.metadataIndexGeneration == 0) return nil;
+            _metadataSnapshot = [[iCloudMetadataSnapshot alloc] initWithEntriesByDocumentPath:self.metadataIndex generation:self.metadataIndexGeneration complete:self.metadataIndexIsWarm];
+        }
+        return _metadataSnapshot;
+    }
+}
+
+- (NSDictionary *)indexedMetadataForDocumentName:(NSString *)documentName indexIsWarm:(BOOL *)indexIsWarm {
+    // Look the entry up in the index itself, a single lookup never makes a copy of the whole index
+    @synchronized (self.metadataIndex) {
+        *indexIsWarm = self.metadataIndexIsWarm;
+        return self.metadataIndex[documentName];
+    }
+}
+
+- (void)moveIndexedDocuments:(NSDictionary *)newNames {
+    NSMutableArray *movedEntries = [NSMutableArray array];
+    NSMutableArray *removedNames = [NSMutableArray array];
+    
+    @synchronized (self.metadataIndex) {
+        for (NSString *documentName in newNames) {
+            // Index keys are document paths, normalise the name the same way the query does
+            NSString *documentPath = [self documentPathForURL:[self URLForDocumentPath:documentName]] ?: documentName;
+            NSDictionary *entry = self.metadataIndex[documentPath];
+            if (entry == nil) continue;
+            [removedNames addObject:documentPath];
+            
+            NSString *newName = (newNames[documentName] == [NSNull null]) ? nil : newNames[documentName];
+            if (newName.length == 0) continue;
+            
+            // The renamed document keeps its attributes under its new path, the next query pass refreshes them
+            NSURL *newURL = [self URLForDocumentPath:newName];
+            NSMutableDictionary *movedEntry = [entry mutableCopy];
+            movedEntry[NSMetadataItemURLKey] = newURL;
+            movedEntry[NSMetadataItemFSNameKey] = [newURL lastPathComponent];
+            movedEntry[iCloudMetadataItemDocumentPathKey] = [self documentPathForURL:newURL] ?: newName;
+            [movedEntries addObject:[movedEntry copy]];
+        }
+    }
+    
+    if ([removedNames count] == 0) return;
+    [self applyMetadataEntries:movedEntries removedNames:removedNames replacingIndex:NO];
+}
+
+
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+//------------ Cancellation -------------------------------------------------------------------------------------------------------------------//
+//---------------------------------------------------------------------------------------------------------------------------------------------//
+#pragma mark - Cancellation
+
+- (NSProgress *)documentOperationProgress {
+    NSProgress *progress = [NSProgress progressWithTotalUnitCount:1];
+    progress.cancellable = YES;
+    progress.pausable = NO;
+    return progress;
+}
+
+- (NSError *)cancellationErrorForDocumentName:(NSString *)documentName {
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:@{@"FileName": documentName ?: @""}];
+}
+
+- (NSError *)exceptionErrorForDocumentName:(NSString *)documentName exception:(NSException *)exception {
+    return [NSError errorWithDomain:[NSString stringWithFormat:@"An exception was caught while working on the document, %@: %@", documentName, exception.reason] code:500 userInfo:@{@"FileName": documentName ?: @""}];
+}
+
+- (void)forwardCancellationOfProgress:(NSProgress *)progress toProgress:(NSProgress *)operationProgress {
+    if (progress.isCancelled) [operationProgress cancel];
+    else progress.cancellationHandler = ^{
+        [operationProgress cancel];
+    };
+}
 
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 //------------ Write --------------------------------------------------------------------------------------------------------------------------//
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 #pragma mark - Write
 
-- (void)saveAndCloseDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+- (NSProgress *)saveAndCloseDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+    NSProgress *progress = [self documentOperationProgress];
+    
+    // A direct save supersedes buffered changes, it is written in their place and reported to their handlers as well. While a buffered write is in flight it goes through the buffer too, so it is written after that write lands instead of alongside it
+    if (documentName.length > 0 && content && [self.writeBehindBuffer hasPendingWritesForDocumentWithName:documentName]) {
+        [self.writeBehindBuffer bufferContent:content forDocumentWithName:documentName completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+            progress.completedUnitCount = progress.totalUnitCount;
+            if (handler) handler(cloudDocument, documentData, error);
+        }];
+        [self.writeBehindBuffer flushDocumentWithName:documentName completion:nil];
+        return progress;
+    }
+    
+    [self writeDocumentWithName:documentName content:content progress:progress completion:handler];
+    return progress;
+}
+
+- (void)writeDocumentWithName:(NSString *)documentName content:(NSData *)content progress:(NSProgress *)progress completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+    // Time the save until the handler is called
+    uint64_t span = [self.telemetry beginSpan];
+    void (^timedHandler)(UIDocument *, NSData *, NSError *) = handler;
+    handler = ^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationSave];
+        if (timedHandler) timedHandler(cloudDocument, documentData, error);
+    };
+    
     // Log save
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Beginning document save");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Beginning document save"];
     
     // Don't Check for iCloud... we need to save the file
     // regardless of being connected so that the saved file
@@ -399,7 +1525,7 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be saved. Specify a document name next time." code:001 userInfo:nil];
         
         handler(nil, nil, error);
@@ -407,230 +1533,473 @@
         return;
     }
     
+    // Saves made while iCloud is unavailable are written locally now and uploaded once it is available
+    if ([self quickCloudCheck] == NO) [self journalOfflineOperation:iCloudJournalOperationSave documentPath:documentName destinationPath:nil completion:nil];
+    
     // Get the URL to save the new file to
-    NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+    NSURL *fileURL = [self URLForDocumentPath:documentName];
     
-    // Initialize a document with that path
-    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
-    document.contents = content;
-    [document updateChangeCount:UIDocumentChangeDone];
+    [self.evictionManager recordAccessToItemAtURL:fileURL];
     
-    if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
-		// The document did not exist and is being saved for the first time.
-		
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Document exists; overwriting, saving and closing");
-        // Save and create the new document, then close it
-        [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForOverwriting completionHandler:^(BOOL success) {
-            if (success) {
-				// Save and close the document
-				[document closeWithCompletionHandler:^(BOOL closeSuccess) {
-					if (closeSuccess) {
-						// Log
-						if (self.verboseLogging == YES) NSLog(@"[iCloud] Written, saved and closed document");
-						
-						handler(document, document.contents, nil);
-					} else {
-						NSLog(@"[iCloud] Error while saving document: %s", __PRETTY_FUNCTION__);
-						NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while saving the document, %@, to iCloud", __PRETTY_FUNCTION__, document.fileURL] code:110 userInfo:@{@"FileURL": fileURL}];
-						
-						handler(document, document.contents, error);
-					}
-				}];
-				
-			} else {
-                NSLog(@"[iCloud] Error while writing to the document: %s", __PRETTY_FUNCTION__);
-                NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while writing to the document, %@, in iCloud", __PRETTY_FUNCTION__, document.fileURL] code:100 userInfo:@{@"FileURL": fileURL}];
+    dispatch_block_t writeDocument = ^{
+        if (progress.isCancelled) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Save of %@ was cancelled before it started", documentName];
+            handler(nil, nil, [self cancellationErrorForDocumentName:documentName]);
+            return;
+        }
+        
+        // Initialize a document with that path
+        iCloudDocument *document = [self documentForFileURL:fileURL];
+        document.contents = content;
+        [document updateChangeCount:UIDocumentChangeDone];
+    
+        if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
+			// The document did not exist and is being saved for the first time.
+			
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document exists; overwriting, saving and closing"];
+            // Save and create the new document, then close it
+            [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForOverwriting completionHandler:^(BOOL success) {
+                if (success) {
+					// Save and close the document
+					[document closeWithCompletionHandler:^(BOOL closeSuccess) {
+						if (closeSuccess) {
+							// Log
+							if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Written, saved and closed document"];
+							
+							handler(document, document.contents, nil);
+						} else {
+							NSLog(@"[iCloud] Error while saving document: %s", __PRETTY_FUNCTION__);
+							NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while saving the document, %@, to iCloud", __PRETTY_FUNCTION__, document.fileURL] code:110 userInfo:@{@"FileURL": fileURL}];
+							
+							handler(document, document.contents, error);
+						}
+					}];
+					
+				} else {
+                    NSLog(@"[iCloud] Error while writing to the document: %s", __PRETTY_FUNCTION__);
+                    NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while writing to the document, %@, in iCloud", __PRETTY_FUNCTION__, document.fileURL] code:100 userInfo:@{@"FileURL": fileURL}];
                 
-                handler(document, document.contents, error);
-            }
-		}];
-    } else {
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Document is new; creating, saving and then closing");
-        
-        // The document is being saved by overwriting the current version, then closed.
-        [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForCreating completionHandler:^(BOOL success) {
-            if (success) {
-                // Saving implicitly opens the file
-                [document closeWithCompletionHandler:^(BOOL closeSuccess) {
-                    if (closeSuccess) {
-                        // Log the save and close
-                        if (self.verboseLogging == YES) NSLog(@"[iCloud] New document created, saved and closed successfully");
+                    handler(document, document.contents, error);
+                }
+			}];
+        } else {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document is new; creating, saving and then closing"];
+        
+            // Documents may be saved into folders which do not exist yet
+            [self createParentFoldersForURL:fileURL error:nil];
+            
+            // The document is being saved by overwriting the current version, then closed.
+            [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForCreating completionHandler:^(BOOL success) {
+                if (success) {
+                    // Saving implicitly opens the file
+                    [document closeWithCompletionHandler:^(BOOL closeSuccess) {
+                        if (closeSuccess) {
+                            // Log the save and close
+                            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] New document created, saved and closed successfully"];
                         
-                        handler(document, document.contents, nil);
-                    } else {
-                        NSLog(@"[iCloud] Error while saving and closing document: %s", __PRETTY_FUNCTION__);
-                        NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while saving the document, %@, to iCloud", __PRETTY_FUNCTION__, document.fileURL] code:110 userInfo:@{@"FileURL": fileURL}];
+                            handler(document, document.contents, nil);
+                        } else {
+                            NSLog(@"[iCloud] Error while saving and closing document: %s", __PRETTY_FUNCTION__);
+                            NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while saving the document, %@, to iCloud", __PRETTY_FUNCTION__, document.fileURL] code:110 userInfo:@{@"FileURL": fileURL}];
                         
-                        handler(document, document.contents, error);
-                    }
-                }];
+                            handler(document, document.contents, error);
+                        }
+                    }];
                 
                 
-            } else {
-                NSLog(@"[iCloud] Error while creating the document: %s", __PRETTY_FUNCTION__);
-                NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while creating the document, %@, in iCloud", __PRETTY_FUNCTION__, document.fileURL] code:100 userInfo:@{@"FileURL": fileURL}];
+                } else {
+                    NSLog(@"[iCloud] Error while creating the document: %s", __PRETTY_FUNCTION__);
+                    NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while creating the document, %@, in iCloud", __PRETTY_FUNCTION__, document.fileURL] code:100 userInfo:@{@"FileURL": fileURL}];
                 
-                handler(document, document.contents, error);
-            }
-        }];
+                    handler(document, document.contents, error);
+                }
+            }];
+        }
+    };
+    
+    // Without a pooled copy the write starts right away, as it always has. A pooled copy is about to be overwritten and closing it saves its own changes, so then the write waits on the main queue until it is closed
+    [self.documentPool removeDocumentWithName:documentName completion:writeDocument];
+}
+
+- (void)saveChangesToDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+    // Without the write-behind buffer every change is a full save and close, just like saveAndCloseDocumentWithName
+    if (self.writeBehindBuffer.enabled == NO || documentName.length == 0 || content == nil) {
+        [self saveAndCloseDocumentWithName:documentName withContent:content completion:handler];
+        return;
     }
+    
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Buffering changes to document, %@", documentName];
+    [self.writeBehindBuffer bufferContent:content forDocumentWithName:documentName completion:handler];
 }
 
-- (void)uploadLocalOfflineDocumentsWithRepeatingHandler:(void (^)(NSString *documentName, NSError *error))repeatingHandler completion:(void (^)(void))completion {
-    // Log upload
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Beginning local file upload to iCloud. This process may take a long time.");
+- (NSProgress *)saveAndCloseDocumentsWithContents:(NSDictionary *)documents completion:(void (^)(NSDictionary *errors))handler {
+    // Log save
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Beginning batch save of %lu documents", (unsigned long)[documents count]];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return;
+    NSProgress *progress = [NSProgress progressWithTotalUnitCount:[documents count]];
+    NSMutableDictionary *errors = [NSMutableDictionary dictionary];
+    NSArray *documentNames = [documents allKeys];
     
-    // Perform tasks on background thread to avoid problems on the main / UI thread
+    // Each slot is one save-and-close cycle in flight
+    dispatch_semaphore_t slots = dispatch_semaphore_create(MAX(self.maximumConcurrentDocumentOperations, (NSUInteger)1));
+    dispatch_group_t group = dispatch_group_create();
+    
+    // Schedule the saves on a background thread so that waiting for a free slot never blocks the main thread
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0ul), ^{
-        // Get the array of files in the documents directory
-        NSString *documentsDirectory = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES)[0];
-        NSArray *localDocuments = [self.fileManager contentsOfDirectoryAtPath:documentsDirectory error:nil];
-        
-        // Log local files
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Files stored locally available for uploading: %@", localDocuments);
-        
-        // Compare the arrays then upload documents not already existent in iCloud
-        for (NSUInteger item = 0; item < [localDocuments count]; item++) {
+        for (NSString *documentName in documentNames) {
+            dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
             
-            // Check to make sure the documents aren't hidden
-            if (![localDocuments[item] hasPrefix:@"."]) {
-                
-                // If the file does not exist in iCloud, upload it
-                if (![self.previousQueryResults containsObject:localDocuments[item]]) {
-                    // Log
-                    if (self.verboseLogging == YES) NSLog(@"[iCloud] Uploading %@ to iCloud (%lu out of %lu)", localDocuments[item], (unsigned long)item, (unsigned long)[localDocuments count]);
-                    
-                    // Move the file to iCloud
-                    NSURL *cloudURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:localDocuments[item]];
-                    NSURL *localURL = [NSURL fileURLWithPath:[documentsDirectory stringByAppendingPathComponent:localDocuments[item]]];
-                    NSError *error;
-                    
-                    BOOL success = [self.fileManager setUbiquitous:YES itemAtURL:localURL destinationURL:cloudURL error:&error];
-                    if (success == NO) {
-                        NSLog(@"[iCloud] Error while uploading document from local directory: %@",error);
-                        dispatch_async(dispatch_get_main_queue(), ^{
-                            repeatingHandler(localDocuments[item], error);
-                        });
-                    } else {
-                        dispatch_async(dispatch_get_main_queue(), ^{
-                            repeatingHandler(localDocuments[item], nil);
-                        });
+            if (progress.isCancelled) {
+                // Report every document that was never started
+                dispatch_semaphore_signal(slots);
+                @synchronized (errors) {
+                    errors[documentName] = [self cancellationErrorForDocumentName:documentName];
+                }
+                progress.completedUnitCount++;
+                continue;
+            }
+            
+            dispatch_group_enter(group);
+            NSData *content = documents[documentName];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self saveAndCloseDocumentWithName:documentName withContent:content completion:^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+                    if (error) {
+                        @synchronized (errors) {
+                            errors[documentName] = error;
+                        }
                     }
                     
-                } else {
-                    // Check if the local document is newer than the cloud document
-                    
-                    // Log conflict
-                    if (self.verboseLogging == YES) NSLog(@"[iCloud] Conflict between local file and remote file, attempting to automatically resolve");
-                    
-                    // Get the file URL for the iCloud document
-                    NSURL *cloudFileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:localDocuments[item]];
-                    NSURL *localFileURL = [NSURL fileURLWithPath:[documentsDirectory stringByAppendingPathComponent:localDocuments[item]]];
-                    
-                    // Create the UIDocument object from the URL
-                    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:cloudFileURL];
-                    NSDate *cloudModDate = document.fileModificationDate;
-                    
-                    NSDictionary *fileAttributes = [self.fileManager attributesOfItemAtPath:[localFileURL absoluteString] error:nil];
-                    NSDate *localModDate = [fileAttributes fileModificationDate];
-                    NSData *localFileData = [self.fileManager contentsAtPath:[localFileURL absoluteString]];
-                    
-                    if ([cloudModDate compare:localModDate] == NSOrderedDescending) {
-                        NSLog(@"[iCloud] The iCloud file was modified more recently than the local file. The local file will be deleted and the iCloud file will be preserved.");
-                        NSError *error;
-                        
-                        if (![self.fileManager removeItemAtPath:[localFileURL absoluteString] error:&error]) {
-                            NSLog(@"[iCloud] Error deleting %@.\n\n%@", [localFileURL absoluteString], error);
-                        }
-                    } else if ([cloudModDate compare:localModDate] == NSOrderedAscending) {
-                        NSLog(@"[iCloud] The local file was modified more recently than the iCloud file. The iCloud file will be overwritten with the contents of the local file.");
-                        // Set the document's new content
-                        document.contents = localFileData;
-                        
-                        dispatch_async(dispatch_get_main_queue(), ^{
-                            // Save and close the document in iCloud
-                            [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForOverwriting completionHandler:^(BOOL success) {
-                                if (success) {
-                                    // Close the document
-                                    [document closeWithCompletionHandler:^(BOOL closeSuccess) {
-                                        repeatingHandler(localDocuments[item], nil);
-                                    }];
-                                } else {
-                                    NSLog(@"[iCloud] Error while overwriting old iCloud file: %s", __PRETTY_FUNCTION__);
-                                    NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while saving the document, %@, to iCloud", __PRETTY_FUNCTION__, document.fileURL] code:110 userInfo:@{@"FileName": localDocuments[item]}];
-                                    
-                                    repeatingHandler(localDocuments[item], error);
-                                }
-                            }];
-                        });
-                    } else {
-                        NSLog(@"[iCloud] The local file and iCloud file have the same modification date. Before overwriting or deleting, iCloud Document Sync will check if both files have the same content.");
-                        if ([self.fileManager contentsEqualAtPath:[cloudFileURL absoluteString] andPath:[localFileURL absoluteString]] == YES) {
-                            NSLog (@"[iCloud] The contents of the local file and the contents of the iCloud file match. The local file will be deleted.");
-                            NSError *error;
-                            
-                            if (![self.fileManager removeItemAtPath:[localFileURL absoluteString] error:&error]) {
-                                NSLog(@"[iCloud] Error deleting %@.\n\n%@", [localFileURL absoluteString], error);
-                            }
-                        } else {
-                            NSLog(@"[iCloud] Both the iCloud file and the local file were last modified at the same time, however their contents do not match. You'll need to handle the conflict using the iCloudFileConflictBetweenCloudFile:andLocalFile: delegate method.");
-                            NSDictionary *cloudFile = @{@"fileContents": document.contents, @"fileURL": cloudFileURL, @"modifiedDate": cloudModDate};
-                            NSDictionary *localFile = @{@"fileContents": localFileData, @"fileURL": localFileURL, @"modifiedDate": localModDate};;
-                            
-                            if ([self.delegate respondsToSelector:@selector(iCloudFileUploadConflictWithCloudFile:andLocalFile:)]) {
-                                [self.delegate iCloudFileConflictBetweenCloudFile:cloudFile andLocalFile:localFile];
-                            } else if ([self.delegate respondsToSelector:@selector(iCloudFileUploadConflictWithCloudFile:andLocalFile:)]) {
-                                NSLog(@"[iCloud] WARNING: iCloudFileUploadConflictWithCloudFile:andLocalFile is deprecated and will become unavailable in a future version. Use iCloudFileConflictBetweenCloudFile:andLocalFile instead.");
+                    progress.completedUnitCount++;
+                    dispatch_semaphore_signal(slots);
+                    dispatch_group_leave(group);
+                }];
+            });
+        }
+        
+        dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+            // Log completion
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished batch save, %lu of %lu documents failed", (unsigned long)[errors count], (unsigned long)[documentNames count]];
+            
+            if (handler) handler(errors);
+        });
+    });
+    
+    return progress;
+}
+
+- (void)uploadLocalOfflineDocumentsWithRepeatingHandler:(void (^)(NSString *documentName, NSError *error))repeatingHandler completion:(void (^)(void))completion {
+    [self uploadLocalOfflineDocumentsWithRepeatingHandler:repeatingHandler report:^(NSDictionary *report) {
+        if (completion)
+            completion();
+    }];
+}
+
+- (NSProgress *)uploadLocalOfflineDocumentsWithRepeatingHandler:(void (^)(NSString *documentName, NSError *error))repeatingHandler report:(void (^)(NSDictionary *report))completion {
+    // Log upload
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Beginning local file upload to iCloud. This process may take a long time."];
+    
+    // Check for iCloud, there is nowhere to upload to but the caller still gets its report and a finished progress
+    if ([self quickCloudCheck] == NO) {
+        NSProgress *progress = [NSProgress progressWithTotalUnitCount:1];
+        progress.completedUnitCount = 1;
+        
+        NSError *error = [NSError errorWithDomain:@"iCloud is not available, no local documents were uploaded" code:503 userInfo:nil];
+        NSDictionary *report = @{@"uploaded": @0, @"replacedInCloud": @0, @"removedLocally": @0, @"conflicts": @0, @"hidden": @0, @"failed": @0, @"cancelled": @0, @"duration": @0, @"error": error};
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (completion) completion(report);
+        });
+        return progress;
+    }
+    
+    NSProgress *progress = [NSProgress progressWithTotalUnitCount:-1];
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    
+    // Resolve both directories once for the whole run
+    NSURL *localDirectory = [NSURL fileURLWithPath:NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES)[0] isDirectory:YES];
+    NSURL *cloudDirectory = [self ubiquitousDocumentsDirectoryURL];
+    
+    // Every stage runs on its own queue with bounded parallelism, so a slow content comparison never holds up metadata checks or moves
+    NSUInteger concurrency = MAX(self.maximumConcurrentDocumentOperations, (NSUInteger)1);
+    NSOperationQueue *metadataQueue = [NSOperationQueue new];
+    NSOperationQueue *contentQueue = [NSOperationQueue new];
+    NSOperationQueue *transferQueue = [NSOperationQueue new];
+    NSArray *stageQueues = @[metadataQueue, contentQueue, transferQueue];
+    for (NSOperationQueue *queue in stageQueues) queue.maxConcurrentOperationCount = concurrency;
+    progress.cancellationHandler = ^{
+        for (NSOperationQueue *queue in stageQueues) [queue cancelAllOperations];
+    };
+    
+    // Bytes read or copied at any one time are capped, a single file larger than the cap is still allowed through on its own
+    NSCondition *byteGate = [NSCondition new];
+    __block unsigned long long bytesInFlight = 0;
+    unsigned long long byteLimit = MAX(self.maximumUploadBytesInFlight, 1ULL);
+    void (^acquireBytes)(unsigned long long) = ^(unsigned long long bytes) {
+        [byteGate lock];
+        while (bytesInFlight > 0 && bytesInFlight + bytes > byteLimit) [byteGate wait];
+        bytesInFlight += bytes;
+        [byteGate unlock];
+    };
+    void (^releaseBytes)(unsigned long long) = ^(unsigned long long bytes) {
+        [byteGate lock];
+        bytesInFlight -= bytes;
+        [byteGate broadcast];
+        [byteGate unlock];
+    };
+    
+    // The summary report counts the outcome of every local file
+    NSMutableDictionary *report = [@{@"uploaded": @0, @"replacedInCloud": @0, @"removedLocally": @0, @"conflicts": @0, @"hidden": @0, @"failed": @0, @"cancelled": @0} mutableCopy];
+    dispatch_group_t items = dispatch_group_create();
+    
+    void (^finishItem)(NSString *, NSString *, NSError *) = ^(NSString *documentName, NSString *outcome, NSError *error) {
+        @synchronized (report) {
+            report[outcome] = @([report[outcome] unsignedIntegerValue] + 1);
+        }
+        progress.completedUnitCount++;
+        
+        if (![outcome isEqualToString:@"cancelled"]) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                repeatingHandler(documentName, error);
+            });
+        }
+        dispatch_group_leave(items);
+    };
+    
+    void (^enqueueStage)(NSOperationQueue *, NSDictionary *, void (^)(NSDictionary *)) = ^(NSOperationQueue *queue, NSDictionary *item, void (^stage)(NSDictionary *)) {
+        __block BOOL executed = NO;
+        NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+            executed = YES;
+            
+            // Stop at the stage boundary once the upload has been cancelled
+            if (progress.isCancelled) finishItem(item[@"name"], @"cancelled", nil);
+            else stage(item);
+        }];
+        operation.completionBlock = ^{
+            // Operations cancelled before they started never ran their stage
+            if (executed == NO) finishItem(item[@"name"], @"cancelled", nil);
+        };
+        [queue addOperation:operation];
+    };
+    
+    // Stage 4: move the local file into iCloud, replace the iCloud file, or remove the redundant local copy
+    void (^transfer)(NSDictionary *) = ^(NSDictionary *item) {
+        NSString *outcome = item[@"outcome"];
+        NSURL *localURL = item[@"localURL"];
+        NSURL *cloudURL = item[@"cloudURL"];
+        NSError *error;
+        BOOL success = NO;
+        
+        if ([outcome isEqualToString:@"uploaded"]) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Uploading %@ to iCloud", item[@"name"]];
+            success = [self.fileManager setUbiquitous:YES itemAtURL:localURL destinationURL:cloudURL error:&error];
+        } else if ([outcome isEqualToString:@"replacedInCloud"]) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The local file, %@, was modified more recently than the iCloud file. The iCloud file will be overwritten with the contents of the local file.", item[@"name"]];
+            unsigned long long bytes = [item[@"localSize"] unsignedLongLongValue];
+            acquireBytes(bytes);
+            success = [self replaceCloudItemAtURL:cloudURL withContentsOfLocalItemAtURL:localURL error:&error];
+            releaseBytes(bytes);
+        } else {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The iCloud file, %@, is newer than or identical to the local file. The local file will be deleted.", item[@"name"]];
+            success = [self.fileManager removeItemAtURL:localURL error:&error];
+        }
+        
+        if (success == NO) NSLog(@"[iCloud] Error while uploading document from local directory: %@", error);
+        finishItem(item[@"name"], success ? outcome : @"failed", success ? nil : error);
+    };
+    
+    // Stage 3: compare contents when both files claim the same modification date
+    void (^compareContents)(NSDictionary *) = ^(NSDictionary *item) {
+        NSURL *localURL = item[@"localURL"];
+        NSURL *cloudURL = item[@"cloudURL"];
+        unsigned long long bytes = [item[@"localSize"] unsignedLongLongValue];
+        
+        // Files of different sizes can never match, so only read them when the sizes agree
+        BOOL contentsMatch = NO;
+        if (bytes == [item[@"cloudSize"] unsignedLongLongValue]) {
+            acquireBytes(bytes * 2);
+            contentsMatch = [self.contentHashCache contentsEqualAtURL:localURL andURL:cloudURL];
+            releaseBytes(bytes * 2);
+        }
+        
+        if (contentsMatch == YES) {
+            NSMutableDictionary *next = [item mutableCopy];
+            next[@"outcome"] = @"removedLocally";
+            enqueueStage(transferQueue, next, transfer);
+            return;
+        }
+        
+        NSLog(@"[iCloud] Both the iCloud file and the local file, %@, were last modified at the same time, however their contents do not match. You'll need to handle the conflict using the iCloudFileConflictBetweenCloudFile:andLocalFile: delegate method.", item[@"name"]);
+        
+        // Map rather than read both files, the delegate may never touch the bytes
+        NSData *cloudData = [NSData dataWithContentsOfURL:cloudURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
+        NSData *localData = [NSData dataWithContentsOfURL:localURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
+        NSDictionary *cloudFile = @{@"fileContents": cloudData, @"fileURL": cloudURL, @"modifiedDate": item[@"cloudDate"]};
+        NSDictionary *localFile = @{@"fileContents": localData, @"fileURL": localURL, @"modifiedDate": item[@"localDate"]};
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if ([self.delegate respondsToSelector:@selector(iCloudFileConflictBetweenCloudFile:andLocalFile:)]) {
+                [self.delegate iCloudFileConflictBetweenCloudFile:cloudFile andLocalFile:localFile];
+            } else if ([self.delegate respondsToSelector:@selector(iCloudFileUploadConflictWithCloudFile:andLocalFile:)]) {
+                NSLog(@"[iCloud] WARNING: iCloudFileUploadConflictWithCloudFile:andLocalFile is deprecated and will become unavailable in a future version. Use iCloudFileConflictBetweenCloudFile:andLocalFile instead.");
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
-                                [self.delegate iCloudFileUploadConflictWithCloudFile:cloudFile andLocalFile:localFile];
+                [self.delegate iCloudFileUploadConflictWithCloudFile:cloudFile andLocalFile:localFile];
 #pragma clang diagnostic pop
-                            }
-                        }
-                    }
-                }
-            } else {
-                // The file is hidden, do not proceed
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    NSError *error = [[NSError alloc] initWithDomain:@"File in directory is hidden and will not be uploaded to iCloud." code:520 userInfo:@{@"FileName": localDocuments[item]}];
-                    repeatingHandler(localDocuments[item], error);
-                });
             }
+        });
+        
+        [self.telemetry incrementCounterForOperation:iCloudTelemetryOperationConflict];
+        finishItem(item[@"name"], @"conflicts", nil);
+    };
+    
+    // Stage 2: compare the local metadata with what iCloud knows about the same file
+    void (^compareMetadata)(NSDictionary *) = ^(NSDictionary *item) {
+        NSMutableDictionary *next = [item mutableCopy];
+        NSURL *cloudURL = item[@"cloudURL"];
+        
+        // Prefer the metadata index, only stat the iCloud file while the index is cold
+        BOOL indexIsWarm = NO;
+        NSDictionary *entry = [self indexedMetadataForDocumentName:item[@"name"] indexIsWarm:&indexIsWarm];
+        if (indexIsWarm == NO) {
+            NSDictionary *attributes = [self.fileManager attributesOfItemAtPath:[cloudURL path] error:nil];
+            if (attributes) entry = @{NSMetadataItemFSSizeKey: @([attributes fileSize]), NSMetadataItemFSContentChangeDateKey: [attributes fileModificationDate]};
         }
         
-        // Log completion
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Finished uploading all local files to iCloud");
+        if (entry == nil) {
+            // The file does not exist in iCloud, upload it
+            next[@"outcome"] = @"uploaded";
+            enqueueStage(transferQueue, next, transfer);
+            return;
+        }
         
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (completion)
-                completion();
+        NSDate *cloudDate = entry[NSMetadataItemFSContentChangeDateKey] ?: [NSDate distantPast];
+        next[@"cloudDate"] = cloudDate;
+        next[@"cloudSize"] = entry[NSMetadataItemFSSizeKey] ?: @0;
+        
+        NSComparisonResult order = [cloudDate compare:item[@"localDate"]];
+        if (order == NSOrderedDescending) {
+            next[@"outcome"] = @"removedLocally";
+            enqueueStage(transferQueue, next, transfer);
+        } else if (order == NSOrderedAscending) {
+            next[@"outcome"] = @"replacedInCloud";
+            enqueueStage(transferQueue, next, transfer);
+        } else {
+            enqueueStage(contentQueue, next, compareContents);
+        }
+    };
+    
+    // Stage 1: scan the local documents directory, prefetching the attributes every later stage needs
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0ul), ^{
+        NSArray *localDocuments = [self.fileManager contentsOfDirectoryAtURL:localDirectory includingPropertiesForKeys:@[NSURLFileSizeKey, NSURLContentModificationDateKey] options:0 error:nil];
+        progress.totalUnitCount = [localDocuments count];
+        
+        // Log local files
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] %lu files stored locally available for uploading", (unsigned long)[localDocuments count]];
+        
+        for (NSURL *localURL in localDocuments) {
+            NSString *documentName = [localURL lastPathComponent];
+            dispatch_group_enter(items);
+            
+            if (progress.isCancelled) {
+                finishItem(documentName, @"cancelled", nil);
+                continue;
+            }
+            
+            // Check to make sure the documents aren't hidden
+            if ([documentName hasPrefix:@"."]) {
+                NSError *error = [[NSError alloc] initWithDomain:@"File in directory is hidden and will not be uploaded to iCloud." code:520 userInfo:@{@"FileName": documentName}];
+                finishItem(documentName, @"hidden", error);
+                continue;
+            }
+            
+            NSNumber *localSize;
+            NSDate *localDate;
+            [localURL getResourceValue:&localSize forKey:NSURLFileSizeKey error:nil];
+            [localURL getResourceValue:&localDate forKey:NSURLContentModificationDateKey error:nil];
+            
+            NSDictionary *item = @{@"name": documentName, @"localURL": localURL, @"cloudURL": [cloudDirectory URLByAppendingPathComponent:documentName], @"localSize": localSize ?: @0, @"localDate": localDate ?: [NSDate distantPast]};
+            enqueueStage(metadataQueue, item, compareMetadata);
+        }
+        
+        dispatch_group_notify(items, dispatch_get_main_queue(), ^{
+            report[@"duration"] = @(CFAbsoluteTimeGetCurrent() - startTime);
+            
+            // Log completion
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished uploading all local files to iCloud: %@", report];
+            
+            // Keep the digests computed during this run for the next one
+            [self.contentHashCache synchronize];
+            
+            if (completion) completion([report copy]);
         });
     });
+    
+    return progress;
 }
 
-- (void)uploadLocalDocumentToCloudWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler {
+- (BOOL)replaceCloudItemAtURL:(NSURL *)cloudURL withContentsOfLocalItemAtURL:(NSURL *)localURL error:(NSError **)error {
+    __block BOOL success = NO;
+    __block NSError *replaceError = nil;
+    NSError *coordinatorError = nil;
+    
+    // Copy the local file aside and swap it in, the local file is left untouched and never read into memory
+    NSFileCoordinator *coordinator = [self.fileManager fileCoordinatorWithFilePresenter:nil];
+    [coordinator coordinateWritingItemAtURL:cloudURL options:NSFileCoordinatorWritingForReplacing error:&coordinatorError byAccessor:^(NSURL *writingURL) {
+        NSURL *temporaryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory() isDirectory:YES] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+        NSError *accessorError;
+        
+        if ([self.fileManager copyItemAtURL:localURL toURL:temporaryURL error:&accessorError]) {
+            success = [self.fileManager replaceItemAtURL:writingURL withItemAtURL:temporaryURL backupItemName:nil options:0 resultingItemURL:nil error:&accessorError];
+            if (success == NO) [self.fileManager removeItemAtURL:temporaryURL error:nil];
+        }
+        replaceError = accessorError;
+    }];
+    
+    if (error) *error = coordinatorError ?: replaceError;
+    return success;
+}
+
+- (NSProgress *)uploadLocalDocumentToCloudWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler {
+    NSProgress *progress = [self documentOperationProgress];
+    
+    // Time the upload until the handler is called
+    uint64_t span = [self.telemetry beginSpan];
+    void (^timedHandler)(NSError *) = handler;
+    handler = ^(NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationUpload];
+        if (timedHandler) timedHandler(error);
+    };
+    
     // Log download
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Attempting to upload document, %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Attempting to upload document, %@", documentName];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return;
+    // Check for iCloud, queue the upload until it is available
+    if ([self quickCloudCheck] == NO) {
+        [self journalOfflineOperation:iCloudJournalOperationSave documentPath:documentName destinationPath:nil completion:handler];
+        return progress;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be saved. Specify a document name next time." code:001 userInfo:nil];
         
         handler(error);
         
-        return;
+        return progress;
     }
     
     // Perform tasks on background thread to avoid problems on the main / UI thread
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0ul), ^{
+        // Stop if the upload was cancelled while waiting for the background queue
+        if (progress.isCancelled) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                handler([self cancellationErrorForDocumentName:documentName]);
+            });
+            return;
+        }
+        
         // Get the array of files in the documents directory
         NSString *documentsDirectory = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES)[0];
         NSString *localDocument = [documentsDirectory stringByAppendingPathComponent:documentName];
@@ -638,13 +2007,14 @@
         // If the file does not exist in iCloud, upload it
         if (![self.previousQueryResults containsObject:localDocument]) {
             // Log
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Uploading %@ to iCloud", localDocument);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Uploading %@ to iCloud", localDocument];
             
             // Move the file to iCloud
-            NSURL *cloudURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+            NSURL *cloudURL = [self URLForDocumentPath:documentName];
             NSURL *localURL = [NSURL fileURLWithPath:localDocument];
             NSError *error;
             
+            [self createParentFoldersForURL:cloudURL error:nil];
             BOOL success = [self.fileManager setUbiquitous:YES itemAtURL:localURL destinationURL:cloudURL error:&error];
             if (!success) {
                 NSLog(@"[iCloud] Error while uploading document from local directory: %@", error);
@@ -663,19 +2033,19 @@
             // Check if the local document is newer than the cloud document
             
             // Log conflict
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Conflict between local file and remote file, attempting to automatically resolve");
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Conflict between local file and remote file, attempting to automatically resolve"];
             
             // Get the file URL for the documents
-            NSURL *cloudURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+            NSURL *cloudURL = [self URLForDocumentPath:documentName];
             NSURL *localURL = [NSURL fileURLWithPath:[documentsDirectory stringByAppendingPathComponent:localDocument]];
             
             // Create the UIDocument object from the URL
-            iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:cloudURL];
+            iCloudDocument *document = [self documentForFileURL:cloudURL];
             NSDate *cloudModDate = document.fileModificationDate;
             
             NSDictionary *fileAttributes = [self.fileManager attributesOfItemAtPath:[localURL absoluteString] error:nil];
             NSDate *localModDate = [fileAttributes fileModificationDate];
-            NSData *localFileData = [self.fileManager contentsAtPath:[localURL absoluteString]];
+            NSData *localFileData = [NSData dataWithContentsOfURL:localURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
             
             if ([cloudModDate compare:localModDate] == NSOrderedDescending) {
                 NSLog(@"[iCloud] The iCloud file was modified more recently than the local file. The local file will be deleted and the iCloud file will be preserved.");
@@ -683,6 +2053,9 @@
                 
                 if (![self.fileManager removeItemAtPath:[localURL absoluteString] error:&error]) {
                     NSLog(@"[iCloud] Error deleting %@.\n\n%@", [localURL absoluteString], error);
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        handler(error);
+                    });
                     return;
                 }
             } else if ([cloudModDate compare:localModDate] == NSOrderedAscending) {
@@ -708,19 +2081,26 @@
                         }
                     }];
                 });
+                
+                // The save answers the handler
+                return;
             } else {
                 NSLog(@"[iCloud] The local file and iCloud file have the same modification date. Before overwriting or deleting, iCloud Document Sync will check if both files have the same content.");
-                if ([self.fileManager contentsEqualAtPath:[cloudURL absoluteString] andPath:[localURL absoluteString]] == YES) {
+                if ([self.contentHashCache contentsEqualAtURL:cloudURL andURL:localURL] == YES) {
                     NSLog (@"[iCloud] The contents of the local file and the contents of the iCloud file match. The local file will be deleted.");
                     NSError *error;
                     
                     if (![self.fileManager removeItemAtPath:[localURL absoluteString] error:&error]) {
                         NSLog(@"[iCloud] Error deleting %@.\n\n%@", [localURL absoluteString], error);
+                        dispatch_async(dispatch_get_main_queue(), ^{
+                            handler(error);
+                        });
                         return;
                     }
                 } else {
                     NSLog(@"[iCloud] Both the iCloud file and the local file were last modified at the same time, however their contents do not match. You'll need to handle the conflict using the iCloudFileConflictBetweenCloudFile:andLocalFile: delegate method.");
-                    NSDictionary *cloudFile = @{@"fileContents": document.contents, @"fileURL": cloudURL, @"modifiedDate": cloudModDate};
+                    NSData *cloudFileData = [NSData dataWithContentsOfURL:cloudURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
+                    NSDictionary *cloudFile = @{@"fileContents": cloudFileData, @"fileURL": cloudURL, @"modifiedDate": cloudModDate};
                     NSDictionary *localFile = @{@"fileContents": localFileData, @"fileURL": localURL, @"modifiedDate": localModDate};;
                     
                     if ([self.delegate respondsToSelector:@selector(iCloudFileUploadConflictWithCloudFile:andLocalFile:)]) {
@@ -733,19 +2113,39 @@
 #pragma clang diagnostic pop
                     }
                     
+                    // The conflict is left to the delegate, the caller still gets an answer
+                    NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The local file and the iCloud file of the document, %@, are in conflict. Resolve the conflict with the iCloudFileConflictBetweenCloudFile:andLocalFile: delegate method.", documentName] code:200 userInfo:@{@"FileURL": cloudURL}];
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        handler(error);
+                    });
                     return;
                 }
             }
         }
         
         // Log completion
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Finished uploading local file to iCloud");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished uploading local file to iCloud"];
         
         dispatch_async(dispatch_get_main_queue(), ^{
             handler(nil);
             return;
         });
     });
+    
+    return progress;
+}
+
+- (iCloudDocument *)documentForFileURL:(NSURL *)fileURL {
+    BOOL isDirectory = NO;
+    BOOL exists = [self.fileManager fileExistsAtPath:[fileURL path] isDirectory:&isDirectory];
+    
+    if ((exists && isDirectory) || [self.packageDocumentExtensions containsObject:[[fileURL pathExtension] lowercaseString]]) {
+        return [[iCloudPackageDocument alloc] initWithFileURL:fileURL];
+    }
+    
+    iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+    document.compressionCodec = self.documentCompressionCodec;
+    return document;
 }
 
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -753,43 +2153,104 @@
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 #pragma mark - Read
 
-- (void)retrieveCloudDocumentWithName:(NSString *)documentName completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+- (NSProgress *)retrieveCloudDocumentWithName:(NSString *)documentName completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+    // Finish the progress when the handler is called
+    NSProgress *progress = [self documentOperationProgress];
+    void (^retrieveHandler)(UIDocument *, NSData *, NSError *) = handler;
+    handler = ^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        if (retrieveHandler) retrieveHandler(cloudDocument, documentData, error);
+    };
+    
+    // Buffered changes land before the document is read, so the retrieved contents include them
+    if (documentName.length > 0 && [self.writeBehindBuffer hasPendingWritesForDocumentWithName:documentName]) {
+        [self.writeBehindBuffer flushDocumentWithName:documentName completion:^{
+            [self forwardCancellationOfProgress:progress toProgress:[self retrieveCloudDocumentWithName:documentName completion:handler]];
+        }];
+        return progress;
+    }
+    
     // Log Retrieval
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Retrieving iCloud document, %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Retrieving iCloud document, %@", documentName];
     
-    // Check for iCloud availability
-    if ([self quickCloudCheck] == NO) return;
+    // Check for iCloud availability, a retrieval cannot be queued so report it instead of dropping the handler
+    if ([self quickCloudCheck] == NO) {
+        NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"iCloud is not available, the document, %@, could not be retrieved", documentName] code:503 userInfo:@{@"FileName": documentName ?: @""}];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(nil, nil, error);
+        });
+        return progress;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be saved. Specify a document name next time." code:001 userInfo:nil];
         
         handler(nil, nil, error);
         
-        return;
+        return progress;
     }
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
+        
+        // Reuse the document if it is still open from a previous retrieval
+        iCloudDocument *pooledDocument = [self.documentPool documentWithName:documentName];
+        if (pooledDocument && (pooledDocument.documentState & UIDocumentStateInConflict) == 0) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document, %@, is already open and will be reused", documentName];
+            [self.evictionManager recordAccessToItemAtURL:fileURL];
+            
+            // Pass data on to the completion handler on the main thread
+            dispatch_async(dispatch_get_main_queue(), ^{
+                handler(pooledDocument, pooledDocument.contents, nil);
+            });
+            
+            return progress;
+        }
+        
+        // A document which is still in iCloud only goes to the front of the download queue
+        BOOL indexIsWarm = NO;
+        NSDictionary *entry = [self indexedMetadataForDocumentName:documentName indexIsWarm:&indexIsWarm];
+        if ([entry[NSMetadataUbiquitousItemDownloadingStatusKey] isEqualToString:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded]) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document, %@, is not downloaded yet and will be downloaded first", documentName];
+            [self.downloadScheduler raisePriorityOfItemAtURL:entry[NSMetadataItemURLKey] ?: fileURL toPriority:iCloudDownloadPriorityRequested];
+        }
         
         // If the file exists open it; otherwise, create it
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Log opening
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] The document, %@, already exists and will be opened", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document, %@, already exists and will be opened", documentName];
             
             // Create the UIDocument object from the URL
-            iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+            iCloudDocument *document = [self documentForFileURL:fileURL];
             
             if (document.documentState & UIDocumentStateClosed) {
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Document is closed and will be opened");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document is closed and will be opened"];
                 
+                CFAbsoluteTime openStart = CFAbsoluteTimeGetCurrent();
+                uint64_t span = [self.telemetry beginSpan];
                 [document openWithCompletionHandler:^(BOOL success){
+                    // The open could not be interrupted, but a cancelled retrieval does not hand out or pool the document
+                    if (progress.isCancelled) {
+                        if (success) [document closeWithCompletionHandler:nil];
+                        dispatch_async(dispatch_get_main_queue(), ^{
+                            handler(nil, nil, [self cancellationErrorForDocumentName:documentName]);
+                        });
+                        return;
+                    }
+                    
                     if (success) {
                         // Log open
-                        if (self.verboseLogging == YES) NSLog(@"[iCloud] Opened document");
+                        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Opened document"];
+                        
+                        // Keep the document open for the next retrieval
+                        [self.evictionManager recordAccessToItemAtURL:fileURL];
+                        [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationOpen];
+                        [self.documentPool recordOpenLatency:CFAbsoluteTimeGetCurrent() - openStart];
+                        [self.documentPool addDocument:document withName:documentName];
                         
                         // Pass data on to the completion handler on the main thread
                         dispatch_async(dispatch_get_main_queue(), ^{
@@ -811,17 +2272,17 @@
                 }];
             } else if (document.documentState & UIDocumentStateNormal) {
                 // Log open
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Document already opened, retrieving content");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document already opened, retrieving content"];
                 
                 // Pass data on to the completion handler on the main thread
                 dispatch_async(dispatch_get_main_queue(), ^{
                     handler(document, document.contents, nil);
                 });
                 
-                return;
+                return progress;
             } else if (document.documentState & UIDocumentStateInConflict) {
                 // Log open
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Document in conflict. The document may not contain correct data. An error will be returned along with the other parameters in the completion handler.");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document in conflict. The document may not contain correct data. An error will be returned along with the other parameters in the completion handler."];
                 
                 // Create Error
                 NSLog(@"[iCloud] Error while retrieving document, %@, because the document is in conflict", documentName);
@@ -832,31 +2293,48 @@
                     handler(document, document.contents, error);
                 });
                 
-                return;
+                return progress;
             } else if (document.documentState & UIDocumentStateEditingDisabled) {
                 // Log open
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Document editing disabled. The document is not currently editable, use the documentStateForFile: method to determine when the document is available again. The document and its contents will still be passed as parameters in the completion handler.");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Document editing disabled. The document is not currently editable, use the documentStateForFile: method to determine when the document is available again. The document and its contents will still be passed as parameters in the completion handler."];
                 
                 // Pass data on to the completion handler on the main thread
                 dispatch_async(dispatch_get_main_queue(), ^{
                     handler(document, document.contents, nil);
                 });
                 
-                return;
+                return progress;
+            } else {
+                // Any other state still answers the caller, with whatever the document holds
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    handler(document, document.contents, nil);
+                });
+                
+                return progress;
             }
             
         } else {
             // Log creation
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] The document, %@, does not exist and will be created as an empty document", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document, %@, does not exist and will be created as an empty document", documentName];
             
             // Create the UIDocument
-            iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+            iCloudDocument *document = [self documentForFileURL:fileURL];
             document.contents = [[NSData alloc] init];
             
-            // Save the new document to disk
+            // Save the new document to disk, creating the folders leading up to it
+            [self createParentFoldersForURL:fileURL error:nil];
             [document saveToURL:fileURL forSaveOperation:UIDocumentSaveForCreating completionHandler:^(BOOL success) {
+                // The empty document is kept, but a cancelled retrieval does not hand it out
+                if (progress.isCancelled) {
+                    if (success) [document closeWithCompletionHandler:nil];
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        handler(nil, nil, [self cancellationErrorForDocumentName:documentName]);
+                    });
+                    return;
+                }
+                
                 // Log save
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Saved and opened the document");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Saved and opened the document"];
                 
                 dispatch_async(dispatch_get_main_queue(), ^{
                     handler(document, document.contents, nil);
@@ -865,12 +2343,18 @@
         }
     } @catch (NSException *exception) {
         NSLog(@"[iCloud] Caught exception while retrieving document: %@\n\n%s", exception, __PRETTY_FUNCTION__);
+        NSError *error = [self exceptionErrorForDocumentName:documentName exception:exception];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(nil, nil, error);
+        });
     }
+    
+    return progress;
 }
 
 - (iCloudDocument *)retrieveCloudDocumentObjectWithName:(NSString *)documentName {
     // Log Retrieval
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Retrieving iCloudDocument object with name: %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Retrieving iCloudDocument object with name: %@", documentName];
     
     // Check for iCloud availability
     if ([self quickCloudCheck] == NO) return nil;
@@ -878,21 +2362,22 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         return nil;
     }
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
-        // Create the iCloudDocument
-        iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+        // Reuse the open document if there is one, otherwise create the iCloudDocument
+        iCloudDocument *document = [self.documentPool documentWithName:documentName] ?: [self documentForFileURL:fileURL];
+        [self.evictionManager recordAccessToItemAtURL:fileURL];
         
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] The document, %@, exists and will be returned as an iCloudDocument object", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document, %@, exists and will be returned as an iCloudDocument object", documentName];
         } else {
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] The document, %@, does not exist but will be returned as an empty iCloudDocument object", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document, %@, does not exist but will be returned as an empty iCloudDocument object", documentName];
         }
         
         // Return the iCloudDocument object
@@ -904,12 +2389,25 @@
     }
 }
 
+- (void)releaseDocumentWithName:(NSString *)documentName {
+    if (documentName.length == 0) return;
+    
+    // The document stays open, the pool may now close it when it needs room
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Released document: %@", documentName];
+    [self.documentPool releaseDocumentWithName:documentName];
+}
+
 - (NSNumber *)fileSize:(NSString *)documentName {
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return nil;
     
+    // Answer from the metadata index once the query has populated it, a miss may just be a change the query has not reported yet
+    BOOL indexIsWarm = NO;
+    NSDictionary *entry = [self indexedMetadataForDocumentName:documentName indexIsWarm:&indexIsWarm];
+    if (indexIsWarm == YES && entry[NSMetadataItemFSSizeKey] != nil) return entry[NSMetadataItemFSSizeKey];
+    
     // Get the URL to get the file from
-	NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+	NSURL *fileURL = [self URLForDocumentPath:documentName];
     
     // Check if the file exists, and return
     if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
@@ -918,7 +2416,7 @@
         return bytes;
     } else {
         // The document could not be found
-        NSLog(@"[iCloud] File not found: %@", documentName);
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
         
         return nil;
     }
@@ -928,8 +2426,13 @@
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return nil;
     
+    // Answer from the metadata index once the query has populated it, a miss may just be a change the query has not reported yet
+    BOOL indexIsWarm = NO;
+    NSDictionary *entry = [self indexedMetadataForDocumentName:documentName indexIsWarm:&indexIsWarm];
+    if (indexIsWarm == YES && entry[NSMetadataItemFSContentChangeDateKey] != nil) return entry[NSMetadataItemFSContentChangeDateKey];
+    
     // Get the URL to get the file from
-	NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+	NSURL *fileURL = [self URLForDocumentPath:documentName];
     
     
     // Check if the file exists, and return
@@ -938,7 +2441,7 @@
         return fileModified;
     } else {
         // The document could not be found
-        NSLog(@"[iCloud] File not found: %@", documentName);
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
         
         return nil;
     }
@@ -948,8 +2451,13 @@
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return nil;
     
+    // Answer from the metadata index once the query has populated it, a miss may just be a change the query has not reported yet
+    BOOL indexIsWarm = NO;
+    NSDictionary *entry = [self indexedMetadataForDocumentName:documentName indexIsWarm:&indexIsWarm];
+    if (indexIsWarm == YES && entry[NSMetadataItemFSCreationDateKey] != nil) return entry[NSMetadataItemFSCreationDateKey];
+    
     // Get the URL to get the file from
-	NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+	NSURL *fileURL = [self URLForDocumentPath:documentName];
     
     
     // Check if the file exists, and return
@@ -965,8 +2473,13 @@
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return NO;
     
+    // An indexed document exists, a miss is unknown until the file system has been checked (a new file may not have been reported yet)
+    BOOL indexIsWarm = NO;
+    NSDictionary *entry = [self indexedMetadataForDocumentName:documentName indexIsWarm:&indexIsWarm];
+    if (indexIsWarm == YES && entry != nil) return YES;
+    
     // Get the URL to get the file from
-	NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+	NSURL *fileURL = [self URLForDocumentPath:documentName];
     
     // Check if the file exists, and return
     if ([self.fileManager fileExistsAtPath:[fileURL path]]) return YES;
@@ -975,21 +2488,31 @@
 
 - (NSArray *)listCloudFiles {
     // Log retrieval
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Getting list of iCloud documents");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Getting list of iCloud documents"];
     
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return nil;
     
-    // Get the directory contents
-    NSArray *directoryContent = [self.fileManager contentsOfDirectoryAtURL:[self ubiquitousDocumentsDirectoryURL] includingPropertiesForKeys:nil options:0 error:nil];
+    // Get the directory contents, prefetching the attributes callers usually ask for next
+    NSArray *directoryContent = [self.fileManager contentsOfDirectoryAtURL:[self ubiquitousDocumentsDirectoryURL] includingPropertiesForKeys:[iCloudFileCursor prefetchedResourceKeys] options:0 error:nil];
     
     // Log retrieval
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Retrieved list of iCloud documents");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Retrieved list of iCloud documents"];
     
     // Return the list of files
     return directoryContent;
 }
 
+- (iCloudFileCursor *)cloudFileCursorWithPageSize:(NSUInteger)pageSize {
+    // Check for iCloud
+    if ([self quickCloudCheck] == NO) return nil;
+    
+    iCloudFileCursor *cursor = [[iCloudFileCursor alloc] initWithDirectoryURL:[self ubiquitousDocumentsDirectoryURL] fileManager:self.fileManager];
+    if (pageSize > 0) cursor.pageSize = pageSize;
+    
+    return cursor;
+}
+
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 //------------ State --------------------------------------------------------------------------------------------------------------------------//
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -1002,7 +2525,7 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be saved. Specify a document name next time." code:001 userInfo:nil];
         
         handler(nil, nil, error);
@@ -1011,18 +2534,18 @@
     }
     
     // Get the URL to get the file from
-	NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+	NSURL *fileURL = [self URLForDocumentPath:documentName];
     
     // Check if the file exists, and return
     if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
         // Create the UIDocument
-        iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+        iCloudDocument *document = [self documentForFileURL:fileURL];
         UIDocumentState state = document.documentState;
         NSString *userStateDescription = document.stateDescription;
         handler(&state, userStateDescription, nil);
     } else {
         // The document could not be found
-        NSLog(@"[iCloud] File not found: %@", documentName);
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
         NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, does not exist at path: %@", documentName, fileURL] code:404 userInfo:@{@"FileURL": fileURL}];
         handler(nil, @"No document available", error);
         return;
@@ -1031,7 +2554,7 @@
 
 - (BOOL)monitorDocumentStateForFile:(NSString *)documentName onTarget:(id)sender withSelector:(SEL)selector {
     // Log monitoring
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Preparing to monitor for changes to %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Preparing to monitor for changes to %@", documentName];
     
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return NO;
@@ -1039,31 +2562,31 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         return NO;
     }
     
     // Log monitoring
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Checking for existance of %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Checking for existance of %@", documentName];
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
         
         // Check if the file exists, and return
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Create the UIDocument
-            iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+            iCloudDocument *document = [self documentForFileURL:fileURL];
             [self.notificationCenter addObserver:sender selector:selector name:UIDocumentStateChangedNotification object:document];
             
             // Log monitoring
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Now successfully monitoring for changes to %@ on %@", documentName, sender);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Now successfully monitoring for changes to %@ on %@", documentName, sender];
             
             return YES;
         } else {
             // The document could not be found
-            NSLog(@"[iCloud] File not found: %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
             
             return NO;
         }
@@ -1077,7 +2600,7 @@
 
 - (BOOL)stopMonitoringDocumentStateChangesForFile:(NSString *)documentName onTarget:(id)sender {
     // Log monitoring
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Preparing to stop monitoring document changes to %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Preparing to stop monitoring document changes to %@", documentName];
     
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return NO;
@@ -1085,32 +2608,32 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         return NO;
     }
     
     // Log monitoring
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Checking for existance of %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Checking for existance of %@", documentName];
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
         
         // Check if the file exists, and return
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Create the UIDocument
-            iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
+            iCloudDocument *document = [self documentForFileURL:fileURL];
             
             [self.notificationCenter removeObserver:sender name:UIDocumentStateChangedNotification object:document];
             
             // Log monitoring
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Stopped monitoring document state changes to %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Stopped monitoring document state changes to %@", documentName];
             
             return YES;
         } else {
             // The document could not be found
-            NSLog(@"[iCloud] File not found: %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
             
             return NO;
         }
@@ -1129,7 +2652,7 @@
 
 - (NSArray *)findUnresolvedConflictingVersionsOfFile:(NSString *)documentName {
     // Log conflict search
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Preparing to find all version conflicts for %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Preparing to find all version conflicts for %@", documentName];
     
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return nil;
@@ -1137,22 +2660,22 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         return nil;
     }
     
     // Log conflict search
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Checking for existance of %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Checking for existance of %@", documentName];
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
         
         // Check if the file exists, and return
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Log conflict search
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] %@ exists at the correct path, proceeding to find the conflicts", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] %@ exists at the correct path, proceeding to find the conflicts", documentName];
         
             NSMutableArray *fileVersions = [NSMutableArray array];
             
@@ -1161,11 +2684,12 @@
             
             NSArray *otherVersions = [NSFileVersion otherVersionsOfItemAtURL:fileURL];
             [fileVersions addObjectsFromArray:otherVersions];
+            if ([otherVersions count] > 0) [self.telemetry incrementCounterForOperation:iCloudTelemetryOperationConflict];
             
             return fileVersions;
         } else {
             // The document could not be found
-            NSLog(@"[iCloud] File not found: %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
             
             return nil;
         }
@@ -1178,8 +2702,10 @@
 }
 
 - (void)resolveConflictForFile:(NSString *)documentName withSelectedFileVersion:(NSFileVersion *)documentVersion {
+    [self.telemetry incrementCounterForOperation:iCloudTelemetryOperationConflict];
+    
     // Log resolution
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Preparing to resolve version conflict for %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Preparing to resolve version conflict for %@", documentName];
     
     // Check for iCloud
     if ([self quickCloudCheck] == NO) return;
@@ -1187,27 +2713,27 @@
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
         return;
     }
     
     // Log resolution
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Checking for existance of %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Checking for existance of %@", documentName];
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
         
         // Check if the file exists, and return
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Log resolution
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] %@ exists at the correct path, proceeding to resolve the conflict", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] %@ exists at the correct path, proceeding to resolve the conflict", documentName];
             
             // Make the current version "win" the conflict if it is selected
             if (![documentVersion isEqual:[NSFileVersion currentVersionOfItemAtURL:fileURL]]) {
                 // Log resolution
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] The current version (%@) of %@ matches the selected version. Resolving conflict...", documentVersion, documentName);
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The current version (%@) of %@ matches the selected version. Resolving conflict...", documentVersion, documentName];
                 
                 [documentVersion replaceItemAtURL:fileURL options:0 error:nil];
             }
@@ -1216,7 +2742,7 @@
             [NSFileVersion removeOtherVersionsOfItemAtURL:fileURL error:nil];
             
             // Log resolution
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Removing all unresolved other versions of %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Removing all unresolved other versions of %@", documentName];
             
             NSArray *conflictVersions = [NSFileVersion unresolvedConflictVersionsOfItemAtURL:fileURL];
             for (NSFileVersion *fileVersion in conflictVersions) {
@@ -1224,10 +2750,10 @@
             }
             
             // Log resolution
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Finished resolving conflicts for %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished resolving conflicts for %@", documentName];
         } else {
             // The document could not be found
-            NSLog(@"[iCloud] File not found: %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
             
             return;
         }
@@ -1239,70 +2765,130 @@
     }
 }
 
+- (void)resolveUnresolvedConflicts {
+    // Check for iCloud
+    if ([self quickCloudCheck] == NO) return;
+    
+    NSSet *conflictedNames = self.conflictedDocumentNames;
+    iCloudMetadataSnapshot *snapshot = self.metadataSnapshot;
+    NSMutableArray *conflictedEntries = [NSMutableArray arrayWithCapacity:conflictedNames.count];
+    for (NSString *documentName in conflictedNames) {
+        NSDictionary *entry = [snapshot entryForDocumentPath:documentName];
+        if (entry) [conflictedEntries addObject:entry];
+    }
+    
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Queueing %lu conflicted files for resolution", (unsigned long)conflictedEntries.count];
+    [self queueConflictedEntries:conflictedEntries];
+}
+
+- (void)queueConflictedEntries:(NSArray *)entries {
+    if (entries.count == 0 || self.conflictResolver.policy == iCloudConflictPolicyManual) return;
+    
+    NSMutableDictionary *documentURLs = [NSMutableDictionary dictionaryWithCapacity:entries.count];
+    for (NSDictionary *entry in entries) {
+        NSString *name = entry[iCloudMetadataItemDocumentPathKey] ?: entry[NSMetadataItemFSNameKey];
+        if (name && entry[NSMetadataItemURLKey]) documentURLs[name] = entry[NSMetadataItemURLKey];
+    }
+    
+    // Merged contents are written in the same format as the rest of the documents
+    self.conflictResolver.compressionCodec = self.documentCompressionCodec;
+    self.conflictResolver.verboseLogging = self.verboseLogging;
+    [self.conflictResolver resolveConflictsInDocuments:documentURLs];
+}
+
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 //------------ Share --------------------------------------------------------------------------------------------------------------------------//
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 #pragma mark - Share
 
 - (NSURL *)shareDocumentWithName:(NSString *)documentName completion:(void (^)(NSURL *sharedURL, NSDate *expirationDate, NSError *error))handler {
+    // The public URL is only known once publishing finishes, so it is always delivered through the handler
+    [self shareDocumentWithName:documentName cancellableCompletion:handler];
+    return nil;
+}
+
+- (NSProgress *)shareDocumentWithName:(NSString *)documentName cancellableCompletion:(void (^)(NSURL *sharedURL, NSDate *expirationDate, NSError *error))handler {
+    NSProgress *progress = [self documentOperationProgress];
+    void (^shareHandler)(NSURL *, NSDate *, NSError *) = handler;
+    handler = ^(NSURL *sharedURL, NSDate *expirationDate, NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        if (shareHandler) shareHandler(sharedURL, expirationDate, error);
+    };
+    
     // Log share
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Attempting to share document");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Attempting to share document"];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return nil;
+    // Check for iCloud, a share cannot be queued so report it instead of dropping the handler
+    if ([self quickCloudCheck] == NO) {
+        NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"iCloud is not available, the document, %@, could not be shared", documentName] code:503 userInfo:@{@"FileName": documentName ?: @""}];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(nil, nil, error);
+        });
+        return progress;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
-        return nil;
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
+        NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be shared. Specify a document name next time." code:001 userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(nil, nil, error);
+        });
+        return progress;
     }
     
     @try {
         // Get the URL to get the file from
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
         // Check that the file exists
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Log share
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] File exists, preparing to share it");
-            
-            // Create the URL to be returned outside of the block
-            __block NSURL *url;
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File exists, preparing to share it"];
             
             // Move to the background thread for safety
             dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void) {
+                // Stop if the share was cancelled while waiting for the background queue
+                if (progress.isCancelled) {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        handler(nil, nil, [self cancellationErrorForDocumentName:documentName]);
+                    });
+                    return;
+                }
+                
                 // Create the Error Object and the Date Object
                 NSError *error;
                 NSDate *date;
                 
                 // Create the URL
-                url = [self.fileManager URLForPublishingUbiquitousItemAtURL:fileURL expirationDate:&date error:&error];
+                NSURL *url = [self.fileManager URLForPublishingUbiquitousItemAtURL:fileURL expirationDate:&date error:&error];
                 
                 // Log share
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Shared iCloud document");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Shared iCloud document"];
                 
                 dispatch_async(dispatch_get_main_queue(), ^{
                     // Pass the data to the handler
                     handler(url, date, error);
                 });
             });
-            
-            // Return the URL
-            return url;
         } else {
             // The document could not be found
-            NSLog(@"[iCloud] File not found: %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
             NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, does not exist at path: %@", documentName, fileURL] code:404 userInfo:@{@"FileURL": fileURL}];
             dispatch_async(dispatch_get_main_queue(), ^{
                 handler(nil, nil, error);
-                return;
             });
         }
     } @catch (NSException *exception) {
         NSLog(@"[iCloud] Caught exception while sharing file: %@\n\n%s", exception, __PRETTY_FUNCTION__);
+        NSError *error = [self exceptionErrorForDocumentName:documentName exception:exception];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(nil, nil, error);
+        });
     }
-    return nil;
+    
+    return progress;
 }
 
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -1310,39 +2896,80 @@
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 #pragma mark - Delete
 
-- (void)deleteDocumentWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler {
+- (NSProgress *)deleteDocumentWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler {
+    NSProgress *progress = [self documentOperationProgress];
+    
+    // Buffered changes of a deleted document are dropped, a write already in flight lands before the delete
+    if (documentName.length > 0) [self.writeBehindBuffer discardPendingWritesForDocumentWithName:documentName];
+    if (documentName.length > 0 && [self.writeBehindBuffer hasPendingWritesForDocumentWithName:documentName]) {
+        [self.writeBehindBuffer flushDocumentWithName:documentName completion:^{
+            [self forwardCancellationOfProgress:progress toProgress:[self deleteDocumentWithName:documentName completion:^(NSError *error) {
+                progress.completedUnitCount = progress.totalUnitCount;
+                if (handler) handler(error);
+            }]];
+        }];
+        return progress;
+    }
+    
+    // Time the file operation until the handler is called
+    uint64_t span = [self.telemetry beginSpan];
+    void (^timedHandler)(NSError *) = handler;
+    handler = ^(NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationFileOperation];
+        if (timedHandler) timedHandler(error);
+    };
+    
     // Log delete
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Attempting to delete document");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Attempting to delete document"];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return;
+    // Check for iCloud, queue the delete until it is available
+    if ([self quickCloudCheck] == NO) {
+        [self journalOfflineOperation:iCloudJournalOperationDelete documentPath:documentName destinationPath:nil completion:handler];
+        return progress;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
-        return;
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
+        NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be deleted. Specify a document name next time." code:001 userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(error);
+        });
+        return progress;
     }
     
     @try {
         // Create the URL for the file that is being removed
-        NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+        NSURL *fileURL = [self URLForDocumentPath:documentName];
         
         // Check that the file exists
         if ([self.fileManager fileExistsAtPath:[fileURL path]]) {
             // Log share
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] File exists, attempting to delete it");
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File exists, attempting to delete it"];
+            
+            // The pooled document would outlive the file
+            [self.documentPool removeDocumentWithName:documentName];
             
             // Move to the background thread for safety
             dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void) {
                 
-                // Use a file coordinator to safely delete the file
-                NSFileCoordinator *fileCoordinator = [[NSFileCoordinator alloc] initWithFilePresenter:nil];
-                [fileCoordinator coordinateWritingItemAtURL:fileURL options:NSFileCoordinatorWritingForDeleting error:nil byAccessor:^(NSURL *writingURL) {
+                // Use a file coordinator to safely delete the file, cancelling the progress abandons the pending coordinated write
+                NSFileCoordinator *fileCoordinator = [self.fileManager fileCoordinatorWithFilePresenter:nil];
+                progress.cancellationHandler = ^{
+                    [fileCoordinator cancel];
+                };
+                if (progress.isCancelled) [fileCoordinator cancel];
+                
+                NSError *coordinatorError = nil;
+                [fileCoordinator coordinateWritingItemAtURL:fileURL options:NSFileCoordinatorWritingForDeleting error:&coordinatorError byAccessor:^(NSURL *writingURL) {
                     // Create the error handler
                     NSError *error;
                     
                     [self.fileManager removeItemAtURL:writingURL error:&error];
+                    if (!error) [self.contentHashCache removeDigestForFileAtURL:writingURL];
+                    if (!error) [self moveIndexedDocuments:@{documentName: [NSNull null]}];
                     if (error) {
                         // Log failure
                         NSLog(@"[iCloud] An error occurred while deleting the document: %@", error);
@@ -1354,7 +2981,7 @@
                         return;
                     } else {
                         // Log success
-                        if (self.verboseLogging == YES) NSLog(@"[iCloud] The document has been deleted");
+                        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] The document has been deleted"];
                         
                         dispatch_async(dispatch_get_main_queue(), ^{
                             [self updateFiles];
@@ -1364,10 +2991,18 @@
                         return;
                     }
                 }];
+                
+                if (coordinatorError) {
+                    // The accessor never ran, either because the delete was cancelled or because coordination failed
+                    NSError *error = progress.isCancelled ? [self cancellationErrorForDocumentName:documentName] : coordinatorError;
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        if (handler) handler(error);
+                    });
+                }
             });
         } else {
             // The document could not be found
-            NSLog(@"[iCloud] File not found: %@", documentName);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] File not found: %@", documentName];
             NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, does not exist at path: %@", documentName, fileURL] code:404 userInfo:@{@"FileURL": fileURL}];
             dispatch_async(dispatch_get_main_queue(), ^{
                 if (handler) handler(error);
@@ -1376,20 +3011,49 @@
         }
     } @catch (NSException *exception) {
         NSLog(@"[iCloud] Caught exception while deleting file: %@\n\n%s", exception, __PRETTY_FUNCTION__);
+        NSError *error = [self exceptionErrorForDocumentName:documentName exception:exception];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(error);
+        });
     }
+    
+    return progress;
+}
+
+- (NSProgress *)deleteDocumentsWithNames:(NSArray *)documentNames completion:(void (^)(NSDictionary *errors))handler {
+    NSMutableDictionary *documents = [NSMutableDictionary dictionaryWithCapacity:[documentNames count]];
+    for (NSString *documentName in documentNames) documents[documentName] = [NSNull null];
+    
+    return [self performBatchOperation:iCloudJournalOperationDelete withDocuments:documents completion:handler];
 }
 
 - (void)evictCloudDocumentWithName:(NSString *)documentName completion:(void (^)(NSError *error))handler {
+    // Every path answers exactly once, the handler is optional in practice even though it is declared nonnull
+    void (^evictHandler)(NSError *) = handler;
+    handler = ^(NSError *error) {
+        if (evictHandler) evictHandler(error);
+    };
+    
     // Log download
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Attempting to evict iCloud document, %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Attempting to evict iCloud document, %@", documentName];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return;
+    // Check for iCloud, an eviction cannot be queued so report it instead of dropping the handler
+    if ([self quickCloudCheck] == NO) {
+        NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"iCloud is not available, the document, %@, could not be evicted", documentName] code:503 userInfo:@{@"FileName": documentName ?: @""}];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(error);
+        });
+        return;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
+        NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be evicted. Specify a document name next time." code:001 userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(error);
+        });
         return;
     }
     
@@ -1402,10 +3066,10 @@
         // If the file does not exist in iCloud, upload it
         if (![self.previousQueryResults containsObject:localDocument]) {
             // Log
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Evicting %@ from iCloud", localDocument);
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Evicting %@ from iCloud", localDocument];
             
             // Move the file to iCloud
-            NSURL *cloudURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+            NSURL *cloudURL = [self URLForDocumentPath:documentName];
             NSURL *localURL = [NSURL fileURLWithPath:localDocument];
             NSError *error;
             
@@ -1427,19 +3091,19 @@
             // Check if the cloud document is newer than the local document
             
             // Log conflict
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Conflict between local file and remote file, attempting to automatically resolve");
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Conflict between local file and remote file, attempting to automatically resolve"];
             
             // Get the file URL for the documents
-            NSURL *cloudURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
+            NSURL *cloudURL = [self URLForDocumentPath:documentName];
             NSURL *localURL = [NSURL fileURLWithPath:[documentsDirectory stringByAppendingPathComponent:localDocument]];
             
             // Create the UIDocument object from the URL
-            iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:cloudURL];
+            iCloudDocument *document = [self documentForFileURL:cloudURL];
             NSDate *cloudModDate = document.fileModificationDate;
             
             NSDictionary *fileAttributes = [self.fileManager attributesOfItemAtPath:[localURL absoluteString] error:nil];
             NSDate *localModDate = [fileAttributes fileModificationDate];
-            NSData *localFileData = [self.fileManager contentsAtPath:[localURL absoluteString]];
+            NSData *localFileData = [NSData dataWithContentsOfURL:localURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
             
             if ([localModDate compare:cloudModDate] == NSOrderedDescending) {
                 NSLog(@"[iCloud] The local file was modified more recently than the iCloud file. The iCloud file will be deleted and the local file will be preserved.");
@@ -1478,7 +3142,7 @@
                 }
             } else {
                 NSLog(@"[iCloud] The iCloud file and local file have the same modification date. Before overwriting or deleting, iCloud Document Sync will check if both files have the same content.");
-                if ([self.fileManager contentsEqualAtPath:[localURL absoluteString] andPath:[cloudURL absoluteString]] == YES) {
+                if ([self.contentHashCache contentsEqualAtURL:localURL andURL:cloudURL] == YES) {
                     NSLog (@"[iCloud] The contents of the iCloud file and the contents of the local file match. The iCloud file will be deleted.");
                     
                     [self deleteDocumentWithName:documentName completion:^(NSError *error) {
@@ -1497,7 +3161,8 @@
                     }];
                 } else {
                     NSLog(@"[iCloud] Both the local file and the iCloud file were last modified at the same time, however their contents do not match. You'll need to handle the conflict using the iCloudFileConflictBetweenCloudFile:andLocalFile: delegate method.");
-                    NSDictionary *cloudFile = @{@"fileContents": document.contents, @"fileURL": cloudURL, @"modifiedDate": cloudModDate};
+                    NSData *cloudFileData = [NSData dataWithContentsOfURL:cloudURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
+                    NSDictionary *cloudFile = @{@"fileContents": cloudFileData, @"fileURL": cloudURL, @"modifiedDate": cloudModDate};
                     NSDictionary *localFile = @{@"fileContents": localFileData, @"fileURL": localURL, @"modifiedDate": localModDate};;
                     
                     if ([self.delegate respondsToSelector:@selector(iCloudFileConflictBetweenCloudFile:andLocalFile:)]) {
@@ -1510,6 +3175,11 @@
 #pragma clang diagnostic pop
                     }
                     
+                    // The conflict is left to the delegate, the caller still gets an answer
+                    NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The local file and the iCloud file of the document, %@, are in conflict. Resolve the conflict with the iCloudFileConflictBetweenCloudFile:andLocalFile: delegate method.", documentName] code:200 userInfo:@{@"FileURL": cloudURL}];
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        handler(error);
+                    });
                     return;
                 }
             }
@@ -1522,23 +3192,55 @@
 //---------------------------------------------------------------------------------------------------------------------------------------------//
 #pragma mark - Manage
 
-- (void)renameOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler {
+- (NSProgress *)renameOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler {
+    NSProgress *progress = [self documentOperationProgress];
+    
+    // Buffered changes land before the document is renamed, otherwise they would recreate it under its old name
+    if (documentName.length > 0 && [self.writeBehindBuffer hasPendingWritesForDocumentWithName:documentName]) {
+        [self.writeBehindBuffer flushDocumentWithName:documentName completion:^{
+            [self forwardCancellationOfProgress:progress toProgress:[self renameOriginalDocument:documentName withNewName:newName completion:^(NSError *error) {
+                progress.completedUnitCount = progress.totalUnitCount;
+                if (handler) handler(error);
+            }]];
+        }];
+        return progress;
+    }
+    
+    // Time the file operation until the handler is called
+    uint64_t span = [self.telemetry beginSpan];
+    void (^timedHandler)(NSError *) = handler;
+    handler = ^(NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationFileOperation];
+        if (timedHandler) timedHandler(error);
+    };
+    
     // Log rename
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Attempting to rename document, %@, to the new name: %@", documentName, newName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Attempting to rename document, %@, to the new name: %@", documentName, newName];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return;
+    // Check for iCloud, queue the rename until it is available
+    if ([self quickCloudCheck] == NO) {
+        [self journalOfflineOperation:iCloudJournalOperationRename documentPath:documentName destinationPath:newName completion:handler];
+        return progress;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""] || newName == nil || [newName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
-        return;
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
+        NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be used. Specify a document name next time." code:001 userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(error);
+        });
+        return progress;
     }
     
     // Create the URLs for the files that are being renamed
-    NSURL *sourceFileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
-    NSURL *newFileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:newName];
+    NSURL *sourceFileURL = [self URLForDocumentPath:documentName];
+    NSURL *newFileURL = [self URLForDocumentPath:newName];
+    
+    // The pooled document would still point at the old URL
+    [self.documentPool removeDocumentWithName:documentName];
     
     // Check if file exists at source URL
     if (![self.fileManager fileExistsAtPath:[sourceFileURL path]]) {
@@ -1550,7 +3252,7 @@
                 handler(error);
         });
         
-        return;
+        return progress;
     }
     
     // Check if file does not exist at new URL
@@ -1563,30 +3265,38 @@
                 handler(error);
         });
         
-        return;
+        return progress;
     }
     
     // Log success of existence
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Files passed existence check, preparing to rename");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Files passed existence check, preparing to rename"];
     
     // Move to the background thread for safety
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void) {
-        // Coordinate renaming safely with a file coordinator
+        // Coordinate renaming safely with a file coordinator, cancelling the progress abandons the pending coordinated write
         NSError *coordinatorError = nil;
-        NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter:nil];
+        NSFileCoordinator *coordinator = [self.fileManager fileCoordinatorWithFilePresenter:nil];
+        progress.cancellationHandler = ^{
+            [coordinator cancel];
+        };
+        if (progress.isCancelled) [coordinator cancel];
+        
         [coordinator coordinateWritingItemAtURL:sourceFileURL options:NSFileCoordinatorWritingForMoving writingItemAtURL:newFileURL options:NSFileCoordinatorWritingForReplacing error:&coordinatorError byAccessor:^(NSURL *newURL1, NSURL *newURL2) {
             NSError *moveError;
             BOOL moveSuccess;
             
             // Log rename
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Renaming Files");
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Renaming Files"];
             
-            // Do the actual renaming
+            // Do the actual renaming, the new name may move the document into another folder
+            [self createParentFoldersForURL:newFileURL error:nil];
             moveSuccess = [self.fileManager moveItemAtURL:sourceFileURL toURL:newFileURL error:&moveError];
             
             if (moveSuccess) {
                 // Log success
-                if (self.verboseLogging == YES) NSLog(@"[iCloud] Renamed Files");
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Renamed Files"];
+                [self.contentHashCache removeDigestForFileAtURL:sourceFileURL];
+                [self moveIndexedDocuments:@{documentName: newName}];
                 
                 dispatch_async(dispatch_get_main_queue(), ^{
                     if (handler)
@@ -1595,50 +3305,77 @@
                 return;
             }
             
-            if (moveError) {
-                // Log failure
-                NSLog(@"[iCloud] Failed to rename file, %@, to new name: %@. Error: %@", documentName, newName , moveError);
-                
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    if (handler)
-                        handler(moveError);
-                });
-                
-                return;
-            }
+            // Log failure, a move which failed without an error is still reported
+            NSLog(@"[iCloud] Failed to rename file, %@, to new name: %@. Error: %@", documentName, newName , moveError);
+            NSError *error = moveError ?: [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, could not be renamed", documentName] code:100 userInfo:@{@"FileURL": sourceFileURL}];
             
-            if (coordinatorError) {
-                // Log failure
-                NSLog(@"[iCloud] Failed to rename file, %@, to new name: %@. Error: %@", documentName, newName , coordinatorError);
-                
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    if (handler)
-                        handler(coordinatorError);
-                });
-                
-                return;
-            }
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (handler)
+                    handler(error);
+            });
         }];
+        
+        if (coordinatorError) {
+            // The accessor never ran, either because the rename was cancelled or because coordination failed
+            NSError *error = progress.isCancelled ? [self cancellationErrorForDocumentName:documentName] : coordinatorError;
+            if (!progress.isCancelled) NSLog(@"[iCloud] Failed to rename file, %@, to new name: %@. Error: %@", documentName, newName , coordinatorError);
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (handler)
+                    handler(error);
+            });
+        }
     });
+    
+    return progress;
 }
 
-- (void)duplicateOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler {
+- (NSProgress *)duplicateOriginalDocument:(NSString *)documentName withNewName:(NSString *)newName completion:(void (^)(NSError *error))handler {
+    NSProgress *progress = [self documentOperationProgress];
+    
+    // Buffered changes land before the document is duplicated, so the copy includes them
+    if (documentName.length > 0 && [self.writeBehindBuffer hasPendingWritesForDocumentWithName:documentName]) {
+        [self.writeBehindBuffer flushDocumentWithName:documentName completion:^{
+            [self forwardCancellationOfProgress:progress toProgress:[self duplicateOriginalDocument:documentName withNewName:newName completion:^(NSError *error) {
+                progress.completedUnitCount = progress.totalUnitCount;
+                if (handler) handler(error);
+            }]];
+        }];
+        return progress;
+    }
+    
+    // Time the file operation until the handler is called
+    uint64_t span = [self.telemetry beginSpan];
+    void (^timedHandler)(NSError *) = handler;
+    handler = ^(NSError *error) {
+        progress.completedUnitCount = progress.totalUnitCount;
+        [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationFileOperation];
+        if (timedHandler) timedHandler(error);
+    };
+    
     // Log duplication
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Attempting to duplicate document, %@", documentName);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Attempting to duplicate document, %@", documentName];
     
-    // Check for iCloud
-    if ([self quickCloudCheck] == NO) return;
+    // Check for iCloud, queue the duplication until it is available
+    if ([self quickCloudCheck] == NO) {
+        [self journalOfflineOperation:iCloudJournalOperationDuplicate documentPath:documentName destinationPath:newName completion:handler];
+        return progress;
+    }
     
     // Check for nil / null document name
     if (documentName == nil || [documentName isEqualToString:@""] || newName == nil || [newName isEqualToString:@""]) {
         // Log error
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
-        return;
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Specified document name must not be empty"];
+        NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be used. Specify a document name next time." code:001 userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(error);
+        });
+        return progress;
     }
     
     // Create the URLs for the files that are being renamed
-    NSURL *sourceFileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
-    NSURL *newFileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:newName];
+    NSURL *sourceFileURL = [self URLForDocumentPath:documentName];
+    NSURL *newFileURL = [self URLForDocumentPath:newName];
     
     // Check if file exists at source URL
     if (![self.fileManager fileExistsAtPath:[sourceFileURL path]]) {
@@ -1650,7 +3387,7 @@
                 handler(error);
         });
         
-        return;
+        return progress;
     }
     
     // Check if file does not exist at new URL
@@ -1663,26 +3400,36 @@
                 handler(error);
         });
         
-        return;
+        return progress;
     }
     
     // Log success of existence
-    if (self.verboseLogging == YES) NSLog(@"[iCloud] Files passed existence check, preparing to duplicate");
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Files passed existence check, preparing to duplicate"];
     
     // Move to the background thread for safety
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void) {
         NSError *moveError;
         BOOL moveSuccess;
         
+        // Stop if the duplication was cancelled while waiting for the background queue
+        if (progress.isCancelled) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (handler)
+                    handler([self cancellationErrorForDocumentName:documentName]);
+            });
+            return;
+        }
+        
         // Log duplication
-        if (self.verboseLogging == YES) NSLog(@"[iCloud] Duplicating Files");
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Duplicating Files"];
         
-        // Do the actual duplicating
+        // Do the actual duplicating, the copy may be placed in another folder
+        [self createParentFoldersForURL:newFileURL error:nil];
         moveSuccess = [self.fileManager copyItemAtURL:sourceFileURL toURL:newFileURL error:&moveError];
         
         if (moveSuccess) {
             // Log success
-            if (self.verboseLogging == YES) NSLog(@"[iCloud] Duplicated Files");
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Duplicated Files"];
             
             dispatch_async(dispatch_get_main_queue(), ^{
                 if (handler)
@@ -1691,18 +3438,195 @@
             return;
         }
         
-        if (moveError) {
-            // Log failure
-            NSLog(@"[iCloud] Failed to duplicate file, %@, with new name: %@. Error: %@", documentName, newName , moveError);
+        // Log failure, a copy which failed without an error is still reported
+        NSLog(@"[iCloud] Failed to duplicate file, %@, with new name: %@. Error: %@", documentName, newName , moveError);
+        NSError *error = moveError ?: [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, could not be duplicated", documentName] code:100 userInfo:@{@"FileURL": sourceFileURL}];
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (handler)
+                handler(error);
+        });
+    });
+    
+    return progress;
+}
+
+- (NSProgress *)renameDocumentsWithNewNames:(NSDictionary *)newNames completion:(void (^)(NSDictionary *errors))handler {
+    return [self performBatchOperation:iCloudJournalOperationRename withDocuments:newNames completion:handler];
+}
+
+- (NSProgress *)duplicateDocumentsWithNewNames:(NSDictionary *)newNames completion:(void (^)(NSDictionary *errors))handler {
+    return [self performBatchOperation:iCloudJournalOperationDuplicate withDocuments:newNames completion:handler];
+}
+
+- (NSProgress *)performBatchOperation:(iCloudJournalOperation)operation withDocuments:(NSDictionary *)documents completion:(void (^)(NSDictionary *errors))handler {
+    NSProgress *progress = [NSProgress progressWithTotalUnitCount:[documents count]];
+    progress.cancellable = YES;
+    progress.pausable = NO;
+    
+    NSMutableDictionary *errors = [NSMutableDictionary dictionary];
+    NSString *operationName = (operation == iCloudJournalOperationDelete) ? @"delete" : ((operation == iCloudJournalOperationRename) ? @"rename" : @"duplicate");
+    
+    // Log batch
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Beginning batch %@ of %lu documents", operationName, (unsigned long)[documents count]];
+    
+    // Time the whole batch until the handler is called
+    uint64_t span = [self.telemetry beginSpan];
+    void (^finish)(void) = ^{
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self.telemetry endSpan:span forOperation:iCloudTelemetryOperationBatch];
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished batch %@, %lu of %lu documents failed", operationName, (unsigned long)[errors count], (unsigned long)[documents count]];
+            if (handler) handler(errors);
+        });
+    };
+    
+    // Check for iCloud, queue every operation until it is available
+    if ([self quickCloudCheck] == NO) {
+        // Every handler is called on the main queue once its operation is queued or has failed, empty names included
+        dispatch_group_t journalGroup = dispatch_group_create();
+        for (NSString *documentName in documents) {
+            NSString *newName = (documents[documentName] == [NSNull null]) ? nil : documents[documentName];
+            dispatch_group_enter(journalGroup);
+            [self journalOfflineOperation:operation documentPath:documentName destinationPath:newName completion:^(NSError *error) {
+                if (error) errors[documentName] = error;
+                progress.completedUnitCount++;
+                dispatch_group_leave(journalGroup);
+            }];
+        }
+        
+        dispatch_group_notify(journalGroup, dispatch_get_main_queue(), ^{
+            finish();
+        });
+        return progress;
+    }
+    
+    // Buffered changes of deleted documents are dropped, the others land before the batch starts
+    dispatch_group_t flushGroup = dispatch_group_create();
+    for (NSString *documentName in documents) {
+        if (documentName.length == 0) continue;
+        if (operation == iCloudJournalOperationDelete) [self.writeBehindBuffer discardPendingWritesForDocumentWithName:documentName];
+        if ([self.writeBehindBuffer hasPendingWritesForDocumentWithName:documentName] == NO) continue;
+        
+        dispatch_group_enter(flushGroup);
+        [self.writeBehindBuffer flushDocumentWithName:documentName completion:^{
+            dispatch_group_leave(flushGroup);
+        }];
+    }
+    
+    // Check every document on a background thread, a batch may hold thousands of them
+    dispatch_group_notify(flushGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSMutableArray *documentNames = [NSMutableArray arrayWithCapacity:[documents count]];
+        NSMutableArray *sourceIntents = [NSMutableArray arrayWithCapacity:[documents count]];
+        NSMutableArray *destinationIntents = [NSMutableArray arrayWithCapacity:[documents count]];
+        NSMutableSet *destinationPaths = [NSMutableSet set];
+        
+        for (NSString *documentName in documents) {
+            NSString *newName = (documents[documentName] == [NSNull null]) ? nil : documents[documentName];
+            NSURL *sourceURL = documentName.length > 0 ? [self URLForDocumentPath:documentName] : nil;
+            NSURL *destinationURL = newName.length > 0 ? [self URLForDocumentPath:newName] : nil;
+            NSError *error = nil;
             
-            dispatch_async(dispatch_get_main_queue(), ^{
-                if (handler)
-                    handler(moveError);
-            });
+            if (sourceURL == nil || (operation != iCloudJournalOperationDelete && destinationURL == nil)) {
+                error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be used. Specify a document name next time." code:001 userInfo:nil];
+            } else if (![self.fileManager fileExistsAtPath:[sourceURL path]]) {
+                error = [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, does not exist at path: %@", documentName, sourceURL] code:404 userInfo:@{@"FileURL": sourceURL}];
+            } else if (destinationURL && ([self.fileManager fileExistsAtPath:[destinationURL path]] || [destinationPaths containsObject:[destinationURL path]])) {
+                error = [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, already exists at path: %@", newName, destinationURL] code:512 userInfo:@{@"FileURL": destinationURL}];
+            }
             
+            if (error) {
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Skipping %@ of %@: %@", operationName, documentName, error.domain];
+                errors[documentName] = error;
+                progress.completedUnitCount++;
+                continue;
+            }
+            
+            // Pooled documents would outlive the file or still point at the old URL
+            if (operation != iCloudJournalOperationDuplicate) [self.documentPool removeDocumentWithName:documentName];
+            
+            [documentNames addObject:documentName];
+            if (operation == iCloudJournalOperationDelete) {
+                [sourceIntents addObject:[NSFileAccessIntent writingIntentWithURL:sourceURL options:NSFileCoordinatorWritingForDeleting]];
+                [destinationIntents addObject:[NSNull null]];
+            } else {
+                [destinationPaths addObject:[destinationURL path]];
+                [sourceIntents addObject:(operation == iCloudJournalOperationRename) ? [NSFileAccessIntent writingIntentWithURL:sourceURL options:NSFileCoordinatorWritingForMoving] : [NSFileAccessIntent readingIntentWithURL:sourceURL options:0]];
+                [destinationIntents addObject:[NSFileAccessIntent writingIntentWithURL:destinationURL options:NSFileCoordinatorWritingForReplacing]];
+            }
+        }
+        
+        if ([documentNames count] == 0) {
+            finish();
             return;
         }
+        
+        // Coordinate every affected URL at once, cancelling the progress abandons the pending coordinated access
+        NSMutableArray *intents = [NSMutableArray arrayWithArray:sourceIntents];
+        for (id intent in destinationIntents) if (intent != [NSNull null]) [intents addObject:intent];
+        
+        NSFileCoordinator *coordinator = [self.fileManager fileCoordinatorWithFilePresenter:nil];
+        progress.cancellationHandler = ^{
+            [coordinator cancel];
+        };
+        if (progress.isCancelled) [coordinator cancel];
+        
+        NSOperationQueue *accessQueue = [[NSOperationQueue alloc] init];
+        accessQueue.qualityOfService = NSQualityOfServiceUserInitiated;
+        [coordinator coordinateAccessWithIntents:intents queue:accessQueue byAccessor:^(NSError *coordinatorError) {
+            if (coordinatorError) {
+                // The accessor never got access, either because the batch was cancelled or because coordination failed
+                if (!progress.isCancelled) NSLog(@"[iCloud] Failed to coordinate batch %@ of %lu documents. Error: %@", operationName, (unsigned long)[documentNames count], coordinatorError);
+                for (NSString *documentName in documentNames) errors[documentName] = progress.isCancelled ? [self cancellationErrorForDocumentName:documentName] : coordinatorError;
+                
+                // Every remaining document has its error, the batch is done
+                progress.completedUnitCount = progress.totalUnitCount;
+                finish();
+                return;
+            }
+            
+            // Do the file work in parallel while the whole batch is coordinated, using the URLs the coordinator handed back
+            __block NSUInteger succeeded = 0;
+            NSMutableDictionary *movedNames = [NSMutableDictionary dictionary];
+            dispatch_apply([documentNames count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+                NSString *documentName = documentNames[index];
+                NSURL *sourceURL = [sourceIntents[index] URL];
+                NSURL *destinationURL = (destinationIntents[index] == [NSNull null]) ? nil : [destinationIntents[index] URL];
+                NSError *error = nil;
+                BOOL success = NO;
+                
+                if (operation == iCloudJournalOperationDelete) {
+                    success = [self.fileManager removeItemAtURL:sourceURL error:&error];
+                } else {
+                    // The new name may place the document in another folder
+                    [self createParentFoldersForURL:destinationURL error:nil];
+                    if (operation == iCloudJournalOperationRename) success = [self.fileManager moveItemAtURL:sourceURL toURL:destinationURL error:&error];
+                    else success = [self.fileManager copyItemAtURL:sourceURL toURL:destinationURL error:&error];
+                }
+                
+                if (success && operation != iCloudJournalOperationDuplicate) [self.contentHashCache removeDigestForFileAtURL:sourceURL];
+                @synchronized (errors) {
+                    // File presenters of a renamed document follow it to its new URL
+                    if (success && operation == iCloudJournalOperationRename) [coordinator itemAtURL:sourceURL didMoveToURL:destinationURL];
+                    if (success && operation != iCloudJournalOperationDuplicate) movedNames[documentName] = documents[documentName];
+                    if (success) succeeded++;
+                    else {
+                        NSLog(@"[iCloud] Failed to %@ file, %@. Error: %@", operationName, documentName, error);
+                        errors[documentName] = error ?: [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, could not be processed", documentName] code:100 userInfo:@{@"FileURL": sourceURL}];
+                    }
+                    progress.completedUnitCount++;
+                }
+            });
+            
+            // The index follows the batch before the coordinated access ends, one refresh covers the whole batch
+            [self moveIndexedDocuments:movedNames];
+            if (succeeded > 0) dispatch_async(dispatch_get_main_queue(), ^{
+                [self updateFiles];
+            });
+            finish();
+        }];
     });
+    
+    return progress;
 }
 
 //---------------------------------------------------------------------------------------------------------------------------------------------//
@@ -1723,68 +3647,4 @@
     return nil;
 }
 
-- (void)saveChangesToDocumentWithName:(NSString *)documentName withContent:(NSData *)content completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
-    // This method is deprecated: Due to the fact, that the document is recreated in closed state on every call, it is just a copy of the saveAndCloseDocumentWithName-method above
-    for (int i = 0; i <= 5; i++) NSLog(@"[iCloud] WARNING: saveChangesToDocumentWithName:withContent:completion: is deprecated and will become unavailable in version 8.0. Use [- saveAndCloseDocumentWithName:withContent:completion:] instead.");
-    
-	[self saveAndCloseDocumentWithName:documentName withContent:content completion:handler];
-    
-	/*
-     
-     // Log save
-     if (verboseLogging == YES) NSLog(@"[iCloud] Beginning document change save");
-     
-     // Check for iCloud
-     if ([self quickCloudCheck] == NO) return;
-     
-     // Check for nil / null document name
-     if (documentName == nil || [documentName isEqualToString:@""]) {
-     // Log error
-     if (verboseLogging == YES) NSLog(@"[iCloud] Specified document name must not be empty");
-     NSError *error = [NSError errorWithDomain:@"The specified document name was empty / blank and could not be saved. Specify a document name next time." code:001 userInfo:nil];
-     
-     handler(nil, nil, error);
-     
-     return;
-     }
-     
-     // Get the URL to save the changes to
-     NSURL *fileURL = [[self ubiquitousDocumentsDirectoryURL] URLByAppendingPathComponent:documentName];
-     
-     // Initialize a document with that path
-     iCloudDocument *document = [[iCloudDocument alloc] initWithFileURL:fileURL];
-     document.contents = content;
-     
-     // If the file exists, close it; otherwise, create it.
-     if ([fileManager fileExistsAtPath:[fileURL path]]) {
-     // Log recording
-     if (verboseLogging == YES) NSLog(@"[iCloud] Document exists, saving changes");
-     
-     // Record Changes
-     [document updateChangeCount:UIDocumentChangeDone];
-     
-     handler(document, document.contents, nil);
-     } else {
-     // Log saving
-     if (verboseLogging == YES) NSLog(@"[iCloud] Document is new, saving");
-     
-     // Save and create the new document
-     [document saveToURL:document.fileURL forSaveOperation:UIDocumentSaveForCreating completionHandler:^(BOOL success) {
-     if (success) {
-     // Log the save
-     if (verboseLogging == YES) NSLog(@"[iCloud] New document created successfully, recorded changes");
-     
-     // Run the completion block and pass the document
-     handler(document, document.contents, nil);;
-     } else {
-     NSLog(@"[iCloud] Error while creating the document: %s", __PRETTY_FUNCTION__);
-     NSError *error = [NSError errorWithDomain:[NSString stringWithFormat:@"%s error while creating the document, %@, in iCloud", __PRETTY_FUNCTION__, document.fileURL] code:100 userInfo:[NSDictionary dictionaryWithObject:fileURL forKey:@"FileURL"]];
-     
-     handler(document, document.contents, error);
-     }
-     }];
-     }
-	 */
-}
-
 @end
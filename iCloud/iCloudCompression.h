@@ -0,0 +1,107 @@
+//
+//  iCloudCompression.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The codecs available for compressed document storage */
+typedef NS_ENUM(NSInteger, iCloudCompressionCodec) {
+    /// Store documents uncompressed
+    iCloudCompressionCodecNone = 0,
+    /// zlib (raw deflate at level 5), the best ratio of the supported codecs
+    iCloudCompressionCodecZlib = 1,
+    /// LZ4, the fastest codec with a lower ratio
+    iCloudCompressionCodecLZ4 = 2,
+    /// LZFSE, close to zlib's ratio at a much higher speed
+    iCloudCompressionCodecLZFSE = 3
+};
+
+/** The length in bytes of the header written in front of compressed payloads */
+extern NSUInteger const iCloudCompressionHeaderLength;
+
+/** The iCloudCompression class compresses and decompresses document payloads.
+
+ Compressed payloads begin with a 16 byte header: the magic bytes "iCDZ", a format version, the codec, two reserved bytes and the uncompressed length as a little-endian 64-bit integer. Payloads without the header are treated as uncompressed, so files written before compression was enabled keep reading transparently.
+
+ Both directions stream the payload through a fixed-size buffer, so the input can be a memory-mapped file and the output can go straight to disk. The codecs are provided by libcompression, which is available on iOS 9.0 and later. On earlier systems no codec is available and documents are stored uncompressed. */
+@interface iCloudCompression : NSObject
+
+
+
+/** @name Codecs */
+
+/** Check whether a codec can be used on this system
+
+ @param codec The codec to check
+ @return YES if payloads can be compressed and decompressed with the codec. Always YES for iCloudCompressionCodecNone. */
++ (BOOL)isCodecAvailable:(iCloudCompressionCodec)codec;
+
+/** Check whether a payload begins with a compression header
+
+ @param data The payload to check. This value must not be nil.
+ @return YES if the payload was written by this class */
++ (BOOL)isCompressedData:(NSData *)data __attribute__((nonnull));
+
+
+
+/** @name Compressing */
+
+/** Compress a payload into a new data object
+
+ @param data The payload to compress. This value must not be nil.
+ @param codec The codec to compress with
+ @param error On failure, contains an NSError describing the problem
+ @return The header followed by the compressed payload, or nil on failure. When codec is iCloudCompressionCodecNone the payload is returned unchanged. */
++ (NSData *)compressData:(NSData *)data codec:(iCloudCompressionCodec)codec error:(NSError **)error __attribute__((nonnull (1)));
+
+/** Compress a payload in a stream of chunks
+
+ @discussion The handler receives the header first, then every chunk of compressed output as soon as the buffer fills up. Only one chunk is held in memory at a time, which makes this the preferred way to write large payloads to a file.
+
+ @param data The payload to compress. This value must not be nil.
+ @param codec The codec to compress with. Must not be iCloudCompressionCodecNone.
+ @param bufferLength The maximum length of each chunk, in bytes. Pass 0 for the default of 256 KB.
+ @param handler Called with each chunk of the compressed payload, in order. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return YES if the whole payload was compressed */
++ (BOOL)compressData:(NSData *)data codec:(iCloudCompressionCodec)codec bufferLength:(NSUInteger)bufferLength chunkHandler:(void (^)(NSData *chunk))handler error:(NSError **)error __attribute__((nonnull (1, 4)));
+
+
+
+/** @name Decompressing */
+
+/** Decompress a payload into a new data object
+
+ @param data The payload to decompress. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return The uncompressed payload, or nil if it is corrupt or its codec is unavailable. Payloads without a compression header are returned unchanged. */
++ (NSData *)decompressData:(NSData *)data error:(NSError **)error __attribute__((nonnull (1)));
+
+/** Decompress a payload in a stream of chunks
+
+ @discussion Payloads without a compression header are sliced into chunks unchanged. Set stop to YES to end decompression early, for example once a requested byte range has been read.
+
+ @param data The payload to decompress. This value must not be nil.
+ @param bufferLength The maximum length of each chunk, in bytes. Pass 0 for the default of 256 KB.
+ @param handler Called with each chunk of the uncompressed payload, in order. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return YES if the payload was decompressed (or the handler stopped early), NO if it is corrupt or its codec is unavailable */
++ (BOOL)decompressData:(NSData *)data bufferLength:(NSUInteger)bufferLength chunkHandler:(void (^)(NSData *chunk, BOOL *stop))handler error:(NSError **)error __attribute__((nonnull (1, 3)));
+
+/** Read the uncompressed length recorded in a compression header
+
+ @param data A compressed payload, or at least its first iCloudCompressionHeaderLength bytes. This value must not be nil.
+ @return The uncompressed length, or the length of data if it has no compression header */
++ (unsigned long long)uncompressedLengthOfData:(NSData *)data __attribute__((nonnull));
+
+@end
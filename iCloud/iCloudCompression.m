@@ -0,0 +1,259 @@
+//
+//  iCloudCompression.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudCompression.h"
+#include <compression.h>
+
+// Streams move through a buffer of this size unless the caller asks for another one
+#define COMPRESSION_BUFFER_LENGTH (256 * 1024)
+
+NSUInteger const iCloudCompressionHeaderLength = 16;
+
+/// Largest uncompressed to compressed length ratio accepted from a header, well above what any supported codec achieves
+static const unsigned long long iCloudCompressionMaximumRatio = 4096;
+
+/// Magic bytes at the start of every compressed payload
+static const unsigned char iCloudCompressionMagic[4] = {'i', 'C', 'D', 'Z'};
+
+/// The header format written by this version
+static const unsigned char iCloudCompressionFormatVersion = 1;
+
+@interface iCloudCompression ()
+
+/// Map a codec to its libcompression algorithm, returns NO if the codec is unknown or unavailable
++ (BOOL)getAlgorithm:(compression_algorithm *)algorithm forCodec:(iCloudCompressionCodec)codec;
+
+/// Build the header written in front of a payload compressed with the codec
++ (NSData *)headerForCodec:(iCloudCompressionCodec)codec uncompressedLength:(unsigned long long)length;
+
+/// The error returned for corrupt payloads and unavailable codecs
++ (NSError *)errorWithMessage:(NSString *)message;
+
+@end
+
+@implementation iCloudCompression
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Codecs -------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Codecs
+
++ (BOOL)getAlgorithm:(compression_algorithm *)algorithm forCodec:(iCloudCompressionCodec)codec {
+    // libcompression is weakly linked, its symbols are missing before iOS 9.0
+    if (&compression_stream_init == NULL) return NO;
+
+    switch (codec) {
+        case iCloudCompressionCodecZlib: *algorithm = COMPRESSION_ZLIB; return YES;
+        case iCloudCompressionCodecLZ4: *algorithm = COMPRESSION_LZ4; return YES;
+        case iCloudCompressionCodecLZFSE: *algorithm = COMPRESSION_LZFSE; return YES;
+        default: return NO;
+    }
+}
+
++ (BOOL)isCodecAvailable:(iCloudCompressionCodec)codec {
+    if (codec == iCloudCompressionCodecNone) return YES;
+
+    compression_algorithm algorithm;
+    return [self getAlgorithm:&algorithm forCodec:codec];
+}
+
++ (BOOL)isCompressedData:(NSData *)data {
+    if (data.length < iCloudCompressionHeaderLength) return NO;
+
+    const unsigned char *bytes = data.bytes;
+    return memcmp(bytes, iCloudCompressionMagic, sizeof(iCloudCompressionMagic)) == 0 && bytes[4] == iCloudCompressionFormatVersion;
+}
+
++ (unsigned long long)uncompressedLengthOfData:(NSData *)data {
+    if (![self isCompressedData:data]) return data.length;
+
+    const unsigned char *bytes = data.bytes;
+    unsigned long long length = 0;
+    for (NSUInteger index = 0; index < 8; index++) length |= (unsigned long long)bytes[8 + index] << (8 * index);
+    return length;
+}
+
++ (NSData *)headerForCodec:(iCloudCompressionCodec)codec uncompressedLength:(unsigned long long)length {
+    unsigned char header[16] = {0};
+    memcpy(header, iCloudCompressionMagic, sizeof(iCloudCompressionMagic));
+    header[4] = iCloudCompressionFormatVersion;
+    header[5] = (unsigned char)codec;
+    for (NSUInteger index = 0; index < 8; index++) header[8 + index] = (unsigned char)(length >> (8 * index));
+
+    return [NSData dataWithBytes:header length:sizeof(header)];
+}
+
++ (NSError *)errorWithMessage:(NSString *)message {
+    return [NSError errorWithDomain:message code:520 userInfo:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Compressing --------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Compressing
+
++ (NSData *)compressData:(NSData *)data codec:(iCloudCompressionCodec)codec error:(NSError **)error {
+    if (codec == iCloudCompressionCodecNone) return data;
+
+    NSMutableData *compressedData = [NSMutableData dataWithCapacity:iCloudCompressionHeaderLength + data.length / 2];
+    BOOL success = [self compressData:data codec:codec bufferLength:0 chunkHandler:^(NSData *chunk) {
+        [compressedData appendData:chunk];
+    } error:error];
+
+    return success ? compressedData : nil;
+}
+
++ (BOOL)compressData:(NSData *)data codec:(iCloudCompressionCodec)codec bufferLength:(NSUInteger)bufferLength chunkHandler:(void (^)(NSData *chunk))handler error:(NSError **)error {
+    compression_algorithm algorithm;
+    if (![self getAlgorithm:&algorithm forCodec:codec]) {
+        if (error) *error = [self errorWithMessage:[NSString stringWithFormat:@"The compression codec, %ld, is not available", (long)codec]];
+        return NO;
+    }
+    if (bufferLength == 0) bufferLength = COMPRESSION_BUFFER_LENGTH;
+
+    compression_stream stream;
+    if (compression_stream_init(&stream, COMPRESSION_STREAM_ENCODE, algorithm) != COMPRESSION_STATUS_OK) {
+        if (error) *error = [self errorWithMessage:@"The compression stream could not be created"];
+        return NO;
+    }
+
+    handler([self headerForCodec:codec uncompressedLength:data.length]);
+
+    // The whole input is available (and possibly mapped), only the output moves through the buffer
+    uint8_t *buffer = malloc(bufferLength);
+    stream.src_ptr = data.bytes;
+    stream.src_size = data.length;
+
+    compression_status status;
+    do {
+        stream.dst_ptr = buffer;
+        stream.dst_size = bufferLength;
+        status = compression_stream_process(&stream, COMPRESSION_STREAM_FINALIZE);
+        if (status == COMPRESSION_STATUS_ERROR) break;
+
+        size_t producedLength = bufferLength - stream.dst_size;
+        if (producedLength > 0) {
+            @autoreleasepool {
+                handler([NSData dataWithBytes:buffer length:producedLength]);
+            }
+        }
+    } while (status == COMPRESSION_STATUS_OK);
+
+    compression_stream_destroy(&stream);
+    free(buffer);
+
+    if (status != COMPRESSION_STATUS_END) {
+        if (error) *error = [self errorWithMessage:@"The payload could not be compressed"];
+        return NO;
+    }
+
+    return YES;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Decompressing ------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Decompressing
+
++ (NSData *)decompressData:(NSData *)data error:(NSError **)error {
+    if (![self isCompressedData:data]) return data;
+
+    // The header records the final length, the output never has to grow
+    unsigned long long uncompressedLength = [self uncompressedLengthOfData:data];
+    if (uncompressedLength > NSUIntegerMax) {
+        if (error) *error = [self errorWithMessage:@"The compressed payload is too large to load"];
+        return nil;
+    }
+
+    // A corrupt or hostile header must not be able to force a huge allocation
+    unsigned long long compressedLength = data.length - iCloudCompressionHeaderLength;
+    if (uncompressedLength > MAX(compressedLength, 1ULL) * iCloudCompressionMaximumRatio) {
+        if (error) *error = [self errorWithMessage:@"The compressed payload is corrupt or truncated"];
+        return nil;
+    }
+
+    NSMutableData *uncompressedData = [NSMutableData dataWithCapacity:(NSUInteger)uncompressedLength];
+    BOOL success = [self decompressData:data bufferLength:0 chunkHandler:^(NSData *chunk, BOOL *stop) {
+        [uncompressedData appendData:chunk];
+    } error:error];
+
+    return success ? uncompressedData : nil;
+}
+
++ (BOOL)decompressData:(NSData *)data bufferLength:(NSUInteger)bufferLength chunkHandler:(void (^)(NSData *chunk, BOOL *stop))handler error:(NSError **)error {
+    if (bufferLength == 0) bufferLength = COMPRESSION_BUFFER_LENGTH;
+    BOOL stop = NO;
+
+    // Uncompressed payloads are handed out as they are
+    if (![self isCompressedData:data]) {
+        for (NSUInteger location = 0; location < data.length && stop == NO; location += bufferLength) {
+            @autoreleasepool {
+                handler([data subdataWithRange:NSMakeRange(location, MIN(bufferLength, data.length - location))], &stop);
+            }
+        }
+        return YES;
+    }
+
+    const unsigned char *bytes = data.bytes;
+    iCloudCompressionCodec codec = (iCloudCompressionCodec)bytes[5];
+    compression_algorithm algorithm;
+    if (![self getAlgorithm:&algorithm forCodec:codec]) {
+        if (error) *error = [self errorWithMessage:[NSString stringWithFormat:@"The compression codec, %ld, is not available", (long)codec]];
+        return NO;
+    }
+
+    compression_stream stream;
+    if (compression_stream_init(&stream, COMPRESSION_STREAM_DECODE, algorithm) != COMPRESSION_STATUS_OK) {
+        if (error) *error = [self errorWithMessage:@"The decompression stream could not be created"];
+        return NO;
+    }
+
+    uint8_t *buffer = malloc(bufferLength);
+    stream.src_ptr = bytes + iCloudCompressionHeaderLength;
+    stream.src_size = data.length - iCloudCompressionHeaderLength;
+    unsigned long long expectedLength = [self uncompressedLengthOfData:data];
+    unsigned long long producedTotal = 0;
+
+    compression_status status;
+    do {
+        stream.dst_ptr = buffer;
+        stream.dst_size = bufferLength;
+        status = compression_stream_process(&stream, 0);
+        if (status == COMPRESSION_STATUS_ERROR) break;
+
+        size_t producedLength = bufferLength - stream.dst_size;
+        producedTotal += producedLength;
+
+        // Never hand out more than the header announced
+        if (producedTotal > expectedLength) {
+            status = COMPRESSION_STATUS_ERROR;
+            break;
+        }
+        if (producedLength > 0) {
+            @autoreleasepool {
+                handler([NSData dataWithBytes:buffer length:producedLength], &stop);
+            }
+        }
+
+        // A stream which produces nothing while input remains is truncated
+        if (status == COMPRESSION_STATUS_OK && producedLength == 0 && stream.src_size == 0) status = COMPRESSION_STATUS_ERROR;
+    } while (status == COMPRESSION_STATUS_OK && stop == NO);
+
+    compression_stream_destroy(&stream);
+    free(buffer);
+
+    if (stop) return YES;
+    if (status != COMPRESSION_STATUS_END || producedTotal != expectedLength) {
+        if (error) *error = [self errorWithMessage:@"The compressed payload is corrupt or truncated"];
+        return NO;
+    }
+
+    return YES;
+}
+
+@end
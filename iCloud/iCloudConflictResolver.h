@@ -0,0 +1,111 @@
+//
+//  iCloudConflictResolver.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+// Import iCloudCompression
+#import "iCloudCompression.h"
+
+// Import iCloudTelemetry
+#import "iCloudTelemetry.h"
+
+/** The policies iCloudConflictResolver can apply to a conflicted document */
+typedef NS_ENUM(NSInteger, iCloudConflictPolicy) {
+    /// Leave conflicts to the application, for example through findUnresolvedConflictingVersionsOfFile: and resolveConflictForFile:withSelectedFileVersion:
+    iCloudConflictPolicyManual = 0,
+    /// Keep the most recently modified version, as chosen by laterVersion(), and discard the others
+    iCloudConflictPolicyLatestWins = 1,
+    /// Keep the current version and save every conflicting version next to it as a separate document
+    iCloudConflictPolicyKeepBoth = 2,
+    /// Replace the document with the contents returned by the merge handler, or by the package merge handler for package documents
+    iCloudConflictPolicyMerge = 3
+};
+
+/** The iCloudConflictResolver class resolves document conflicts in the background according to a policy.
+
+ Documents are queued with resolveConflictsInDocuments: and resolved in batches of at most maximumBatchSize documents, with batchInterval seconds between batches, so a container with many conflicts never monopolizes the disk or the file coordinator. Each document is resolved inside a coordinated write: its unresolved versions are looked up, the policy is applied, the versions are marked resolved and the other versions are removed. Versions are read, and copies kept by iCloudConflictPolicyKeepBoth are written, under the same coordinator. Documents which fail to resolve stay queued and are tried again after retryInterval, doubling up to maximumRetryInterval. Merging a document without a merge handler fails with code 521 and is not retried, queue the document again once a handler is set. After each batch, reportHandler is called with what was resolved and how.
+
+ The iCloud class owns a resolver. It tracks conflicts from NSMetadataUbiquitousItemHasUnresolvedConflictsKey in its metadata query and queues each newly conflicted document here, unless the policy is iCloudConflictPolicyManual. */
+@interface iCloudConflictResolver : NSObject
+
+
+
+/** @name Resolving Conflicts */
+
+/** Queue documents for resolution
+
+ @discussion Does nothing when the policy is iCloudConflictPolicyManual. Documents which are already queued are not queued twice.
+
+ @param documentURLs A dictionary of document names (NSString) and their file URLs (NSURL). This value must not be nil. */
+- (void)resolveConflictsInDocuments:(NSDictionary *)documentURLs __attribute__((nonnull));
+
+/** Resolve the conflicts of one document right away, on the calling thread
+
+ @discussion Blocks while the document is coordinated, never call it on the main thread.
+
+ @param documentName The name of the document. This value must not be nil.
+ @param fileURL The file URL of the document. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return A description of the resolution (see reportHandler), an empty dictionary if the document had no unresolved conflicts, or nil on failure */
+- (NSDictionary *)resolveConflictsInDocumentWithName:(NSString *)documentName atURL:(NSURL *)fileURL error:(NSError **)error __attribute__((nonnull (1, 2)));
+
+
+
+/** @name Properties */
+
+/** The policy applied to conflicted documents. The default value is iCloudConflictPolicyManual. */
+@property (assign) iCloudConflictPolicy policy;
+
+/** Code block called by iCloudConflictPolicyMerge with the current contents of a document and the contents (NSData) of each conflicting version, newest first. Return the merged contents, or nil to leave the conflict unresolved. Contents are passed decompressed. Called on a background thread. */
+@property (copy) NSData *(^mergeHandler)(NSString *documentName, NSData *currentContents, NSArray *conflictContents);
+
+/** Code block called by iCloudConflictPolicyMerge instead of mergeHandler for package documents, with a file wrapper of the current package and one (NSFileWrapper) of each conflicting version, newest first. Return a file wrapper of the merged package, which replaces the document, or nil to leave the conflict unresolved. The wrappers are read completely before the handler is called. Called on a background thread. */
+@property (copy) NSFileWrapper *(^packageMergeHandler)(NSString *documentName, NSFileWrapper *currentContents, NSArray *conflictContents);
+
+/** The maximum number of documents resolved in one batch. The default value is 16. */
+@property (assign) NSUInteger maximumBatchSize;
+
+/** The pause, in seconds, between two batches. The default value is 0.25 seconds. */
+@property (assign) NSTimeInterval batchInterval;
+
+/** The delay, in seconds, before a document which failed to resolve is queued again. It doubles with every failure of the same document. The default value is 5 seconds. */
+@property (assign) NSTimeInterval retryInterval;
+
+/** The longest delay, in seconds, between two attempts at the same document. The default value is 10 minutes. */
+@property (assign) NSTimeInterval maximumRetryInterval;
+
+/** The codec merged contents are compressed with before they are written. Set by the iCloud class from its documentCompressionCodec. */
+@property (assign) iCloudCompressionCodec compressionCodec;
+
+/** The storage backend used to look up versions and copy conflicting versions. Set by the iCloud class. */
+@property (strong) NSFileManager *fileManager;
+
+/** Receives a conflict count for every resolved document */
+@property (strong) iCloudTelemetry *telemetry;
+
+/** Log each resolution */
+@property (assign) BOOL verboseLogging;
+
+/** Code block called on the main thread after each batch which resolved or failed to resolve a document.
+
+ @discussion The resolutions dictionary maps the name of each resolved document to a dictionary with the applied policy (NSNumber) under `policy`, the number of conflicting versions (NSNumber) under `versions` and, for iCloudConflictPolicyKeepBoth, the names (NSString) of the documents the versions were saved to under `copies`. The errors dictionary maps the name of each document which could not be resolved to its NSError, such documents are retried unless the error code is 521 (no merge handler). */
+@property (copy) void (^reportHandler)(NSDictionary *resolutions, NSDictionary *errors);
+
+/** The number of documents waiting for resolution, including the documents waiting to be retried */
+@property (assign, readonly) NSUInteger pendingDocumentCount;
+
+/** The number of documents resolved since the resolver was created */
+@property (assign, readonly) NSUInteger resolvedDocumentCount;
+
+@end
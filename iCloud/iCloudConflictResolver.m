@@ -0,0 +1,369 @@
+//
+//  iCloudConflictResolver.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudConflictResolver.h"
+#import "iCloudStorageBackend.h"
+
+@interface iCloudConflictResolver ()
+
+/// File URLs of the queued documents keyed by name
+@property (strong) NSMutableDictionary *pendingURLs;
+
+/// Names of the queued documents, in the order they were queued
+@property (strong) NSMutableArray *pendingNames;
+
+/// File URLs of the documents which failed to resolve and wait for a retry, keyed by name
+@property (strong) NSMutableDictionary *retryURLs;
+
+/// The number of failed attempts of each document since it last resolved, keyed by name
+@property (strong) NSMutableDictionary *failedAttempts;
+
+/// The number of documents of the running batch which have not been resolved yet
+@property (assign) NSUInteger activeDocumentCount;
+
+/// Set while a batch is scheduled or running, so that only one runs at a time
+@property (assign) BOOL batchScheduled;
+
+/// Batches run here, one at a time
+@property (strong) dispatch_queue_t resolverQueue;
+
+@property (assign, readwrite) NSUInteger resolvedDocumentCount;
+
+/// Run the next batch after a delay unless one is already scheduled
+- (void)scheduleBatchAfterDelay:(NSTimeInterval)delay;
+
+/// Resolve up to maximumBatchSize queued documents and report them
+- (void)runBatch;
+
+/// Keep a document which failed to resolve and queue it again once its backoff has passed
+- (void)scheduleRetryOfDocumentWithName:(NSString *)documentName atURL:(NSURL *)fileURL;
+
+/// Check whether trying again can succeed, a failure which needs a change of configuration (such as a missing merge handler) is not retried
+- (BOOL)isRetryableError:(NSError *)error;
+
+/// Apply the policy to the unresolved versions of a document, called inside the coordinated write
+- (NSDictionary *)applyPolicy:(iCloudConflictPolicy)policy toDocumentWithName:(NSString *)documentName atURL:(NSURL *)fileURL conflictVersions:(NSArray *)conflictVersions coordinator:(NSFileCoordinator *)coordinator error:(NSError **)error;
+
+/// Read the contents of a document or of one of its versions for the merge handler, an NSFileWrapper for packages and decompressed NSData otherwise
+- (id)mergeContentsAtURL:(NSURL *)fileURL isPackage:(BOOL)isPackage coordinator:(NSFileCoordinator *)coordinator error:(NSError **)error;
+
+/// A free file URL next to the document for a conflicting version kept by iCloudConflictPolicyKeepBoth
+- (NSURL *)copyURLForDocumentAtURL:(NSURL *)fileURL version:(id <iCloudFileVersion>)version;
+
+@end
+
+@implementation iCloudConflictResolver
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _maximumBatchSize = 16;
+        _batchInterval = 0.25;
+        _retryInterval = 5;
+        _maximumRetryInterval = 10 * 60;
+        _pendingURLs = [NSMutableDictionary dictionary];
+        _pendingNames = [NSMutableArray array];
+        _retryURLs = [NSMutableDictionary dictionary];
+        _failedAttempts = [NSMutableDictionary dictionary];
+        _fileManager = [NSFileManager defaultManager];
+        _resolverQueue = dispatch_queue_create("com.iRareMedia.iCloud.conflicts", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_resolverQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    }
+    return self;
+}
+
+- (NSUInteger)pendingDocumentCount {
+    @synchronized (self) {
+        return self.pendingNames.count + self.activeDocumentCount + self.retryURLs.count;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Batches ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Batches
+
+- (void)resolveConflictsInDocuments:(NSDictionary *)documentURLs {
+    if (self.policy == iCloudConflictPolicyManual || documentURLs.count == 0) return;
+
+    @synchronized (self) {
+        for (NSString *documentName in documentURLs) {
+            // Queueing a document again skips the rest of its backoff
+            [self.retryURLs removeObjectForKey:documentName];
+            if (!self.pendingURLs[documentName]) [self.pendingNames addObject:documentName];
+            self.pendingURLs[documentName] = documentURLs[documentName];
+        }
+    }
+
+    [self scheduleBatchAfterDelay:0];
+}
+
+- (void)scheduleBatchAfterDelay:(NSTimeInterval)delay {
+    @synchronized (self) {
+        if (self.batchScheduled || self.pendingNames.count == 0) return;
+        self.batchScheduled = YES;
+    }
+
+    __weak __typeof(self) wself=self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.resolverQueue, ^{
+        [wself runBatch];
+    });
+}
+
+- (void)runBatch {
+    NSMutableDictionary *batch = [NSMutableDictionary dictionary];
+    NSArray *batchNames;
+    @synchronized (self) {
+        batchNames = [self.pendingNames subarrayWithRange:NSMakeRange(0, MIN(self.pendingNames.count, MAX(self.maximumBatchSize, (NSUInteger)1)))];
+        for (NSString *documentName in batchNames) batch[documentName] = self.pendingURLs[documentName];
+        [self.pendingNames removeObjectsInRange:NSMakeRange(0, batchNames.count)];
+        [self.pendingURLs removeObjectsForKeys:batchNames];
+        self.activeDocumentCount = batchNames.count;
+    }
+
+    NSMutableDictionary *resolutions = [NSMutableDictionary dictionary];
+    NSMutableDictionary *errors = [NSMutableDictionary dictionary];
+    for (NSString *documentName in batchNames) {
+        @autoreleasepool {
+            NSError *error = nil;
+            NSDictionary *resolution = [self resolveConflictsInDocumentWithName:documentName atURL:batch[documentName] error:&error];
+            if (resolution.count > 0) resolutions[documentName] = resolution;
+            else if (!resolution) errors[documentName] = error;
+            
+            // A retryable failure moves straight to the retries, so it is never missing from pendingDocumentCount. Only the first failure of a document is logged
+            @synchronized (self) {
+                self.activeDocumentCount--;
+                if (resolution) {
+                    [self.failedAttempts removeObjectForKey:documentName];
+                } else {
+                    BOOL retryable = [self isRetryableError:error];
+                    if (self.failedAttempts[documentName] == nil) [self.telemetry log:@"[iCloud] Failed to resolve the conflicts of %@%@: %@", documentName, retryable ? @", it will be retried" : @"", error];
+                    if (retryable) [self scheduleRetryOfDocumentWithName:documentName atURL:batch[documentName]];
+                    else [self.failedAttempts removeObjectForKey:documentName];
+                }
+            }
+        }
+    }
+
+    // Pause between batches so other file work gets a turn
+    @synchronized (self) {
+        self.batchScheduled = NO;
+    }
+    [self scheduleBatchAfterDelay:self.batchInterval];
+
+    if (resolutions.count == 0 && errors.count == 0) return;
+    void (^reportHandler)(NSDictionary *, NSDictionary *) = self.reportHandler;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (reportHandler) reportHandler(resolutions, errors);
+    });
+}
+
+- (void)scheduleRetryOfDocumentWithName:(NSString *)documentName atURL:(NSURL *)fileURL {
+    NSUInteger attempts;
+    @synchronized (self) {
+        attempts = [self.failedAttempts[documentName] unsignedIntegerValue] + 1;
+        self.failedAttempts[documentName] = @(attempts);
+        self.retryURLs[documentName] = fileURL;
+    }
+    
+    // Back off exponentially, a document which keeps failing is still tried now and then
+    NSTimeInterval delay = MIN(self.retryInterval * pow(2, MIN(attempts - 1, (NSUInteger)20)), self.maximumRetryInterval);
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Retrying the conflicts of %@ in %.1fs (attempt %lu)", documentName, delay, (unsigned long)attempts + 1];
+    
+    __weak __typeof(self) wself=self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.resolverQueue, ^{
+        __strong __typeof(wself) sself = wself;
+        if (!sself) return;
+        
+        @synchronized (sself) {
+            // Queued again in the meantime, or dropped when the policy became manual
+            NSURL *retryURL = sself.retryURLs[documentName];
+            if (!retryURL || sself.policy == iCloudConflictPolicyManual) {
+                [sself.retryURLs removeObjectForKey:documentName];
+                return;
+            }
+            
+            [sself.retryURLs removeObjectForKey:documentName];
+            if (!sself.pendingURLs[documentName]) [sself.pendingNames addObject:documentName];
+            sself.pendingURLs[documentName] = retryURL;
+        }
+        [sself scheduleBatchAfterDelay:0];
+    });
+}
+
+- (BOOL)isRetryableError:(NSError *)error {
+    // 521 is a merge without a merge handler, it fails the same way until a handler is set and the document is queued again
+    return error.code != 521;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Resolution ---------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Resolution
+
+- (NSDictionary *)resolveConflictsInDocumentWithName:(NSString *)documentName atURL:(NSURL *)fileURL error:(NSError **)error {
+    iCloudConflictPolicy policy = self.policy;
+    if (policy == iCloudConflictPolicyManual) return @{};
+
+    __block NSDictionary *resolution = @{};
+    __block NSError *resolutionError = nil;
+    NSError *coordinatorError = nil;
+    NSFileManager *fileManager = self.fileManager;
+
+    // Merging coordination lets presenters, such as open documents, save first and reload afterwards
+    NSFileCoordinator *coordinator = [fileManager fileCoordinatorWithFilePresenter:nil];
+    [coordinator coordinateWritingItemAtURL:fileURL options:NSFileCoordinatorWritingForMerging error:&coordinatorError byAccessor:^(NSURL *writingURL) {
+        NSArray *conflictVersions = [fileManager unresolvedConflictVersionsOfItemAtURL:writingURL];
+        if (conflictVersions.count == 0) return;
+
+        NSError *policyError = nil;
+        resolution = [self applyPolicy:policy toDocumentWithName:documentName atURL:writingURL conflictVersions:conflictVersions coordinator:coordinator error:&policyError];
+        if (!resolution) {
+            resolutionError = policyError;
+            return;
+        }
+
+        for (id <iCloudFileVersion> version in conflictVersions) version.resolved = YES;
+        [fileManager removeOtherVersionsOfItemAtURL:writingURL error:nil];
+    }];
+
+    if (coordinatorError) resolutionError = coordinatorError;
+    if (resolutionError) {
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Failed to resolve the conflicts of %@: %@", documentName, resolutionError];
+        if (error) *error = resolutionError;
+        return nil;
+    }
+
+    if (resolution.count > 0) {
+        @synchronized (self) {
+            self.resolvedDocumentCount++;
+        }
+        [self.telemetry incrementCounterForOperation:iCloudTelemetryOperationConflict];
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Resolved %@ conflicting versions of %@ with policy %@", resolution[@"versions"], documentName, resolution[@"policy"]];
+    }
+
+    return resolution;
+}
+
+- (NSDictionary *)applyPolicy:(iCloudConflictPolicy)policy toDocumentWithName:(NSString *)documentName atURL:(NSURL *)fileURL conflictVersions:(NSArray *)conflictVersions coordinator:(NSFileCoordinator *)coordinator error:(NSError **)error {
+    NSMutableArray *copies = [NSMutableArray array];
+
+    switch (policy) {
+        case iCloudConflictPolicyLatestWins: {
+            // The same choice as laterVersion(), a tie goes to the conflicting version
+            id <iCloudFileVersion> currentVersion = [self.fileManager currentVersionOfItemAtURL:fileURL];
+            id <iCloudFileVersion> latestVersion = currentVersion;
+            for (id <iCloudFileVersion> version in conflictVersions) {
+                if (!latestVersion || [latestVersion.modificationDate compare:version.modificationDate] != NSOrderedDescending) latestVersion = version;
+            }
+
+            if (latestVersion != currentVersion && ![latestVersion replaceItemAtURL:fileURL options:0 error:error]) return nil;
+            break;
+        }
+        case iCloudConflictPolicyKeepBoth: {
+            NSString *folderPath = [documentName stringByDeletingLastPathComponent];
+            for (id <iCloudFileVersion> version in conflictVersions) {
+                NSURL *copyURL = [self copyURLForDocumentAtURL:fileURL version:version];
+
+                // Read the version and write the copy under coordination too, packages are copied whole
+                __block BOOL copied = NO;
+                __block NSError *copyError = nil;
+                NSError *coordinatorError = nil;
+                [coordinator coordinateReadingItemAtURL:version.URL options:NSFileCoordinatorReadingWithoutChanges writingItemAtURL:copyURL options:NSFileCoordinatorWritingForReplacing error:&coordinatorError byAccessor:^(NSURL *newReadingURL, NSURL *newWritingURL) {
+                    copied = [self.fileManager copyItemAtURL:newReadingURL toURL:newWritingURL error:&copyError];
+                }];
+                if (!copied) {
+                    if (error) *error = coordinatorError ?: copyError;
+                    return nil;
+                }
+                [copies addObject:[folderPath stringByAppendingPathComponent:[copyURL lastPathComponent]]];
+            }
+            break;
+        }
+        case iCloudConflictPolicyMerge: {
+            BOOL isPackage = NO;
+            [self.fileManager fileExistsAtPath:[fileURL path] isDirectory:&isPackage];
+            if ((isPackage && !self.packageMergeHandler) || (!isPackage && !self.mergeHandler)) {
+                if (error) *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The conflicts of %@ could not be merged because no %@ is set", documentName, isPackage ? @"package merge handler" : @"merge handler"] code:521 userInfo:@{@"FileURL": fileURL}];
+                return nil;
+            }
+
+            // The document itself is already coordinated for writing
+            id currentContents = [self mergeContentsAtURL:fileURL isPackage:isPackage coordinator:nil error:error];
+            if (!currentContents) return nil;
+
+            // Newest first, so that simple handlers can prefer the first version they see
+            NSArray *sortedVersions = [conflictVersions sortedArrayUsingComparator:^NSComparisonResult(id <iCloudFileVersion> first, id <iCloudFileVersion> second) {
+                return [second.modificationDate compare:first.modificationDate];
+            }];
+            NSMutableArray *conflictContents = [NSMutableArray arrayWithCapacity:sortedVersions.count];
+            for (id <iCloudFileVersion> version in sortedVersions) {
+                id contents = [self mergeContentsAtURL:version.URL isPackage:isPackage coordinator:coordinator error:error];
+                if (!contents) return nil;
+                [conflictContents addObject:contents];
+            }
+
+            id mergedContents = isPackage ? self.packageMergeHandler(documentName, currentContents, conflictContents) : self.mergeHandler(documentName, currentContents, conflictContents);
+            if (!mergedContents) {
+                if (error) *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The merge handler left the conflicts of %@ unresolved", documentName] code:520 userInfo:@{@"FileURL": fileURL}];
+                return nil;
+            }
+
+            if (isPackage) {
+                if (![(NSFileWrapper *)mergedContents writeToURL:fileURL options:NSFileWrapperWritingAtomic originalContentsURL:fileURL error:error]) return nil;
+            } else {
+                if (self.compressionCodec != iCloudCompressionCodecNone && [iCloudCompression isCodecAvailable:self.compressionCodec]) mergedContents = [iCloudCompression compressData:mergedContents codec:self.compressionCodec error:error];
+                if (!mergedContents || ![(NSData *)mergedContents writeToURL:fileURL options:NSDataWritingAtomic error:error]) return nil;
+            }
+            break;
+        }
+        default:
+            return @{};
+    }
+
+    return @{@"policy": @(policy), @"versions": @(conflictVersions.count), @"copies": copies};
+}
+
+- (id)mergeContentsAtURL:(NSURL *)fileURL isPackage:(BOOL)isPackage coordinator:(NSFileCoordinator *)coordinator error:(NSError **)error {
+    __block id contents = nil;
+    __block NSError *readError = nil;
+    void (^readContents)(NSURL *) = ^(NSURL *readingURL) {
+        if (isPackage) {
+            // Read the whole package now, the version may be removed before the merged package is written
+            contents = [[NSFileWrapper alloc] initWithURL:readingURL options:NSFileWrapperReadingImmediate error:&readError];
+        } else {
+            NSData *data = [NSData dataWithContentsOfURL:readingURL options:NSDataReadingMappedIfSafe error:&readError];
+            contents = data ? [iCloudCompression decompressData:data error:&readError] : nil;
+        }
+    };
+
+    NSError *coordinatorError = nil;
+    if (coordinator) [coordinator coordinateReadingItemAtURL:fileURL options:NSFileCoordinatorReadingWithoutChanges error:&coordinatorError byAccessor:readContents];
+    else readContents(fileURL);
+
+    if (!contents && error) *error = coordinatorError ?: readError;
+    return contents;
+}
+
+- (NSURL *)copyURLForDocumentAtURL:(NSURL *)fileURL version:(id <iCloudFileVersion>)version {
+    NSString *extension = [fileURL pathExtension];
+    NSString *baseName = [[fileURL lastPathComponent] stringByDeletingPathExtension];
+    NSString *label = version.localizedNameOfSavingComputer.length > 0 ? version.localizedNameOfSavingComputer : @"Conflict";
+    NSURL *folderURL = [fileURL URLByDeletingLastPathComponent];
+
+    // Name (iPad).ext, then Name (iPad 2).ext and so on
+    for (NSUInteger attempt = 1; ; attempt++) {
+        NSString *name = (attempt == 1) ? [NSString stringWithFormat:@"%@ (%@)", baseName, label] : [NSString stringWithFormat:@"%@ (%@ %lu)", baseName, label, (unsigned long)attempt];
+        if (extension.length > 0) name = [name stringByAppendingPathExtension:extension];
+
+        NSURL *copyURL = [folderURL URLByAppendingPathComponent:name];
+        if (![self.fileManager fileExistsAtPath:[copyURL path]]) return copyURL;
+    }
+}
+
+@end
@@ -0,0 +1,83 @@
+//
+//  iCloudContentHashCache.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The iCloudContentHashCache class remembers a content digest for every file it has hashed, so that deciding whether two files are the same rarely has to read them.
+ 
+ Each SHA-256 digest is stored with the inode, size and modification time of the file it was computed from. As long as that tuple is unchanged the stored digest is reused, so a repeated comparison only costs a stat of each file. The cache is persisted in the application's Caches directory and survives relaunches.
+ 
+ Digests of files which were deleted or renamed are dropped each time the cache is saved, and the least recently used digests are dropped whenever the cache grows past maximumEntryCount.
+ 
+ The iCloud class owns a shared cache and uses it for every equality check during uploads and evictions. */
+@interface iCloudContentHashCache : NSObject
+
+
+
+/** @name Methods */
+
+/** Initialize a content hash cache persisted at the specified location
+ 
+ @param cacheURL The file URL where the cache is loaded from and saved to. Pass nil to keep the cache in memory only.
+ @return A content hash cache with any previously saved digests loaded */
+- (instancetype)initWithCacheURL:(NSURL *)cacheURL;
+
+/** Get the content digest of a file, hashing it only if it changed since it was last hashed
+ 
+ @param fileURL The file URL of the file. This value must not be nil.
+ @param error If the file could not be read, contains an NSError describing the problem
+ @return The digest of the file contents, or nil if the file could not be read */
+- (NSData *)digestForFileAtURL:(NSURL *)fileURL error:(NSError **)error __attribute__((nonnull (1)));
+
+/** Check whether two files have the same contents
+ 
+ @discussion Files of different sizes are reported as different without being read. Otherwise their cached digests are compared, and only files whose inode, size or modification time changed are hashed again.
+ 
+ @param firstURL The file URL of the first file. This value must not be nil.
+ @param secondURL The file URL of the second file. This value must not be nil.
+ @return YES if both files exist and have the same contents, NO otherwise */
+- (BOOL)contentsEqualAtURL:(NSURL *)firstURL andURL:(NSURL *)secondURL __attribute__((nonnull));
+
+/** Forget the digest stored for a file
+ 
+ @param fileURL The file URL of the file. This value must not be nil. */
+- (void)removeDigestForFileAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Write the cache to disk immediately. Changes are otherwise written a few seconds after they happen.
+ 
+ @discussion Digests of files which no longer exist are dropped before the cache is written.
+ 
+ @return YES if the cache was saved, NO if it could not be written or has no cacheURL */
+- (BOOL)synchronize;
+
+
+
+/** @name Properties */
+
+/** The location where the cache is persisted, may be nil */
+@property (strong, readonly) NSURL *cacheURL;
+
+/** The number of digests the cache keeps before it drops the least recently used ones. Defaults to 10,000. */
+@property (assign) NSUInteger maximumEntryCount;
+
+/** The number of digests currently stored */
+@property (readonly) NSUInteger entryCount;
+
+/** The number of lookups answered from a stored digest without reading the file */
+@property (readonly) NSUInteger hitCount;
+
+/** The number of lookups which had to read and hash the file */
+@property (readonly) NSUInteger missCount;
+
+@end
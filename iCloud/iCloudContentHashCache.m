@@ -0,0 +1,225 @@
+//
+//  iCloudContentHashCache.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudContentHashCache.h"
+#import <CommonCrypto/CommonDigest.h>
+#include <sys/stat.h>
+
+// Files are hashed in chunks of this size so that large files never have to be read into memory at once
+#define HASH_CHUNK_LENGTH (1024 * 1024)
+
+// When the cache is full it is trimmed to this fraction of its maximum, so that trimming does not happen on every new digest
+#define HASH_CACHE_TRIM_RATIO 0.9
+
+@interface iCloudContentHashCache ()
+@property (strong, readwrite) NSURL *cacheURL;
+@property (nonatomic, strong) NSMutableDictionary *entries;
+@property (readwrite) NSUInteger hitCount;
+@property (readwrite) NSUInteger missCount;
+@property (nonatomic, assign) BOOL saveScheduled;
+
+/// Read the stat tuple of a file, returns nil if the file does not exist
+- (NSArray *)statTupleForFileAtURL:(NSURL *)fileURL size:(unsigned long long *)size;
+
+/// Read and hash a whole file in chunks
+- (NSData *)hashFileAtURL:(NSURL *)fileURL error:(NSError **)error;
+
+/// Drop the least recently used digests once the cache holds more than maximumEntryCount, must be called while holding the entries lock
+- (void)trimEntries;
+
+/// Drop the digests of files which no longer exist, must be called while holding the entries lock
+- (void)removeEntriesOfMissingFiles;
+
+/// Persist the cache a few seconds from now, collapsing repeated changes into one write
+- (void)scheduleSave;
+
+@end
+
+@implementation iCloudContentHashCache
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Setup --------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Setup
+
+- (instancetype)initWithCacheURL:(NSURL *)cacheURL {
+    self = [super init];
+    if (self) {
+        _cacheURL = cacheURL;
+        _entries = [NSMutableDictionary dictionary];
+        _maximumEntryCount = 10000;
+        
+        if (cacheURL) {
+            NSData *data = [NSData dataWithContentsOfURL:cacheURL];
+            NSDictionary *saved = data ? [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListMutableContainers format:NULL error:nil] : nil;
+            if ([saved isKindOfClass:[NSDictionary class]]) {
+                // Digests saved by an older version were not SHA-256, they are hashed again on their next lookup
+                [saved enumerateKeysAndObjectsUsingBlock:^(NSString *path, NSMutableDictionary *entry, BOOL *stop) {
+                    if ([entry isKindOfClass:[NSDictionary class]] && [entry[@"digest"] length] == CC_SHA256_DIGEST_LENGTH) self->_entries[path] = entry;
+                }];
+            }
+        }
+    }
+    return self;
+}
+
+- (instancetype)init {
+    return [self initWithCacheURL:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Digests ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Digests
+
+- (NSData *)digestForFileAtURL:(NSURL *)fileURL error:(NSError **)error {
+    NSString *path = [[fileURL URLByStandardizingPath] path];
+    NSArray *tuple = [self statTupleForFileAtURL:fileURL size:NULL];
+    if (tuple == nil) {
+        if (error) *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The file, %@, does not exist", path] code:404 userInfo:@{@"FileURL": fileURL}];
+        return nil;
+    }
+    
+    // The stored digest is still valid as long as the inode, size and modification time are unchanged
+    NSNumber *now = @([NSDate timeIntervalSinceReferenceDate]);
+    @synchronized (self.entries) {
+        NSMutableDictionary *entry = self.entries[path];
+        if ([entry[@"stat"] isEqualToArray:tuple]) {
+            self.hitCount++;
+            entry[@"used"] = now;
+            return entry[@"digest"];
+        }
+        self.missCount++;
+    }
+    
+    NSData *digest = [self hashFileAtURL:fileURL error:error];
+    if (digest == nil) return nil;
+    
+    @synchronized (self.entries) {
+        self.entries[path] = [@{@"stat": tuple, @"digest": digest, @"used": now} mutableCopy];
+        [self trimEntries];
+    }
+    [self scheduleSave];
+    
+    return digest;
+}
+
+- (BOOL)contentsEqualAtURL:(NSURL *)firstURL andURL:(NSURL *)secondURL {
+    unsigned long long firstSize = 0;
+    unsigned long long secondSize = 0;
+    if ([self statTupleForFileAtURL:firstURL size:&firstSize] == nil || [self statTupleForFileAtURL:secondURL size:&secondSize] == nil) return NO;
+    if (firstSize != secondSize) return NO;
+    
+    NSData *firstDigest = [self digestForFileAtURL:firstURL error:nil];
+    NSData *secondDigest = [self digestForFileAtURL:secondURL error:nil];
+    if (firstDigest == nil || secondDigest == nil) return NO;
+    
+    return [firstDigest isEqualToData:secondDigest];
+}
+
+- (void)removeDigestForFileAtURL:(NSURL *)fileURL {
+    @synchronized (self.entries) {
+        [self.entries removeObjectForKey:[[fileURL URLByStandardizingPath] path]];
+    }
+    [self scheduleSave];
+}
+
+- (NSUInteger)entryCount {
+    @synchronized (self.entries) {
+        return self.entries.count;
+    }
+}
+
+- (void)trimEntries {
+    if (self.entries.count <= self.maximumEntryCount) return;
+    
+    NSArray *paths = [self.entries keysSortedByValueUsingComparator:^NSComparisonResult(NSDictionary *first, NSDictionary *second) {
+        return [first[@"used"] compare:second[@"used"]];
+    }];
+    NSUInteger keptCount = (NSUInteger)(self.maximumEntryCount * HASH_CACHE_TRIM_RATIO);
+    [self.entries removeObjectsForKeys:[paths subarrayWithRange:NSMakeRange(0, paths.count - keptCount)]];
+}
+
+- (void)removeEntriesOfMissingFiles {
+    NSMutableArray *missingPaths = [NSMutableArray array];
+    for (NSString *path in self.entries) {
+        struct stat info;
+        if (stat([path fileSystemRepresentation], &info) != 0) [missingPaths addObject:path];
+    }
+    [self.entries removeObjectsForKeys:missingPaths];
+}
+
+- (NSArray *)statTupleForFileAtURL:(NSURL *)fileURL size:(unsigned long long *)size {
+    struct stat info;
+    if (stat([fileURL fileSystemRepresentation], &info) != 0) return nil;
+    if (size) *size = (unsigned long long)info.st_size;
+    
+    return @[@((unsigned long long)info.st_ino), @((unsigned long long)info.st_size), @((long long)info.st_mtimespec.tv_sec), @((long)info.st_mtimespec.tv_nsec)];
+}
+
+- (NSData *)hashFileAtURL:(NSURL *)fileURL error:(NSError **)error {
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingFromURL:fileURL error:error];
+    if (handle == nil) return nil;
+    
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    
+    while (YES) {
+        @autoreleasepool {
+            NSData *chunk = [handle readDataOfLength:HASH_CHUNK_LENGTH];
+            if ([chunk length] == 0) break;
+            CC_SHA256_Update(&context, [chunk bytes], (CC_LONG)[chunk length]);
+        }
+    }
+    [handle closeFile];
+    
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
+    return [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Persistence --------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Persistence
+
+- (void)scheduleSave {
+    if (self.cacheURL == nil) return;
+    
+    @synchronized (self) {
+        if (self.saveScheduled == YES) return;
+        self.saveScheduled = YES;
+    }
+    
+    __weak __typeof(self) wself=self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [wself synchronize];
+    });
+}
+
+- (BOOL)synchronize {
+    @synchronized (self) {
+        self.saveScheduled = NO;
+    }
+    if (self.cacheURL == nil) return NO;
+    
+    // Deleted and renamed files leave their digests behind, drop them before they are written out again
+    NSDictionary *snapshot;
+    @synchronized (self.entries) {
+        [self removeEntriesOfMissingFiles];
+        snapshot = [[NSDictionary alloc] initWithDictionary:self.entries copyItems:YES];
+    }
+    
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:snapshot format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+    if (data == nil) return NO;
+    
+    [[NSFileManager defaultManager] createDirectoryAtURL:[self.cacheURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+    return [data writeToURL:self.cacheURL atomically:YES];
+}
+
+@end
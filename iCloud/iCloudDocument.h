@@ -2,7 +2,7 @@
 //  iCloudDocument.h
 //  iCloud Document Sync
 //
-//  Created by iRare Media. Last updated January 2014.
+//  Created by iRare Media. Last updated October 2026.
 //  Available on GitHub. Licensed under MIT with Attribution.
 //
 
@@ -16,6 +16,8 @@
     #import <UIKit/UIKit.h>
 #endif
 
+#import "iCloudCompression.h"
+
 /** Use the iCloudDocument class (a subclass of UIDocument) to read and write documents managed by the iCloud class. You should rarely interact directly with iCloudDocument. The iCloud class manages all interactions with iCloudDocument. You can however retieve an iCloudDocument object by specifying its URL in the iCloud class.
  
  iCloudDocument can read and write any files with the following exceptions:
@@ -24,7 +26,7 @@
  - Packages
  - Aliases
  
- If you'd like support for the above faux files then please consider [filing an Issue on GitHub](https://github.com/iRareMedia/iCloudDocumentSync/issues/new) or [submitting a Pull Request](https://github.com/iRareMedia/iCloudDocumentSync/pulls) if you've figured out how. This can be done using an NSFileWrapper. 
+ Packages of chunk files are supported by the iCloudPackageDocument subclass, which the iCloud class uses automatically for packages and for the extensions listed in its packageDocumentExtensions property. If you'd like support for the other faux files then please consider [filing an Issue on GitHub](https://github.com/iRareMedia/iCloudDocumentSync/issues/new) or [submitting a Pull Request](https://github.com/iRareMedia/iCloudDocumentSync/pulls) if you've figured out how. 
  
  You may want to consider subclassing iCloudDocument for custom implementations of many features. */
 @class iCloudDocument;
@@ -44,6 +46,19 @@
 
 
 
+/** @name Use Tracking */
+
+/** Check whether any iCloudDocument is using the file at a URL
+ 
+ @discussion A document is in use from the moment it starts opening until it is closed, while it is being saved (including documents which are saved without being opened), and while its contents are read with contentsInRange:error: or enumerateContentsInChunksOfLength:usingBlock:error:. The iCloud class never evicts a file which is in use.
+ 
+ @param url The file URL to check. This value must not be nil.
+ @return YES if a document is using the file, NO otherwise */
++ (BOOL)isDocumentInUseAtURL:(NSURL *)url __attribute__((nonnull));
+
+
+
+
 /** @name Delegate */
 
 /** iCloud Delegate helps call methods when document processes begin or end */
@@ -52,8 +67,74 @@
 
 
 
+/** @name Reading Contents */
+
+/** Read a range of bytes from the document without loading the whole payload
+ 
+ @discussion If the document is open, the bytes are sliced from the (memory-mapped) contents. Otherwise they are read straight from the file under a coordinated read, so the rest of the file is never made resident. A closed package document (a directory, such as an iCloudPackageDocument) has no single file to read from, open it first.
+ 
+ @param range The byte range to read. The range is clamped to the end of the file.
+ @param error On failure, contains an NSError describing the problem. Reading a closed package document fails with error code 415.
+ @return The requested bytes, or nil if the file could not be read. */
+- (NSData *)contentsInRange:(NSRange)range error:(NSError **)error;
+
+/** Enumerate the document's contents in fixed-size chunks
+ 
+ @discussion Only one chunk is resident at a time when the document is closed. This is the preferred way to hash, upload or parse very large documents. Like contentsInRange:error:, a package document has to be open to be enumerated.
+ 
+ @param chunkLength The maximum length of each chunk, in bytes. Must be greater than zero.
+ @param block Called once per chunk with the chunk data and its offset in the file. Set stop to YES to end the enumeration early.
+ @param error On failure, contains an NSError describing the problem. Enumerating a closed package document fails with error code 415.
+ @return YES if every chunk was read (or the block stopped the enumeration), NO if the file could not be read. */
+- (BOOL)enumerateContentsInChunksOfLength:(NSUInteger)chunkLength usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error __attribute__((nonnull (2)));
+
+
+
+
+/** @name Undo */
+
+/** Replace the document's contents and register the change with the undo manager
+ 
+ @discussion By default the entire previous contents are registered for undo. When differentialUndo is enabled only the bytes which differ between the previous and new contents are kept, and the oldest undo levels are dropped once undoMemoryBudget is exceeded.
+ 
+ @param newData The new contents of the document */
+- (void)setDocumentData:(NSData *)newData;
+
+/** Store compact binary diffs in the undo manager instead of full copies of the previous contents
+ 
+ @discussion Defaults to NO. Each edit keeps only the changed region of the previous contents (found by trimming the common prefix and suffix), so the memory held by the undo manager grows with the size of the edits rather than the size of the document. */
+@property (assign) BOOL differentialUndo;
+
+/** The maximum number of bytes of undo and redo data kept when differentialUndo is enabled
+ 
+ @discussion Defaults to 8 MB. When the budget is exceeded the oldest undo levels are dropped first, and the undo manager discards them so that they can no longer be reached. The undo manager's levelsOfUndo setting is left as configured. */
+@property (assign, nonatomic) unsigned long long undoMemoryBudget;
+
+/** The number of bytes of undo and redo data currently kept when differentialUndo is enabled. Data is released as soon as its level is undone, redone, cleared by a new edit or discarded by the undo manager's levelsOfUndo limit. */
+@property (assign, readonly) unsigned long long undoMemoryUsage;
+
+
+
+
+/** @name Compression */
+
+/** The codec used to compress the document's contents when it is saved
+ 
+ @discussion Defaults to iCloudCompressionCodecNone. When set, saves compress the contents behind a small versioned header, so the document takes less space locally, uploads faster and counts less against the user's iCloud quota. The compressed payload is written with UIDocument's usual safe-save, so a failed save never leaves a partially written file. The contents property always holds the uncompressed payload.
+ 
+ Reading does not depend on this property: compressed files are recognized by their header and decompressed whatever the codec, and files without the header are read as they are. Turning compression on or off therefore never breaks existing documents, which are converted the next time they are saved. If the codec is not available on the running system (see iCloudCompression), documents are saved uncompressed. */
+@property (assign) iCloudCompressionCodec compressionCodec;
+
+
+
+
 /** @name Properties */
 
+/** Load document contents by memory-mapping the file instead of reading it into memory
+ 
+ @discussion Defaults to YES. The file is mapped with mapped-if-safe semantics, so the system falls back to a regular read for files on volumes where mapping is not safe. Loading, saving and undo registration then share the same buffer rather than holding several full copies of the payload. Set to NO to always read the full file into memory. */
+@property (assign) BOOL mappedReading;
+
 /** The file version of the UIDocument object, used for handling file conflicts */
 NSFileVersion *laterVersion(NSFileVersion *first, NSFileVersion *second);
 
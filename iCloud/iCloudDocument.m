@@ -2,7 +2,7 @@
 //  iCloudDocument.m
 //  iCloud Document Sync
 //
-//  Created by iRare Media. Last updated January 2014.
+//  Created by iRare Media. Last updated October 2026.
 //  Available on GitHub. Licensed under MIT with Attribution.
 //
 
@@ -14,6 +14,71 @@ NSFileVersion *laterVersion (NSFileVersion *first, NSFileVersion *second) {
     return ([firstDate compare:secondDate] != NSOrderedDescending) ? second : first;
 }
 
+/// Paths of the files used by open, saving or reading documents, counted per document
+static NSCountedSet *iCloudDocumentPathsInUse = nil;
+
+/// Fixed bookkeeping cost charged against the undo budget for every diff record
+static unsigned long long const iCloudDocumentUndoRecordOverhead = 64;
+
+@interface iCloudDocument ()
+
+/// Diff records still held for undo and redo, keyed by the token registered with the undo manager
+@property (strong) NSMutableDictionary *undoRecords;
+
+/// Tokens of the diff records per undo level, oldest level first, mirroring the undo manager's undo stack
+@property (strong) NSMutableArray *undoLevels;
+
+/// Tokens of the diff records per redo level, oldest level first, mirroring the undo manager's redo stack
+@property (strong) NSMutableArray *redoLevels;
+
+/// The level whose records are being undone or redone, and the level collecting their reverse records
+@property (strong) NSMutableArray *reversedLevel;
+@property (strong) NSMutableArray *reverseLevel;
+
+/// The number of top-level undo groups opened so far, and the group the newest undo level was registered in
+@property (assign) NSUInteger undoGroupSerial;
+@property (assign) NSUInteger newestUndoLevelSerial;
+
+/// The undo manager whose groups are counted
+@property (weak) NSUndoManager *observedUndoManager;
+
+@property (assign, readwrite) unsigned long long undoMemoryUsage;
+
+/// The token assigned to the next diff record
+@property (assign) NSUInteger nextUndoToken;
+
+/// Paths this document has marked as in use, one element per use
+@property (strong) NSMutableArray *pathsInUse;
+
+/// The path marked as in use while the document is open
+@property (copy) NSString *openPath;
+
+/// Mark the file at a URL as in use by this document, returns the path to pass to endUsingPath:
+- (NSString *)beginUsingURL:(NSURL *)url;
+
+/// Balance a call to beginUsingURL:
+- (void)endUsingPath:(NSString *)path;
+
+/// Count the undo groups of the document's undo manager, so records made in one group share a level
+- (void)observeUndoManager;
+
+/// Called when the observed undo manager opens a group
+- (void)undoManagerDidOpenUndoGroup:(NSNotification *)notification;
+
+/// Forget the diff records of a level and give their bytes back to the budget
+- (void)forgetUndoRecordsInLevel:(NSArray *)level;
+
+/// Register a diff which turns newData back into oldData
+- (void)registerUndoFromData:(NSData *)newData toData:(NSData *)oldData redo:(BOOL)redo;
+
+/// Apply the diff record registered under the token
+- (void)applyUndoRecord:(NSNumber *)token;
+
+/// Drop the oldest undo levels until the records fit in the budget, and make the undo manager discard them
+- (void)trimUndoRecords;
+
+@end
+
 @implementation iCloudDocument
 
 //----------------------------------------------------------------------------------------------------------------//
@@ -25,10 +90,25 @@ NSFileVersion *laterVersion (NSFileVersion *first, NSFileVersion *second) {
 	self = [super initWithFileURL:url];
 	if (self) {
 		_contents = [[NSData alloc] init];
+		_mappedReading = YES;
+		_undoMemoryBudget = 8 * 1024 * 1024;
+		_undoRecords = [NSMutableDictionary dictionary];
+		_undoLevels = [NSMutableArray array];
+		_redoLevels = [NSMutableArray array];
+		_pathsInUse = [NSMutableArray array];
 	}
 	return self;
 }
 
+- (void)dealloc {
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	// A document released without being closed stops protecting its file
+	@synchronized (iCloudDocumentPathsInUse) {
+		for (NSString *path in _pathsInUse) [iCloudDocumentPathsInUse removeObject:path];
+	}
+}
+
 - (NSString *)localizedName {
 	return [self.fileURL lastPathComponent];
 }
@@ -46,6 +126,76 @@ NSFileVersion *laterVersion (NSFileVersion *first, NSFileVersion *second) {
     return string;
 }
 
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Use Tracking -------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Use Tracking
+
++ (BOOL)isDocumentInUseAtURL:(NSURL *)url {
+	@synchronized (iCloudDocumentPathsInUse) {
+		return [iCloudDocumentPathsInUse countForObject:[[url URLByStandardizingPath] path]] > 0;
+	}
+}
+
+- (NSString *)beginUsingURL:(NSURL *)url {
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		iCloudDocumentPathsInUse = [NSCountedSet set];
+	});
+	
+	NSString *path = [[url URLByStandardizingPath] path];
+	@synchronized (iCloudDocumentPathsInUse) {
+		[iCloudDocumentPathsInUse addObject:path];
+		[self.pathsInUse addObject:path];
+	}
+	return path;
+}
+
+- (void)endUsingPath:(NSString *)path {
+	if (!path) return;
+	
+	@synchronized (iCloudDocumentPathsInUse) {
+		NSUInteger index = [self.pathsInUse indexOfObject:path];
+		if (index == NSNotFound) return;
+		
+		[self.pathsInUse removeObjectAtIndex:index];
+		[iCloudDocumentPathsInUse removeObject:path];
+	}
+}
+
+- (void)openWithCompletionHandler:(void (^)(BOOL success))completionHandler {
+	NSString *path = [self beginUsingURL:self.fileURL];
+	[super openWithCompletionHandler:^(BOOL success) {
+		if (success) {
+			[self endUsingPath:self.openPath];
+			self.openPath = path;
+		} else {
+			[self endUsingPath:path];
+		}
+		
+		if (completionHandler) completionHandler(success);
+	}];
+}
+
+- (void)closeWithCompletionHandler:(void (^)(BOOL success))completionHandler {
+	[super closeWithCompletionHandler:^(BOOL success) {
+		// The document is closed whether or not its last save succeeded
+		NSString *path = self.openPath;
+		self.openPath = nil;
+		[self endUsingPath:path];
+		
+		if (completionHandler) completionHandler(success);
+	}];
+}
+
+- (void)saveToURL:(NSURL *)url forSaveOperation:(UIDocumentSaveOperation)saveOperation completionHandler:(void (^)(BOOL success))completionHandler {
+	NSString *path = [self beginUsingURL:url];
+	[super saveToURL:url forSaveOperation:saveOperation completionHandler:^(BOOL success) {
+		[self endUsingPath:path];
+		if (completionHandler) completionHandler(success);
+	}];
+}
+
 //----------------------------------------------------------------------------------------------------------------//
 //------------  Loading and Saving -------------------------------------------------------------------------------//
 //----------------------------------------------------------------------------------------------------------------//
@@ -59,9 +209,38 @@ NSFileVersion *laterVersion (NSFileVersion *first, NSFileVersion *second) {
 	return self.contents;
 }
 
+- (BOOL)readFromURL:(NSURL *)url error:(NSError **)outError {
+	if (self.mappedReading == NO) return [super readFromURL:url error:outError];
+	
+	// UIDocument already holds a coordinated read on the URL here, map the file instead of reading it into memory
+	NSData *fileContents = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:outError];
+	if (!fileContents) return NO;
+	
+	return [self loadFromContents:fileContents ofType:self.fileType error:outError];
+}
+
+- (BOOL)writeContents:(id)contents toURL:(NSURL *)url forSaveOperation:(UIDocumentSaveOperation)saveOperation originalContentsURL:(NSURL *)originalContentsURL error:(NSError **)outError {
+    if (self.compressionCodec == iCloudCompressionCodecNone || ![contents isKindOfClass:[NSData class]] || ![iCloudCompression isCodecAvailable:self.compressionCodec]) {
+        return [super writeContents:contents toURL:url forSaveOperation:saveOperation originalContentsURL:originalContentsURL error:outError];
+    }
+    
+    // Hand the compressed payload to UIDocument, which writes it with the same safe-save semantics as uncompressed contents
+    NSData *compressedContents = [iCloudCompression compressData:contents codec:self.compressionCodec error:outError];
+    if (!compressedContents) return NO;
+    
+    return [super writeContents:compressedContents toURL:url forSaveOperation:saveOperation originalContentsURL:originalContentsURL error:outError];
+}
+
 - (BOOL)loadFromContents:(id)fileContents ofType:(NSString *)typeName error:(NSError **)outError {
+    // Compressed files are recognized by their header, older files are loaded as they are
+    if ([fileContents isKindOfClass:[NSData class]] && [iCloudCompression isCompressedData:fileContents]) {
+        fileContents = [iCloudCompression decompressData:fileContents error:outError];
+        if (!fileContents) return NO;
+    }
+    
     if ([fileContents length] > 0) {
-        self.contents = [[NSData alloc] initWithData:fileContents];
+        // Copying immutable (and mapped) data only retains it
+        self.contents = fileContents;
     } else {
         self.contents = [[NSData alloc] init];
     }
@@ -71,13 +250,290 @@ NSFileVersion *laterVersion (NSFileVersion *first, NSFileVersion *second) {
 
 - (void)setDocumentData:(NSData *)newData {
     NSData *oldData = self.contents;
-    self.contents = [newData copy];
+    self.contents = newData;
+    
+    if (self.differentialUndo == YES) {
+        [self registerUndoFromData:self.contents toData:oldData redo:self.undoManager.isUndoing];
+        [self.undoManager setActionName:@"Data Change"];
+        return;
+    }
         
     // Register the undo operation
     [self.undoManager setActionName:@"Data Change"];
     [self.undoManager registerUndoWithTarget:self selector:@selector(setDocumentData:) object:oldData];
 }
 
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Differential Undo --------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Differential Undo
+
+- (void)setUndoMemoryBudget:(unsigned long long)undoMemoryBudget {
+    _undoMemoryBudget = undoMemoryBudget;
+    [self trimUndoRecords];
+}
+
+- (void)observeUndoManager {
+    NSUndoManager *undoManager = self.undoManager;
+    if (undoManager == self.observedUndoManager) return;
+    
+    if (self.observedUndoManager) [[NSNotificationCenter defaultCenter] removeObserver:self name:NSUndoManagerDidOpenUndoGroupNotification object:self.observedUndoManager];
+    self.observedUndoManager = undoManager;
+    if (undoManager) [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(undoManagerDidOpenUndoGroup:) name:NSUndoManagerDidOpenUndoGroupNotification object:undoManager];
+}
+
+- (void)undoManagerDidOpenUndoGroup:(NSNotification *)notification {
+    // Nested groups belong to the level of the group around them
+    if ([notification.object groupingLevel] == 1) self.undoGroupSerial++;
+}
+
+- (void)forgetUndoRecordsInLevel:(NSArray *)level {
+    for (NSNumber *token in level) {
+        NSDictionary *record = self.undoRecords[token];
+        if (!record) continue;
+        
+        self.undoMemoryUsage -= [record[@"bytes"] length] + iCloudDocumentUndoRecordOverhead;
+        [self.undoRecords removeObjectForKey:token];
+    }
+}
+
+- (void)registerUndoFromData:(NSData *)newData toData:(NSData *)oldData redo:(BOOL)redo {
+    [self observeUndoManager];
+    
+    @synchronized (self.undoRecords) {
+        // A new edit (not an undo or redo) clears the redo stack, forget its records
+        BOOL reversing = self.undoManager.isUndoing || self.undoManager.isRedoing;
+        if (!reversing) {
+            for (NSArray *level in self.redoLevels) [self forgetUndoRecordsInLevel:level];
+            [self.redoLevels removeAllObjects];
+        }
+        
+        // Trim the common prefix and suffix, only the changed region of the old data is kept
+        const unsigned char *newBytes = newData.bytes;
+        const unsigned char *oldBytes = oldData.bytes;
+        NSUInteger newLength = newData.length;
+        NSUInteger oldLength = oldData.length;
+        
+        NSUInteger prefix = 0;
+        NSUInteger maxPrefix = MIN(newLength, oldLength);
+        while (prefix < maxPrefix && newBytes[prefix] == oldBytes[prefix]) prefix++;
+        
+        NSUInteger suffix = 0;
+        NSUInteger maxSuffix = maxPrefix - prefix;
+        while (suffix < maxSuffix && newBytes[newLength - suffix - 1] == oldBytes[oldLength - suffix - 1]) suffix++;
+        
+        NSData *replacedBytes = [oldData subdataWithRange:NSMakeRange(prefix, oldLength - prefix - suffix)];
+        NSDictionary *record = @{@"location": @(prefix), @"length": @(newLength - prefix - suffix), @"bytes": replacedBytes};
+        
+        NSNumber *token = @(self.nextUndoToken++);
+        self.undoRecords[token] = record;
+        self.undoMemoryUsage += replacedBytes.length + iCloudDocumentUndoRecordOverhead;
+        
+        // File the record in the level the undo manager puts its action in: the reverse of an undone or redone level forms one level on the other stack, and edits made in the same undo group share a level
+        NSMutableArray *stack = redo ? self.redoLevels : self.undoLevels;
+        NSMutableArray *level = reversing ? self.reverseLevel : nil;
+        if (!reversing && self.undoLevels.count > 0 && self.newestUndoLevelSerial == self.undoGroupSerial) level = self.undoLevels.lastObject;
+        if (!level) {
+            level = [NSMutableArray array];
+            [stack addObject:level];
+            if (reversing) self.reverseLevel = level;
+            self.newestUndoLevelSerial = reversing ? NSNotFound : self.undoGroupSerial;
+        }
+        [level addObject:token];
+        
+        [self.undoManager registerUndoWithTarget:self selector:@selector(applyUndoRecord:) object:token];
+        
+        // The undo manager discards its oldest groups beyond levelsOfUndo, their records go with them
+        NSUInteger levelsOfUndo = self.undoManager.levelsOfUndo;
+        while (levelsOfUndo > 0 && self.undoLevels.count > levelsOfUndo) {
+            [self forgetUndoRecordsInLevel:self.undoLevels.firstObject];
+            [self.undoLevels removeObjectAtIndex:0];
+        }
+    }
+    
+    [self trimUndoRecords];
+}
+
+- (void)applyUndoRecord:(NSNumber *)token {
+    NSDictionary *record;
+    @synchronized (self.undoRecords) {
+        // Undoing takes the record off the undo stack and redoing off the redo stack
+        NSMutableArray *stack = self.undoManager.isRedoing ? self.redoLevels : self.undoLevels;
+        for (NSMutableArray *level in [stack copy]) {
+            if (![level containsObject:token]) continue;
+            
+            // The first record applied from a level starts a new reverse level
+            if (level != self.reversedLevel) {
+                self.reversedLevel = level;
+                self.reverseLevel = nil;
+            }
+            [level removeObject:token];
+            if (level.count == 0) [stack removeObjectIdenticalTo:level];
+            break;
+        }
+        
+        record = self.undoRecords[token];
+        if (!record) return; // The level was dropped to stay under the budget
+        
+        self.undoMemoryUsage -= [record[@"bytes"] length] + iCloudDocumentUndoRecordOverhead;
+        [self.undoRecords removeObjectForKey:token];
+    }
+    
+    NSMutableData *restoredData = [self.contents mutableCopy];
+    NSRange range = NSMakeRange([record[@"location"] unsignedIntegerValue], [record[@"length"] unsignedIntegerValue]);
+    [restoredData replaceBytesInRange:range withBytes:[record[@"bytes"] bytes] length:[record[@"bytes"] length]];
+    
+    // Registers the reverse diff, which the undo manager files as redo (or undo when redoing)
+    [self setDocumentData:restoredData];
+}
+
+- (void)trimUndoRecords {
+    @synchronized (self.undoRecords) {
+        if (self.undoMemoryUsage <= self.undoMemoryBudget) return;
+        
+        // Drop whole levels, the oldest undo levels first. Redo levels belong to the newest edits and go last
+        NSUInteger droppedUndoLevels = 0;
+        while (self.undoMemoryUsage > self.undoMemoryBudget && self.undoLevels.count > 0) {
+            [self forgetUndoRecordsInLevel:self.undoLevels.firstObject];
+            [self.undoLevels removeObjectAtIndex:0];
+            droppedUndoLevels++;
+        }
+        while (self.undoMemoryUsage > self.undoMemoryBudget && self.redoLevels.count > 0) {
+            [self forgetUndoRecordsInLevel:self.redoLevels.firstObject];
+            [self.redoLevels removeObjectAtIndex:0];
+        }
+        if (droppedUndoLevels == 0) return;
+        
+        if (self.undoLevels.count == 0) {
+            // Nothing is left to undo, and a levelsOfUndo of 0 would mean unlimited
+            [self.undoManager removeAllActionsWithTarget:self];
+            for (NSArray *level in self.redoLevels) [self forgetUndoRecordsInLevel:level];
+            [self.redoLevels removeAllObjects];
+        } else {
+            // Lowering levelsOfUndo makes the undo manager discard the dropped levels right away, then the configured limit applies again to new edits
+            NSUInteger configuredLevelsOfUndo = self.undoManager.levelsOfUndo;
+            self.undoManager.levelsOfUndo = self.undoLevels.count;
+            self.undoManager.levelsOfUndo = configuredLevelsOfUndo;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Reading Contents ---------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Reading Contents
+
+- (BOOL)isLoaded {
+	return (self.documentState & UIDocumentStateClosed) == 0;
+}
+
+- (NSData *)contentsInRange:(NSRange)range error:(NSError **)error {
+	__block NSData *data = nil;
+	BOOL success = [self enumerateContentsInRange:range chunkLength:range.length usingBlock:^(NSData *chunk, unsigned long long offset, BOOL *stop) {
+		data = chunk;
+	} error:error];
+	
+	if (!success) return nil;
+	return data ?: [NSData data];
+}
+
+- (BOOL)enumerateContentsInChunksOfLength:(NSUInteger)chunkLength usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error {
+	return [self enumerateContentsInRange:NSMakeRange(0, NSUIntegerMax) chunkLength:chunkLength usingBlock:block error:error];
+}
+
+- (BOOL)enumerateContentsInRange:(NSRange)range chunkLength:(NSUInteger)chunkLength usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error {
+	NSString *path = [self beginUsingURL:self.fileURL];
+	BOOL success = [self readContentsInRange:range chunkLength:chunkLength usingBlock:block error:error];
+	[self endUsingPath:path];
+	
+	return success;
+}
+
+- (BOOL)readContentsInRange:(NSRange)range chunkLength:(NSUInteger)chunkLength usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error {
+	if (chunkLength == 0) chunkLength = 1024 * 1024;
+	
+	// An open document already has its (mapped) contents, slice them
+	if ([self isLoaded]) {
+		NSData *contents = self.contents;
+		NSUInteger location = MIN(range.location, contents.length);
+		NSUInteger end = (range.length > contents.length - location) ? contents.length : location + range.length;
+		BOOL stop = NO;
+		
+		while (location < end && stop == NO) {
+			NSUInteger length = MIN(chunkLength, end - location);
+			@autoreleasepool {
+				block([contents subdataWithRange:NSMakeRange(location, length)], location, &stop);
+			}
+			location += length;
+		}
+		
+		return YES;
+	}
+	
+	// Otherwise read the file one chunk at a time under a coordinated read
+	__block BOOL success = NO;
+	__block NSError *readError = nil;
+	NSError *coordinatorError = nil;
+	NSFileCoordinator *coordinator = [[NSFileCoordinator alloc] initWithFilePresenter:nil];
+	[coordinator coordinateReadingItemAtURL:self.fileURL options:NSFileCoordinatorReadingWithoutChanges error:&coordinatorError byAccessor:^(NSURL *newURL) {
+		// A package is a directory of files, its contents only exist once the document is open
+		NSNumber *isDirectory = nil;
+		[newURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:nil];
+		if ([isDirectory boolValue]) {
+			readError = [NSError errorWithDomain:[NSString stringWithFormat:@"The document, %@, is a package and can only be read in ranges while it is open", self.localizedName] code:415 userInfo:@{@"FileURL": self.fileURL}];
+			return;
+		}
+		
+		NSFileHandle *handle = [NSFileHandle fileHandleForReadingFromURL:newURL error:&readError];
+		if (!handle) return;
+		
+		// Compressed files have to be decoded from the start, map them and stream the decoded bytes up to the end of the range
+		if ([iCloudCompression isCompressedData:[handle readDataOfLength:iCloudCompressionHeaderLength]]) {
+			[handle closeFile];
+			NSData *fileContents = [NSData dataWithContentsOfURL:newURL options:NSDataReadingMappedIfSafe error:&readError];
+			if (!fileContents) return;
+			
+			unsigned long long rangeEnd = (unsigned long long)range.location + range.length;
+			if (rangeEnd < range.location) rangeEnd = ULLONG_MAX;
+			__block unsigned long long decodedOffset = 0;
+			success = [iCloudCompression decompressData:fileContents bufferLength:chunkLength chunkHandler:^(NSData *chunk, BOOL *stop) {
+				unsigned long long chunkStart = decodedOffset;
+				unsigned long long chunkEnd = chunkStart + chunk.length;
+				decodedOffset = chunkEnd;
+				if (chunkEnd <= range.location) return;
+				
+				unsigned long long sliceStart = MAX(chunkStart, (unsigned long long)range.location);
+				unsigned long long sliceEnd = MIN(chunkEnd, rangeEnd);
+				if (sliceStart < sliceEnd) block([chunk subdataWithRange:NSMakeRange((NSUInteger)(sliceStart - chunkStart), (NSUInteger)(sliceEnd - sliceStart))], sliceStart, stop);
+				if (chunkEnd >= rangeEnd) *stop = YES;
+			} error:&readError];
+			return;
+		}
+		
+		unsigned long long fileLength = [handle seekToEndOfFile];
+		unsigned long long location = MIN((unsigned long long)range.location, fileLength);
+		unsigned long long end = ((unsigned long long)range.length > fileLength - location) ? fileLength : location + range.length;
+		BOOL stop = NO;
+		
+		[handle seekToFileOffset:location];
+		while (location < end && stop == NO) {
+			@autoreleasepool {
+				NSData *chunk = [handle readDataOfLength:(NSUInteger)MIN((unsigned long long)chunkLength, end - location)];
+				if (chunk.length == 0) break;
+				
+				block(chunk, location, &stop);
+				location += chunk.length;
+			}
+		}
+		
+		[handle closeFile];
+		success = YES;
+	}];
+	
+	if (error) *error = coordinatorError ?: readError;
+	return success;
+}
+
 //----------------------------------------------------------------------------------------------------------------//
 //------------  Error Handling ----------------------------------------------------------------------------------//
 //----------------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,116 @@
+//
+//  iCloudDocumentPool.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+    @import UIKit;
+#else
+    #import <Foundation/Foundation.h>
+    #import <UIKit/UIKit.h>
+#endif
+
+// Import iCloudDocument
+#import "iCloudDocument.h"
+
+/** The iCloudDocumentPool class keeps recently opened documents open so that retrieving the same document again does not read and coordinate the file a second time.
+ 
+ Documents are keyed by name and evicted in least-recently-used order once either the document count or the total size of their contents exceeds the pool's limits. Evicted documents are closed. Only idle documents are evicted: a document is in use from the moment it is handed out (by documentWithName: or addDocument:withName:) until it is released with releaseDocumentWithName:, and documents with unsaved changes are never evicted either. The pool may therefore stay above its limits while documents are in use. When the application receives a memory warning every idle document is released.
+ 
+ The iCloud class owns a pool and uses it from retrieveCloudDocumentWithName:completion: and retrieveCloudDocumentObjectWithName:. Entries are invalidated when the metadata query reports a newer version of the document, or when the document is deleted or renamed. */
+@interface iCloudDocumentPool : NSObject
+
+
+
+/** @name Methods */
+
+/** Get an open document from the pool and mark it as most recently used
+ 
+ @discussion The document is handed out, so it stays in the pool until it is released with releaseDocumentWithName:.
+ 
+ @param documentName The name of the document. This value must not be nil.
+ @return The pooled document, or nil if the document is not in the pool. Lookups are counted as hits or misses. */
+- (iCloudDocument *)documentWithName:(NSString *)documentName __attribute__((nonnull));
+
+/** Check whether the pool holds an open document for a file, without counting a lookup
+ 
+ @param fileURL The file URL of the document. This value must not be nil.
+ @return YES if an open document for the file is in the pool, NO otherwise */
+- (BOOL)containsDocumentAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Add an open document which is being handed out to the pool, evicting the least recently used idle documents if the pool is over its limits
+ 
+ @param document The open document. This value must not be nil.
+ @param documentName The name of the document. This value must not be nil. */
+- (void)addDocument:(iCloudDocument *)document withName:(NSString *)documentName __attribute__((nonnull));
+
+/** Release a document handed out by documentWithName: or addDocument:withName:
+ 
+ @discussion Call this once for every time the document was handed out. Once it is no longer in use, the document can be evicted when the pool is over its limits.
+ 
+ @param documentName The name of the document. This value must not be nil. */
+- (void)releaseDocumentWithName:(NSString *)documentName __attribute__((nonnull));
+
+/** Remove a document from the pool and close it
+ 
+ @param documentName The name of the document. This value must not be nil. */
+- (void)removeDocumentWithName:(NSString *)documentName __attribute__((nonnull));
+
+/** Remove a document from the pool, close it and wait for the close to finish
+ 
+ @discussion Closing saves the document's unsaved changes. Writers which replace the file wait for the completion, so the pooled document's save cannot overwrite theirs.
+ 
+ @param documentName The name of the document. This value must not be nil.
+ @param completion Called once the document is closed, on the main thread, or right away if the pool does not hold the document. May be nil. */
+- (void)removeDocumentWithName:(NSString *)documentName completion:(void (^)(void))completion __attribute__((nonnull (1)));
+
+/** Remove a document from the pool if a newer version of it exists
+ 
+ @param documentName The name of the document. This value must not be nil.
+ @param modifiedDate The modification date of the document as reported by the metadata query. The pooled document is removed if it was last read or saved before this date. */
+- (void)invalidateDocumentWithName:(NSString *)documentName modifiedDate:(NSDate *)modifiedDate __attribute__((nonnull (1)));
+
+/** Remove every document from the pool and close them, including documents which are in use */
+- (void)removeAllDocuments;
+
+/** Record how long a document took to open when it was not in the pool
+ 
+ @param latency The time between the request and the document being open, in seconds */
+- (void)recordOpenLatency:(NSTimeInterval)latency;
+
+
+
+
+/** @name Properties */
+
+/** The maximum number of documents kept open. The default value is 8. */
+@property (assign, nonatomic) NSUInteger maximumDocumentCount;
+
+/** The maximum total size, in bytes, of the contents of the documents kept open. The default value is 64 MB. */
+@property (assign, nonatomic) unsigned long long maximumTotalBytes;
+
+/** The number of documents currently in the pool */
+@property (assign, readonly) NSUInteger documentCount;
+
+/** The number of lookups which found an open document */
+@property (assign, readonly) NSUInteger hitCount;
+
+/** The number of lookups which did not find an open document */
+@property (assign, readonly) NSUInteger missCount;
+
+/** The fraction of lookups which found an open document, between 0 and 1 */
+@property (assign, readonly) double hitRate;
+
+/** The number of documents opened because they were not in the pool */
+@property (assign, readonly) NSUInteger openCount;
+
+/** The average time it took to open a document which was not in the pool, in seconds */
+@property (assign, readonly) NSTimeInterval averageOpenLatency;
+
+@end
@@ -0,0 +1,269 @@
+//
+//  iCloudDocumentPool.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudDocumentPool.h"
+
+@interface iCloudDocumentPool ()
+
+/// Pooled documents keyed by name
+@property (strong) NSMutableDictionary *documents;
+
+/// Document names, least recently used first
+@property (strong) NSMutableArray *recentNames;
+
+/// Names of the documents handed out and not released yet, counted once per hand-out
+@property (strong) NSCountedSet *outstandingNames;
+
+@property (assign, readwrite) NSUInteger hitCount;
+@property (assign, readwrite) NSUInteger missCount;
+@property (assign, readwrite) NSUInteger openCount;
+
+/// The sum of all recorded open latencies
+@property (assign) NSTimeInterval totalOpenLatency;
+
+/// Evict the least recently used idle documents until the pool is within its limits
+- (void)trimToLimits;
+
+/// Check whether a pooled document can be closed without pulling it from under a caller or losing changes
+- (BOOL)isDocumentIdleWithName:(NSString *)documentName;
+
+/// Drop a document and its hand-outs from the pool without closing it
+- (void)forgetDocumentWithName:(NSString *)documentName;
+
+/// Close an evicted document, calling the completion on the main thread once it is closed
+- (void)closeDocument:(iCloudDocument *)document completion:(void (^)(void))completion;
+
+/// Release every document when the system is low on memory
+- (void)didReceiveMemoryWarning:(NSNotification *)notification;
+
+@end
+
+@implementation iCloudDocumentPool
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _maximumDocumentCount = 8;
+        _maximumTotalBytes = 64 * 1024 * 1024;
+        _documents = [NSMutableDictionary dictionary];
+        _recentNames = [NSMutableArray array];
+        _outstandingNames = [NSCountedSet set];
+        
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Pooling ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Pooling
+
+- (iCloudDocument *)documentWithName:(NSString *)documentName {
+    @synchronized (self) {
+        iCloudDocument *document = self.documents[documentName];
+        
+        // Closed documents are of no use to callers, drop them
+        if (document && (document.documentState & UIDocumentStateClosed)) {
+            [self forgetDocumentWithName:documentName];
+            document = nil;
+        }
+        
+        if (document) {
+            self.hitCount++;
+            [self.outstandingNames addObject:documentName];
+            [self.recentNames removeObject:documentName];
+            [self.recentNames addObject:documentName];
+        } else {
+            self.missCount++;
+        }
+        
+        return document;
+    }
+}
+
+- (BOOL)containsDocumentAtURL:(NSURL *)fileURL {
+    @synchronized (self) {
+        for (iCloudDocument *document in [self.documents allValues]) {
+            if ([[document.fileURL path] isEqualToString:[fileURL path]] && (document.documentState & UIDocumentStateClosed) == 0) return YES;
+        }
+        return NO;
+    }
+}
+
+- (void)addDocument:(iCloudDocument *)document withName:(NSString *)documentName {
+    @synchronized (self) {
+        iCloudDocument *existingDocument = self.documents[documentName];
+        if (existingDocument && existingDocument != document) {
+            [self forgetDocumentWithName:documentName];
+            [self closeDocument:existingDocument completion:nil];
+        }
+        
+        self.documents[documentName] = document;
+        [self.outstandingNames addObject:documentName];
+        [self.recentNames removeObject:documentName];
+        [self.recentNames addObject:documentName];
+        
+        [self trimToLimits];
+    }
+}
+
+- (void)releaseDocumentWithName:(NSString *)documentName {
+    @synchronized (self) {
+        if ([self.outstandingNames countForObject:documentName] == 0) return;
+        [self.outstandingNames removeObject:documentName];
+        
+        // The pool may have grown past its limits while the document was in use
+        [self trimToLimits];
+    }
+}
+
+- (void)removeDocumentWithName:(NSString *)documentName {
+    [self removeDocumentWithName:documentName completion:nil];
+}
+
+- (void)removeDocumentWithName:(NSString *)documentName completion:(void (^)(void))completion {
+    iCloudDocument *document;
+    @synchronized (self) {
+        document = self.documents[documentName];
+        [self forgetDocumentWithName:documentName];
+    }
+    
+    if (document) [self closeDocument:document completion:completion];
+    else if (completion) completion();
+}
+
+- (void)invalidateDocumentWithName:(NSString *)documentName modifiedDate:(NSDate *)modifiedDate {
+    @synchronized (self) {
+        iCloudDocument *document = self.documents[documentName];
+        if (!document) return;
+        
+        // Our own saves also show up as changes, only drop documents which are behind the file
+        NSDate *documentDate = document.fileModificationDate;
+        if (modifiedDate && documentDate && [documentDate compare:modifiedDate] != NSOrderedAscending) return;
+    }
+    
+    [self removeDocumentWithName:documentName];
+}
+
+- (void)removeAllDocuments {
+    NSArray *documents;
+    @synchronized (self) {
+        documents = [self.documents allValues];
+        [self.documents removeAllObjects];
+        [self.recentNames removeAllObjects];
+        [self.outstandingNames removeAllObjects];
+    }
+    
+    for (iCloudDocument *document in documents) [self closeDocument:document completion:nil];
+}
+
+- (void)trimToLimits {
+    unsigned long long totalBytes = 0;
+    for (iCloudDocument *document in [self.documents allValues]) totalBytes += document.contents.length;
+    
+    // Always keep the most recently used document, even if it is larger than the byte limit. Documents in use are skipped, not waited for
+    NSUInteger documentCount = self.recentNames.count;
+    for (NSString *name in [self.recentNames subarrayWithRange:NSMakeRange(0, documentCount > 0 ? documentCount - 1 : 0)]) {
+        if (documentCount <= self.maximumDocumentCount && totalBytes <= self.maximumTotalBytes) break;
+        if (![self isDocumentIdleWithName:name]) continue;
+        
+        iCloudDocument *document = self.documents[name];
+        totalBytes -= document.contents.length;
+        documentCount--;
+        [self forgetDocumentWithName:name];
+        [self closeDocument:document completion:nil];
+    }
+}
+
+- (BOOL)isDocumentIdleWithName:(NSString *)documentName {
+    if ([self.outstandingNames countForObject:documentName] > 0) return NO;
+    return ![self.documents[documentName] hasUnsavedChanges];
+}
+
+- (void)forgetDocumentWithName:(NSString *)documentName {
+    [self.documents removeObjectForKey:documentName];
+    [self.recentNames removeObject:documentName];
+    while ([self.outstandingNames countForObject:documentName] > 0) [self.outstandingNames removeObject:documentName];
+}
+
+- (void)closeDocument:(iCloudDocument *)document completion:(void (^)(void))completion {
+    if (document.documentState & UIDocumentStateClosed) {
+        if (completion) completion();
+        return;
+    }
+    
+    [document closeWithCompletionHandler:^(BOOL success) {
+        if (completion) completion();
+    }];
+}
+
+- (void)setMaximumDocumentCount:(NSUInteger)maximumDocumentCount {
+    @synchronized (self) {
+        _maximumDocumentCount = maximumDocumentCount;
+        [self trimToLimits];
+    }
+}
+
+- (void)setMaximumTotalBytes:(unsigned long long)maximumTotalBytes {
+    @synchronized (self) {
+        _maximumTotalBytes = maximumTotalBytes;
+        [self trimToLimits];
+    }
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    // Documents in use or with unsaved changes would be closed under their callers, keep them
+    NSMutableArray *documents = [NSMutableArray array];
+    @synchronized (self) {
+        for (NSString *name in [self.recentNames copy]) {
+            if (![self isDocumentIdleWithName:name]) continue;
+            [documents addObject:self.documents[name]];
+            [self forgetDocumentWithName:name];
+        }
+    }
+    
+    for (iCloudDocument *document in documents) [self closeDocument:document completion:nil];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Statistics ---------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Statistics
+
+- (NSUInteger)documentCount {
+    @synchronized (self) {
+        return self.documents.count;
+    }
+}
+
+- (double)hitRate {
+    @synchronized (self) {
+        NSUInteger lookups = self.hitCount + self.missCount;
+        return lookups > 0 ? (double)self.hitCount / (double)lookups : 0;
+    }
+}
+
+- (void)recordOpenLatency:(NSTimeInterval)latency {
+    @synchronized (self) {
+        self.openCount++;
+        self.totalOpenLatency += latency;
+    }
+}
+
+- (NSTimeInterval)averageOpenLatency {
+    @synchronized (self) {
+        return self.openCount > 0 ? self.totalOpenLatency / self.openCount : 0;
+    }
+}
+
+@end
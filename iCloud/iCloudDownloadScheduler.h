@@ -0,0 +1,116 @@
+//
+//  iCloudDownloadScheduler.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+// Import iCloudTelemetry
+#import "iCloudTelemetry.h"
+
+/** The priority classes used by iCloudDownloadScheduler, from most to least urgent */
+typedef NS_ENUM(NSInteger, iCloudDownloadPriority) {
+    /// The document was explicitly requested, for example by retrieveCloudDocumentWithName:completion:
+    iCloudDownloadPriorityRequested = 0,
+    /// The document was modified recently and is likely to be opened soon
+    iCloudDownloadPriorityRecentlyModified = 1,
+    /// The document is downloaded ahead of time when nothing more urgent is waiting
+    iCloudDownloadPriorityBackground = 2
+};
+
+/** The iCloudDownloadScheduler class decides which iCloud documents are downloaded, and when.
+ 
+ Instead of asking for every document that is not available locally at once, the scheduler keeps a queue per priority class and only starts a download when fewer than maximumConcurrentDownloads are in flight and the download fits in maximumBytesInFlight. Explicitly requested documents always go first, followed by recently modified documents and finally background prefetches, oldest first within each class.
+ 
+ The scheduler's state machine is driven by the downloading status reported by the metadata query: an item that is not downloaded is queued, a queued item becomes downloading once the scheduler asks the system for it, and it leaves the scheduler once the query reports it as downloaded or current. A download which fails to start, which the query reports with a downloading error, or which does not finish within downloadTimeout gives its slot back and is queued again after retryInterval, a delay which doubles with every failed attempt up to maximumRetryInterval. The iCloud class owns a scheduler and feeds it every metadata update. */
+@interface iCloudDownloadScheduler : NSObject
+
+
+
+/** @name Methods */
+
+/** Update the scheduler with the downloading status of an item reported by the metadata query
+ 
+ @discussion Items which are not downloaded are queued with a priority based on their modification date, unless they are already queued or downloading. Items which are downloaded or current are completed and free their slot and bytes.
+ 
+ @param fileURL The URL of the item. This value must not be nil.
+ @param status The NSMetadataUbiquitousItemDownloadingStatusKey value of the item
+ @param fileSize The size of the item in bytes, or nil if unknown
+ @param modifiedDate The content modification date of the item, or nil if unknown */
+- (void)updateItemAtURL:(NSURL *)fileURL downloadingStatus:(NSString *)status fileSize:(NSNumber *)fileSize modifiedDate:(NSDate *)modifiedDate __attribute__((nonnull (1)));
+
+/** Update the scheduler with the downloading status and error of an item reported by the metadata query
+ 
+ @discussion Behaves like updateItemAtURL:downloadingStatus:fileSize:modifiedDate:. When an item which is downloading is reported as not downloaded with an error, its slot and bytes are freed and it is queued again after the retry delay.
+ 
+ @param fileURL The URL of the item. This value must not be nil.
+ @param status The NSMetadataUbiquitousItemDownloadingStatusKey value of the item
+ @param error The NSMetadataUbiquitousItemDownloadingErrorKey value of the item, or nil if the download has not failed
+ @param fileSize The size of the item in bytes, or nil if unknown
+ @param modifiedDate The content modification date of the item, or nil if unknown */
+- (void)updateItemAtURL:(NSURL *)fileURL downloadingStatus:(NSString *)status downloadingError:(NSError *)error fileSize:(NSNumber *)fileSize modifiedDate:(NSDate *)modifiedDate __attribute__((nonnull (1)));
+
+/** Raise the priority of an item
+ 
+ @discussion If the item is already downloading nothing changes. If it is queued, or waiting to be retried after a failure, it moves to the front of the requested priority class. If it is not known to the scheduler it is queued with that priority.
+ 
+ @param fileURL The URL of the item. This value must not be nil.
+ @param priority The new priority. Priorities are only ever raised by this method. */
+- (void)raisePriorityOfItemAtURL:(NSURL *)fileURL toPriority:(iCloudDownloadPriority)priority __attribute__((nonnull (1)));
+
+/** Forget an item, for example because it was deleted
+ 
+ @param fileURL The URL of the item. This value must not be nil. */
+- (void)removeItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+
+
+
+/** @name Properties */
+
+/** The maximum number of downloads started at the same time. The default value is 3. */
+@property (assign, nonatomic) NSUInteger maximumConcurrentDownloads;
+
+/** The maximum number of bytes of downloads started at the same time. A single download larger than the budget is still started when nothing else is in flight. The default value is 64 MB. */
+@property (assign, nonatomic) unsigned long long maximumBytesInFlight;
+
+/** Items modified within this interval are downloaded with the recently modified priority instead of the background priority. The default value is 7 days. */
+@property (assign, nonatomic) NSTimeInterval recentlyModifiedInterval;
+
+/** The time, in seconds, a download may take before its slot is given back and it is queued again. The default value is 5 minutes. */
+@property (assign) NSTimeInterval downloadTimeout;
+
+/** The delay, in seconds, before a failed download is queued again. The delay doubles with every failed attempt of the same item. The default value is 2 seconds. */
+@property (assign) NSTimeInterval retryInterval;
+
+/** The longest delay, in seconds, before a failed download is queued again. The default value is 10 minutes. */
+@property (assign) NSTimeInterval maximumRetryInterval;
+
+/** The number of items waiting to be downloaded, not counting failed downloads waiting to be retried */
+@property (assign, readonly) NSUInteger queuedCount;
+
+/** The number of items currently downloading */
+@property (assign, readonly) NSUInteger downloadingCount;
+
+/** The number of bytes of the items currently downloading */
+@property (assign, readonly) unsigned long long bytesInFlight;
+
+/** The file manager (storage backend) used to start downloads and evictions. The default value is [NSFileManager defaultManager]. */
+@property (strong) NSFileManager *fileManager;
+
+/** The telemetry which receives the manager's counters and log messages */
+@property (strong) iCloudTelemetry *telemetry;
+
+/** Enable verbose logging of scheduling decisions */
+@property (assign) BOOL verboseLogging;
+
+@end
@@ -0,0 +1,263 @@
+//
+//  iCloudDownloadScheduler.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudDownloadScheduler.h"
+
+@interface iCloudDownloadScheduler ()
+
+/// Serial queue protecting the scheduler state
+@property (strong) dispatch_queue_t schedulerQueue;
+
+/// Queued items per priority class, oldest first. Each item is a mutable dictionary with url, size and priority keys, plus attempts, started and retrying keys once it has been started.
+@property (strong) NSArray *queues;
+
+/// Queued and downloading items keyed by file path
+@property (strong) NSMutableDictionary *items;
+
+/// Paths of the items currently downloading
+@property (strong) NSMutableSet *downloadingPaths;
+
+@property (assign, readwrite) unsigned long long bytesInFlight;
+
+/// Queue an item in its priority class
+- (void)enqueueItem:(NSMutableDictionary *)item;
+
+/// Start as many queued downloads as the budgets allow. Must be called on the scheduler queue.
+- (void)startDownloads;
+
+/// Free the slot of a failed or timed out download and queue it again after a growing delay. Must be called on the scheduler queue.
+- (void)retryItem:(NSMutableDictionary *)item error:(NSError *)error;
+
+@end
+
+@implementation iCloudDownloadScheduler
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _maximumConcurrentDownloads = 3;
+        _maximumBytesInFlight = 64 * 1024 * 1024;
+        _recentlyModifiedInterval = 7 * 24 * 60 * 60;
+        _downloadTimeout = 5 * 60;
+        _retryInterval = 2;
+        _maximumRetryInterval = 10 * 60;
+        _schedulerQueue = dispatch_queue_create("com.iRareMedia.iCloud.downloads", DISPATCH_QUEUE_SERIAL);
+        _queues = @[[NSMutableArray array], [NSMutableArray array], [NSMutableArray array]];
+        _items = [NSMutableDictionary dictionary];
+        _fileManager = [NSFileManager defaultManager];
+        _downloadingPaths = [NSMutableSet set];
+    }
+    return self;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  State Machine ------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - State Machine
+
+- (void)updateItemAtURL:(NSURL *)fileURL downloadingStatus:(NSString *)status fileSize:(NSNumber *)fileSize modifiedDate:(NSDate *)modifiedDate {
+    [self updateItemAtURL:fileURL downloadingStatus:status downloadingError:nil fileSize:fileSize modifiedDate:modifiedDate];
+}
+
+- (void)updateItemAtURL:(NSURL *)fileURL downloadingStatus:(NSString *)status downloadingError:(NSError *)error fileSize:(NSNumber *)fileSize modifiedDate:(NSDate *)modifiedDate {
+    NSString *path = [fileURL path];
+    dispatch_async(self.schedulerQueue, ^{
+        NSMutableDictionary *item = self.items[path];
+        
+        if ([status isEqualToString:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded]) {
+            // A failed download gives its slot back and is tried again later
+            if (item && error && [self.downloadingPaths containsObject:path]) {
+                [self retryItem:item error:error];
+                [self startDownloads];
+                return;
+            }
+            
+            // Already queued, downloading or waiting to be retried, keep waiting for the query to report completion
+            if (item) {
+                if (fileSize && ![self.downloadingPaths containsObject:path]) item[@"size"] = fileSize;
+                return;
+            }
+            
+            BOOL recent = modifiedDate && [[NSDate date] timeIntervalSinceDate:modifiedDate] <= self.recentlyModifiedInterval;
+            item = [@{@"url": fileURL, @"size": fileSize ?: @0, @"priority": @(recent ? iCloudDownloadPriorityRecentlyModified : iCloudDownloadPriorityBackground)} mutableCopy];
+            self.items[path] = item;
+            [self enqueueItem:item];
+        } else if (item) {
+            // Downloaded or current, the item is done
+            [self.items removeObjectForKey:path];
+            [self.queues[[item[@"priority"] integerValue]] removeObjectIdenticalTo:item];
+            if ([self.downloadingPaths containsObject:path]) {
+                [self.downloadingPaths removeObject:path];
+                self.bytesInFlight -= [item[@"size"] unsignedLongLongValue];
+                if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Finished downloading %@", [fileURL lastPathComponent]];
+            }
+        }
+        
+        [self startDownloads];
+    });
+}
+
+- (void)raisePriorityOfItemAtURL:(NSURL *)fileURL toPriority:(iCloudDownloadPriority)priority {
+    NSString *path = [fileURL path];
+    dispatch_async(self.schedulerQueue, ^{
+        NSMutableDictionary *item = self.items[path];
+        
+        if (!item) {
+            item = [@{@"url": fileURL, @"size": @0, @"priority": @(priority)} mutableCopy];
+            self.items[path] = item;
+            [self enqueueItem:item];
+        } else if ([item[@"retrying"] boolValue]) {
+            // An explicit request does not wait for the backoff of an earlier failure
+            [item removeObjectForKey:@"retrying"];
+            item[@"priority"] = @(MIN([item[@"priority"] integerValue], priority));
+            [self.queues[[item[@"priority"] integerValue]] insertObject:item atIndex:0];
+        } else if (![self.downloadingPaths containsObject:path] && [item[@"priority"] integerValue] > priority) {
+            // Move the item to the front of the more urgent class
+            [self.queues[[item[@"priority"] integerValue]] removeObjectIdenticalTo:item];
+            item[@"priority"] = @(priority);
+            [self.queues[priority] insertObject:item atIndex:0];
+        }
+        
+        [self startDownloads];
+    });
+}
+
+- (void)removeItemAtURL:(NSURL *)fileURL {
+    NSString *path = [fileURL path];
+    dispatch_async(self.schedulerQueue, ^{
+        NSMutableDictionary *item = self.items[path];
+        if (!item) return;
+        
+        [self.items removeObjectForKey:path];
+        [self.queues[[item[@"priority"] integerValue]] removeObjectIdenticalTo:item];
+        if ([self.downloadingPaths containsObject:path]) {
+            [self.downloadingPaths removeObject:path];
+            self.bytesInFlight -= [item[@"size"] unsignedLongLongValue];
+        }
+        
+        [self startDownloads];
+    });
+}
+
+- (void)enqueueItem:(NSMutableDictionary *)item {
+    [self.queues[[item[@"priority"] integerValue]] addObject:item];
+}
+
+- (void)startDownloads {
+    while (self.downloadingPaths.count < self.maximumConcurrentDownloads) {
+        // Pick the oldest item of the most urgent non-empty class
+        NSMutableArray *queue = nil;
+        for (NSMutableArray *candidate in self.queues) {
+            if (candidate.count > 0) {
+                queue = candidate;
+                break;
+            }
+        }
+        if (!queue) return;
+        
+        NSMutableDictionary *item = queue.firstObject;
+        unsigned long long size = [item[@"size"] unsignedLongLongValue];
+        if (self.downloadingPaths.count > 0 && self.bytesInFlight + size > self.maximumBytesInFlight) return;
+        
+        [queue removeObjectAtIndex:0];
+        NSURL *fileURL = item[@"url"];
+        
+        NSError *error;
+        BOOL downloading = [self.fileManager startDownloadingUbiquitousItemAtURL:fileURL error:&error];
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] %@ started downloading locally with priority %@, successful? %@", [fileURL lastPathComponent], item[@"priority"], downloading ? @"YES" : @"NO"];
+        
+        if (!downloading) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Ubiquitous item failed to start downloading with error: %@", error];
+            [self retryItem:item error:error];
+            continue;
+        }
+        
+        [self.telemetry incrementCounterForOperation:iCloudTelemetryOperationDownloadStart];
+        [self.downloadingPaths addObject:[fileURL path]];
+        self.bytesInFlight += size;
+        
+        // A download the query never reports as finished or failed must not hold its slot forever
+        NSDate *started = [NSDate date];
+        item[@"started"] = started;
+        __weak __typeof(self) wself=self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.downloadTimeout * NSEC_PER_SEC)), self.schedulerQueue, ^{
+            __typeof(self) sself = wself;
+            if (!sself || sself.items[[fileURL path]] != item || item[@"started"] != started || ![sself.downloadingPaths containsObject:[fileURL path]]) return;
+            
+            [sself retryItem:item error:[NSError errorWithDomain:[NSString stringWithFormat:@"The download of %@ did not finish within %.0f seconds", [fileURL lastPathComponent], sself.downloadTimeout] code:408 userInfo:@{@"FileURL": fileURL}]];
+            [sself startDownloads];
+        });
+    }
+}
+
+- (void)retryItem:(NSMutableDictionary *)item error:(NSError *)error {
+    NSURL *fileURL = item[@"url"];
+    NSString *path = [fileURL path];
+    if ([self.downloadingPaths containsObject:path]) {
+        [self.downloadingPaths removeObject:path];
+        self.bytesInFlight -= [item[@"size"] unsignedLongLongValue];
+    }
+    
+    // Double the delay with every failed attempt, up to the maximum
+    NSUInteger attempts = [item[@"attempts"] unsignedIntegerValue] + 1;
+    NSTimeInterval delay = MIN(self.retryInterval * pow(2, MIN(attempts - 1, (NSUInteger)30)), self.maximumRetryInterval);
+    item[@"attempts"] = @(attempts);
+    item[@"retrying"] = @YES;
+    [item removeObjectForKey:@"started"];
+    [self.telemetry incrementCounterForOperation:iCloudTelemetryOperationDownloadRetry];
+    if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] %@ will be downloaded again in %.0f seconds (attempt %lu), error: %@", [fileURL lastPathComponent], delay, (unsigned long)attempts, error];
+    
+    __weak __typeof(self) wself=self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.schedulerQueue, ^{
+        __typeof(self) sself = wself;
+        
+        // The item may have finished, been removed or been requested explicitly in the meantime
+        if (!sself || sself.items[path] != item || ![item[@"retrying"] boolValue]) return;
+        
+        [item removeObjectForKey:@"retrying"];
+        [sself enqueueItem:item];
+        [sself startDownloads];
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Budgets ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Budgets
+
+- (void)setMaximumConcurrentDownloads:(NSUInteger)maximumConcurrentDownloads {
+    _maximumConcurrentDownloads = MAX(maximumConcurrentDownloads, (NSUInteger)1);
+    dispatch_async(self.schedulerQueue, ^{
+        [self startDownloads];
+    });
+}
+
+- (void)setMaximumBytesInFlight:(unsigned long long)maximumBytesInFlight {
+    _maximumBytesInFlight = maximumBytesInFlight;
+    dispatch_async(self.schedulerQueue, ^{
+        [self startDownloads];
+    });
+}
+
+- (NSUInteger)queuedCount {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.schedulerQueue, ^{
+        for (NSArray *queue in self.queues) count += queue.count;
+    });
+    return count;
+}
+
+- (NSUInteger)downloadingCount {
+    __block NSUInteger count = 0;
+    dispatch_sync(self.schedulerQueue, ^{
+        count = self.downloadingPaths.count;
+    });
+    return count;
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  iCloudEvictionManager.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+// Import iCloudTelemetry
+#import "iCloudTelemetry.h"
+
+/** The iCloudEvictionManager class keeps the on-device footprint of downloaded iCloud documents within a byte budget.
+ 
+ The manager tracks the size and last access of every downloaded item. Sizes come from the metadata query. Accesses are recorded whenever the iCloud class opens or reads a document, and fall back to the item's modification date for items which have not been accessed since launch. When the total size exceeds localByteBudget, the least recently used items are evicted with evictUbiquitousItemAtURL:, which removes the local copy but keeps the document in iCloud.
+ 
+ Eviction is disabled until localByteBudget is set. Pinned items and items reported as in use by the inUseHandler are never evicted. The iCloud class reports every document held by its pool and every file an iCloudDocument is opening, saving or reading, whether or not the document came from the pool. */
+@interface iCloudEvictionManager : NSObject
+
+
+
+/** @name Methods */
+
+/** Update the manager with the state of an item reported by the metadata query
+ 
+ @param fileURL The URL of the item. This value must not be nil.
+ @param status The NSMetadataUbiquitousItemDownloadingStatusKey value of the item. Only downloaded and current items count against the budget.
+ @param fileSize The size of the item in bytes, or nil if unknown
+ @param modifiedDate The content modification date of the item, used as its last access until it is accessed through the library */
+- (void)updateItemAtURL:(NSURL *)fileURL downloadingStatus:(NSString *)status fileSize:(NSNumber *)fileSize modifiedDate:(NSDate *)modifiedDate __attribute__((nonnull (1)));
+
+/** Record that an item was opened or read
+ 
+ @param fileURL The URL of the item. This value must not be nil. */
+- (void)recordAccessToItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Stop tracking an item, for example because it was deleted
+ 
+ @param fileURL The URL of the item. This value must not be nil. */
+- (void)removeItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Prevent an item from being evicted
+ 
+ @param fileURL The URL of the item. This value must not be nil. */
+- (void)pinItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Allow a pinned item to be evicted again
+ 
+ @param fileURL The URL of the item. This value must not be nil. */
+- (void)unpinItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Check whether an item is pinned
+ 
+ @param fileURL The URL of the item. This value must not be nil.
+ @return YES if the item is pinned, NO otherwise */
+- (BOOL)isItemPinnedAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Evict least recently used items until the local usage is within the budget
+ 
+ @discussion This is called automatically after every metadata update and access. Call it directly after lowering the budget to reclaim space immediately. */
+- (void)enforceBudget;
+
+
+
+
+/** @name Properties */
+
+/** The maximum number of bytes of downloaded items kept on the device. The default value is 0, which disables eviction.
+ 
+ @discussion Eviction is opt-in: existing local copies are never removed until a budget is set, for example `[iCloud sharedCloud].evictionManager.localByteBudget = 512 * 1024 * 1024;`. Setting a budget below the current usage evicts right away. */
+@property (assign, nonatomic) unsigned long long localByteBudget;
+
+/** Called (on a background queue) before an item is evicted. Return YES if the item is in use and must be kept. */
+@property (copy) BOOL (^inUseHandler)(NSURL *fileURL);
+
+/** The number of bytes of downloaded items currently on the device */
+@property (assign, readonly) unsigned long long localBytes;
+
+/** The number of items evicted since launch */
+@property (assign, readonly) NSUInteger evictionCount;
+
+/** The number of bytes evicted since launch */
+@property (assign, readonly) unsigned long long evictedBytes;
+
+/** The file manager (storage backend) used to start downloads and evictions. The default value is [NSFileManager defaultManager]. */
+@property (strong) NSFileManager *fileManager;
+
+/** The telemetry which receives the manager's counters and log messages */
+@property (strong) iCloudTelemetry *telemetry;
+
+/** Enable verbose logging of evictions */
+@property (assign) BOOL verboseLogging;
+
+@end
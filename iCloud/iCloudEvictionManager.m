@@ -0,0 +1,190 @@
+//
+//  iCloudEvictionManager.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudEvictionManager.h"
+
+@interface iCloudEvictionManager ()
+
+/// Serial queue protecting the manager state and running evictions
+@property (strong) dispatch_queue_t evictionQueue;
+
+/// Downloaded items keyed by file path. Each item is a mutable dictionary with url, size and lastAccess keys.
+@property (strong) NSMutableDictionary *items;
+
+/// Paths of the pinned items
+@property (strong) NSMutableSet *pinnedPaths;
+
+/// Whether an enforcement pass is already queued
+@property (assign) BOOL enforcementScheduled;
+
+@property (assign, readwrite) unsigned long long localBytes;
+@property (assign, readwrite) NSUInteger evictionCount;
+@property (assign, readwrite) unsigned long long evictedBytes;
+
+/// Queue a single enforcement pass for a burst of updates. Must be called on the eviction queue.
+- (void)scheduleEnforcement;
+
+/// Evict items until the budget is met. Must be called on the eviction queue.
+- (void)evictLeastRecentlyUsedItems;
+
+@end
+
+@implementation iCloudEvictionManager
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _localByteBudget = 0;
+        _evictionQueue = dispatch_queue_create("com.iRareMedia.iCloud.eviction", DISPATCH_QUEUE_SERIAL);
+        _items = [NSMutableDictionary dictionary];
+        _fileManager = [NSFileManager defaultManager];
+        _pinnedPaths = [NSMutableSet set];
+    }
+    return self;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Tracking -----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Tracking
+
+- (void)updateItemAtURL:(NSURL *)fileURL downloadingStatus:(NSString *)status fileSize:(NSNumber *)fileSize modifiedDate:(NSDate *)modifiedDate {
+    NSString *path = [fileURL path];
+    BOOL downloaded = [status isEqualToString:NSMetadataUbiquitousItemDownloadingStatusCurrent] || [status isEqualToString:NSMetadataUbiquitousItemDownloadingStatusDownloaded];
+    
+    dispatch_async(self.evictionQueue, ^{
+        NSMutableDictionary *item = self.items[path];
+        
+        if (!downloaded) {
+            if (item) {
+                self.localBytes -= [item[@"size"] unsignedLongLongValue];
+                [self.items removeObjectForKey:path];
+            }
+            return;
+        }
+        
+        if (!item) {
+            item = [@{@"url": fileURL, @"size": @0, @"lastAccess": modifiedDate ?: [NSDate date]} mutableCopy];
+            self.items[path] = item;
+        } else if (modifiedDate && [modifiedDate compare:item[@"lastAccess"]] == NSOrderedDescending) {
+            item[@"lastAccess"] = modifiedDate;
+        }
+        
+        self.localBytes -= [item[@"size"] unsignedLongLongValue];
+        item[@"size"] = fileSize ?: item[@"size"];
+        self.localBytes += [item[@"size"] unsignedLongLongValue];
+        
+        [self scheduleEnforcement];
+    });
+}
+
+- (void)recordAccessToItemAtURL:(NSURL *)fileURL {
+    NSString *path = [fileURL path];
+    NSDate *accessDate = [NSDate date];
+    dispatch_async(self.evictionQueue, ^{
+        NSMutableDictionary *item = self.items[path];
+        if (item) item[@"lastAccess"] = accessDate;
+    });
+}
+
+- (void)removeItemAtURL:(NSURL *)fileURL {
+    NSString *path = [fileURL path];
+    dispatch_async(self.evictionQueue, ^{
+        NSMutableDictionary *item = self.items[path];
+        if (!item) return;
+        
+        self.localBytes -= [item[@"size"] unsignedLongLongValue];
+        [self.items removeObjectForKey:path];
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Pinning ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Pinning
+
+- (void)pinItemAtURL:(NSURL *)fileURL {
+    @synchronized (self.pinnedPaths) {
+        [self.pinnedPaths addObject:[fileURL path]];
+    }
+}
+
+- (void)unpinItemAtURL:(NSURL *)fileURL {
+    @synchronized (self.pinnedPaths) {
+        [self.pinnedPaths removeObject:[fileURL path]];
+    }
+    
+    [self enforceBudget];
+}
+
+- (BOOL)isItemPinnedAtURL:(NSURL *)fileURL {
+    @synchronized (self.pinnedPaths) {
+        return [self.pinnedPaths containsObject:[fileURL path]];
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Eviction -----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Eviction
+
+- (void)setLocalByteBudget:(unsigned long long)localByteBudget {
+    _localByteBudget = localByteBudget;
+    [self enforceBudget];
+}
+
+- (void)enforceBudget {
+    dispatch_async(self.evictionQueue, ^{
+        [self scheduleEnforcement];
+    });
+}
+
+- (void)scheduleEnforcement {
+    if (self.enforcementScheduled) return;
+    self.enforcementScheduled = YES;
+    
+    // Updates arrive in bursts from the metadata query, evict once after the burst
+    dispatch_async(self.evictionQueue, ^{
+        self.enforcementScheduled = NO;
+        [self evictLeastRecentlyUsedItems];
+    });
+}
+
+- (void)evictLeastRecentlyUsedItems {
+    if (self.localByteBudget == 0 || self.localBytes <= self.localByteBudget) return;
+    
+    NSArray *candidates = [[self.items allValues] sortedArrayUsingComparator:^NSComparisonResult(NSDictionary *first, NSDictionary *second) {
+        return [first[@"lastAccess"] compare:second[@"lastAccess"]];
+    }];
+    
+    for (NSMutableDictionary *item in candidates) {
+        if (self.localBytes <= self.localByteBudget) break;
+        
+        NSURL *fileURL = item[@"url"];
+        if ([self isItemPinnedAtURL:fileURL]) continue;
+        if (self.inUseHandler && self.inUseHandler(fileURL)) continue;
+        
+        NSError *error;
+        BOOL evicted = [self.fileManager evictUbiquitousItemAtURL:fileURL error:&error];
+        if (!evicted) {
+            if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Failed to evict %@ to stay within the local budget: %@", [fileURL lastPathComponent], error];
+            continue;
+        }
+        
+        // The query reports the item as not downloaded shortly, account for it now
+        unsigned long long size = [item[@"size"] unsignedLongLongValue];
+        self.localBytes -= size;
+        self.evictedBytes += size;
+        self.evictionCount++;
+        [self.items removeObjectForKey:[fileURL path]];
+        
+        if (self.verboseLogging == YES) [self.telemetry log:@"[iCloud] Evicted %@ (%llu bytes) to stay within the local budget", [fileURL lastPathComponent], size];
+    }
+}
+
+@end
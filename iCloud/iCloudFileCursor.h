@@ -0,0 +1,108 @@
+//
+//  iCloudFileCursor.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The attributes of one file returned by iCloudFileCursor. Every attribute is read in the same pass as the directory listing, so no further file system calls are needed to display it. */
+@interface iCloudFileInfo : NSObject
+
+/** The name of the file, including its extension */
+@property (copy, readonly) NSString *name;
+
+/** The URL of the file */
+@property (strong, readonly) NSURL *fileURL;
+
+/** The size of the file in bytes, zero for directories and packages */
+@property (assign, readonly) unsigned long long fileSize;
+
+/** The date the file was created */
+@property (strong, readonly) NSDate *creationDate;
+
+/** The date the contents of the file were last modified */
+@property (strong, readonly) NSDate *modificationDate;
+
+/** The ubiquitous downloading status of the file (one of the NSURLUbiquitousItemDownloadingStatus constants), or nil if the file is not ubiquitous */
+@property (copy, readonly) NSString *downloadingStatus;
+
+/** YES if the current version of the file is available locally. Files which are not ubiquitous are always downloaded. */
+@property (assign, readonly) BOOL isDownloaded;
+
+/** YES if the file has been uploaded to iCloud */
+@property (assign, readonly) BOOL isUploaded;
+
+/** YES if the item is a directory or a package */
+@property (assign, readonly) BOOL isDirectory;
+
+@end
+
+
+
+/** The iCloudFileCursor class lists the files in a directory one page at a time.
+
+ Size, dates and ubiquity status are prefetched with the listing, so the first page of a huge directory is available after reading only as many entries as it needs, and callers do not need to call fileSize: or fileModifiedDate: for each file.
+
+ Without sort descriptors the cursor streams the directory and keeps only the current page in memory. With sort descriptors the first page lists the directory once and keeps the URL and sort values of every matching file in sorted order, and every later page is taken from that list, so each file is read once more only when its page is returned. A sorted cursor therefore holds memory in proportion to the number of matching files until its last page is read, use a filter predicate to narrow very large directories. Files added to the directory after the first page are not returned until the cursor is reset.
+
+ Pages are read synchronously. Call nextPage: from a background queue when listing large directories. */
+@interface iCloudFileCursor : NSObject
+
+
+
+/** @name Creating a Cursor */
+
+/** Create a cursor over the files in a directory
+
+ @param directoryURL The directory to list. Only the direct children of the directory are returned. This value must not be nil.
+ @param fileManager The file manager used to read the directory. This value must not be nil.
+ @return A cursor positioned before the first page */
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL fileManager:(NSFileManager *)fileManager __attribute__((nonnull));
+
+
+
+/** @name Paging */
+
+/** Read the next page of files
+
+ @param error On failure, contains an NSError describing the problem.
+ @return An array of up to pageSize iCloudFileInfo objects. The array is empty once every file has been returned, and nil if the directory could not be read. */
+- (NSArray *)nextPage:(NSError **)error;
+
+/** Move the cursor back before the first page so that the directory is listed again */
+- (void)reset;
+
+/** YES once every file has been returned */
+@property (assign, readonly, getter=isFinished) BOOL finished;
+
+
+
+/** @name Configuration */
+
+/** The maximum number of files returned by each page. Defaults to 100. */
+@property (assign, nonatomic) NSUInteger pageSize;
+
+/** Only files matching this predicate are returned. The predicate is evaluated against iCloudFileInfo objects, for example `fileSize > 1024 AND isDownloaded == YES`. Defaults to nil, which returns every file. */
+@property (strong, nonatomic) NSPredicate *filterPredicate;
+
+/** The order in which files are returned, as NSSortDescriptor objects with iCloudFileInfo keys. Files which compare equal are ordered by name. Defaults to nil, which returns files in directory order.
+
+ @discussion Changing the sort descriptors or the filter predicate resets the cursor. */
+@property (copy, nonatomic) NSArray *sortDescriptors;
+
+/** The directory being listed */
+@property (strong, readonly) NSURL *directoryURL;
+
+/** The resource keys prefetched for every file */
++ (NSArray *)prefetchedResourceKeys;
+
+@end
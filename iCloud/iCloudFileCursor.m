@@ -0,0 +1,284 @@
+//
+//  iCloudFileCursor.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudFileCursor.h"
+
+@interface iCloudFileInfo ()
+
+/// Create the info for a URL from its prefetched resource values
+- (instancetype)initWithURL:(NSURL *)url;
+
+@end
+
+@implementation iCloudFileInfo
+
+- (instancetype)initWithURL:(NSURL *)url {
+    self = [super init];
+    if (self) {
+        NSDictionary *values = [url resourceValuesForKeys:[iCloudFileCursor prefetchedResourceKeys] error:nil];
+
+        _fileURL = url;
+        _name = [values[NSURLNameKey] copy] ?: [url lastPathComponent];
+        _fileSize = [values[NSURLFileSizeKey] unsignedLongLongValue];
+        _creationDate = values[NSURLCreationDateKey];
+        _modificationDate = values[NSURLContentModificationDateKey];
+        _isDirectory = [values[NSURLIsDirectoryKey] boolValue];
+        _downloadingStatus = [values[NSURLUbiquitousItemDownloadingStatusKey] copy];
+        _isDownloaded = (_downloadingStatus == nil || [_downloadingStatus isEqualToString:NSURLUbiquitousItemDownloadingStatusCurrent]);
+        _isUploaded = [values[NSURLUbiquitousItemIsUploadedKey] boolValue];
+    }
+    return self;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %@, %llu bytes, modified %@>", NSStringFromClass([self class]), self.name, self.fileSize, self.modificationDate];
+}
+
+@end
+
+
+
+/// The URL of a file and the values it is sorted by, collected once for a sorted listing
+@interface iCloudFileSortEntry : NSObject
+
+@property (strong) NSURL *fileURL;
+@property (copy) NSString *name;
+
+/// The value of each sort descriptor key, NSNull for nil
+@property (strong) NSDictionary *sortValues;
+
+@end
+
+@implementation iCloudFileSortEntry
+
+// Sort descriptors read their keys through key-value coding, which is answered from the collected values
+- (id)valueForKey:(NSString *)key {
+    id value = self.sortValues[key];
+    return (value == [NSNull null]) ? nil : value;
+}
+
+// Sort descriptor keys are key paths, a dotted key was collected under the whole path and must not be split
+- (id)valueForKeyPath:(NSString *)keyPath {
+    return [self valueForKey:keyPath];
+}
+
+@end
+
+
+
+@interface iCloudFileCursor ()
+
+@property (strong) NSFileManager *fileManager;
+@property (assign, readwrite, getter=isFinished) BOOL finished;
+
+/// The enumerator kept open between pages when no sort descriptors are set
+@property (strong) NSDirectoryEnumerator *enumerator;
+
+/// Every matching file in sorted order, collected by the first page when sort descriptors are set
+@property (strong) NSArray *sortedEntries;
+
+/// The index in sortedEntries of the first file of the next page
+@property (assign) NSUInteger sortedOffset;
+
+/// The first error reported while enumerating
+@property (strong) NSError *enumerationError;
+
+/// Create an enumerator over the direct children of the directory
+- (NSDirectoryEnumerator *)directoryEnumerator;
+
+/// Read the next page in directory order, keeping the enumerator open
+- (NSArray *)nextStreamedPage;
+
+/// Read the next page in sorted order, listing the directory on the first page only
+- (NSArray *)nextSortedPage;
+
+/// List the directory once and collect the URL and sort values of every matching file in sorted order
+- (NSArray *)collectSortedEntries;
+
+/// Compare two files using the sort descriptors, then their names
+- (NSComparisonResult)compareEntry:(iCloudFileSortEntry *)first toEntry:(iCloudFileSortEntry *)second;
+
+@end
+
+@implementation iCloudFileCursor
+
++ (NSArray *)prefetchedResourceKeys {
+    static NSArray *keys;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        keys = @[NSURLNameKey, NSURLFileSizeKey, NSURLCreationDateKey, NSURLContentModificationDateKey, NSURLIsDirectoryKey, NSURLUbiquitousItemDownloadingStatusKey, NSURLUbiquitousItemIsUploadedKey];
+    });
+    return keys;
+}
+
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL fileManager:(NSFileManager *)fileManager {
+    self = [super init];
+    if (self) {
+        _directoryURL = directoryURL;
+        _fileManager = fileManager;
+        _pageSize = 100;
+    }
+    return self;
+}
+
+- (void)setFilterPredicate:(NSPredicate *)filterPredicate {
+    @synchronized (self) {
+        _filterPredicate = filterPredicate;
+        [self reset];
+    }
+}
+
+- (void)setSortDescriptors:(NSArray *)sortDescriptors {
+    @synchronized (self) {
+        _sortDescriptors = [sortDescriptors copy];
+        [self reset];
+    }
+}
+
+- (void)reset {
+    @synchronized (self) {
+        self.enumerator = nil;
+        self.sortedEntries = nil;
+        self.sortedOffset = 0;
+        self.enumerationError = nil;
+        self.finished = NO;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Paging -------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Paging
+
+- (NSArray *)nextPage:(NSError **)error {
+    @synchronized (self) {
+        if (self.finished) return @[];
+
+        NSArray *page = (self.sortDescriptors.count > 0) ? [self nextSortedPage] : [self nextStreamedPage];
+
+        if (self.enumerationError) {
+            if (error) *error = self.enumerationError;
+            self.finished = YES;
+            return nil;
+        }
+
+        return page;
+    }
+}
+
+- (NSDirectoryEnumerator *)directoryEnumerator {
+    __weak __typeof(self) wself = self;
+    return [self.fileManager enumeratorAtURL:self.directoryURL includingPropertiesForKeys:[iCloudFileCursor prefetchedResourceKeys] options:NSDirectoryEnumerationSkipsSubdirectoryDescendants | NSDirectoryEnumerationSkipsPackageDescendants errorHandler:^BOOL(NSURL *url, NSError *enumerationError) {
+        // A missing directory ends the listing, an unreadable entry is skipped
+        if ([url isEqual:wself.directoryURL] || [[url URLByStandardizingPath] isEqual:[wself.directoryURL URLByStandardizingPath]]) {
+            if (wself.enumerationError == nil) wself.enumerationError = enumerationError;
+            return NO;
+        }
+        return YES;
+    }];
+}
+
+- (NSArray *)nextStreamedPage {
+    if (self.enumerator == nil) self.enumerator = [self directoryEnumerator];
+    if (self.enumerator == nil) {
+        self.enumerationError = [NSError errorWithDomain:[NSString stringWithFormat:@"The directory, %@, could not be listed", self.directoryURL] code:404 userInfo:@{@"FileURL": self.directoryURL}];
+        return nil;
+    }
+
+    NSUInteger pageSize = MAX(self.pageSize, (NSUInteger)1);
+    NSMutableArray *page = [NSMutableArray arrayWithCapacity:pageSize];
+
+    while (page.count < pageSize) {
+        @autoreleasepool {
+            NSURL *url = [self.enumerator nextObject];
+            if (url == nil) {
+                self.finished = YES;
+                self.enumerator = nil;
+                break;
+            }
+
+            iCloudFileInfo *info = [[iCloudFileInfo alloc] initWithURL:url];
+            if (self.filterPredicate && ![self.filterPredicate evaluateWithObject:info]) continue;
+            [page addObject:info];
+        }
+    }
+
+    return page;
+}
+
+- (NSArray *)nextSortedPage {
+    if (self.sortedEntries == nil) self.sortedEntries = [self collectSortedEntries];
+    if (self.sortedEntries == nil) return nil;
+
+    // Only the files of this page are read again, the rest of the listing is never touched
+    NSUInteger pageSize = MAX(self.pageSize, (NSUInteger)1);
+    NSRange range = NSMakeRange(self.sortedOffset, MIN(pageSize, self.sortedEntries.count - self.sortedOffset));
+    NSMutableArray *page = [NSMutableArray arrayWithCapacity:range.length];
+    for (iCloudFileSortEntry *entry in [self.sortedEntries subarrayWithRange:range]) {
+        @autoreleasepool {
+            [page addObject:[[iCloudFileInfo alloc] initWithURL:entry.fileURL]];
+        }
+    }
+
+    self.sortedOffset = NSMaxRange(range);
+    if (self.sortedOffset >= self.sortedEntries.count) {
+        self.finished = YES;
+        self.sortedEntries = nil;
+    }
+
+    return page;
+}
+
+- (NSArray *)collectSortedEntries {
+    NSDirectoryEnumerator *enumerator = [self directoryEnumerator];
+    if (enumerator == nil) {
+        self.enumerationError = [NSError errorWithDomain:[NSString stringWithFormat:@"The directory, %@, could not be listed", self.directoryURL] code:404 userInfo:@{@"FileURL": self.directoryURL}];
+        return nil;
+    }
+
+    NSMutableArray *sortKeys = [NSMutableArray arrayWithCapacity:self.sortDescriptors.count];
+    for (NSSortDescriptor *descriptor in self.sortDescriptors) {
+        if (descriptor.key) [sortKeys addObject:descriptor.key];
+    }
+
+    // One pass reads every file, filters it with its prefetched attributes and keeps only what sorting needs
+    NSMutableArray *entries = [NSMutableArray array];
+    for (NSURL *url in enumerator) {
+        @autoreleasepool {
+            iCloudFileInfo *info = [[iCloudFileInfo alloc] initWithURL:url];
+            if (self.filterPredicate && ![self.filterPredicate evaluateWithObject:info]) continue;
+
+            NSMutableDictionary *sortValues = [NSMutableDictionary dictionaryWithCapacity:sortKeys.count];
+            for (NSString *key in sortKeys) sortValues[key] = [info valueForKeyPath:key] ?: [NSNull null];
+
+            iCloudFileSortEntry *entry = [[iCloudFileSortEntry alloc] init];
+            entry.fileURL = info.fileURL;
+            entry.name = info.name;
+            entry.sortValues = sortValues;
+            [entries addObject:entry];
+        }
+    }
+
+    if (self.enumerationError) return nil;
+
+    [entries sortUsingComparator:^NSComparisonResult(iCloudFileSortEntry *first, iCloudFileSortEntry *second) {
+        return [self compareEntry:first toEntry:second];
+    }];
+    return entries;
+}
+
+- (NSComparisonResult)compareEntry:(iCloudFileSortEntry *)first toEntry:(iCloudFileSortEntry *)second {
+    for (NSSortDescriptor *descriptor in self.sortDescriptors) {
+        NSComparisonResult result = [descriptor compareObject:first toObject:second];
+        if (result != NSOrderedSame) return result;
+    }
+
+    return [first.name compare:second.name];
+}
+
+@end
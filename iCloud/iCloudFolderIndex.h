@@ -0,0 +1,76 @@
+//
+//  iCloudFolderIndex.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The iCloudFolderIndex class keeps the folder tree of the iCloud documents directory.
+
+ Every path is relative to the documents directory, for example @"Projects/2026/Notes.txt". The root folder is the empty string. Folders are implied by the documents inside them: a folder is part of the index while it contains at least one document, directly or in a subfolder.
+
+ Listing a folder only touches that folder's entries, so the cost of browsing a folder is proportional to its size rather than to the size of the container. The iCloud class keeps its index in line with every metadata update pass. All methods are thread safe. */
+@interface iCloudFolderIndex : NSObject
+
+
+
+/** @name Updating the Index */
+
+/** Add a document to the index, creating the folders leading up to it
+
+ @param documentPath The path of the document relative to the documents directory. This value must not be nil. */
+- (void)addDocumentAtPath:(NSString *)documentPath __attribute__((nonnull));
+
+/** Remove a document from the index, removing the folders which no longer contain any documents
+
+ @param documentPath The path of the document relative to the documents directory. This value must not be nil. */
+- (void)removeDocumentAtPath:(NSString *)documentPath __attribute__((nonnull));
+
+/** Remove every document and folder from the index */
+- (void)removeAllDocuments;
+
+
+
+/** @name Reading the Index */
+
+/** Get the paths of the documents in a folder
+
+ @param folderPath The path of the folder relative to the documents directory. Pass the empty string for the documents directory itself. This value must not be nil.
+ @param recursive YES to include the documents in every subfolder, NO for only the documents directly inside the folder
+ @return The document paths, relative to the documents directory, in no particular order */
+- (NSArray *)documentPathsInFolderAtPath:(NSString *)folderPath recursive:(BOOL)recursive __attribute__((nonnull));
+
+/** Get the paths of the folders directly inside a folder
+
+ @param folderPath The path of the folder relative to the documents directory. Pass the empty string for the documents directory itself. This value must not be nil.
+ @return The subfolder paths, relative to the documents directory, in no particular order */
+- (NSArray *)subfolderPathsOfFolderAtPath:(NSString *)folderPath __attribute__((nonnull));
+
+/** Get the number of documents in a folder and all of its subfolders, without listing them
+
+ @param folderPath The path of the folder relative to the documents directory. This value must not be nil.
+ @return The number of documents, or 0 if the folder is not in the index */
+- (NSUInteger)documentCountInFolderAtPath:(NSString *)folderPath __attribute__((nonnull));
+
+/** Check whether a folder contains any documents
+
+ @param folderPath The path of the folder relative to the documents directory. This value must not be nil.
+ @return YES if the folder is in the index, NO otherwise */
+- (BOOL)folderExistsAtPath:(NSString *)folderPath __attribute__((nonnull));
+
+/** The number of documents in the index */
+@property (assign, readonly) NSUInteger documentCount;
+
+/** The number of folders in the index, not counting the documents directory itself */
+@property (assign, readonly) NSUInteger folderCount;
+
+@end
@@ -0,0 +1,183 @@
+//
+//  iCloudFolderIndex.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudFolderIndex.h"
+
+@interface iCloudFolderIndex ()
+
+/// Document paths directly inside each folder, keyed by folder path
+@property (strong) NSMutableDictionary *documentsByFolder;
+
+/// Subfolder paths directly inside each folder, keyed by folder path
+@property (strong) NSMutableDictionary *subfoldersByFolder;
+
+/// The number of documents in each folder and its subfolders, keyed by folder path
+@property (strong) NSMutableDictionary *documentCounts;
+
+/// Every document path in the index
+@property (strong) NSMutableSet *documentPaths;
+
+/// Create a folder and the folders leading up to it
+- (void)addFolderAtPath:(NSString *)folderPath;
+
+/// Adjust the document count of a folder and every folder above it, pruning folders which become empty
+- (void)adjustDocumentCountOfFolderAtPath:(NSString *)folderPath by:(NSInteger)delta;
+
+/// The path of the folder containing a document or folder, the empty string for the root
+- (NSString *)parentPathOfPath:(NSString *)path;
+
+@end
+
+@implementation iCloudFolderIndex
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _documentsByFolder = [NSMutableDictionary dictionary];
+        _subfoldersByFolder = [NSMutableDictionary dictionary];
+        _documentCounts = [NSMutableDictionary dictionary];
+        _documentPaths = [NSMutableSet set];
+        [self addFolderAtPath:@""];
+    }
+    return self;
+}
+
+- (NSString *)parentPathOfPath:(NSString *)path {
+    NSRange separator = [path rangeOfString:@"/" options:NSBackwardsSearch];
+    if (separator.location == NSNotFound) return @"";
+    return [path substringToIndex:separator.location];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Updating -----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Updating
+
+- (void)addDocumentAtPath:(NSString *)documentPath {
+    @synchronized (self) {
+        if ([self.documentPaths containsObject:documentPath]) return;
+        [self.documentPaths addObject:documentPath];
+
+        NSString *folderPath = [self parentPathOfPath:documentPath];
+        [self addFolderAtPath:folderPath];
+        [self.documentsByFolder[folderPath] addObject:documentPath];
+        [self adjustDocumentCountOfFolderAtPath:folderPath by:1];
+    }
+}
+
+- (void)removeDocumentAtPath:(NSString *)documentPath {
+    @synchronized (self) {
+        if (![self.documentPaths containsObject:documentPath]) return;
+        [self.documentPaths removeObject:documentPath];
+
+        NSString *folderPath = [self parentPathOfPath:documentPath];
+        [self.documentsByFolder[folderPath] removeObject:documentPath];
+        [self adjustDocumentCountOfFolderAtPath:folderPath by:-1];
+    }
+}
+
+- (void)removeAllDocuments {
+    @synchronized (self) {
+        [self.documentsByFolder removeAllObjects];
+        [self.subfoldersByFolder removeAllObjects];
+        [self.documentCounts removeAllObjects];
+        [self.documentPaths removeAllObjects];
+        [self addFolderAtPath:@""];
+    }
+}
+
+- (void)addFolderAtPath:(NSString *)folderPath {
+    if (self.documentsByFolder[folderPath] != nil) return;
+
+    self.documentsByFolder[folderPath] = [NSMutableSet set];
+    self.subfoldersByFolder[folderPath] = [NSMutableSet set];
+    self.documentCounts[folderPath] = @0;
+    if (folderPath.length == 0) return;
+
+    // Link the folder to its parent, creating the parent first if needed
+    NSString *parentPath = [self parentPathOfPath:folderPath];
+    [self addFolderAtPath:parentPath];
+    [self.subfoldersByFolder[parentPath] addObject:folderPath];
+}
+
+- (void)adjustDocumentCountOfFolderAtPath:(NSString *)folderPath by:(NSInteger)delta {
+    NSString *path = folderPath;
+    while (YES) {
+        NSInteger count = [self.documentCounts[path] integerValue] + delta;
+        NSString *parentPath = [self parentPathOfPath:path];
+
+        if (count <= 0 && path.length > 0) {
+            // The folder no longer holds any documents
+            [self.documentsByFolder removeObjectForKey:path];
+            [self.subfoldersByFolder removeObjectForKey:path];
+            [self.documentCounts removeObjectForKey:path];
+            [self.subfoldersByFolder[parentPath] removeObject:path];
+        } else {
+            self.documentCounts[path] = @(MAX(count, (NSInteger)0));
+        }
+
+        if (path.length == 0) break;
+        path = parentPath;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Reading ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Reading
+
+- (NSArray *)documentPathsInFolderAtPath:(NSString *)folderPath recursive:(BOOL)recursive {
+    @synchronized (self) {
+        if (!recursive) return [self.documentsByFolder[folderPath] allObjects] ?: @[];
+
+        NSMutableArray *documentPaths = [NSMutableArray array];
+        NSMutableArray *pendingFolders = [NSMutableArray arrayWithObject:folderPath];
+        while (pendingFolders.count > 0) {
+            NSString *path = [pendingFolders lastObject];
+            [pendingFolders removeLastObject];
+
+            NSSet *documents = self.documentsByFolder[path];
+            if (documents) [documentPaths addObjectsFromArray:[documents allObjects]];
+            NSSet *subfolders = self.subfoldersByFolder[path];
+            if (subfolders) [pendingFolders addObjectsFromArray:[subfolders allObjects]];
+        }
+        return documentPaths;
+    }
+}
+
+- (NSArray *)subfolderPathsOfFolderAtPath:(NSString *)folderPath {
+    @synchronized (self) {
+        return [self.subfoldersByFolder[folderPath] allObjects] ?: @[];
+    }
+}
+
+- (NSUInteger)documentCountInFolderAtPath:(NSString *)folderPath {
+    @synchronized (self) {
+        return [self.documentCounts[folderPath] unsignedIntegerValue];
+    }
+}
+
+- (BOOL)folderExistsAtPath:(NSString *)folderPath {
+    @synchronized (self) {
+        return self.documentsByFolder[folderPath] != nil;
+    }
+}
+
+- (NSUInteger)documentCount {
+    @synchronized (self) {
+        return self.documentPaths.count;
+    }
+}
+
+- (NSUInteger)folderCount {
+    @synchronized (self) {
+        return self.documentsByFolder.count - 1;
+    }
+}
+
+@end
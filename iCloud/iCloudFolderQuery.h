@@ -0,0 +1,87 @@
+//
+//  iCloudFolderQuery.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The iCloudFolderQuery class keeps a live list of the documents in one folder of the iCloud documents directory.
+
+ The query's NSMetadataQuery searches the ubiquitous documents scope with a predicate on the item path which only matches the folder, so gathering only costs as much as the folder being viewed, however large the rest of the container is. After gathering, each update only applies the items it added, changed or removed to the results. The query runs on its own serial operation queue and publishes each result pass as an immutable array of metadata entries, in the same format as the entries of iCloudMetadataSnapshot.
+
+ Create folder queries with the startQueryForFolderAtPath:includingSubfolders:updateHandler: method of the iCloud class. When the storage backend reports its own metadata (see iCloudStorageBackend), folder queries are answered from the iCloud class's folder index instead of a metadata query. */
+@interface iCloudFolderQuery : NSObject
+
+
+
+/** @name Creating a Query */
+
+/** Create a query for the documents in a folder
+
+ @param folderURL The URL of the folder. This value must not be nil.
+ @param folderPath The path of the folder relative to the documents directory, used to build the document path of each entry. Pass the empty string for the documents directory itself. This value must not be nil.
+ @param includeSubfolders YES to also list the documents in every subfolder, NO for only the documents directly inside the folder
+ @return A stopped query */
+- (instancetype)initWithFolderURL:(NSURL *)folderURL folderPath:(NSString *)folderPath includingSubfolders:(BOOL)includeSubfolders __attribute__((nonnull));
+
+
+
+/** @name Running the Query */
+
+/** Start gathering results
+
+ @return YES if the query started, NO if it could not be started or is already running */
+- (BOOL)start;
+
+/** Stop the query. The last results stay available. */
+- (void)stop;
+
+/** YES between start and stop */
+@property (assign, readonly, getter=isRunning) BOOL running;
+
+/** Replace the results with entries gathered elsewhere
+
+ @discussion Used by the iCloud class to feed queries from its folder index when usesMetadataQuery is NO. Entries outside the folder, or in subfolders when includesSubfolders is NO, are ignored.
+
+ @param entries Metadata entries which include iCloudMetadataItemDocumentPathKey. This value must not be nil. */
+- (void)updateWithEntries:(NSArray *)entries __attribute__((nonnull));
+
+
+
+/** @name Results */
+
+/** The most recent results, as immutable metadata entries. Safe to read from any thread. */
+@property (copy, readonly) NSArray *results;
+
+/** Called on the main thread with the new results every time they change */
+@property (copy) void (^updateHandler)(NSArray *entries);
+
+
+
+/** @name Configuration */
+
+/** Only documents matching this predicate are returned. The predicate is evaluated against the metadata entries as results are published, so it must use NSMetadataItem attribute keys. Set it before starting the query. Defaults to nil. */
+@property (strong) NSPredicate *predicate;
+
+/** NO to skip the metadata query and rely on updateWithEntries: for results. Defaults to YES. */
+@property (assign) BOOL usesMetadataQuery;
+
+/** The folder being queried, relative to the documents directory */
+@property (copy, readonly) NSString *folderPath;
+
+/** The URL of the folder being queried */
+@property (strong, readonly) NSURL *folderURL;
+
+/** Whether documents in subfolders are included */
+@property (assign, readonly) BOOL includesSubfolders;
+
+@end
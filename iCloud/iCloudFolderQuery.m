@@ -0,0 +1,231 @@
+//
+//  iCloudFolderQuery.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudFolderQuery.h"
+#import "iCloudMetadataSnapshot.h"
+
+@interface iCloudFolderQuery ()
+
+@property (strong) NSMetadataQuery *query;
+@property (strong) NSOperationQueue *queryQueue;
+@property (copy, readwrite) NSArray *results;
+@property (assign, readwrite, getter=isRunning) BOOL running;
+
+/// The document path of every metadata item in the results, so removed items can be found without reading their attributes
+@property (strong) NSMapTable *documentPathsByItem;
+
+/// Build the results from the gathered items, or apply the items an update added, changed or removed, called on the query queue
+- (void)queryDidUpdate:(NSNotification *)notification;
+
+/// The metadata entry of an item, or nil if the item is not in the folder or does not match the predicate
+- (NSDictionary *)entryForItem:(NSMetadataItem *)item;
+
+/// Insert the entry of an item into the results, which are sorted by document path
+- (void)addItem:(NSMetadataItem *)item toResults:(NSMutableArray *)results;
+
+/// Remove the entry of an item from the results, if it is there
+- (void)removeItem:(NSMetadataItem *)item fromResults:(NSMutableArray *)results;
+
+/// Check whether a document path belongs to the folder
+- (BOOL)containsDocumentPath:(NSString *)documentPath;
+
+/// Publish new results and hand them to the update handler on the main thread
+- (void)publishResults:(NSArray *)results;
+
+@end
+
+@implementation iCloudFolderQuery
+
+- (instancetype)initWithFolderURL:(NSURL *)folderURL folderPath:(NSString *)folderPath includingSubfolders:(BOOL)includeSubfolders {
+    self = [super init];
+    if (self) {
+        _folderURL = folderURL;
+        _folderPath = [folderPath copy];
+        _includesSubfolders = includeSubfolders;
+        _usesMetadataQuery = YES;
+        _results = @[];
+        _documentPathsByItem = [NSMapTable strongToStrongObjectsMapTable];
+
+        _queryQueue = [[NSOperationQueue alloc] init];
+        _queryQueue.name = @"com.iRareMedia.iCloud.folderQuery";
+        _queryQueue.maxConcurrentOperationCount = 1;
+        _queryQueue.qualityOfService = NSQualityOfServiceUtility;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [_query stopQuery];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Running ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Running
+
+- (BOOL)start {
+    @synchronized (self) {
+        if (self.running) return NO;
+        self.running = YES;
+        if (!self.usesMetadataQuery) return YES;
+
+        // Only the ubiquitous scopes are valid on iOS, narrow the query to the folder by path so the rest of the container is never gathered. Metadata paths may or may not carry the /private prefix of the folder URL, match both
+        NSString *folderDirectoryPath = [[self.folderURL path] stringByAppendingString:@"/"];
+        NSString *alternatePath = [folderDirectoryPath hasPrefix:@"/private/"] ? [folderDirectoryPath substringFromIndex:8] : [@"/private" stringByAppendingString:folderDirectoryPath];
+        NSMetadataQuery *query = [[NSMetadataQuery alloc] init];
+        query.searchScopes = @[NSMetadataQueryUbiquitousDocumentsScope];
+        query.predicate = [NSPredicate predicateWithFormat:@"%K BEGINSWITH %@ OR %K BEGINSWITH %@", NSMetadataItemPathKey, folderDirectoryPath, NSMetadataItemPathKey, alternatePath];
+        if ([query respondsToSelector:@selector(setOperationQueue:)]) query.operationQueue = self.queryQueue;
+        self.query = query;
+
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(queryDidUpdate:) name:NSMetadataQueryDidFinishGatheringNotification object:query];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(queryDidUpdate:) name:NSMetadataQueryDidUpdateNotification object:query];
+
+        __block BOOL started = NO;
+        NSOperationQueue *startQueue = query.operationQueue ?: [NSOperationQueue mainQueue];
+        NSBlockOperation *startOperation = [NSBlockOperation blockOperationWithBlock:^{
+            started = [query startQuery];
+        }];
+        if ([NSOperationQueue currentQueue] == startQueue) [startOperation start];
+        else [startQueue addOperations:@[startOperation] waitUntilFinished:YES];
+
+        if (!started) {
+            [[NSNotificationCenter defaultCenter] removeObserver:self];
+            self.query = nil;
+            self.running = NO;
+        }
+        return started;
+    }
+}
+
+- (void)stop {
+    @synchronized (self) {
+        if (!self.running) return;
+        self.running = NO;
+
+        [[NSNotificationCenter defaultCenter] removeObserver:self];
+        [self.query stopQuery];
+        self.query = nil;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Results ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Results
+
+- (void)queryDidUpdate:(NSNotification *)notification {
+    NSMetadataQuery *query = notification.object;
+    NSArray *addedItems = notification.userInfo[NSMetadataQueryUpdateAddedItemsKey];
+    NSArray *changedItems = notification.userInfo[NSMetadataQueryUpdateChangedItemsKey];
+    NSArray *removedItems = notification.userInfo[NSMetadataQueryUpdateRemovedItemsKey];
+    BOOL incremental = [notification.name isEqualToString:NSMetadataQueryDidUpdateNotification] && (addedItems || changedItems || removedItems);
+    NSMutableArray *results;
+
+    [query disableUpdates];
+    if (incremental) {
+        // Updates only touch the items they list, the rest of the results are kept as they are
+        results = [self.results mutableCopy];
+        for (NSMetadataItem *item in removedItems) [self removeItem:item fromResults:results];
+        for (NSMetadataItem *item in changedItems) {
+            [self removeItem:item fromResults:results];
+            [self addItem:item toResults:results];
+        }
+        for (NSMetadataItem *item in addedItems) {
+            [self removeItem:item fromResults:results];
+            [self addItem:item toResults:results];
+        }
+    } else {
+        results = [NSMutableArray arrayWithCapacity:query.resultCount];
+        [self.documentPathsByItem removeAllObjects];
+        for (NSUInteger index = 0; index < query.resultCount; index++) [self addItem:[query resultAtIndex:index] toResults:results];
+    }
+    [query enableUpdates];
+
+    if (incremental && [results isEqualToArray:self.results]) return;
+    [self publishResults:results];
+}
+
+- (NSDictionary *)entryForItem:(NSMetadataItem *)item {
+    NSString *folderDirectoryPath = [[self.folderURL path] stringByAppendingString:@"/"];
+
+    // Metadata queries may report /private/var paths for a /var folder, compare both without the prefix
+    if ([folderDirectoryPath hasPrefix:@"/private/"]) folderDirectoryPath = [folderDirectoryPath substringFromIndex:8];
+
+    NSMutableDictionary *entry = [[item valuesForAttributes:[iCloudMetadataSnapshot indexedAttributes]] mutableCopy];
+    if (![entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] boolValue]) [entry removeObjectForKey:NSMetadataUbiquitousItemHasUnresolvedConflictsKey];
+
+    // Build the document path from the item's location inside the folder
+    NSString *itemPath = [entry[NSMetadataItemURLKey] path];
+    if ([itemPath hasPrefix:@"/private/"]) itemPath = [itemPath substringFromIndex:8];
+    if (![itemPath hasPrefix:folderDirectoryPath]) return nil;
+    NSString *relativePath = [itemPath substringFromIndex:folderDirectoryPath.length];
+    if (!self.includesSubfolders && [relativePath rangeOfString:@"/"].location != NSNotFound) return nil;
+
+    // Filter the entries rather than the query, so documents whose status changes stay gathered
+    entry[iCloudMetadataItemDocumentPathKey] = self.folderPath.length > 0 ? [self.folderPath stringByAppendingPathComponent:relativePath] : relativePath;
+    if (self.predicate && ![self.predicate evaluateWithObject:entry]) return nil;
+    return [entry copy];
+}
+
+- (void)addItem:(NSMetadataItem *)item toResults:(NSMutableArray *)results {
+    NSDictionary *entry = [self entryForItem:item];
+    if (!entry) return;
+
+    NSUInteger index = [results indexOfObject:entry inSortedRange:NSMakeRange(0, results.count) options:NSBinarySearchingInsertionIndex usingComparator:^NSComparisonResult(NSDictionary *first, NSDictionary *second) {
+        return [first[iCloudMetadataItemDocumentPathKey] compare:second[iCloudMetadataItemDocumentPathKey]];
+    }];
+    [results insertObject:entry atIndex:index];
+    [self.documentPathsByItem setObject:entry[iCloudMetadataItemDocumentPathKey] forKey:item];
+}
+
+- (void)removeItem:(NSMetadataItem *)item fromResults:(NSMutableArray *)results {
+    NSString *documentPath = [self.documentPathsByItem objectForKey:item];
+    if (!documentPath) return;
+    [self.documentPathsByItem removeObjectForKey:item];
+
+    NSUInteger index = [results indexOfObject:@{iCloudMetadataItemDocumentPathKey: documentPath} inSortedRange:NSMakeRange(0, results.count) options:NSBinarySearchingFirstEqual usingComparator:^NSComparisonResult(NSDictionary *first, NSDictionary *second) {
+        return [first[iCloudMetadataItemDocumentPathKey] compare:second[iCloudMetadataItemDocumentPathKey]];
+    }];
+    if (index != NSNotFound) [results removeObjectAtIndex:index];
+}
+
+- (void)updateWithEntries:(NSArray *)entries {
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:entries.count];
+    for (NSDictionary *entry in entries) {
+        if (![self containsDocumentPath:entry[iCloudMetadataItemDocumentPathKey]]) continue;
+        if (self.predicate && ![self.predicate evaluateWithObject:entry]) continue;
+        [results addObject:entry];
+    }
+    [results sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:iCloudMetadataItemDocumentPathKey ascending:YES]]];
+
+    // Index-fed queries are refreshed after every update pass, only report real changes
+    if ([results isEqualToArray:self.results]) return;
+    [self publishResults:results];
+}
+
+- (BOOL)containsDocumentPath:(NSString *)documentPath {
+    if (documentPath == nil) return NO;
+    if (self.folderPath.length == 0) return self.includesSubfolders || [documentPath rangeOfString:@"/"].location == NSNotFound;
+
+    NSString *folderPrefix = [self.folderPath stringByAppendingString:@"/"];
+    if (![documentPath hasPrefix:folderPrefix]) return NO;
+    return self.includesSubfolders || [[documentPath substringFromIndex:folderPrefix.length] rangeOfString:@"/"].location == NSNotFound;
+}
+
+- (void)publishResults:(NSArray *)results {
+    NSArray *immutableResults = [results copy];
+    self.results = immutableResults;
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (self.running && self.updateHandler) self.updateHandler(immutableResults);
+    });
+}
+
+@end
@@ -0,0 +1,83 @@
+//
+//  iCloudLocalBackend.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+// Import iCloudStorageBackend
+#import "iCloudStorageBackend.h"
+
+/** The iCloudLocalBackend class simulates a ubiquity container in a local directory, so that the iCloud class can be tested and benchmarked without an iCloud account or a device.
+ 
+ Assign a local backend to the fileManager property of an iCloud object before calling setupiCloudDocumentSyncWithUbiquityContainer:. The backend then reports its directory as the ubiquity container, always has an identity token, and reports item metadata itself instead of NSMetadataQuery. Coordinated writes inside the container (including UIDocument saves) are picked up through file presentation and reported as metadata updates.
+ 
+ Every file operation can be slowed down with a fixed latency and a bandwidth limit, any item can be marked as not downloaded. Starting to download such an item completes after the time its size takes at the simulated bandwidth, and is reported through a metadata update like a real download. Conflicting versions can be added to any item, to exercise conflict resolution. */
+@interface iCloudLocalBackend : NSFileManager <iCloudStorageBackend>
+
+
+
+/** @name Methods */
+
+/** Initialize a local backend
+ 
+ @param containerURL The local directory used as the ubiquity container. It is created if it does not exist.
+ @return A local backend for the directory */
+- (instancetype)initWithContainerURL:(NSURL *)containerURL __attribute__((nonnull));
+
+/** Set the simulated downloading status of an item and report it in a metadata update
+ 
+ @param status One of the NSMetadataUbiquitousItemDownloadingStatus constants
+ @param fileURL The URL of the item in the container */
+- (void)setDownloadingStatus:(NSString *)status forItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Get the simulated downloading status of an item
+ 
+ @param fileURL The URL of the item in the container
+ @return The downloading status, NSMetadataUbiquitousItemDownloadingStatusCurrent unless it was changed */
+- (NSString *)downloadingStatusForItemAtURL:(NSURL *)fileURL __attribute__((nonnull));
+
+/** Simulate a version of an item saved on another device, which conflicts with the current version
+ 
+ @discussion The item is reported with NSMetadataUbiquitousItemHasUnresolvedConflictsKey until the version is resolved and removeOtherVersionsOfItemAtURL:error: is called, like iCloudConflictResolver does.
+ 
+ @param fileURL The URL of the item in the container
+ @param contentsURL The file or package holding the contents of the conflicting version, it is copied
+ @param computerName The name of the device the version was saved on, or nil
+ @param error On failure, contains an NSError describing the problem
+ @return The conflicting version, or nil if its contents could not be copied */
+- (id <iCloudFileVersion>)addConflictVersionOfItemAtURL:(NSURL *)fileURL withContentsOfURL:(NSURL *)contentsURL savingComputer:(NSString *)computerName error:(NSError **)error __attribute__((nonnull (1, 2)));
+
+/** Rescan the observed directory and report any changes, returning once the metadata handler has processed them */
+- (void)refreshMetadata;
+
+
+
+
+/** @name Properties */
+
+/** The local directory used as the ubiquity container */
+@property (strong, readonly) NSURL *containerURL;
+
+/** The latency added to every simulated file operation, in seconds. The default value is 0. */
+@property (assign) NSTimeInterval operationLatency;
+
+/** The simulated transfer rate for copies, moves into or out of the container and downloads, in bytes per second. Set to 0 for unlimited bandwidth. The default value is 0. */
+@property (assign) unsigned long long bandwidth;
+
+/** The identity token reported by the backend. Set to nil to simulate a signed out iCloud account. */
+@property (copy) NSString *identityToken;
+
+/** The number of file coordinators handed out by fileCoordinatorWithFilePresenter: */
+@property (readonly) NSUInteger fileCoordinatorCount;
+
+@end
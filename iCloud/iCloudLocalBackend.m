@@ -0,0 +1,416 @@
+//
+//  iCloudLocalBackend.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudLocalBackend.h"
+#import "iCloudMetadataSnapshot.h"
+
+/// A simulated conflicting version, its contents are kept in a hidden folder of the container
+@interface iCloudLocalFileVersion : NSObject <iCloudFileVersion>
+
+@property (readwrite, copy) NSURL *URL;
+@property (readwrite, copy) NSDate *modificationDate;
+@property (readwrite, copy) NSString *localizedNameOfSavingComputer;
+@property (getter=isResolved) BOOL resolved;
+
+@end
+
+@implementation iCloudLocalFileVersion
+
+- (NSURL *)replaceItemAtURL:(NSURL *)url options:(NSFileVersionReplacingOptions)options error:(NSError **)error {
+    // Like NSFileVersion, the caller is expected to coordinate the write
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    if ([self.URL isEqual:url]) return url;
+    if ([fileManager fileExistsAtPath:[url path]] && ![fileManager removeItemAtURL:url error:error]) return nil;
+    return [fileManager copyItemAtURL:self.URL toURL:url error:error] ? url : nil;
+}
+
+@end
+
+@interface iCloudLocalBackend () <NSFilePresenter>
+
+@property (strong, readwrite) NSURL *containerURL;
+
+/// Serial queue on which metadata is scanned and reported
+@property (strong) dispatch_queue_t metadataQueue;
+
+/// Operation queue on which file presentation messages are received
+@property (strong) NSOperationQueue *presenterQueue;
+
+/// The directory whose metadata is reported
+@property (strong) NSURL *observedDirectoryURL;
+
+/// Receives metadata updates
+@property (copy) void (^metadataHandler)(NSArray *entries, NSArray *removedNames, BOOL fullPass);
+
+/// The entries of the previous scan keyed by file name
+@property (strong) NSDictionary *reportedEntries;
+
+/// Simulated downloading status keyed by file path, items which are not listed are current
+@property (strong) NSMutableDictionary *downloadingStatuses;
+
+/// Simulated conflicting versions (NSMutableArray of iCloudLocalFileVersion) keyed by file path
+@property (strong) NSMutableDictionary *conflictVersions;
+
+/// Whether a rescan is already queued
+@property (assign) BOOL rescanScheduled;
+
+@property (readwrite) NSUInteger fileCoordinatorCount;
+
+/// Whether the first (full) pass was reported to the current handler
+@property (assign) BOOL reportedFullPass;
+
+/// Sleep for the latency of one operation plus the transfer time of the specified number of bytes
+- (void)simulateTransferOfBytes:(unsigned long long)bytes;
+
+/// Scan the observed directory and report the differences to the handler. Must be called on the metadata queue.
+- (void)scanAndReport;
+
+/// Queue a rescan after a change in the observed directory
+- (void)scheduleRescan;
+
+@end
+
+@implementation iCloudLocalBackend
+
+- (instancetype)initWithContainerURL:(NSURL *)containerURL {
+    self = [super init];
+    if (self) {
+        _containerURL = containerURL;
+        _identityToken = @"com.iRareMedia.iCloud.local";
+        _metadataQueue = dispatch_queue_create("com.iRareMedia.iCloud.localBackend", DISPATCH_QUEUE_SERIAL);
+        _presenterQueue = [[NSOperationQueue alloc] init];
+        _presenterQueue.maxConcurrentOperationCount = 1;
+        _downloadingStatuses = [NSMutableDictionary dictionary];
+        _conflictVersions = [NSMutableDictionary dictionary];
+        _reportedEntries = @{};
+        
+        [super createDirectoryAtURL:containerURL withIntermediateDirectories:YES attributes:nil error:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self stopMetadataUpdates];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Simulation ---------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Simulation
+
+- (void)simulateTransferOfBytes:(unsigned long long)bytes {
+    NSTimeInterval delay = self.operationLatency;
+    if (self.bandwidth > 0) delay += (NSTimeInterval)bytes / (NSTimeInterval)self.bandwidth;
+    if (delay > 0) [NSThread sleepForTimeInterval:delay];
+}
+
+- (void)setDownloadingStatus:(NSString *)status forItemAtURL:(NSURL *)fileURL {
+    @synchronized (self.downloadingStatuses) {
+        if ([status isEqualToString:NSMetadataUbiquitousItemDownloadingStatusCurrent]) [self.downloadingStatuses removeObjectForKey:[fileURL path]];
+        else self.downloadingStatuses[[fileURL path]] = status;
+    }
+    
+    [self scheduleRescan];
+}
+
+- (NSString *)downloadingStatusForItemAtURL:(NSURL *)fileURL {
+    @synchronized (self.downloadingStatuses) {
+        return self.downloadingStatuses[[fileURL path]] ?: NSMetadataUbiquitousItemDownloadingStatusCurrent;
+    }
+}
+
+- (id <iCloudFileVersion>)addConflictVersionOfItemAtURL:(NSURL *)fileURL withContentsOfURL:(NSURL *)contentsURL savingComputer:(NSString *)computerName error:(NSError **)error {
+    // Keep the contents out of the scanned directory, hidden files are never reported
+    NSURL *versionURL = [[[self.containerURL URLByAppendingPathComponent:@".Versions"] URLByAppendingPathComponent:[[NSUUID UUID] UUIDString]] URLByAppendingPathComponent:[fileURL lastPathComponent]];
+    if (![super createDirectoryAtURL:[versionURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:error]) return nil;
+    if (![super copyItemAtURL:contentsURL toURL:versionURL error:error]) return nil;
+    
+    iCloudLocalFileVersion *version = [[iCloudLocalFileVersion alloc] init];
+    version.URL = versionURL;
+    version.modificationDate = [NSDate date];
+    version.localizedNameOfSavingComputer = computerName;
+    
+    @synchronized (self.conflictVersions) {
+        NSMutableArray *versions = self.conflictVersions[[fileURL path]];
+        if (!versions) self.conflictVersions[[fileURL path]] = versions = [NSMutableArray array];
+        [versions addObject:version];
+    }
+    
+    [self scheduleRescan];
+    return version;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Storage Backend ----------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Storage Backend
+
+- (NSURL *)URLForUbiquityContainerIdentifier:(NSString *)containerIdentifier {
+    [self simulateTransferOfBytes:0];
+    return self.identityToken ? self.containerURL : nil;
+}
+
+- (id <NSObject, NSCopying, NSCoding>)ubiquityIdentityToken {
+    return self.identityToken;
+}
+
+- (BOOL)setUbiquitous:(BOOL)flag itemAtURL:(NSURL *)url destinationURL:(NSURL *)destinationURL error:(NSError **)error {
+    [self simulateTransferOfBytes:[[super attributesOfItemAtPath:[url path] error:nil] fileSize]];
+    
+    BOOL success = [super moveItemAtURL:url toURL:destinationURL error:error];
+    if (success) [self scheduleRescan];
+    return success;
+}
+
+- (BOOL)startDownloadingUbiquitousItemAtURL:(NSURL *)url error:(NSError **)error {
+    if ([[self downloadingStatusForItemAtURL:url] isEqualToString:NSMetadataUbiquitousItemDownloadingStatusCurrent]) return YES;
+    
+    // Complete the download in the background after the simulated transfer time
+    unsigned long long size = [[super attributesOfItemAtPath:[url path] error:nil] fileSize];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [self simulateTransferOfBytes:size];
+        [self setDownloadingStatus:NSMetadataUbiquitousItemDownloadingStatusCurrent forItemAtURL:url];
+    });
+    
+    return YES;
+}
+
+- (BOOL)evictUbiquitousItemAtURL:(NSURL *)url error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    
+    // The simulated container keeps the bytes, only the status changes
+    [self setDownloadingStatus:NSMetadataUbiquitousItemDownloadingStatusNotDownloaded forItemAtURL:url];
+    return YES;
+}
+
+- (NSURL *)URLForPublishingUbiquitousItemAtURL:(NSURL *)url expirationDate:(NSDate **)outDate error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    
+    if (outDate) *outDate = [NSDate dateWithTimeIntervalSinceNow:30 * 24 * 60 * 60];
+    return url;
+}
+
+- (NSFileCoordinator *)fileCoordinatorWithFilePresenter:(id <NSFilePresenter>)filePresenter {
+    @synchronized (self) {
+        self.fileCoordinatorCount++;
+    }
+    return [super fileCoordinatorWithFilePresenter:filePresenter];
+}
+
+- (NSArray *)unresolvedConflictVersionsOfItemAtURL:(NSURL *)url {
+    @synchronized (self.conflictVersions) {
+        return [self.conflictVersions[[url path]] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"resolved == NO"]] ?: @[];
+    }
+}
+
+- (id <iCloudFileVersion>)currentVersionOfItemAtURL:(NSURL *)url {
+    if (![super fileExistsAtPath:[url path]]) return nil;
+    
+    iCloudLocalFileVersion *version = [[iCloudLocalFileVersion alloc] init];
+    version.URL = url;
+    version.modificationDate = [[super attributesOfItemAtPath:[url path] error:nil] fileModificationDate];
+    return version;
+}
+
+- (BOOL)removeOtherVersionsOfItemAtURL:(NSURL *)url error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    
+    NSArray *versions;
+    @synchronized (self.conflictVersions) {
+        versions = self.conflictVersions[[url path]];
+        [self.conflictVersions removeObjectForKey:[url path]];
+    }
+    for (iCloudLocalFileVersion *version in versions) [super removeItemAtURL:[version.URL URLByDeletingLastPathComponent] error:nil];
+    
+    [self scheduleRescan];
+    return YES;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  File Operations ----------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - File Operations
+
+- (BOOL)fileExistsAtPath:(NSString *)path {
+    [self simulateTransferOfBytes:0];
+    return [super fileExistsAtPath:path];
+}
+
+- (BOOL)fileExistsAtPath:(NSString *)path isDirectory:(BOOL *)isDirectory {
+    [self simulateTransferOfBytes:0];
+    return [super fileExistsAtPath:path isDirectory:isDirectory];
+}
+
+- (NSDictionary *)attributesOfItemAtPath:(NSString *)path error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    return [super attributesOfItemAtPath:path error:error];
+}
+
+- (NSData *)contentsAtPath:(NSString *)path {
+    NSData *contents = [super contentsAtPath:path];
+    [self simulateTransferOfBytes:contents.length];
+    return contents;
+}
+
+- (NSArray *)contentsOfDirectoryAtURL:(NSURL *)url includingPropertiesForKeys:(NSArray *)keys options:(NSDirectoryEnumerationOptions)mask error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    return [super contentsOfDirectoryAtURL:url includingPropertiesForKeys:keys options:mask error:error];
+}
+
+- (BOOL)copyItemAtURL:(NSURL *)srcURL toURL:(NSURL *)dstURL error:(NSError **)error {
+    [self simulateTransferOfBytes:[[super attributesOfItemAtPath:[srcURL path] error:nil] fileSize]];
+    
+    BOOL success = [super copyItemAtURL:srcURL toURL:dstURL error:error];
+    if (success) [self scheduleRescan];
+    return success;
+}
+
+- (BOOL)moveItemAtURL:(NSURL *)srcURL toURL:(NSURL *)dstURL error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    
+    BOOL success = [super moveItemAtURL:srcURL toURL:dstURL error:error];
+    if (success) [self scheduleRescan];
+    return success;
+}
+
+- (BOOL)removeItemAtURL:(NSURL *)URL error:(NSError **)error {
+    [self simulateTransferOfBytes:0];
+    
+    BOOL success = [super removeItemAtURL:URL error:error];
+    if (success) [self scheduleRescan];
+    return success;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Metadata -----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Metadata
+
+- (void)startMetadataUpdatesForDirectoryAtURL:(NSURL *)directoryURL handler:(void (^)(NSArray *entries, NSArray *removedNames, BOOL fullPass))handler {
+    [self stopMetadataUpdates];
+    
+    dispatch_sync(self.metadataQueue, ^{
+        self.observedDirectoryURL = directoryURL;
+        self.metadataHandler = handler;
+        self.reportedEntries = @{};
+        self.reportedFullPass = NO;
+    });
+    
+    // Coordinated writes by anyone (UIDocument included) are reported to the presenter
+    [NSFileCoordinator addFilePresenter:self];
+    [self refreshMetadata];
+}
+
+- (void)stopMetadataUpdates {
+    if (self.observedDirectoryURL == nil) return;
+    
+    [NSFileCoordinator removeFilePresenter:self];
+    dispatch_sync(self.metadataQueue, ^{
+        self.observedDirectoryURL = nil;
+        self.metadataHandler = nil;
+    });
+}
+
+- (void)refreshMetadata {
+    dispatch_sync(self.metadataQueue, ^{
+        [self scanAndReport];
+    });
+}
+
+- (void)scheduleRescan {
+    dispatch_async(self.metadataQueue, ^{
+        if (self.rescanScheduled) return;
+        self.rescanScheduled = YES;
+        
+        // Let a burst of changes settle into one report
+        dispatch_async(self.metadataQueue, ^{
+            self.rescanScheduled = NO;
+            [self scanAndReport];
+        });
+    });
+}
+
+- (void)scanAndReport {
+    if (self.observedDirectoryURL == nil || self.metadataHandler == nil) return;
+    
+    BOOL fullPass = !self.reportedFullPass;
+    NSArray *keys = @[NSURLNameKey, NSURLFileSizeKey, NSURLContentModificationDateKey, NSURLCreationDateKey, NSURLIsDirectoryKey, NSURLIsPackageKey];
+    NSDirectoryEnumerator *enumerator = [super enumeratorAtURL:self.observedDirectoryURL includingPropertiesForKeys:keys options:NSDirectoryEnumerationSkipsHiddenFiles | NSDirectoryEnumerationSkipsPackageDescendants errorHandler:nil];
+    NSString *directoryPrefix = [[[self.observedDirectoryURL URLByStandardizingPath] path] stringByAppendingString:@"/"];
+    
+    NSMutableDictionary *scannedEntries = [NSMutableDictionary dictionary];
+    NSMutableArray *changedEntries = [NSMutableArray array];
+    
+    for (NSURL *fileURL in enumerator) {
+        NSDictionary *values = [fileURL resourceValuesForKeys:keys error:nil];
+        
+        // Like NSMetadataQuery, report documents (packages included) and walk into plain folders
+        if ([values[NSURLIsDirectoryKey] boolValue] && ![values[NSURLIsPackageKey] boolValue]) continue;
+        
+        // Documents in folders are keyed by their path relative to the observed directory
+        NSString *filePath = [[fileURL URLByStandardizingPath] path];
+        NSString *name = [filePath hasPrefix:directoryPrefix] ? [filePath substringFromIndex:directoryPrefix.length] : (values[NSURLNameKey] ?: [fileURL lastPathComponent]);
+        
+        NSMutableDictionary *entry = [NSMutableDictionary dictionary];
+        entry[NSMetadataItemFSNameKey] = values[NSURLNameKey] ?: [fileURL lastPathComponent];
+        entry[iCloudMetadataItemDocumentPathKey] = name;
+        entry[NSMetadataItemURLKey] = fileURL;
+        if (values[NSURLFileSizeKey]) entry[NSMetadataItemFSSizeKey] = values[NSURLFileSizeKey];
+        if (values[NSURLContentModificationDateKey]) entry[NSMetadataItemFSContentChangeDateKey] = values[NSURLContentModificationDateKey];
+        if (values[NSURLCreationDateKey]) entry[NSMetadataItemFSCreationDateKey] = values[NSURLCreationDateKey];
+        entry[NSMetadataUbiquitousItemDownloadingStatusKey] = [self downloadingStatusForItemAtURL:fileURL];
+        if ([self unresolvedConflictVersionsOfItemAtURL:fileURL].count > 0) entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] = @YES;
+        
+        NSDictionary *immutableEntry = [entry copy];
+        scannedEntries[name] = immutableEntry;
+        if (fullPass || ![self.reportedEntries[name] isEqualToDictionary:immutableEntry]) [changedEntries addObject:immutableEntry];
+    }
+    
+    NSMutableArray *removedNames = [NSMutableArray array];
+    for (NSString *name in self.reportedEntries) {
+        if (!scannedEntries[name]) [removedNames addObject:name];
+    }
+    
+    self.reportedEntries = scannedEntries;
+    self.reportedFullPass = YES;
+    if (!fullPass && changedEntries.count == 0 && removedNames.count == 0) return;
+    
+    self.metadataHandler(changedEntries, removedNames, fullPass);
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  File Presenter -----------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - File Presenter
+
+- (NSURL *)presentedItemURL {
+    return self.observedDirectoryURL;
+}
+
+- (NSOperationQueue *)presentedItemOperationQueue {
+    return self.presenterQueue;
+}
+
+- (void)presentedSubitemDidChangeAtURL:(NSURL *)url {
+    [self scheduleRescan];
+}
+
+- (void)presentedSubitemDidAppearAtURL:(NSURL *)url {
+    [self scheduleRescan];
+}
+
+- (void)presentedSubitemAtURL:(NSURL *)oldURL didMoveToURL:(NSURL *)newURL {
+    [self scheduleRescan];
+}
+
+- (void)accommodatePresentedSubitemDeletionAtURL:(NSURL *)url completionHandler:(void (^)(NSError *errorOrNil))completionHandler {
+    [self scheduleRescan];
+    completionHandler(nil);
+}
+
+@end
@@ -0,0 +1,100 @@
+//
+//  iCloudMetadataSnapshot.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The metadata entry key for the path of a document relative to the documents directory, for example @"Projects/Notes.txt". Documents at the top of the documents directory have the same path and name. */
+extern NSString * const iCloudMetadataItemDocumentPathKey;
+
+/** An iCloudMetadataSnapshot is an immutable view of the iCloud documents directory as of one metadata update pass.
+
+ Each entry is an NSDictionary keyed by the NSMetadataItem attribute keys listed in indexedAttributes, plus iCloudMetadataItemDocumentPathKey. NSMetadataUbiquitousItemHasUnresolvedConflictsKey is only present, as @YES, in the entries of conflicted documents. NSMetadataUbiquitousItemDownloadingErrorKey is only present while a download has failed, and is not saved with the snapshot. Entries are keyed by document path, so documents with the same name in different folders are kept apart.
+
+ Snapshots are never modified once published, so they can be read from any thread without locking. A new snapshot replaces the previous one on the first read after an update pass changed the index.
+
+ Snapshots can be saved to a compact binary file and restored from it, which lets the iCloud class show the last known file list on launch before the metadata query has gathered anything. */
+@interface iCloudMetadataSnapshot : NSObject
+
+
+
+/** @name Creating a Snapshot */
+
+/** Create a snapshot from metadata entries keyed by document path
+
+ @param entriesByDocumentPath Immutable metadata entries keyed by document path. The dictionary is copied. This value must not be nil.
+ @param generation The number of changes to the index this snapshot includes
+ @param complete YES if a full pass over the container has been made, NO if the entries may be partial
+ @return An immutable snapshot */
+- (instancetype)initWithEntriesByDocumentPath:(NSDictionary *)entriesByDocumentPath generation:(NSUInteger)generation complete:(BOOL)complete __attribute__((nonnull));
+
+/** Restore a snapshot saved with writeToURL:error:
+
+ @discussion The file is memory-mapped and decoded in a single pass. Restored snapshots are never complete, since the container may have changed since they were saved.
+
+ @param url The file URL of the saved snapshot. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return The restored snapshot, or nil if the file is missing, corrupt or of an unsupported version */
+- (instancetype)initWithContentsOfURL:(NSURL *)url error:(NSError **)error __attribute__((nonnull (1)));
+
+
+
+/** @name Saving a Snapshot */
+
+/** Save the snapshot to a compact binary file
+
+ @discussion Entries are written as length-prefixed fields behind a versioned header. The file URLs share one stored prefix, and names equal to the last component of the document path are not stored, so the file stays a fraction of the size of a property list. The file is replaced atomically.
+
+ @param url The file URL to write to. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return YES if the snapshot was written */
+- (BOOL)writeToURL:(NSURL *)url error:(NSError **)error __attribute__((nonnull (1)));
+
+
+
+/** @name Reading a Snapshot */
+
+/** Get the metadata entry of a document
+
+ @param documentPath The path of the document relative to the documents directory, which is the document's name for documents at the top of the directory. This value must not be nil.
+ @return The metadata entry, or nil if the document was not in the container when the snapshot was taken */
+- (NSDictionary *)entryForDocumentPath:(NSString *)documentPath __attribute__((nonnull));
+
+/** Every metadata entry in the snapshot, in no particular order */
+@property (copy, readonly) NSArray *entries;
+
+/** The paths of every document in the snapshot */
+@property (copy, readonly) NSArray *documentPaths;
+
+/** The paths of the documents whose current version is downloaded */
+@property (copy, readonly) NSArray *downloadedDocumentPaths;
+
+/** The number of files in the snapshot */
+@property (assign, readonly) NSUInteger count;
+
+/** Increases with every change to the index, so readers can tell whether anything changed since they last looked */
+@property (assign, readonly) NSUInteger generation;
+
+/** YES once a full pass over the container has been made. Incomplete snapshots only hold the files reported so far. */
+@property (assign, readonly, getter=isComplete) BOOL complete;
+
+/** YES if the snapshot was restored from a saved file rather than built from a live update pass */
+@property (assign, readonly, getter=isRestored) BOOL restored;
+
+/** The date the snapshot was taken */
+@property (strong, readonly) NSDate *creationDate;
+
+/** The NSMetadataItem attributes captured in every entry */
++ (NSArray *)indexedAttributes;
+
+@end
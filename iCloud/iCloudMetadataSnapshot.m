@@ -0,0 +1,288 @@
+//
+//  iCloudMetadataSnapshot.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudMetadataSnapshot.h"
+
+NSString * const iCloudMetadataItemDocumentPathKey = @"iCloudMetadataItemDocumentPath";
+
+/// Magic bytes at the start of a saved snapshot
+static const unsigned char iCloudMetadataSnapshotMagic[4] = {'i', 'C', 'M', 'S'};
+
+/// The file format written by this version
+static const uint32_t iCloudMetadataSnapshotFormatVersion = 1;
+
+/// Flags marking the optional fields stored for an entry
+typedef NS_OPTIONS(uint8_t, iCloudMetadataSnapshotField) {
+    iCloudMetadataSnapshotFieldName = 1 << 0,
+    iCloudMetadataSnapshotFieldURL = 1 << 1,
+    iCloudMetadataSnapshotFieldSize = 1 << 2,
+    iCloudMetadataSnapshotFieldModificationDate = 1 << 3,
+    iCloudMetadataSnapshotFieldCreationDate = 1 << 4,
+    /// Not a field, the document has unresolved conflicts. Snapshots saved before this flag existed read as conflict-free.
+    iCloudMetadataSnapshotFieldHasUnresolvedConflicts = 1 << 5
+};
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Binary Encoding ----------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Binary Encoding
+
+static void iCloudAppendUInt64(NSMutableData *data, uint64_t value) {
+    uint64_t littleEndian = CFSwapInt64HostToLittle(value);
+    [data appendBytes:&littleEndian length:sizeof(littleEndian)];
+}
+
+static void iCloudAppendUInt32(NSMutableData *data, uint32_t value) {
+    uint32_t littleEndian = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&littleEndian length:sizeof(littleEndian)];
+}
+
+static void iCloudAppendDouble(NSMutableData *data, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    iCloudAppendUInt64(data, bits);
+}
+
+static void iCloudAppendString(NSMutableData *data, NSString *string) {
+    NSData *bytes = [string dataUsingEncoding:NSUTF8StringEncoding] ?: [NSData data];
+    iCloudAppendUInt32(data, (uint32_t)bytes.length);
+    [data appendData:bytes];
+}
+
+/// A bounds-checked read position in a saved snapshot. Any read past the end marks the reader as failed
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger offset;
+    BOOL failed;
+} iCloudSnapshotReader;
+
+static const uint8_t *iCloudReadBytes(iCloudSnapshotReader *reader, NSUInteger length) {
+    if (reader->failed || length > reader->length - reader->offset) {
+        reader->failed = YES;
+        return NULL;
+    }
+    const uint8_t *bytes = reader->bytes + reader->offset;
+    reader->offset += length;
+    return bytes;
+}
+
+static uint64_t iCloudReadUInt64(iCloudSnapshotReader *reader) {
+    const uint8_t *bytes = iCloudReadBytes(reader, sizeof(uint64_t));
+    if (!bytes) return 0;
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return CFSwapInt64LittleToHost(value);
+}
+
+static uint32_t iCloudReadUInt32(iCloudSnapshotReader *reader) {
+    const uint8_t *bytes = iCloudReadBytes(reader, sizeof(uint32_t));
+    if (!bytes) return 0;
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return CFSwapInt32LittleToHost(value);
+}
+
+static uint8_t iCloudReadUInt8(iCloudSnapshotReader *reader) {
+    const uint8_t *bytes = iCloudReadBytes(reader, 1);
+    return bytes ? bytes[0] : 0;
+}
+
+static double iCloudReadDouble(iCloudSnapshotReader *reader) {
+    uint64_t bits = iCloudReadUInt64(reader);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static NSString *iCloudReadString(iCloudSnapshotReader *reader) {
+    uint32_t length = iCloudReadUInt32(reader);
+    const uint8_t *bytes = iCloudReadBytes(reader, length);
+    if (!bytes) return nil;
+    
+    NSString *string = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    if (!string) reader->failed = YES;
+    return string;
+}
+
+@interface iCloudMetadataSnapshot ()
+
+/// Entries keyed by document path
+@property (copy) NSDictionary *entriesByDocumentPath;
+
+@property (assign, readwrite, getter=isRestored) BOOL restored;
+@property (strong, readwrite) NSDate *creationDate;
+
+/// The downloading status constants, in the order their indexes are stored
++ (NSArray *)downloadingStatuses;
+
+@end
+
+@implementation iCloudMetadataSnapshot
+
++ (NSArray *)indexedAttributes {
+    static NSArray *indexedAttributes = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        indexedAttributes = @[NSMetadataItemFSNameKey, NSMetadataItemURLKey, NSMetadataItemFSSizeKey, NSMetadataItemFSContentChangeDateKey, NSMetadataItemFSCreationDateKey, NSMetadataUbiquitousItemDownloadingStatusKey, NSMetadataUbiquitousItemDownloadingErrorKey, NSMetadataUbiquitousItemHasUnresolvedConflictsKey];
+    });
+    return indexedAttributes;
+}
+
+- (instancetype)initWithEntriesByDocumentPath:(NSDictionary *)entriesByDocumentPath generation:(NSUInteger)generation complete:(BOOL)complete {
+    self = [super init];
+    if (self) {
+        _entriesByDocumentPath = [entriesByDocumentPath copy];
+        _generation = generation;
+        _complete = complete;
+        _creationDate = [NSDate date];
+    }
+    return self;
+}
+
+- (instancetype)initWithContentsOfURL:(NSURL *)url error:(NSError **)error {
+    NSData *data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:error];
+    if (!data) return nil;
+    
+    iCloudSnapshotReader reader = {data.bytes, data.length, 0, NO};
+    const uint8_t *magic = iCloudReadBytes(&reader, sizeof(iCloudMetadataSnapshotMagic));
+    uint32_t version = iCloudReadUInt32(&reader);
+    if (!magic || memcmp(magic, iCloudMetadataSnapshotMagic, sizeof(iCloudMetadataSnapshotMagic)) != 0 || version != iCloudMetadataSnapshotFormatVersion) {
+        if (error) *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The metadata snapshot, %@, has an unsupported format", [url lastPathComponent]] code:520 userInfo:@{@"FileURL": url}];
+        return nil;
+    }
+    
+    uint64_t generation = iCloudReadUInt64(&reader);
+    double creationTime = iCloudReadDouble(&reader);
+    uint32_t count = iCloudReadUInt32(&reader);
+    NSString *URLPrefix = iCloudReadString(&reader);
+    NSArray *statuses = [[self class] downloadingStatuses];
+    
+    // Never trust the count for the allocation, a corrupt file could claim billions of entries
+    NSMutableDictionary *entriesByDocumentPath = [NSMutableDictionary dictionaryWithCapacity:MIN(count, (uint32_t)(data.length / 8))];
+    for (uint32_t index = 0; index < count && !reader.failed; index++) {
+        @autoreleasepool {
+            uint8_t fields = iCloudReadUInt8(&reader);
+            uint8_t status = iCloudReadUInt8(&reader);
+            NSString *documentPath = iCloudReadString(&reader);
+            if (reader.failed || documentPath.length == 0) break;
+            
+            NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithCapacity:7];
+            entry[iCloudMetadataItemDocumentPathKey] = documentPath;
+            entry[NSMetadataItemFSNameKey] = (fields & iCloudMetadataSnapshotFieldName) ? iCloudReadString(&reader) : [documentPath lastPathComponent];
+            if (fields & iCloudMetadataSnapshotFieldURL) {
+                NSString *URLSuffix = iCloudReadString(&reader);
+                NSURL *fileURL = URLSuffix ? [NSURL URLWithString:[URLPrefix stringByAppendingString:URLSuffix]] : nil;
+                if (fileURL) entry[NSMetadataItemURLKey] = fileURL;
+            }
+            if (fields & iCloudMetadataSnapshotFieldSize) entry[NSMetadataItemFSSizeKey] = @(iCloudReadUInt64(&reader));
+            if (fields & iCloudMetadataSnapshotFieldModificationDate) entry[NSMetadataItemFSContentChangeDateKey] = [NSDate dateWithTimeIntervalSinceReferenceDate:iCloudReadDouble(&reader)];
+            if (fields & iCloudMetadataSnapshotFieldCreationDate) entry[NSMetadataItemFSCreationDateKey] = [NSDate dateWithTimeIntervalSinceReferenceDate:iCloudReadDouble(&reader)];
+            if (status > 0 && status <= statuses.count) entry[NSMetadataUbiquitousItemDownloadingStatusKey] = statuses[status - 1];
+            if (fields & iCloudMetadataSnapshotFieldHasUnresolvedConflicts) entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] = @YES;
+            
+            if (!reader.failed && entry[NSMetadataItemFSNameKey]) entriesByDocumentPath[documentPath] = [entry copy];
+        }
+    }
+    
+    if (reader.failed || entriesByDocumentPath.count != count) {
+        if (error) *error = [NSError errorWithDomain:[NSString stringWithFormat:@"The metadata snapshot, %@, is corrupt or truncated", [url lastPathComponent]] code:520 userInfo:@{@"FileURL": url}];
+        return nil;
+    }
+    
+    self = [self initWithEntriesByDocumentPath:entriesByDocumentPath generation:(NSUInteger)generation complete:NO];
+    if (self) {
+        _restored = YES;
+        _creationDate = [NSDate dateWithTimeIntervalSinceReferenceDate:creationTime];
+    }
+    return self;
+}
+
++ (NSArray *)downloadingStatuses {
+    return @[NSMetadataUbiquitousItemDownloadingStatusNotDownloaded, NSMetadataUbiquitousItemDownloadingStatusDownloaded, NSMetadataUbiquitousItemDownloadingStatusCurrent];
+}
+
+- (BOOL)writeToURL:(NSURL *)url error:(NSError **)error {
+    NSDictionary *entriesByDocumentPath = self.entriesByDocumentPath;
+    
+    // Every URL in a container shares a long prefix, store it once
+    NSString *URLPrefix = nil;
+    for (NSDictionary *entry in [entriesByDocumentPath objectEnumerator]) {
+        NSString *URLString = [entry[NSMetadataItemURLKey] absoluteString];
+        if (!URLString) continue;
+        URLPrefix = URLPrefix ? [URLPrefix commonPrefixWithString:URLString options:NSLiteralSearch] : URLString;
+    }
+    if (!URLPrefix) URLPrefix = @"";
+    
+    NSArray *statuses = [[self class] downloadingStatuses];
+    NSMutableData *data = [NSMutableData dataWithCapacity:64 + entriesByDocumentPath.count * 64];
+    [data appendBytes:iCloudMetadataSnapshotMagic length:sizeof(iCloudMetadataSnapshotMagic)];
+    iCloudAppendUInt32(data, iCloudMetadataSnapshotFormatVersion);
+    iCloudAppendUInt64(data, self.generation);
+    iCloudAppendDouble(data, [self.creationDate timeIntervalSinceReferenceDate]);
+    iCloudAppendUInt32(data, (uint32_t)entriesByDocumentPath.count);
+    iCloudAppendString(data, URLPrefix);
+    
+    [entriesByDocumentPath enumerateKeysAndObjectsUsingBlock:^(NSString *documentPath, NSDictionary *entry, BOOL *stop) {
+        NSString *name = entry[NSMetadataItemFSNameKey];
+        NSString *URLString = [entry[NSMetadataItemURLKey] absoluteString];
+        NSNumber *fileSize = entry[NSMetadataItemFSSizeKey];
+        NSDate *modificationDate = entry[NSMetadataItemFSContentChangeDateKey];
+        NSDate *creationDate = entry[NSMetadataItemFSCreationDateKey];
+        NSUInteger statusIndex = entry[NSMetadataUbiquitousItemDownloadingStatusKey] ? [statuses indexOfObject:entry[NSMetadataUbiquitousItemDownloadingStatusKey]] : NSNotFound;
+        
+        iCloudMetadataSnapshotField fields = 0;
+        if (name && ![name isEqualToString:[documentPath lastPathComponent]]) fields |= iCloudMetadataSnapshotFieldName;
+        if (URLString) fields |= iCloudMetadataSnapshotFieldURL;
+        if (fileSize) fields |= iCloudMetadataSnapshotFieldSize;
+        if (modificationDate) fields |= iCloudMetadataSnapshotFieldModificationDate;
+        if (creationDate) fields |= iCloudMetadataSnapshotFieldCreationDate;
+        if ([entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] boolValue]) fields |= iCloudMetadataSnapshotFieldHasUnresolvedConflicts;
+        
+        uint8_t header[2] = {fields, statusIndex == NSNotFound ? 0 : (uint8_t)(statusIndex + 1)};
+        [data appendBytes:header length:sizeof(header)];
+        iCloudAppendString(data, documentPath);
+        if (fields & iCloudMetadataSnapshotFieldName) iCloudAppendString(data, name);
+        if (fields & iCloudMetadataSnapshotFieldURL) iCloudAppendString(data, [URLString substringFromIndex:URLPrefix.length]);
+        if (fields & iCloudMetadataSnapshotFieldSize) iCloudAppendUInt64(data, [fileSize unsignedLongLongValue]);
+        if (fields & iCloudMetadataSnapshotFieldModificationDate) iCloudAppendDouble(data, [modificationDate timeIntervalSinceReferenceDate]);
+        if (fields & iCloudMetadataSnapshotFieldCreationDate) iCloudAppendDouble(data, [creationDate timeIntervalSinceReferenceDate]);
+    }];
+    
+    NSURL *directoryURL = [url URLByDeletingLastPathComponent];
+    if (![[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:error]) return NO;
+    return [data writeToURL:url options:NSDataWritingAtomic error:error];
+}
+
+- (NSDictionary *)entryForDocumentPath:(NSString *)documentPath {
+    return self.entriesByDocumentPath[documentPath];
+}
+
+- (NSArray *)entries {
+    return [self.entriesByDocumentPath allValues];
+}
+
+- (NSArray *)documentPaths {
+    return [self.entriesByDocumentPath allKeys];
+}
+
+- (NSArray *)downloadedDocumentPaths {
+    return [[self.entriesByDocumentPath keysOfEntriesPassingTest:^BOOL(NSString *documentPath, NSDictionary *entry, BOOL *stop) {
+        return [entry[NSMetadataUbiquitousItemDownloadingStatusKey] isEqualToString:NSMetadataUbiquitousItemDownloadingStatusCurrent];
+    }] allObjects];
+}
+
+- (NSUInteger)count {
+    return self.entriesByDocumentPath.count;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: generation %lu, %lu files%@%@>", NSStringFromClass([self class]), (unsigned long)self.generation, (unsigned long)self.count, self.complete ? @"" : @", incomplete", self.restored ? @", restored" : @""];
+}
+
+@end
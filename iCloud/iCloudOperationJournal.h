@@ -0,0 +1,161 @@
+//
+//  iCloudOperationJournal.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The document operations recorded by iCloudOperationJournal */
+typedef NS_ENUM(NSInteger, iCloudJournalOperation) {
+    /// A document was saved or uploaded, replayed by uploading the local document
+    iCloudJournalOperationSave = 0,
+    /// A document was deleted
+    iCloudJournalOperationDelete = 1,
+    /// A document was renamed to the destination path
+    iCloudJournalOperationRename = 2,
+    /// A document was duplicated to the destination path
+    iCloudJournalOperationDuplicate = 3
+};
+
+/** An immutable record of one document operation made while iCloud was unavailable */
+@interface iCloudJournalEntry : NSObject
+
+/** Create a journal entry
+
+ @param operation The recorded operation
+ @param documentPath The path of the document relative to the documents directory. This value must not be nil.
+ @param destinationPath The new path for renames and duplicates, nil for other operations
+ @param sequence The position of the entry in the journal
+ @param date The date the operation was made. This value must not be nil.
+ @return A journal entry */
+- (instancetype)initWithOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath sequence:(uint64_t)sequence date:(NSDate *)date __attribute__((nonnull (2, 5)));
+
+/** The recorded operation */
+@property (assign, readonly) iCloudJournalOperation operation;
+
+/** The path of the document the operation applies to */
+@property (copy, readonly) NSString *documentPath;
+
+/** The new path for renames and duplicates, nil for other operations */
+@property (copy, readonly) NSString *destinationPath;
+
+/** The position of the entry in the journal, increasing with every entry appended */
+@property (assign, readonly) uint64_t sequence;
+
+/** The date the operation was made */
+@property (strong, readonly) NSDate *date;
+
+/** The archived ubiquity identity token of the iCloud account the operation was made for, nil if no account was known yet */
+@property (copy, readonly) NSData *identityToken;
+
+/** The identifier of the ubiquity container the operation was made for, nil for the default container */
+@property (copy, readonly) NSString *containerIdentifier;
+
+/** YES if the operation was already applied, under file coordination, to the document in the ubiquity container. Replay then leaves the files alone and iCloud uploads the change once the account is available. */
+@property (assign, readonly, getter=isAppliedLocally) BOOL appliedLocally;
+
+@end
+
+
+/** The iCloudOperationJournal class is a crash-safe, append-only log of the document operations made while iCloud is unavailable.
+
+ Every entry is appended as a length-prefixed, checksummed record and flushed to disk before append returns, so entries survive a crash or the app being killed. A record torn by a crash is detected by its checksum when the journal is opened and cut off, without losing the records before it.
+
+ Each entry records the iCloud account and ubiquity container it was made for, so that a replay after the user switched accounts never applies one account's operations to another account's container.
+
+ Before replay, coalescedEntries folds the journal into its net effect: repeated saves of a document become one, a save followed by a delete becomes the delete, chains of renames become a single rename (pending saves follow the document to its new name), and a document duplicated and then deleted is never created. Replay therefore costs time proportional to the net changes rather than to the number of recorded operations.
+
+ The iCloud class owns a journal, records operations in it while iCloud is unavailable and replays it once iCloud becomes available again. */
+@interface iCloudOperationJournal : NSObject
+
+
+
+/** @name Creating a Journal */
+
+/** Open the journal stored at the specified location, creating it on the first append
+
+ @param journalURL The file URL of the journal. This value must not be nil.
+ @return A journal holding every intact entry already in the file */
+- (instancetype)initWithJournalURL:(NSURL *)journalURL __attribute__((nonnull));
+
+/** The file URL of the journal */
+@property (strong, readonly) NSURL *journalURL;
+
+
+
+/** @name Recording Operations */
+
+/** Append an operation to the journal and flush it to disk
+
+ @param operation The operation to record
+ @param documentPath The path of the document relative to the documents directory. This value must not be nil.
+ @param destinationPath The new path for renames and duplicates, nil for other operations
+ @param error On failure, contains an NSError describing the problem
+ @return The appended entry, or nil if it could not be written */
+- (iCloudJournalEntry *)appendOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath error:(NSError **)error __attribute__((nonnull (2)));
+
+/** Append an operation to the journal and flush it to disk
+
+ @param operation The operation to record
+ @param documentPath The path of the document relative to the documents directory. This value must not be nil.
+ @param destinationPath The new path for renames and duplicates, nil for other operations
+ @param appliedLocally YES if the operation was already applied to the document in the ubiquity container
+ @param error On failure, contains an NSError describing the problem
+ @return The appended entry, stamped with the journal's identityToken and containerIdentifier, or nil if it could not be written */
+- (iCloudJournalEntry *)appendOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath appliedLocally:(BOOL)appliedLocally error:(NSError **)error __attribute__((nonnull (2)));
+
+/** The archived ubiquity identity token stamped on appended entries. The iCloud class sets it to the last account it saw. */
+@property (copy) NSData *identityToken;
+
+/** The ubiquity container identifier stamped on appended entries. The iCloud class sets it to the container passed to setup. */
+@property (copy) NSString *containerIdentifier;
+
+
+
+/** @name Reading the Journal */
+
+/** Every entry in the order it was appended */
+@property (copy, readonly) NSArray *entries;
+
+/** The net effect of the journal, in replay order. See the class discussion for the rules used. */
+- (NSArray *)coalescedEntries;
+
+/** Fold a list of entries into its net effect
+
+ @param entries Journal entries in the order they were appended. This value must not be nil.
+ @return The coalesced entries, in replay order */
++ (NSArray *)coalescedEntriesFromEntries:(NSArray *)entries __attribute__((nonnull));
+
+/** The number of entries in the journal */
+@property (assign, readonly) NSUInteger count;
+
+/** The sequence number of the most recently appended entry, 0 if nothing was ever appended */
+@property (assign, readonly) uint64_t lastSequence;
+
+
+
+/** @name Compacting the Journal */
+
+/** Replace the entries up to a sequence number after they were replayed
+
+ @discussion Entries appended after the sequence number, for example while the replay was running, are kept after the replacement entries. The journal is rewritten atomically.
+
+ @param sequence The sequence number of the last entry covered by the replay
+ @param remainingEntries The entries which still have to be replayed, in replay order. Pass an empty array once everything was replayed. This value must not be nil.
+ @param error On failure, contains an NSError describing the problem
+ @return YES if the journal was rewritten */
+- (BOOL)replaceEntriesThroughSequence:(uint64_t)sequence withEntries:(NSArray *)remainingEntries error:(NSError **)error __attribute__((nonnull (2)));
+
+/** Remove every entry and delete the journal file */
+- (void)removeAllEntries;
+
+@end
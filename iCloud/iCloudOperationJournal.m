@@ -0,0 +1,376 @@
+//
+//  iCloudOperationJournal.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudOperationJournal.h"
+
+/// Magic bytes and format version at the start of the journal file
+static const unsigned char iCloudJournalMagic[4] = {'i', 'C', 'O', 'J'};
+static const uint32_t iCloudJournalFormatVersion = 1;
+
+/// Length of the file header and of the length and checksum in front of every record
+#define JOURNAL_HEADER_LENGTH 8
+#define JOURNAL_RECORD_HEADER_LENGTH 8
+
+/// FNV-1a, enough to tell a torn or partially written record from an intact one
+static uint32_t iCloudJournalChecksum(const uint8_t *bytes, NSUInteger length) {
+    uint32_t hash = 2166136261u;
+    for (NSUInteger index = 0; index < length; index++) {
+        hash ^= bytes[index];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+@interface iCloudJournalEntry ()
+
+@property (copy, readwrite) NSData *identityToken;
+@property (copy, readwrite) NSString *containerIdentifier;
+@property (assign, readwrite, getter=isAppliedLocally) BOOL appliedLocally;
+
+/// An entry made for the same account and container as this one, used when coalescing
+- (iCloudJournalEntry *)entryWithOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath sequence:(uint64_t)sequence date:(NSDate *)date appliedLocally:(BOOL)appliedLocally;
+
+@end
+
+@implementation iCloudJournalEntry
+
+- (instancetype)initWithOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath sequence:(uint64_t)sequence date:(NSDate *)date {
+    self = [super init];
+    if (self) {
+        _operation = operation;
+        _documentPath = [documentPath copy];
+        _destinationPath = [destinationPath copy];
+        _sequence = sequence;
+        _date = date;
+    }
+    return self;
+}
+
+- (iCloudJournalEntry *)entryWithOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath sequence:(uint64_t)sequence date:(NSDate *)date appliedLocally:(BOOL)appliedLocally {
+    iCloudJournalEntry *entry = [[iCloudJournalEntry alloc] initWithOperation:operation documentPath:documentPath destinationPath:destinationPath sequence:sequence date:date];
+    entry.identityToken = self.identityToken;
+    entry.containerIdentifier = self.containerIdentifier;
+    entry.appliedLocally = appliedLocally;
+    return entry;
+}
+
+- (NSString *)description {
+    NSArray *names = @[@"save", @"delete", @"rename", @"duplicate"];
+    NSString *name = (self.operation >= 0 && self.operation < (NSInteger)names.count) ? names[self.operation] : @"unknown";
+    if (self.destinationPath) return [NSString stringWithFormat:@"<%@ #%llu: %@ %@ -> %@>", NSStringFromClass([self class]), self.sequence, name, self.documentPath, self.destinationPath];
+    return [NSString stringWithFormat:@"<%@ #%llu: %@ %@>", NSStringFromClass([self class]), self.sequence, name, self.documentPath];
+}
+
+@end
+
+@interface iCloudOperationJournal ()
+
+@property (strong, readwrite) NSURL *journalURL;
+@property (nonatomic, strong) NSMutableArray *mutableEntries;
+@property (assign, readwrite) uint64_t lastSequence;
+
+/// Read every intact record in the journal file, cutting off a record torn by a crash
+- (void)loadEntries;
+
+/// Encode an entry as a record: length, checksum and property list payload
+- (NSData *)recordForEntry:(iCloudJournalEntry *)entry;
+
+/// Decode the property list payload of a record
+- (iCloudJournalEntry *)entryFromPayload:(NSData *)payload;
+
+/// The file header written in front of the first record
+- (NSData *)fileHeader;
+
+@end
+
+@implementation iCloudOperationJournal
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Setup --------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Setup
+
+- (instancetype)initWithJournalURL:(NSURL *)journalURL {
+    self = [super init];
+    if (self) {
+        _journalURL = journalURL;
+        _mutableEntries = [NSMutableArray array];
+        [self loadEntries];
+    }
+    return self;
+}
+
+- (NSData *)fileHeader {
+    NSMutableData *header = [NSMutableData dataWithBytes:iCloudJournalMagic length:sizeof(iCloudJournalMagic)];
+    uint32_t version = CFSwapInt32HostToLittle(iCloudJournalFormatVersion);
+    [header appendBytes:&version length:sizeof(version)];
+    return header;
+}
+
+- (void)loadEntries {
+    NSData *data = [NSData dataWithContentsOfURL:self.journalURL options:NSDataReadingMappedIfSafe error:nil];
+    if (data.length < JOURNAL_HEADER_LENGTH) return;
+
+    const uint8_t *bytes = data.bytes;
+    if (![[data subdataWithRange:NSMakeRange(0, JOURNAL_HEADER_LENGTH)] isEqualToData:[self fileHeader]]) {
+        NSLog(@"[iCloud] Ignoring operation journal with an unsupported format: %@", self.journalURL);
+        return;
+    }
+
+    NSUInteger offset = JOURNAL_HEADER_LENGTH;
+    while (data.length - offset >= JOURNAL_RECORD_HEADER_LENGTH) {
+        uint32_t length, checksum;
+        memcpy(&length, bytes + offset, sizeof(length));
+        memcpy(&checksum, bytes + offset + 4, sizeof(checksum));
+        length = CFSwapInt32LittleToHost(length);
+        checksum = CFSwapInt32LittleToHost(checksum);
+
+        if (length > data.length - offset - JOURNAL_RECORD_HEADER_LENGTH) break;
+        const uint8_t *payload = bytes + offset + JOURNAL_RECORD_HEADER_LENGTH;
+        if (iCloudJournalChecksum(payload, length) != checksum) break;
+
+        iCloudJournalEntry *entry = [self entryFromPayload:[NSData dataWithBytes:payload length:length]];
+        if (!entry) break;
+
+        [self.mutableEntries addObject:entry];
+        self.lastSequence = MAX(self.lastSequence, entry.sequence);
+        offset += JOURNAL_RECORD_HEADER_LENGTH + length;
+    }
+
+    // Anything after the last intact record was torn by a crash, cut it off so new records follow intact ones
+    if (offset < data.length) {
+        NSLog(@"[iCloud] Discarding %lu bytes of a torn record at the end of the operation journal", (unsigned long)(data.length - offset));
+        NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:self.journalURL error:nil];
+        [handle truncateFileAtOffset:offset];
+        [handle synchronizeFile];
+        [handle closeFile];
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Records ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Records
+
+- (NSData *)recordForEntry:(iCloudJournalEntry *)entry {
+    NSMutableDictionary *plist = [NSMutableDictionary dictionaryWithCapacity:8];
+    plist[@"operation"] = @(entry.operation);
+    plist[@"path"] = entry.documentPath;
+    plist[@"sequence"] = @(entry.sequence);
+    plist[@"date"] = entry.date;
+    if (entry.destinationPath) plist[@"destination"] = entry.destinationPath;
+    if (entry.identityToken) plist[@"identity"] = entry.identityToken;
+    if (entry.containerIdentifier) plist[@"container"] = entry.containerIdentifier;
+    if (entry.appliedLocally) plist[@"local"] = @YES;
+
+    NSData *payload = [NSPropertyListSerialization dataWithPropertyList:plist format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+    uint32_t header[2] = {CFSwapInt32HostToLittle((uint32_t)payload.length), CFSwapInt32HostToLittle(iCloudJournalChecksum(payload.bytes, payload.length))};
+
+    NSMutableData *record = [NSMutableData dataWithBytes:header length:sizeof(header)];
+    [record appendData:payload];
+    return record;
+}
+
+- (iCloudJournalEntry *)entryFromPayload:(NSData *)payload {
+    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:payload options:NSPropertyListImmutable format:NULL error:nil];
+    if (![plist isKindOfClass:[NSDictionary class]] || ![plist[@"path"] isKindOfClass:[NSString class]]) return nil;
+
+    iCloudJournalEntry *entry = [[iCloudJournalEntry alloc] initWithOperation:[plist[@"operation"] integerValue] documentPath:plist[@"path"] destinationPath:plist[@"destination"] sequence:[plist[@"sequence"] unsignedLongLongValue] date:plist[@"date"] ?: [NSDate date]];
+    entry.identityToken = [plist[@"identity"] isKindOfClass:[NSData class]] ? plist[@"identity"] : nil;
+    entry.containerIdentifier = [plist[@"container"] isKindOfClass:[NSString class]] ? plist[@"container"] : nil;
+    entry.appliedLocally = [plist[@"local"] boolValue];
+    return entry;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Recording Operations -----------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Recording Operations
+
+- (iCloudJournalEntry *)appendOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath error:(NSError **)error {
+    return [self appendOperation:operation documentPath:documentPath destinationPath:destinationPath appliedLocally:NO error:error];
+}
+
+- (iCloudJournalEntry *)appendOperation:(iCloudJournalOperation)operation documentPath:(NSString *)documentPath destinationPath:(NSString *)destinationPath appliedLocally:(BOOL)appliedLocally error:(NSError **)error {
+    @synchronized (self) {
+        iCloudJournalEntry *entry = [[iCloudJournalEntry alloc] initWithOperation:operation documentPath:documentPath destinationPath:destinationPath sequence:self.lastSequence + 1 date:[NSDate date]];
+        entry.identityToken = self.identityToken;
+        entry.containerIdentifier = self.containerIdentifier;
+        entry.appliedLocally = appliedLocally;
+
+        // Create the journal with its header on the first append
+        NSString *path = [self.journalURL path];
+        if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            if (![[NSFileManager defaultManager] createDirectoryAtURL:[self.journalURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:error]) return nil;
+            if (![[self fileHeader] writeToURL:self.journalURL options:NSDataWritingAtomic error:error]) return nil;
+        }
+
+        NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:self.journalURL error:error];
+        if (!handle) return nil;
+
+        // The record is on disk before the caller carries on, a crash can only tear the record being written
+        [handle seekToEndOfFile];
+        [handle writeData:[self recordForEntry:entry]];
+        [handle synchronizeFile];
+        [handle closeFile];
+
+        [self.mutableEntries addObject:entry];
+        self.lastSequence = entry.sequence;
+        return entry;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Reading the Journal ------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Reading the Journal
+
+- (NSArray *)entries {
+    @synchronized (self) {
+        return [self.mutableEntries copy];
+    }
+}
+
+- (NSUInteger)count {
+    @synchronized (self) {
+        return self.mutableEntries.count;
+    }
+}
+
+- (NSArray *)coalescedEntries {
+    return [[self class] coalescedEntriesFromEntries:self.entries];
+}
+
++ (NSArray *)coalescedEntriesFromEntries:(NSArray *)entries {
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:entries.count];
+
+    // The most recent coalesced entry matching the operation and path, searching backwards
+    iCloudJournalEntry *(^lastEntry)(iCloudJournalOperation, NSString *, BOOL) = ^iCloudJournalEntry *(iCloudJournalOperation operation, NSString *path, BOOL matchDestination) {
+        for (iCloudJournalEntry *candidate in [result reverseObjectEnumerator]) {
+            if (candidate.operation != operation) continue;
+            if ([(matchDestination ? candidate.destinationPath : candidate.documentPath) isEqualToString:path]) return candidate;
+        }
+        return nil;
+    };
+
+    for (iCloudJournalEntry *entry in entries) {
+        switch (entry.operation) {
+            case iCloudJournalOperationSave: {
+                // Only the last save of a document matters, its local file holds the latest contents
+                [result removeObjectsInArray:[result filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(iCloudJournalEntry *candidate, NSDictionary *bindings) {
+                    return candidate.operation == iCloudJournalOperationSave && [candidate.documentPath isEqualToString:entry.documentPath];
+                }]]];
+                [result addObject:entry];
+                break;
+            }
+            case iCloudJournalOperationDelete: {
+                NSString *path = entry.documentPath;
+                [result removeObjectsInArray:[result filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(iCloudJournalEntry *candidate, NSDictionary *bindings) {
+                    return candidate.operation == iCloudJournalOperationSave && [candidate.documentPath isEqualToString:path];
+                }]]];
+
+                // A duplicate which is deleted again never has to be made
+                iCloudJournalEntry *duplicate = lastEntry(iCloudJournalOperationDuplicate, path, YES);
+                if (duplicate) {
+                    [result removeObject:duplicate];
+                    break;
+                }
+
+                // Deleting the end of a rename chain deletes the original document, which is only done locally if every step was
+                iCloudJournalEntry *rename = nil;
+                BOOL appliedLocally = entry.appliedLocally;
+                NSUInteger insertionIndex = result.count;
+                while ((rename = lastEntry(iCloudJournalOperationRename, path, YES))) {
+                    insertionIndex = MIN(insertionIndex, [result indexOfObject:rename]);
+                    [result removeObject:rename];
+                    path = rename.documentPath;
+                    appliedLocally = appliedLocally && rename.appliedLocally;
+                }
+
+                // The original document goes where the chain started, later entries may already reuse its name
+                [result insertObject:[entry entryWithOperation:iCloudJournalOperationDelete documentPath:path destinationPath:nil sequence:entry.sequence date:entry.date appliedLocally:appliedLocally] atIndex:insertionIndex];
+                break;
+            }
+            case iCloudJournalOperationRename: {
+                // Join a rename chain, A to B then B to C is A to C, and A to B then B to A is nothing
+                NSString *sourcePath = entry.documentPath;
+                iCloudJournalEntry *previousRename = lastEntry(iCloudJournalOperationRename, sourcePath, YES);
+                if (previousRename) {
+                    [result removeObject:previousRename];
+                    sourcePath = previousRename.documentPath;
+                }
+
+                // Pending saves follow the document, its local file was moved along with it
+                NSArray *saves = [result filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(iCloudJournalEntry *candidate, NSDictionary *bindings) {
+                    return candidate.operation == iCloudJournalOperationSave && [candidate.documentPath isEqualToString:entry.documentPath];
+                }]];
+                [result removeObjectsInArray:saves];
+
+                // Duplicates of the renamed document are made from its new name
+                iCloudJournalEntry *duplicate = lastEntry(iCloudJournalOperationDuplicate, entry.documentPath, YES);
+                if (duplicate) {
+                    [result replaceObjectAtIndex:[result indexOfObject:duplicate] withObject:[duplicate entryWithOperation:iCloudJournalOperationDuplicate documentPath:duplicate.documentPath destinationPath:entry.destinationPath sequence:duplicate.sequence date:duplicate.date appliedLocally:(duplicate.appliedLocally && entry.appliedLocally)]];
+                } else if (![sourcePath isEqualToString:entry.destinationPath]) {
+                    BOOL appliedLocally = entry.appliedLocally && (previousRename == nil || previousRename.appliedLocally);
+                    [result addObject:[entry entryWithOperation:iCloudJournalOperationRename documentPath:sourcePath destinationPath:entry.destinationPath sequence:entry.sequence date:entry.date appliedLocally:appliedLocally]];
+                }
+
+                if (saves.count > 0) {
+                    iCloudJournalEntry *save = [saves lastObject];
+                    [result addObject:[save entryWithOperation:iCloudJournalOperationSave documentPath:entry.destinationPath destinationPath:nil sequence:save.sequence date:save.date appliedLocally:save.appliedLocally]];
+                }
+                break;
+            }
+            default:
+                [result addObject:entry];
+                break;
+        }
+    }
+
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Compacting the Journal ---------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Compacting the Journal
+
+- (BOOL)replaceEntriesThroughSequence:(uint64_t)sequence withEntries:(NSArray *)remainingEntries error:(NSError **)error {
+    @synchronized (self) {
+        NSMutableArray *entries = [NSMutableArray arrayWithArray:remainingEntries];
+        for (iCloudJournalEntry *entry in self.mutableEntries) {
+            if (entry.sequence > sequence) [entries addObject:entry];
+        }
+
+        if (entries.count == 0) {
+            [[NSFileManager defaultManager] removeItemAtURL:self.journalURL error:nil];
+            [self.mutableEntries removeAllObjects];
+            return YES;
+        }
+
+        NSMutableData *data = [NSMutableData dataWithData:[self fileHeader]];
+        for (iCloudJournalEntry *entry in entries) [data appendData:[self recordForEntry:entry]];
+        if (![data writeToURL:self.journalURL options:NSDataWritingAtomic error:error]) return NO;
+
+        [self.mutableEntries setArray:entries];
+        return YES;
+    }
+}
+
+- (void)removeAllEntries {
+    @synchronized (self) {
+        [[NSFileManager defaultManager] removeItemAtURL:self.journalURL error:nil];
+        [self.mutableEntries removeAllObjects];
+    }
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %lu entries>", NSStringFromClass([self class]), (unsigned long)self.count];
+}
+
+@end
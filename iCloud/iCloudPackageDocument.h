@@ -0,0 +1,59 @@
+//
+//  iCloudPackageDocument.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+    @import UIKit;
+#else
+    #import <Foundation/Foundation.h>
+    #import <UIKit/UIKit.h>
+#endif
+
+// Import iCloudDocument
+#import "iCloudDocument.h"
+
+/** Use the iCloudPackageDocument class (a subclass of iCloudDocument) to store large documents as a package of chunk files instead of a single flat file.
+ 
+ The document's contents are split into fixed-size chunk files inside a package directory, along with a small manifest that lists each chunk's length and SHA-256 digest. Chunks are marked dirty as the contents are written, and when the document is saved only the dirty chunks are written. Unchanged chunk files are carried over from the previous version of the package by the file wrapper, so an edit to a large document only writes and syncs the chunks it touches.
+ 
+ The chunking is transparent: the contents property and the iCloud class's retrieveCloudDocumentWithName:completion: method still deal in a single NSData. The iCloud class uses iCloudPackageDocument for any document that is already a package on disk, or whose extension is listed in its packageDocumentExtensions property. */
+@interface iCloudPackageDocument : iCloudDocument
+
+
+
+/** @name Chunking */
+
+/** The length of each chunk file written to the package, in bytes
+ 
+ @discussion Defaults to 1 MB. Smaller chunks reduce the bytes written per edit at the cost of more files in the package. Changing the chunk length marks every chunk as dirty for the next save. Existing packages written with a different chunk length are read correctly, since the manifest records the length of every chunk. */
+@property (assign, nonatomic) NSUInteger chunkLength;
+
+/** Replace a range of the document's contents and register the change with the undo manager
+ 
+ @discussion Only the chunks covered by the range are marked dirty, without comparing any bytes. If the replacement changes the length of the contents, every chunk from the start of the range to the end of the contents is marked dirty, since their bytes shift.
+ 
+ @param range The range of bytes to replace. It must lie within the current contents.
+ @param data The bytes to put in place of the range. This value must not be nil. */
+- (void)replaceContentsInRange:(NSRange)range withData:(NSData *)data __attribute__((nonnull));
+
+/** Retrieve the indexes of the chunks that will be written by the next save
+ 
+ @discussion Chunks are marked dirty when the contents are written. Setting the contents property (or calling setDocumentData:) compares the new contents with the previous ones chunk by chunk from both ends and marks the chunks in between. replaceContentsInRange:withData: marks the chunks of its range directly. Nothing is hashed until the dirty chunks are saved.
+ 
+ @return An index set of the dirty chunks. Chunks past the end of the previous package are always dirty. */
+- (NSIndexSet *)dirtyChunkIndexes;
+
+/** The number of chunk files written by the most recent save */
+@property (assign, readonly) NSUInteger lastSaveWrittenChunkCount;
+
+/** The number of chunk bytes written by the most recent save, excluding the manifest */
+@property (assign, readonly) unsigned long long lastSaveWrittenByteCount;
+
+@end
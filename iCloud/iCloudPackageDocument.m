@@ -0,0 +1,251 @@
+//
+//  iCloudPackageDocument.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import <CommonCrypto/CommonDigest.h>
+#import "iCloudPackageDocument.h"
+
+static NSString *const iCloudPackageManifestName = @"Manifest.plist";
+static NSInteger const iCloudPackageManifestVersion = 1;
+
+@interface iCloudPackageDocument ()
+
+/// The root directory file wrapper of the package, kept between saves so unchanged chunks are not rewritten
+@property (strong) NSFileWrapper *packageWrapper;
+
+/// Manifest entries (name, length and digest) of the chunks as they were last read or written
+@property (strong) NSArray *savedChunks;
+
+/// Chunks whose bytes were written since the package was last read or written
+@property (strong) NSMutableIndexSet *writtenChunks;
+
+/// Set while the caller marks the written chunks itself, so setting the contents does not compare them
+@property (assign) BOOL marksWrittenChunks;
+
+@property (assign, readwrite) NSUInteger lastSaveWrittenChunkCount;
+@property (assign, readwrite) unsigned long long lastSaveWrittenByteCount;
+
+/// Compute the digest of a range of bytes
+- (NSData *)digestForBytes:(const void *)bytes length:(NSUInteger)length;
+
+/// The file name of the chunk at the specified index
+- (NSString *)chunkNameAtIndex:(NSUInteger)index;
+
+/// Mark the chunks which differ between the previous and new contents as written
+- (void)markChunksWrittenFromData:(NSData *)oldData toData:(NSData *)newData;
+
+@end
+
+@implementation iCloudPackageDocument
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Document Life Cycle ------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Document Life Cycle
+
+- (instancetype)initWithFileURL:(NSURL *)url {
+    self = [super initWithFileURL:url];
+    if (self) {
+        _chunkLength = 1024 * 1024;
+        _savedChunks = @[];
+        _writtenChunks = [NSMutableIndexSet indexSet];
+        
+        // Packages are read through a file wrapper, chunk files are mapped individually by the wrapper
+        self.mappedReading = NO;
+    }
+    return self;
+}
+
+- (void)setChunkLength:(NSUInteger)chunkLength {
+    if (chunkLength == 0 || chunkLength == _chunkLength) return;
+    _chunkLength = chunkLength;
+    
+    // Chunk boundaries moved, nothing on disk can be reused
+    self.savedChunks = @[];
+    [self.writtenChunks removeAllIndexes];
+}
+
+- (void)setContents:(NSData *)contents {
+    NSData *oldData = self.contents;
+    [super setContents:contents];
+    if (self.marksWrittenChunks == NO) [self markChunksWrittenFromData:oldData toData:self.contents];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Chunking -----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Chunking
+
+- (NSString *)chunkNameAtIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"%08lu.chunk", (unsigned long)index];
+}
+
+- (NSData *)digestForBytes:(const void *)bytes length:(NSUInteger)length {
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(bytes, (CC_LONG)length, digest);
+    return [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
+
+- (void)markChunksWrittenFromData:(NSData *)oldData toData:(NSData *)newData {
+    if (oldData == newData) return;
+    
+    // Skip the chunks both contents share at the start
+    NSUInteger chunkLength = self.chunkLength;
+    NSUInteger commonLength = MIN(oldData.length, newData.length);
+    NSUInteger firstChunk = 0;
+    while ((firstChunk + 1) * chunkLength <= commonLength && memcmp((const char *)oldData.bytes + firstChunk * chunkLength, (const char *)newData.bytes + firstChunk * chunkLength, chunkLength) == 0) firstChunk++;
+    
+    NSUInteger chunkCount = (MAX(oldData.length, newData.length) + chunkLength - 1) / chunkLength;
+    if (firstChunk >= chunkCount) return;
+    
+    // A change of length shifts every following byte, otherwise skip the chunks both contents share at the end too
+    NSUInteger lastChunk = chunkCount - 1;
+    if (oldData.length == newData.length) {
+        while (lastChunk > firstChunk) {
+            NSUInteger location = lastChunk * chunkLength;
+            NSUInteger length = MIN(chunkLength, newData.length - location);
+            if (memcmp((const char *)oldData.bytes + location, (const char *)newData.bytes + location, length) != 0) break;
+            lastChunk--;
+        }
+        
+        NSUInteger location = firstChunk * chunkLength;
+        if (lastChunk == firstChunk && memcmp((const char *)oldData.bytes + location, (const char *)newData.bytes + location, MIN(chunkLength, newData.length - location)) == 0) return;
+    }
+    
+    [self.writtenChunks addIndexesInRange:NSMakeRange(firstChunk, lastChunk - firstChunk + 1)];
+}
+
+- (void)replaceContentsInRange:(NSRange)range withData:(NSData *)data {
+    NSMutableData *newData = [self.contents mutableCopy];
+    NSUInteger oldLength = newData.length;
+    [newData replaceBytesInRange:range withBytes:data.bytes length:data.length];
+    
+    // The chunks of the range are known, no need to compare the contents
+    NSUInteger chunkLength = self.chunkLength;
+    NSUInteger end = (data.length == range.length) ? range.location + range.length : MAX(oldLength, newData.length);
+    if (end > range.location) [self.writtenChunks addIndexesInRange:NSMakeRange(range.location / chunkLength, (end - 1) / chunkLength - range.location / chunkLength + 1)];
+    
+    self.marksWrittenChunks = YES;
+    [self setDocumentData:newData];
+    self.marksWrittenChunks = NO;
+}
+
+- (NSIndexSet *)dirtyChunkIndexes {
+    NSUInteger chunkCount = (self.contents.length + self.chunkLength - 1) / self.chunkLength;
+    NSMutableIndexSet *dirtyChunks = [self.writtenChunks mutableCopy];
+    
+    if (self.savedChunks.count < chunkCount) [dirtyChunks addIndexesInRange:NSMakeRange(self.savedChunks.count, chunkCount - self.savedChunks.count)];
+    if (dirtyChunks.count > 0 && dirtyChunks.lastIndex >= chunkCount) [dirtyChunks removeIndexesInRange:NSMakeRange(chunkCount, dirtyChunks.lastIndex - chunkCount + 1)];
+    
+    return dirtyChunks;
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Loading and Saving -------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Loading and Saving
+
+- (id)contentsForType:(NSString *)typeName error:(NSError **)outError {
+    NSData *contents = self.contents ?: [NSData data];
+    NSIndexSet *dirtyChunks = [self dirtyChunkIndexes];
+    
+    if (!self.packageWrapper) self.packageWrapper = [[NSFileWrapper alloc] initDirectoryWithFileWrappers:@{}];
+    NSDictionary *existingWrappers = self.packageWrapper.fileWrappers;
+    
+    NSMutableArray *chunks = [NSMutableArray array];
+    NSUInteger writtenChunkCount = 0;
+    unsigned long long writtenByteCount = 0;
+    
+    NSUInteger index = 0;
+    for (NSUInteger location = 0; location < contents.length; location += self.chunkLength, index++) {
+        NSUInteger length = MIN(self.chunkLength, contents.length - location);
+        NSString *chunkName = [self chunkNameAtIndex:index];
+        
+        if ([dirtyChunks containsIndex:index] || !existingWrappers[chunkName]) {
+            // Replace the chunk file, clean chunks keep their wrapper and are not rewritten
+            if (existingWrappers[chunkName]) [self.packageWrapper removeFileWrapper:existingWrappers[chunkName]];
+            
+            NSData *chunkData = [contents subdataWithRange:NSMakeRange(location, length)];
+            NSFileWrapper *chunkWrapper = [[NSFileWrapper alloc] initRegularFileWithContents:chunkData];
+            chunkWrapper.preferredFilename = chunkName;
+            [self.packageWrapper addFileWrapper:chunkWrapper];
+            
+            [chunks addObject:@{@"name": chunkName, @"length": @(length), @"digest": [self digestForBytes:chunkData.bytes length:length]}];
+            writtenChunkCount++;
+            writtenByteCount += length;
+        } else {
+            [chunks addObject:self.savedChunks[index]];
+        }
+    }
+    
+    // Remove chunks past the end of the (shorter) contents
+    for (NSString *fileName in [existingWrappers allKeys]) {
+        if (![fileName.pathExtension isEqualToString:@"chunk"]) continue;
+        if ([[fileName stringByDeletingPathExtension] integerValue] < (NSInteger)index) continue;
+        [self.packageWrapper removeFileWrapper:existingWrappers[fileName]];
+    }
+    
+    // Write the manifest
+    NSDictionary *manifest = @{@"version": @(iCloudPackageManifestVersion), @"length": @(contents.length), @"chunks": chunks};
+    NSData *manifestData = [NSPropertyListSerialization dataWithPropertyList:manifest format:NSPropertyListBinaryFormat_v1_0 options:0 error:outError];
+    if (!manifestData) return nil;
+    
+    NSFileWrapper *existingManifest = self.packageWrapper.fileWrappers[iCloudPackageManifestName];
+    if (existingManifest) [self.packageWrapper removeFileWrapper:existingManifest];
+    [self.packageWrapper addRegularFileWithContents:manifestData preferredFilename:iCloudPackageManifestName];
+    
+    self.savedChunks = chunks;
+    [self.writtenChunks removeAllIndexes];
+    self.lastSaveWrittenChunkCount = writtenChunkCount;
+    self.lastSaveWrittenByteCount = writtenByteCount;
+    
+    return self.packageWrapper;
+}
+
+- (BOOL)loadFromContents:(id)fileContents ofType:(NSString *)typeName error:(NSError **)outError {
+    // A flat file at the package URL (e.g. written by an older version) is loaded as-is and converted on the next save
+    if (![fileContents isKindOfClass:[NSFileWrapper class]]) {
+        self.packageWrapper = nil;
+        self.savedChunks = @[];
+        [self.writtenChunks removeAllIndexes];
+        return [super loadFromContents:fileContents ofType:typeName error:outError];
+    }
+    
+    NSFileWrapper *packageWrapper = fileContents;
+    NSData *manifestData = [packageWrapper.fileWrappers[iCloudPackageManifestName] regularFileContents];
+    NSDictionary *manifest = manifestData ? [NSPropertyListSerialization propertyListWithData:manifestData options:NSPropertyListImmutable format:NULL error:nil] : nil;
+    
+    if (![manifest isKindOfClass:[NSDictionary class]] || [manifest[@"version"] integerValue] > iCloudPackageManifestVersion) {
+        if (outError) *outError = [NSError errorWithDomain:[NSString stringWithFormat:@"The package document, %@, has a missing or unsupported manifest", self.localizedName] code:520 userInfo:@{@"FileURL": self.fileURL}];
+        return NO;
+    }
+    
+    // Reassemble the chunks into a single buffer
+    NSArray *chunks = manifest[@"chunks"];
+    NSMutableData *contents = [NSMutableData dataWithCapacity:[manifest[@"length"] unsignedIntegerValue]];
+    for (NSDictionary *chunk in chunks) {
+        NSData *chunkData = [packageWrapper.fileWrappers[chunk[@"name"]] regularFileContents];
+        if (chunkData.length != [chunk[@"length"] unsignedIntegerValue]) {
+            if (outError) *outError = [NSError errorWithDomain:[NSString stringWithFormat:@"The package document, %@, is missing data for chunk %@", self.localizedName, chunk[@"name"]] code:520 userInfo:@{@"FileURL": self.fileURL}];
+            return NO;
+        }
+        [contents appendData:chunkData];
+    }
+    
+    self.packageWrapper = packageWrapper;
+    self.savedChunks = chunks;
+    [self.writtenChunks removeAllIndexes];
+    
+    // The loaded contents match the package, there is nothing to compare
+    self.marksWrittenChunks = YES;
+    BOOL success = [super loadFromContents:contents ofType:typeName error:outError];
+    self.marksWrittenChunks = NO;
+    
+    return success;
+}
+
+@end
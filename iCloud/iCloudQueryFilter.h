@@ -0,0 +1,95 @@
+//
+//  iCloudQueryFilter.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** An iCloudQueryFilter describes which iCloud documents the iCloud class reports to its delegate.
+
+ The iCloud class keeps gathering and indexing every document in the container, so existence and attribute checks, downloads and conflict resolution are never affected by the filter. The filter is applied when changes are delivered to the delegate: documents which do not match are left out of the file lists, and documents which start or stop matching are reported as inserted or deleted. Every criterion is optional; a document must match all of the criteria which are set.
+
+ Assign the filter to the queryFilter property of the iCloud class. Filters are copied when assigned, so changing a filter afterwards has no effect until it is assigned again. */
+@interface iCloudQueryFilter : NSObject <NSCopying>
+
+
+
+/** @name Creating a Filter */
+
+/** Create a filter which only matches documents with one of the specified file extensions
+
+ @param fileExtensions File extensions without the leading period, for example @[@"txt", @"md"]. This value must not be nil.
+ @return A new filter */
++ (instancetype)filterWithFileExtensions:(NSArray *)fileExtensions __attribute__((nonnull));
+
+
+
+/** @name Names */
+
+/** Only match documents with one of these file extensions (NSString, without the leading period, case insensitive). Defaults to nil. */
+@property (copy) NSArray *fileExtensions;
+
+/** Only match documents whose name begins with this string (case insensitive). Defaults to nil. */
+@property (copy) NSString *namePrefix;
+
+/** Only match documents whose name matches this glob pattern, where * matches any run of characters and ? matches one character (case insensitive). Defaults to nil. */
+@property (copy) NSString *nameGlob;
+
+
+
+/** @name Size and Dates */
+
+/** Only match documents of at least this many bytes. Defaults to nil. */
+@property (copy) NSNumber *minimumFileSize;
+
+/** Only match documents of at most this many bytes. Defaults to nil. */
+@property (copy) NSNumber *maximumFileSize;
+
+/** Only match documents modified on or after this date. Defaults to nil. */
+@property (copy) NSDate *modifiedAfter;
+
+/** Only match documents modified on or before this date. Defaults to nil. */
+@property (copy) NSDate *modifiedBefore;
+
+
+
+/** @name Status */
+
+/** Only match documents with one of these downloading statuses (NSMetadataUbiquitousItemDownloadingStatusNotDownloaded, NSMetadataUbiquitousItemDownloadingStatusDownloaded or NSMetadataUbiquitousItemDownloadingStatusCurrent). Defaults to nil. */
+@property (copy) NSSet *downloadingStatuses;
+
+/** Set to @YES to only match documents with unresolved conflicts, or @NO to only match documents without them. Defaults to nil. */
+@property (copy) NSNumber *hasUnresolvedConflicts;
+
+
+
+/** @name Compiling the Filter */
+
+/** The predicate equivalent to the filter, using NSMetadataItem attribute keys
+
+ @discussion The predicate can be evaluated against metadata entries, for example to narrow the iCloud class's metadataSnapshot, or set as the predicate of an iCloudFolderQuery.
+
+ @return The compiled predicate, or nil if no criteria are set */
+- (NSPredicate *)predicate;
+
+/** Check whether a metadata entry matches the filter
+
+ @discussion This is how the iCloud class applies the filter to the metadata index. The name pattern is compiled once and reused by later calls. Missing attributes count as a mismatch, except for the conflict status, which counts as no conflicts.
+
+ @param entry A metadata entry keyed by NSMetadataItem attribute keys. This value must not be nil.
+ @return YES if the entry matches every criterion which is set */
+- (BOOL)evaluateEntry:(NSDictionary *)entry __attribute__((nonnull));
+
+/** YES if no criteria are set */
+@property (assign, readonly, getter=isEmpty) BOOL empty;
+
+@end
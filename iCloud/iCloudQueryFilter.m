@@ -0,0 +1,145 @@
+//
+//  iCloudQueryFilter.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudQueryFilter.h"
+
+@interface iCloudQueryFilter ()
+
+/// The nameGlob pattern compiled by globPredicate, and the predicate compiled from it
+@property (copy) NSString *compiledGlob;
+@property (strong) NSPredicate *compiledGlobPredicate;
+
+/// The predicate matching nameGlob, compiled once and reused until nameGlob changes
+- (NSPredicate *)globPredicate;
+
+/// Escape the characters which LIKE treats as wildcards
+- (NSString *)escapedLikePattern:(NSString *)string;
+
+@end
+
+@implementation iCloudQueryFilter
+
++ (instancetype)filterWithFileExtensions:(NSArray *)fileExtensions {
+    iCloudQueryFilter *filter = [[self alloc] init];
+    filter.fileExtensions = fileExtensions;
+    return filter;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    iCloudQueryFilter *filter = [[[self class] allocWithZone:zone] init];
+    filter.fileExtensions = self.fileExtensions;
+    filter.namePrefix = self.namePrefix;
+    filter.nameGlob = self.nameGlob;
+    filter.minimumFileSize = self.minimumFileSize;
+    filter.maximumFileSize = self.maximumFileSize;
+    filter.modifiedAfter = self.modifiedAfter;
+    filter.modifiedBefore = self.modifiedBefore;
+    filter.downloadingStatuses = self.downloadingStatuses;
+    filter.hasUnresolvedConflicts = self.hasUnresolvedConflicts;
+    return filter;
+}
+
+- (BOOL)isEmpty {
+    return self.fileExtensions.count == 0 && self.namePrefix.length == 0 && self.nameGlob.length == 0 && self.minimumFileSize == nil && self.maximumFileSize == nil && self.modifiedAfter == nil && self.modifiedBefore == nil && self.downloadingStatuses.count == 0 && self.hasUnresolvedConflicts == nil;
+}
+
+- (NSString *)escapedLikePattern:(NSString *)string {
+    NSString *escaped = [string stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"];
+    escaped = [escaped stringByReplacingOccurrencesOfString:@"*" withString:@"\\*"];
+    return [escaped stringByReplacingOccurrencesOfString:@"?" withString:@"\\?"];
+}
+
+- (NSPredicate *)globPredicate {
+    @synchronized (self) {
+        NSString *nameGlob = self.nameGlob;
+        if (self.compiledGlobPredicate == nil || ![self.compiledGlob isEqualToString:nameGlob]) {
+            self.compiledGlob = nameGlob;
+            self.compiledGlobPredicate = [NSPredicate predicateWithFormat:@"SELF LIKE[c] %@", nameGlob];
+        }
+        return self.compiledGlobPredicate;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Compiling ----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Compiling
+
+- (NSPredicate *)predicate {
+    NSMutableArray *subpredicates = [NSMutableArray array];
+
+    if (self.fileExtensions.count > 0) {
+        NSMutableArray *extensionPredicates = [NSMutableArray arrayWithCapacity:self.fileExtensions.count];
+        for (NSString *fileExtension in self.fileExtensions) {
+            NSString *pattern = [@"*." stringByAppendingString:[self escapedLikePattern:fileExtension]];
+            [extensionPredicates addObject:[NSPredicate predicateWithFormat:@"%K LIKE[c] %@", NSMetadataItemFSNameKey, pattern]];
+        }
+        [subpredicates addObject:[NSCompoundPredicate orPredicateWithSubpredicates:extensionPredicates]];
+    }
+
+    if (self.namePrefix.length > 0) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K BEGINSWITH[c] %@", NSMetadataItemFSNameKey, self.namePrefix]];
+    if (self.nameGlob.length > 0) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K LIKE[c] %@", NSMetadataItemFSNameKey, self.nameGlob]];
+
+    if (self.minimumFileSize) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K >= %@", NSMetadataItemFSSizeKey, self.minimumFileSize]];
+    if (self.maximumFileSize) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K <= %@", NSMetadataItemFSSizeKey, self.maximumFileSize]];
+
+    if (self.modifiedAfter) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K >= %@", NSMetadataItemFSContentChangeDateKey, self.modifiedAfter]];
+    if (self.modifiedBefore) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K <= %@", NSMetadataItemFSContentChangeDateKey, self.modifiedBefore]];
+
+    if (self.downloadingStatuses.count > 0) {
+        NSMutableArray *statusPredicates = [NSMutableArray arrayWithCapacity:self.downloadingStatuses.count];
+        for (NSString *status in self.downloadingStatuses) {
+            [statusPredicates addObject:[NSPredicate predicateWithFormat:@"%K == %@", NSMetadataUbiquitousItemDownloadingStatusKey, status]];
+        }
+        [subpredicates addObject:[NSCompoundPredicate orPredicateWithSubpredicates:statusPredicates]];
+    }
+
+    if (self.hasUnresolvedConflicts) [subpredicates addObject:[NSPredicate predicateWithFormat:@"%K == %@", NSMetadataUbiquitousItemHasUnresolvedConflictsKey, @([self.hasUnresolvedConflicts boolValue])]];
+
+    if (subpredicates.count == 0) return nil;
+    if (subpredicates.count == 1) return subpredicates[0];
+    return [NSCompoundPredicate andPredicateWithSubpredicates:subpredicates];
+}
+
+- (BOOL)evaluateEntry:(NSDictionary *)entry {
+    NSString *name = entry[NSMetadataItemFSNameKey];
+
+    if (self.fileExtensions.count > 0) {
+        NSString *entryExtension = [name pathExtension];
+        BOOL matchesExtension = NO;
+        for (NSString *fileExtension in self.fileExtensions) {
+            if ([entryExtension caseInsensitiveCompare:fileExtension] == NSOrderedSame) {
+                matchesExtension = YES;
+                break;
+            }
+        }
+        if (!matchesExtension) return NO;
+    }
+
+    if (self.namePrefix.length > 0 && ![[name lowercaseString] hasPrefix:[self.namePrefix lowercaseString]]) return NO;
+    if (self.nameGlob.length > 0 && ![[self globPredicate] evaluateWithObject:name]) return NO;
+
+    NSNumber *fileSize = entry[NSMetadataItemFSSizeKey];
+    if (self.minimumFileSize && (fileSize == nil || [fileSize compare:self.minimumFileSize] == NSOrderedAscending)) return NO;
+    if (self.maximumFileSize && (fileSize == nil || [fileSize compare:self.maximumFileSize] == NSOrderedDescending)) return NO;
+
+    NSDate *modifiedDate = entry[NSMetadataItemFSContentChangeDateKey];
+    if (self.modifiedAfter && (modifiedDate == nil || [modifiedDate compare:self.modifiedAfter] == NSOrderedAscending)) return NO;
+    if (self.modifiedBefore && (modifiedDate == nil || [modifiedDate compare:self.modifiedBefore] == NSOrderedDescending)) return NO;
+
+    if (self.downloadingStatuses.count > 0 && ![self.downloadingStatuses containsObject:entry[NSMetadataUbiquitousItemDownloadingStatusKey] ?: @""]) return NO;
+    if (self.hasUnresolvedConflicts && [entry[NSMetadataUbiquitousItemHasUnresolvedConflictsKey] boolValue] != [self.hasUnresolvedConflicts boolValue]) return NO;
+
+    return YES;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %@>", NSStringFromClass([self class]), [self predicate] ?: @"all documents"];
+}
+
+@end
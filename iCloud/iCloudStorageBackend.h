@@ -0,0 +1,105 @@
+//
+//  iCloudStorageBackend.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The parts of NSFileVersion the iCloud class uses to resolve conflicts. NSFileVersion conforms to it, and backends which simulate conflicts return their own versions. */
+@protocol iCloudFileVersion <NSObject>
+
+/** The location of the contents of the version */
+@property (readonly, copy) NSURL *URL;
+
+/** The date the version was last modified */
+@property (readonly, copy) NSDate *modificationDate;
+
+/** The name of the device the version was saved on, if known */
+@property (readonly, copy) NSString *localizedNameOfSavingComputer;
+
+/** Whether the conflict of the version has been resolved */
+@property (getter=isResolved) BOOL resolved;
+
+/** Replace the item at a URL with the contents of the version */
+- (NSURL *)replaceItemAtURL:(NSURL *)url options:(NSFileVersionReplacingOptions)options error:(NSError **)error;
+
+@end
+
+
+/** The iCloudStorageBackend protocol defines the container access the iCloud class needs beyond plain file management.
+ 
+ The iCloud class performs all of its file management through an NSFileManager (its fileManager property), and all ubiquity-specific access, file versions and file coordination included, through the methods of this protocol. NSFileManager already implements every required method, so the default backend is simply [NSFileManager defaultManager]. A backend may be an NSFileManager subclass which changes where the container lives and how it behaves, such as iCloudLocalBackend, which simulates a ubiquity container in a local directory for testing and benchmarking.
+ 
+ Backends which cannot be observed by NSMetadataQuery implement the optional metadata methods, in which case the iCloud class uses them instead of its query. */
+@protocol iCloudStorageBackend <NSObject>
+
+
+/** @name Required Methods */
+
+@required
+
+/** Returns the URL of the ubiquity container with the specified identifier, or nil if it is not available */
+- (NSURL *)URLForUbiquityContainerIdentifier:(NSString *)containerIdentifier;
+
+/** Returns an opaque token for the current iCloud identity, or nil if iCloud is not available */
+- (id <NSObject, NSCopying, NSCoding>)ubiquityIdentityToken;
+
+/** Moves an item into or out of the ubiquity container */
+- (BOOL)setUbiquitous:(BOOL)flag itemAtURL:(NSURL *)url destinationURL:(NSURL *)destinationURL error:(NSError **)error;
+
+/** Starts downloading a ubiquitous item which is not available locally */
+- (BOOL)startDownloadingUbiquitousItemAtURL:(NSURL *)url error:(NSError **)error;
+
+/** Removes the local copy of a ubiquitous item, keeping it in the container */
+- (BOOL)evictUbiquitousItemAtURL:(NSURL *)url error:(NSError **)error;
+
+/** Returns a URL which can be used to share a ubiquitous item */
+- (NSURL *)URLForPublishingUbiquitousItemAtURL:(NSURL *)url expirationDate:(NSDate **)outDate error:(NSError **)error;
+
+/** Returns the versions (id <iCloudFileVersion>) of an item which conflict with its current version and are not resolved yet */
+- (NSArray *)unresolvedConflictVersionsOfItemAtURL:(NSURL *)url;
+
+/** Returns the current version of an item */
+- (id <iCloudFileVersion>)currentVersionOfItemAtURL:(NSURL *)url;
+
+/** Removes every version of an item other than the current one */
+- (BOOL)removeOtherVersionsOfItemAtURL:(NSURL *)url error:(NSError **)error;
+
+/** Returns a file coordinator for the coordinated reads and writes the iCloud class and its conflict resolver make in the container */
+- (NSFileCoordinator *)fileCoordinatorWithFilePresenter:(id <NSFilePresenter>)filePresenter;
+
+
+/** @name Optional Metadata Methods */
+
+@optional
+
+/** Start reporting the metadata of the items in a directory
+ 
+ @discussion The handler is called on a serial queue owned by the backend. The first call is a full pass listing every item, later calls list the items which were added or changed and the document paths of the items which were removed. Items in subfolders of the directory are reported too. Each entry is a dictionary keyed by NSMetadataItemFSNameKey, NSMetadataItemURLKey, NSMetadataItemFSSizeKey, NSMetadataItemFSContentChangeDateKey, NSMetadataItemFSCreationDateKey, NSMetadataUbiquitousItemDownloadingStatusKey and iCloudMetadataItemDocumentPathKey (the item's path relative to the directory), exactly like the entries the iCloud class builds from NSMetadataQuery results.
+ 
+ @param directoryURL The directory to observe
+ @param handler Called with the entries which were added or changed, the names of the removed items, and whether the call is a full pass */
+- (void)startMetadataUpdatesForDirectoryAtURL:(NSURL *)directoryURL handler:(void (^)(NSArray *entries, NSArray *removedNames, BOOL fullPass))handler;
+
+/** Stop reporting metadata started with startMetadataUpdatesForDirectoryAtURL:handler: */
+- (void)stopMetadataUpdates;
+
+@end
+
+
+/** NSFileManager is the default storage backend, it talks to the real ubiquity container */
+@interface NSFileManager (iCloudStorageBackend) <iCloudStorageBackend>
+@end
+
+/** NSFileVersion is the version type of the default storage backend */
+@interface NSFileVersion (iCloudStorageBackend) <iCloudFileVersion>
+@end
@@ -0,0 +1,34 @@
+//
+//  iCloudStorageBackend.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudStorageBackend.h"
+
+// NSFileManager implements the ubiquity methods of the protocol already, file versions come from NSFileVersion
+@implementation NSFileManager (iCloudStorageBackend)
+
+- (NSArray *)unresolvedConflictVersionsOfItemAtURL:(NSURL *)url {
+    return [NSFileVersion unresolvedConflictVersionsOfItemAtURL:url];
+}
+
+- (id <iCloudFileVersion>)currentVersionOfItemAtURL:(NSURL *)url {
+    return [NSFileVersion currentVersionOfItemAtURL:url];
+}
+
+- (BOOL)removeOtherVersionsOfItemAtURL:(NSURL *)url error:(NSError **)error {
+    return [NSFileVersion removeOtherVersionsOfItemAtURL:url error:error];
+}
+
+- (NSFileCoordinator *)fileCoordinatorWithFilePresenter:(id <NSFilePresenter>)filePresenter {
+    return [[NSFileCoordinator alloc] initWithFilePresenter:filePresenter];
+}
+
+@end
+
+// NSFileVersion declares every member of the version protocol
+@implementation NSFileVersion (iCloudStorageBackend)
+@end
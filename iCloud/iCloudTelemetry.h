@@ -0,0 +1,122 @@
+//
+//  iCloudTelemetry.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+#else
+    #import <Foundation/Foundation.h>
+#endif
+
+/** The operations measured by iCloudTelemetry */
+typedef NS_ENUM(NSUInteger, iCloudTelemetryOperation) {
+    /// Saving a document, from the save request to the document being closed
+    iCloudTelemetryOperationSave = 0,
+    /// Opening a document which was not already open
+    iCloudTelemetryOperationOpen,
+    /// Applying a (possibly coalesced) metadata update to the index
+    iCloudTelemetryOperationUpdatePass,
+    /// Asking the system to download an item
+    iCloudTelemetryOperationDownloadStart,
+    /// Finding or resolving a conflict
+    iCloudTelemetryOperationConflict,
+    /// Uploading a local document to iCloud
+    iCloudTelemetryOperationUpload,
+    /// Deleting, renaming or duplicating a document
+    iCloudTelemetryOperationFileOperation,
+    /// From setup to the first file list handed to the delegate, restored from disk or gathered live
+    iCloudTelemetryOperationFirstFileList,
+    /// Queueing a failed or timed out download again
+    iCloudTelemetryOperationDownloadRetry,
+    /// Deleting, renaming or duplicating a batch of documents, from the request to the completion handler
+    iCloudTelemetryOperationBatch,
+    /// The number of operations, not an operation itself
+    iCloudTelemetryOperationCount
+};
+
+@protocol iCloudTelemetrySink;
+
+/** The iCloudTelemetry class records counters and latency histograms for the operations performed by the iCloud class.
+ 
+ Recording is lock-free while no sink receives spans: every operation has a fixed set of atomic counters and a histogram of power-of-two microsecond buckets, so recording a span costs a few atomic increments and never blocks. Whether the sink receives spans is checked once, when it is set. While such a sink is set, every span also reads the weak sink reference, which takes the runtime's weak reference lock. When telemetry is disabled, beginning a span returns 0 without reading the clock and ending it returns immediately.
+ 
+ Recorded spans and log messages can be forwarded to a sink, for example to ship them to your own analytics. Forwarding happens asynchronously on a private serial queue, never on the thread doing the work. Use snapshot to read the aggregated statistics at any time. */
+@interface iCloudTelemetry : NSObject
+
+
+
+/** @name Recording */
+
+/** Begin timing an operation
+ 
+ @return An opaque start time to pass to endSpan:forOperation:, or 0 if telemetry is disabled */
+- (uint64_t)beginSpan;
+
+/** Finish timing an operation and record its duration
+ 
+ @param start The value returned by beginSpan. Spans which began while telemetry was disabled are ignored.
+ @param operation The operation which was timed */
+- (void)endSpan:(uint64_t)start forOperation:(iCloudTelemetryOperation)operation;
+
+/** Count an operation which is not timed
+ 
+ @param operation The operation which occured */
+- (void)incrementCounterForOperation:(iCloudTelemetryOperation)operation;
+
+/** Log a diagnostic message
+ 
+ @discussion The message is formatted and forwarded to the sink if it accepts messages, otherwise it is written with NSLog on a background queue so the caller never waits for the log to be written.
+ 
+ @param format A format string, followed by its arguments */
+- (void)log:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
+
+
+
+
+/** @name Reading */
+
+/** Get the statistics recorded so far
+ 
+ @return A dictionary keyed by operation name (save, open, updatePass, downloadStart, conflict, upload, fileOperation, firstFileList, downloadRetry, batch). Each value is a dictionary with the count, the totalDuration, meanDuration and maxDuration in seconds, the p50, p90 and p99 durations in seconds estimated from the histogram, and the raw histogram as an array of bucket counts where bucket i holds durations below 2^i microseconds. */
+- (NSDictionary *)snapshot;
+
+/** Clear every counter and histogram */
+- (void)reset;
+
+
+
+
+/** @name Properties */
+
+/** Record spans and counters. The default value is YES. Logging is not affected by this property. */
+@property (assign, nonatomic) BOOL enabled;
+
+/** The sink which receives recorded spans and log messages, or nil */
+@property (weak) id <iCloudTelemetrySink> sink;
+
+@end
+
+
+/** The iCloudTelemetrySink protocol defines the methods used to receive telemetry as it is recorded. Methods are called on a private serial queue. */
+@protocol iCloudTelemetrySink <NSObject>
+
+@optional
+
+/** Called when a span or counter was recorded
+ 
+ @param operation The operation which was recorded
+ @param duration The duration of the span in seconds, or 0 for counters */
+- (void)telemetryDidRecordOperation:(iCloudTelemetryOperation)operation duration:(NSTimeInterval)duration;
+
+/** Called with every diagnostic message instead of writing it to the console
+ 
+ @param message The formatted message */
+- (void)telemetryDidLogMessage:(NSString *)message;
+
+@end
@@ -0,0 +1,201 @@
+//
+//  iCloudTelemetry.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import <mach/mach_time.h>
+#import <stdatomic.h>
+#import "iCloudTelemetry.h"
+
+/// Histogram buckets, bucket i counts durations below 2^i microseconds (the last bucket is open ended)
+#define ICLOUD_TELEMETRY_BUCKETS 40
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t totalMicroseconds;
+    _Atomic uint64_t maxMicroseconds;
+    _Atomic uint64_t buckets[ICLOUD_TELEMETRY_BUCKETS];
+} iCloudTelemetryStats;
+
+@interface iCloudTelemetry () {
+    iCloudTelemetryStats _stats[iCloudTelemetryOperationCount];
+    _Atomic bool _enabled;
+    _Atomic bool _sinkRecordsOperations;
+    __weak id <iCloudTelemetrySink> _sink;
+}
+
+/// Serial queue on which the sink and the console are written
+@property (strong) dispatch_queue_t sinkQueue;
+
+/// Record one sample, duration is in microseconds
+- (void)recordOperation:(iCloudTelemetryOperation)operation microseconds:(uint64_t)microseconds timed:(BOOL)timed;
+
+@end
+
+@implementation iCloudTelemetry
+
+static mach_timebase_info_data_t iCloudTelemetryTimebase;
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+            mach_timebase_info(&iCloudTelemetryTimebase);
+        });
+        
+        _sinkQueue = dispatch_queue_create("com.iRareMedia.iCloud.telemetry", DISPATCH_QUEUE_SERIAL);
+        atomic_init(&_enabled, true);
+        atomic_init(&_sinkRecordsOperations, false);
+        [self reset];
+    }
+    return self;
+}
+
+- (BOOL)enabled {
+    return atomic_load_explicit(&_enabled, memory_order_relaxed);
+}
+
+- (void)setEnabled:(BOOL)enabled {
+    atomic_store_explicit(&_enabled, enabled, memory_order_relaxed);
+}
+
+- (id <iCloudTelemetrySink>)sink {
+    return _sink;
+}
+
+- (void)setSink:(id <iCloudTelemetrySink>)sink {
+    // Reading a weak reference takes a lock, so recording only reads the sink when it wants spans
+    _sink = sink;
+    atomic_store_explicit(&_sinkRecordsOperations, [sink respondsToSelector:@selector(telemetryDidRecordOperation:duration:)], memory_order_release);
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Recording ----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Recording
+
+- (uint64_t)beginSpan {
+    if (!atomic_load_explicit(&_enabled, memory_order_relaxed)) return 0;
+    return mach_absolute_time();
+}
+
+- (void)endSpan:(uint64_t)start forOperation:(iCloudTelemetryOperation)operation {
+    if (start == 0 || operation >= iCloudTelemetryOperationCount) return;
+    
+    uint64_t elapsed = mach_absolute_time() - start;
+    uint64_t microseconds = elapsed * iCloudTelemetryTimebase.numer / iCloudTelemetryTimebase.denom / 1000;
+    [self recordOperation:operation microseconds:microseconds timed:YES];
+}
+
+- (void)incrementCounterForOperation:(iCloudTelemetryOperation)operation {
+    if (!atomic_load_explicit(&_enabled, memory_order_relaxed) || operation >= iCloudTelemetryOperationCount) return;
+    [self recordOperation:operation microseconds:0 timed:NO];
+}
+
+- (void)recordOperation:(iCloudTelemetryOperation)operation microseconds:(uint64_t)microseconds timed:(BOOL)timed {
+    iCloudTelemetryStats *stats = &_stats[operation];
+    atomic_fetch_add_explicit(&stats->count, 1, memory_order_relaxed);
+    
+    if (timed) {
+        atomic_fetch_add_explicit(&stats->totalMicroseconds, microseconds, memory_order_relaxed);
+        
+        uint64_t currentMax = atomic_load_explicit(&stats->maxMicroseconds, memory_order_relaxed);
+        while (microseconds > currentMax && !atomic_compare_exchange_weak_explicit(&stats->maxMicroseconds, &currentMax, microseconds, memory_order_relaxed, memory_order_relaxed));
+        
+        // Bucket by the position of the highest set bit
+        NSUInteger bucket = microseconds == 0 ? 0 : (NSUInteger)(64 - __builtin_clzll(microseconds));
+        if (bucket >= ICLOUD_TELEMETRY_BUCKETS) bucket = ICLOUD_TELEMETRY_BUCKETS - 1;
+        atomic_fetch_add_explicit(&stats->buckets[bucket], 1, memory_order_relaxed);
+    }
+    
+    if (!atomic_load_explicit(&_sinkRecordsOperations, memory_order_acquire)) return;
+    
+    id <iCloudTelemetrySink> sink = _sink;
+    if (sink) {
+        NSTimeInterval duration = microseconds / 1000000.0;
+        dispatch_async(self.sinkQueue, ^{
+            [sink telemetryDidRecordOperation:operation duration:duration];
+        });
+    }
+}
+
+- (void)log:(NSString *)format, ... {
+    va_list arguments;
+    va_start(arguments, format);
+    NSString *message = [[NSString alloc] initWithFormat:format arguments:arguments];
+    va_end(arguments);
+    
+    id <iCloudTelemetrySink> sink = self.sink;
+    dispatch_async(self.sinkQueue, ^{
+        if ([sink respondsToSelector:@selector(telemetryDidLogMessage:)]) [sink telemetryDidLogMessage:message];
+        else NSLog(@"%@", message);
+    });
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Reading ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Reading
+
+- (NSDictionary *)snapshot {
+    static NSArray *operationNames = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        operationNames = @[@"save", @"open", @"updatePass", @"downloadStart", @"conflict", @"upload", @"fileOperation", @"firstFileList", @"downloadRetry", @"batch"];
+    });
+    
+    NSMutableDictionary *snapshot = [NSMutableDictionary dictionaryWithCapacity:iCloudTelemetryOperationCount];
+    for (NSUInteger operation = 0; operation < iCloudTelemetryOperationCount; operation++) {
+        iCloudTelemetryStats *stats = &_stats[operation];
+        
+        uint64_t buckets[ICLOUD_TELEMETRY_BUCKETS];
+        uint64_t timedCount = 0;
+        NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:ICLOUD_TELEMETRY_BUCKETS];
+        for (NSUInteger bucket = 0; bucket < ICLOUD_TELEMETRY_BUCKETS; bucket++) {
+            buckets[bucket] = atomic_load_explicit(&stats->buckets[bucket], memory_order_relaxed);
+            timedCount += buckets[bucket];
+            [histogram addObject:@(buckets[bucket])];
+        }
+        
+        // Estimate percentiles as the upper bound of the bucket holding them
+        double (^percentile)(double) = ^double(double fraction) {
+            if (timedCount == 0) return 0;
+            uint64_t rank = (uint64_t)ceil(fraction * timedCount);
+            uint64_t seen = 0;
+            for (NSUInteger bucket = 0; bucket < ICLOUD_TELEMETRY_BUCKETS; bucket++) {
+                seen += buckets[bucket];
+                if (seen >= rank) return ldexp(1.0, (int)bucket) / 1000000.0;
+            }
+            return ldexp(1.0, ICLOUD_TELEMETRY_BUCKETS - 1) / 1000000.0;
+        };
+        
+        uint64_t count = atomic_load_explicit(&stats->count, memory_order_relaxed);
+        double total = atomic_load_explicit(&stats->totalMicroseconds, memory_order_relaxed) / 1000000.0;
+        snapshot[operationNames[operation]] = @{@"count": @(count),
+                                               @"totalDuration": @(total),
+                                               @"meanDuration": @(timedCount > 0 ? total / timedCount : 0),
+                                               @"maxDuration": @(atomic_load_explicit(&stats->maxMicroseconds, memory_order_relaxed) / 1000000.0),
+                                               @"p50": @(percentile(0.50)),
+                                               @"p90": @(percentile(0.90)),
+                                               @"p99": @(percentile(0.99)),
+                                               @"histogram": histogram};
+    }
+    
+    return snapshot;
+}
+
+- (void)reset {
+    for (NSUInteger operation = 0; operation < iCloudTelemetryOperationCount; operation++) {
+        iCloudTelemetryStats *stats = &_stats[operation];
+        atomic_store_explicit(&stats->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&stats->totalMicroseconds, 0, memory_order_relaxed);
+        atomic_store_explicit(&stats->maxMicroseconds, 0, memory_order_relaxed);
+        for (NSUInteger bucket = 0; bucket < ICLOUD_TELEMETRY_BUCKETS; bucket++) atomic_store_explicit(&stats->buckets[bucket], 0, memory_order_relaxed);
+    }
+}
+
+@end
@@ -0,0 +1,98 @@
+//
+//  iCloudWriteBehindBuffer.h
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+// Check for Objective-C Modules
+#if __has_feature(objc_modules)
+    // We recommend enabling Objective-C Modules in your project Build Settings for numerous benefits over regular #imports. Read more from the Modules documentation: http://clang.llvm.org/docs/Modules.html
+    @import Foundation;
+    @import UIKit;
+#else
+    #import <Foundation/Foundation.h>
+    #import <UIKit/UIKit.h>
+#endif
+
+/** The iCloudWriteBehindBuffer class holds the latest content of documents which are edited faster than they need to be written.
+
+ Each call to bufferContent:forDocumentWithName:completion: replaces the buffered content of the document and adds the handler to the ones waiting for it. The content is written once, through writeHandler, after the document has not been changed for idleDelay seconds, or at the latest maximumStaleness seconds after its first unwritten change. Every waiting handler is then called with the result of that single write. Content buffered while a write of the same document is in flight is written after that write lands, so writes of a document never overlap and always land in order.
+
+ Buffered documents are also written when flushDocumentWithName:completion: or flushAllDocumentsWithCompletion: is called, and when the application enters the background, in which case a background task keeps the application running until the writes have landed.
+
+ The iCloud class owns a buffer and uses it from saveChangesToDocumentWithName:withContent:completion: when the buffer is enabled. Retrieving, renaming or duplicating a document flushes it first, deleting a document discards its buffered content, and saving it with saveAndCloseDocumentWithName:withContent:completion: replaces its buffered content, or waits for a write of it which is in flight. */
+@interface iCloudWriteBehindBuffer : NSObject
+
+
+
+/** @name Buffering */
+
+/** Buffer the latest content of a document
+
+ @param content The full content of the document, replacing any content buffered before. It is copied, so a mutable buffer can be changed again right away. This value must not be nil.
+ @param documentName The name of the document. This value must not be nil.
+ @param handler Code block called on the main thread when the write which includes this content lands. It is passed the written document, the written content (which may be newer than the content passed here) and any error from the write. */
+- (void)bufferContent:(NSData *)content forDocumentWithName:(NSString *)documentName completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler __attribute__((nonnull (1, 2)));
+
+/** Check whether a document has buffered content, or a write of it is in flight
+
+ @param documentName The name of the document. This value must not be nil.
+ @return YES if flushing the document would wait for a write */
+- (BOOL)hasPendingWritesForDocumentWithName:(NSString *)documentName __attribute__((nonnull));
+
+/** Check whether a document has buffered content which has not started writing yet
+
+ @param documentName The name of the document. This value must not be nil.
+ @return YES if content of the document is waiting in the buffer */
+- (BOOL)hasBufferedContentForDocumentWithName:(NSString *)documentName __attribute__((nonnull));
+
+/** Drop the buffered content of a document without writing it, for example because the document is being deleted
+
+ @discussion The handlers waiting for the content are called with an NSUserCancelledError. A write which is already in flight is not affected.
+
+ @param documentName The name of the document. This value must not be nil. */
+- (void)discardPendingWritesForDocumentWithName:(NSString *)documentName __attribute__((nonnull));
+
+
+
+/** @name Flushing */
+
+/** Write the buffered content of a document now
+
+ @param documentName The name of the document. This value must not be nil.
+ @param completion Code block called on the main thread once the document has no buffered content and no write in flight. May be nil. */
+- (void)flushDocumentWithName:(NSString *)documentName completion:(void (^)(void))completion __attribute__((nonnull (1)));
+
+/** Write the buffered content of every document now
+
+ @param completion Code block called on the main thread once every write has landed. May be nil. */
+- (void)flushAllDocumentsWithCompletion:(void (^)(void))completion;
+
+
+
+/** @name Properties */
+
+/** Buffer changes made through saveChangesToDocumentWithName:withContent:completion: instead of writing each one. The default value is NO. Turning the buffer off flushes every buffered document. */
+@property (assign, nonatomic) BOOL enabled;
+
+/** The time, in seconds, a document must go unchanged before its buffered content is written. The default value is 1 second. */
+@property (assign) NSTimeInterval idleDelay;
+
+/** The maximum time, in seconds, content stays buffered while the document keeps changing. The default value is 10 seconds. */
+@property (assign) NSTimeInterval maximumStaleness;
+
+/** Code block which performs the real write of a document and calls completion on the main thread once it has landed. Set by the iCloud class. */
+@property (copy) void (^writeHandler)(NSString *documentName, NSData *content, void (^completion)(UIDocument *cloudDocument, NSData *documentData, NSError *error));
+
+/** The number of documents with buffered content */
+@property (assign, readonly) NSUInteger pendingDocumentCount;
+
+/** The number of changes buffered since the buffer was created */
+@property (assign, readonly) NSUInteger bufferedChangeCount;
+
+/** The number of writes performed since the buffer was created. Compare with bufferedChangeCount to see how many writes were saved. */
+@property (assign, readonly) NSUInteger writeCount;
+
+@end
@@ -0,0 +1,282 @@
+//
+//  iCloudWriteBehindBuffer.m
+//  iCloud Document Sync
+//
+//  Created by iRare Media. Last updated October 2026.
+//  Available on GitHub. Licensed under MIT with Attribution.
+//
+
+#import "iCloudWriteBehindBuffer.h"
+
+/// The buffered content of one document and the handlers waiting for it
+@interface iCloudBufferedWrite : NSObject
+
+@property (copy) NSData *content;
+@property (strong) NSMutableArray *handlers;
+
+/// Incremented on every change, an idle timer only fires if no change followed it
+@property (assign) NSUInteger generation;
+
+/// Set when a timer or flush found a write of the document in flight, the content is written as soon as it lands
+@property (assign) BOOL due;
+
+@end
+
+@implementation iCloudBufferedWrite
+@end
+
+
+@interface iCloudWriteBehindBuffer ()
+
+/// Buffered writes keyed by document name
+@property (strong) NSMutableDictionary *pendingWrites;
+
+/// Names of the documents with a write in flight
+@property (strong) NSMutableSet *writingNames;
+
+/// Flush completions keyed by document name, called once the document has nothing left to write
+@property (strong) NSMutableDictionary *flushCompletions;
+
+@property (assign, readwrite) NSUInteger bufferedChangeCount;
+@property (assign, readwrite) NSUInteger writeCount;
+
+/// Write the buffered content of a document unless a write of it is in flight, called on the main thread
+- (void)writeDocumentWithName:(NSString *)documentName;
+
+/// Called on the main thread when a write lands, writes content buffered in the meantime or reports the flush
+- (void)didWriteDocumentWithName:(NSString *)documentName;
+
+/// Fire an idle or staleness timer for a buffered write
+- (void)timerFiredForWrite:(iCloudBufferedWrite *)write documentName:(NSString *)documentName generation:(NSUInteger)generation;
+
+/// Flush every document inside a background task
+- (void)applicationDidEnterBackground:(NSNotification *)notification;
+
+@end
+
+@implementation iCloudWriteBehindBuffer
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _idleDelay = 1.0;
+        _maximumStaleness = 10.0;
+        _pendingWrites = [NSMutableDictionary dictionary];
+        _writingNames = [NSMutableSet set];
+        _flushCompletions = [NSMutableDictionary dictionary];
+
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:nil];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)setEnabled:(BOOL)enabled {
+    _enabled = enabled;
+    if (enabled == NO) [self flushAllDocumentsWithCompletion:nil];
+}
+
+- (NSUInteger)pendingDocumentCount {
+    @synchronized (self) {
+        return self.pendingWrites.count;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Buffering ----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Buffering
+
+- (void)bufferContent:(NSData *)content forDocumentWithName:(NSString *)documentName completion:(void (^)(UIDocument *cloudDocument, NSData *documentData, NSError *error))handler {
+    iCloudBufferedWrite *write;
+    BOOL firstChange = NO;
+    NSUInteger generation;
+
+    @synchronized (self) {
+        write = self.pendingWrites[documentName];
+        if (!write) {
+            write = [[iCloudBufferedWrite alloc] init];
+            write.handlers = [NSMutableArray array];
+            self.pendingWrites[documentName] = write;
+            firstChange = YES;
+        }
+
+        // Callers may keep changing a mutable buffer after handing it over, the write must see what was buffered
+        write.content = [content copy];
+        if (handler) [write.handlers addObject:[handler copy]];
+        generation = ++write.generation;
+        self.bufferedChangeCount++;
+    }
+
+    // The idle timer restarts with every change, the staleness timer only runs from the first unwritten one
+    __weak __typeof(self) wself=self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.idleDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [wself timerFiredForWrite:write documentName:documentName generation:generation];
+    });
+    if (firstChange) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.maximumStaleness * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [wself timerFiredForWrite:write documentName:documentName generation:0];
+        });
+    }
+}
+
+- (BOOL)hasPendingWritesForDocumentWithName:(NSString *)documentName {
+    @synchronized (self) {
+        return self.pendingWrites[documentName] != nil || [self.writingNames containsObject:documentName];
+    }
+}
+
+- (BOOL)hasBufferedContentForDocumentWithName:(NSString *)documentName {
+    @synchronized (self) {
+        return self.pendingWrites[documentName] != nil;
+    }
+}
+
+- (void)discardPendingWritesForDocumentWithName:(NSString *)documentName {
+    iCloudBufferedWrite *write;
+    @synchronized (self) {
+        write = self.pendingWrites[documentName];
+        [self.pendingWrites removeObjectForKey:documentName];
+    }
+    if (!write) return;
+
+    NSError *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:@{@"FileName": documentName}];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (void (^handler)(UIDocument *, NSData *, NSError *) in write.handlers) handler(nil, nil, error);
+        [self didWriteDocumentWithName:documentName];
+    });
+}
+
+- (void)timerFiredForWrite:(iCloudBufferedWrite *)write documentName:(NSString *)documentName generation:(NSUInteger)generation {
+    @synchronized (self) {
+        // The content was written or discarded already, or changed again since the idle timer started
+        if (self.pendingWrites[documentName] != write) return;
+        if (generation != 0 && generation != write.generation) return;
+        write.due = YES;
+    }
+
+    [self writeDocumentWithName:documentName];
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Writing ------------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Writing
+
+- (void)writeDocumentWithName:(NSString *)documentName {
+    iCloudBufferedWrite *write;
+    @synchronized (self) {
+        write = self.pendingWrites[documentName];
+        if (!write) return;
+
+        // Writes of a document never overlap, this one follows as soon as the current one lands
+        if ([self.writingNames containsObject:documentName]) {
+            write.due = YES;
+            return;
+        }
+
+        [self.pendingWrites removeObjectForKey:documentName];
+        [self.writingNames addObject:documentName];
+        self.writeCount++;
+    }
+
+    void (^writeHandler)(NSString *, NSData *, void (^)(UIDocument *, NSData *, NSError *)) = self.writeHandler;
+    void (^completion)(UIDocument *, NSData *, NSError *) = ^(UIDocument *cloudDocument, NSData *documentData, NSError *error) {
+        for (void (^handler)(UIDocument *, NSData *, NSError *) in write.handlers) handler(cloudDocument, documentData, error);
+
+        @synchronized (self) {
+            [self.writingNames removeObject:documentName];
+        }
+        [self didWriteDocumentWithName:documentName];
+    };
+
+    if (writeHandler) writeHandler(documentName, write.content, completion);
+    else completion(nil, nil, [NSError errorWithDomain:@"The write-behind buffer has no write handler" code:500 userInfo:@{@"FileName": documentName}]);
+}
+
+- (void)didWriteDocumentWithName:(NSString *)documentName {
+    NSArray *completions = nil;
+    BOOL writeAgain = NO;
+
+    @synchronized (self) {
+        if ([self.writingNames containsObject:documentName]) return;
+
+        iCloudBufferedWrite *write = self.pendingWrites[documentName];
+        if (write && (write.due || self.flushCompletions[documentName])) {
+            writeAgain = YES;
+        } else if (!write) {
+            completions = self.flushCompletions[documentName];
+            [self.flushCompletions removeObjectForKey:documentName];
+        }
+    }
+
+    if (writeAgain) [self writeDocumentWithName:documentName];
+    for (void (^completion)(void) in completions) completion();
+}
+
+//----------------------------------------------------------------------------------------------------------------//
+//------------  Flushing -----------------------------------------------------------------------------------------//
+//----------------------------------------------------------------------------------------------------------------//
+#pragma mark - Flushing
+
+- (void)flushDocumentWithName:(NSString *)documentName completion:(void (^)(void))completion {
+    @synchronized (self) {
+        if (completion) {
+            NSMutableArray *completions = self.flushCompletions[documentName] ?: [NSMutableArray array];
+            [completions addObject:[completion copy]];
+            self.flushCompletions[documentName] = completions;
+        }
+
+        [self.pendingWrites[documentName] setDue:YES];
+    }
+
+    // Writing and reporting happen on the main thread, like the writes themselves
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self writeDocumentWithName:documentName];
+        [self didWriteDocumentWithName:documentName];
+    });
+}
+
+- (void)flushAllDocumentsWithCompletion:(void (^)(void))completion {
+    NSMutableSet *documentNames;
+    @synchronized (self) {
+        documentNames = [NSMutableSet setWithArray:[self.pendingWrites allKeys]];
+        [documentNames unionSet:self.writingNames];
+    }
+
+    dispatch_group_t group = dispatch_group_create();
+    for (NSString *documentName in documentNames) {
+        dispatch_group_enter(group);
+        [self flushDocumentWithName:documentName completion:^{
+            dispatch_group_leave(group);
+        }];
+    }
+
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        if (completion) completion();
+    });
+}
+
+- (void)applicationDidEnterBackground:(NSNotification *)notification {
+    @synchronized (self) {
+        if (self.pendingWrites.count == 0 && self.writingNames.count == 0) return;
+    }
+
+    // Keep running until the buffered content is on disk, the system suspends the app otherwise
+    UIApplication *application = [UIApplication sharedApplication];
+    __block UIBackgroundTaskIdentifier backgroundTask = [application beginBackgroundTaskWithExpirationHandler:^{
+        [application endBackgroundTask:backgroundTask];
+        backgroundTask = UIBackgroundTaskInvalid;
+    }];
+
+    [self flushAllDocumentsWithCompletion:^{
+        if (backgroundTask == UIBackgroundTaskInvalid) return;
+        [application endBackgroundTask:backgroundTask];
+        backgroundTask = UIBackgroundTaskInvalid;
+    }];
+}
+
+@end